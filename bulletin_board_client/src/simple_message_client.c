@@ -30,6 +30,11 @@
 #include <string.h>
 #include <arpa/inet.h>
 #include <assert.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+#include "smc.h"
 
 /*
  * ---------------------------------------------------------------- defines --
@@ -45,21 +50,33 @@
 /* macro used for printing source line etc. in verbose function */
 #define VERBOSE(...) verbose(__FILE__, __func__, __LINE__, __VA_ARGS__)
 
-/* Defines for the request/response string literals */
-#define SET_USER "user="
-#define SET_IMAGE "img="
-#define GET_STATUS "status="
-#define GET_FILE "file="
-#define GET_LEN "len="
-
-#define HTML_FILE ".html"
-
-/* Define for the request field terminator */
-#define FIELD_TERMINATOR '\n'
+/* with SMC_MESSAGE_SOURCE=file the message names a file, "-" stdin */
+#define MESSAGE_SOURCE_VARIABLE "SMC_MESSAGE_SOURCE"
+#define MESSAGE_SOURCE_FILE "file"
+#define MESSAGE_STDIN "-"
 
 /* Timeout for waiting on socket to become ready in seconds */
 #define SOCKET_TIMEOUT 30
 
+#define MS_PER_SECOND 1000
+
+/* Writer threads on network filesystems, where close() may take long */
+#define WRITER_THREADS 2
+#define MAX_WRITER_THREADS 16
+/* Bytes of received files queued for the writer threads at most */
+#define WRITER_QUEUE (8 * 1024 * 1024)
+/* Overrides the number of writer threads, 0 writes the files directly */
+#define WRITERS_VARIABLE "SMC_WRITERS"
+
+/* Streams the received files as a tar archive into a file, "-" to stdout */
+#define ARCHIVE_VARIABLE "SMC_ARCHIVE"
+#define ARCHIVE_STDOUT "-"
+/* permissions of the archive, reduced by the umask */
+#define ARCHIVE_MODE 0666
+
+/* Index of the files stored, unchanged files are not written again */
+#define CACHE_VARIABLE "SMC_CACHE"
+
 /*
  * ---------------------------------------------------------------- globals --
  */
@@ -77,6 +94,12 @@ static const char* sprogram_arg0 = NULL;
 /** Controls the verbose output. */
 static int sverbose = 0;
 
+/** Where the verbose output goes, NULL for stdout. */
+static FILE* sverbose_stream = NULL;
+
+/** Archive the files are streamed to, -1 to store them as files. */
+static int sarchive_fd = -1;
+
 /*
  * ------------------------------------------------------------- prototypes --
  */
@@ -88,15 +111,12 @@ static void verbose(const char* file_name, const char* function_name, int line,
     const char* message, ...);
 static int execute(const char* server, const char* port, const char* user,
     const char* message, const char* image_url);
-static int send_request(const char* user, const char* message,
-    const char* image_url, int socket_fd);
-static int read_response(int socket_fd);
-static char* search_terminator(char* start, char* end);
-static int convert_server_status(char* start, char* end, int* server_status);
-static int convert_file_size(char* start, char* end, long* size);
-int check_text(size_t amount, char* text, char* parse_buf);
-int search_end_marker(char** found, char* parse_buf, int amount,
-    bool buffer_full);
+static int connect_server(const struct addrinfo* addr_result,
+    const struct addrinfo** winner);
+static int open_message(const char* message, struct post_request* request);
+static int run_post(struct post* post, struct store* store);
+static int writer_threads(void);
+static int open_archive(const char* archive);
 
 /*
  * -------------------------------------------------------------- functions --
@@ -154,6 +174,12 @@ int main(int argc, const char* argv[])
         print_usage(stderr, sprogram_arg0, EXIT_FAILURE);
     }
 
+    if ((getenv(ARCHIVE_VARIABLE) != NULL) &&
+            (open_archive(getenv(ARCHIVE_VARIABLE)) != EXIT_SUCCESS))
+    {
+        cleanup(true);
+    }
+
     img_url_text = img_url == NULL ? "<no image>" : img_url;
     VERBOSE("Got parameter server %s, port %s, user %s, message %s, "
             "image %s", server, port, user, message, img_url_text);
@@ -165,6 +191,12 @@ int main(int argc, const char* argv[])
     }
 
     result = execute(server, port, user, message, img_url);
+    /* a file system may report failed writes of the archive only now */
+    if ((sarchive_fd > STDOUT_FILENO) && (close(sarchive_fd) < 0))
+    {
+        print_error("Could not close archive: %s.", strerror(errno));
+        result = EXIT_FAILURE;
+    }
     cleanup(false);
     VERBOSE("%s exit with code %d.", sprogram_arg0, result);
 
@@ -277,7 +309,19 @@ static void print_usage(FILE* stream, const char* command, int exit_code)
         "  -i, --image <URL>       URL pointing to an image of the posting user\n"
         "  -m, --message <message> message to be added to the bulletin board\n"
         "  -v, --verbose           verbose output\n"
-        "  -h, --help\n", LOWER_PORT_RANGE, UPPER_PORT_RANGE);
+        "  -h, --help\n"
+        "environment:\n"
+        "  %s=%s   -m names a file to post, \"%s\" reads stdin\n"
+        "  %s=<path>        stream the received files as a tar archive\n"
+        "                            into path, \"%s\" to stdout (-v goes to stderr)\n"
+        "  %s=<path>          index of the stored files, unchanged ones are\n"
+        "                            not written again\n"
+        "  %s=<n>           threads writing the received files [0..%d],\n"
+        "                            %d on network file systems, else 0\n",
+        LOWER_PORT_RANGE, UPPER_PORT_RANGE,
+        MESSAGE_SOURCE_VARIABLE, MESSAGE_SOURCE_FILE, MESSAGE_STDIN,
+        ARCHIVE_VARIABLE, ARCHIVE_STDOUT, CACHE_VARIABLE, WRITERS_VARIABLE,
+        MAX_WRITER_THREADS, WRITER_THREADS);
     if (written < 0)
     {
         print_error(strerror(errno));
@@ -305,23 +349,24 @@ static void verbose(const char* file_name, const char* function_name, int line,
 {
     int written;
     va_list args;
+    FILE* stream = sverbose_stream != NULL ? sverbose_stream : stdout;
 
     if (sverbose > 0)
     {
-        written = fprintf(stdout, "%s [%s, %s(), line %d]: ", sprogram_arg0,
+        written = fprintf(stream, "%s [%s, %s(), line %d]: ", sprogram_arg0,
                 file_name, function_name, line);
         if (written < 0)
         {
             print_error(strerror(errno));
         }
         va_start(args, message);
-        written = vfprintf(stdout, message, args);
+        written = vfprintf(stream, message, args);
         if (written < 0)
         {
             print_error(strerror(errno));
         }
         va_end(args);
-        written = fprintf(stdout, "\n");
+        written = fprintf(stream, "\n");
         if (written < 0)
         {
             print_error(strerror(errno));
@@ -345,14 +390,22 @@ static int execute(const char* server, const char* port, const char* user,
 {
     struct addrinfo hints;
     struct addrinfo* addr_result;
-    struct addrinfo* info;
+    const struct addrinfo* info;
     int info_result;
     int socket_fd;
     void* in_addr = NULL;
     char straddr[INET6_ADDRSTRLEN];
     struct sockaddr_in* s4;
     struct sockaddr_in6* s6;
-    int read_result;
+    struct post post;
+    struct post_request request;
+    struct store store;
+    struct response_sink sink;
+    struct writer writer;
+    struct cache cache;
+    const char* cache_path = getenv(CACHE_VARIABLE);
+    int threads;
+    int result;
     int close_result;
 
     /* Obtain address(es) matching host/port */
@@ -368,34 +421,9 @@ static int execute(const char* server, const char* port, const char* user,
         return EXIT_FAILURE;
     }
 
-    /* getaddrinfo() returns a list of address structures.
-     Try each address until we successfully connect(2).
-     If socket(2) (or connect(2)) fails, we (close the socket
-     and) try the next address. */
-
-    for (info = addr_result; info != NULL; info = info->ai_next)
-    {
-        socket_fd = socket(info->ai_family, info->ai_socktype,
-                info->ai_protocol);
-        if (socket_fd == -1)
-        {
-            continue;
-        }
-
-        if (connect(socket_fd, info->ai_addr, info->ai_addrlen) != -1)
-        {
-            /* got a file descriptor, success */
-            break;
-        }
-
-        close_result = close(socket_fd);
-        if (close_result < 0)
-        {
-            print_error("Could not close tested socket: %s", strerror(errno));
-        }
-    }
-
-    if (info == NULL)
+    /* getaddrinfo() returns a list of address structures, race them */
+    socket_fd = connect_server(addr_result, &info);
+    if (socket_fd < 0)
     {
         /* No address succeeded */
         print_error("Could not connect %s:%s.", server, port);
@@ -443,7 +471,9 @@ static int execute(const char* server, const char* port, const char* user,
 
     freeaddrinfo(addr_result); /* no longer needed */
 
-    if (send_request(user, message, image_url, socket_fd) != EXIT_SUCCESS)
+    request.user = user;
+    request.image = image_url;
+    if (open_message(message, &request) != EXIT_SUCCESS)
     {
         close_result = close(socket_fd);
         if (close_result < 0)
@@ -453,826 +483,308 @@ static int execute(const char* server, const char* port, const char* user,
         return EXIT_FAILURE;
     }
 
-    read_result = read_response(socket_fd);
-    close_result = close(socket_fd);
-    if (close_result < 0)
-    {
-        print_error("Could not close socket: %s", strerror(errno));
-    }
-    return read_result;
-
-}
-
-/**
- * /brief Send message request to server.
- *
- * /param user which wrote the message.
- * /param message to be shown in bulletin board.
- * /param image_url URL of image or NULL.
- * /param socket_fd open socket file descriptor.
- *
- * /return EXIT_SUCCESS on success, else EXIT_FAILURE.
- */
-static int send_request(const char* user, const char* message,
-        const char* image_url, int socket_fd)
-{
-    size_t len_user;
-    size_t len_user_data;
-    size_t len_message;
-    size_t len_image;
-    size_t len_image_url;
-    size_t len;
-    char* send_buf;
-    char* destination;
-    ssize_t written;
-    ssize_t to_be_written;
-    char* current_write_pos;
-
-    len_user = strlen(SET_USER);
-    len_user_data = strlen(user) + 1; /* + 1 for 0xa terminator */
-    len_message = strlen(message);
-    if (image_url == NULL)
+    /* the files are stored in the working directory */
+    store_init(&store, AT_FDCWD, &sink);
+    /* or streamed into the archive, which is written on this thread */
+    if (sarchive_fd >= 0)
     {
-        len_image = 0;
-        len_image_url = 0;
+        store_archive(&store, sarchive_fd);
+        VERBOSE("Files are streamed into a tar archive.");
     }
-    else
+    /* or written only if they changed since the last time */
+    else if (cache_path != NULL)
     {
-        len_image = strlen(SET_IMAGE);
-        len_image_url = strlen(image_url) + 1; /* +1 for 0xa terminator */
+        if (cache_load(&cache, AT_FDCWD, cache_path) < 0)
+        {
+            print_error("Could not read index %s: %s.", cache_path,
+                    strerror(errno));
+            cache_free(&cache);
+        }
+        else
+        {
+            store_cache(&store, &cache);
+            VERBOSE("Files unchanged since %s are not written.", cache_path);
+        }
     }
-    len = len_user + len_user_data + len_image + len_image_url + len_message;
-    VERBOSE("Send request of %ld bytes.", (long ) len);
-
-    send_buf = malloc(len * sizeof(char));
-    if (send_buf == NULL)
+    /* a slow disk must not stall receiving */
+    threads = (sarchive_fd >= 0) || (store.cache != NULL) ? 0 :
+            writer_threads();
+    if (threads > 0)
     {
-        print_error(strerror(ENOMEM));
-        return EXIT_FAILURE;
+        if (writer_init(&writer, threads, WRITER_QUEUE) < 0)
+        {
+            VERBOSE("Can not start writer threads: %s.", strerror(errno));
+        }
+        else
+        {
+            store_offload(&store, &writer);
+            VERBOSE("Files are written by %d threads.", threads);
+        }
     }
-    destination = send_buf;
-    strncpy(destination, SET_USER, len_user);
-    destination += len_user;
-    strncpy(destination, user, len_user_data - 1);
-    destination += len_user_data - 1;
-    *destination = FIELD_TERMINATOR;
-    ++destination;
-    if (image_url != NULL)
+    /* the file name limit is separate from the receive buffer */
+    if (post_init(&post, smax_filename) < 0)
     {
-        strncpy(destination, SET_IMAGE, len_image);
-        destination += len_image;
-        strncpy(destination, image_url, len_image_url - 1);
-        destination += len_image_url - 1;
-        *destination = FIELD_TERMINATOR;
-        ++destination;
+        print_error("Can not allocate read buffer: %s.", strerror(ENOMEM));
+        result = EXIT_FAILURE;
+        close_result = close(socket_fd);
     }
-    strncpy(destination, message, len_message);
-    current_write_pos = send_buf;
-    to_be_written = len;
-    while (to_be_written > 0)
+    else
     {
-        written = write(socket_fd, current_write_pos, to_be_written);
-        if (written < 0)
+        /* the post owns the socket from now on */
+        if ((post_start(&post, &request, &sink) < 0) ||
+                (post_attach(&post, socket_fd) < 0))
         {
-            print_error("Could not write request: %s", strerror(errno));
-            free(send_buf);
-            return EXIT_FAILURE;
+            print_error("%s", post.error);
+            result = EXIT_FAILURE;
         }
-        current_write_pos += written;
-        to_be_written -= written;
-    }
-    VERBOSE("Send request of %ld bytes successful.", (long ) len);
-
-    if (0 != shutdown(socket_fd, SHUT_WR)) /* no more writes */
-    {
-        print_error("Could not shutdown write connection: %s", strerror(errno));
-        free(send_buf);
-        return EXIT_FAILURE;
+        else
+        {
+            result = run_post(&post, &store);
+        }
+        close_result = post.fd >= 0 ? close(post.fd) : 0;
+        post.fd = -1;
+        post_free(&post);
     }
-    free(send_buf);
-    return EXIT_SUCCESS;
-}
-
-/**
- * /brief Read response from server.
- *
- * /param socket_fd open socket file descriptor.
- *
- * /return EXIT_SUCCESS on success, else error status from server.
- */
-static int read_response(int socket_fd)
-{
-    ssize_t read_count;
-    fd_set set;
-    struct timeval timeout;
-    int ready;
-    char* read_buf;
-    char* parse_buf;
-    bool finished = false;
-    int result;
-    size_t read_size;
-    bool expect_status = true;
-    bool expect_file = false;
-    char* current_write_pos;
-    size_t amount;
-    char* search;
-    char* found;
-    int server_status;
-    size_t move;
-    bool receive_status = true;
-    bool search_filename = true;
-    bool search_end;
-    bool buffer_full;
-    char* filename_buf;
-    long file_size = 0;
-    bool search_len = false;
-    bool store_file = false;
-    bool search_end2 = false;
-    FILE* store = NULL;
-    bool eof = false;
-    size_t written = 0;
-    size_t file_written;
-    size_t to_file;
-    bool check_further_file = false;
-    bool received_html = false;
-    size_t html_extension = strlen(HTML_FILE);
-    size_t filename_len;
-
-    read_size = smax_filename;
-
-    /* filenames must not exceed maximum name length of system */
-    read_buf = malloc(read_size * sizeof(char));
-    if (read_buf == NULL)
+    if (close_result < 0)
     {
-        print_error("Can not allocate read buffer: %s.", strerror(ENOMEM));
-        return EXIT_FAILURE;
+        print_error("Could not close socket: %s", strerror(errno));
     }
-    parse_buf = malloc(2 * read_size * sizeof(char));
-    if (parse_buf == NULL)
+    /* with writer threads the files may fail only now */
+    if (store_close(&store) < 0)
     {
-        print_error("Can not allocate parse buffer: %s.", strerror(ENOMEM));
-        free(read_buf);
-        print_error(strerror(ENOMEM));
-        return EXIT_FAILURE;
+        print_error("%s", store.error);
+        result = EXIT_FAILURE;
     }
-    filename_buf = malloc(read_size * sizeof(char));
-    if (filename_buf == NULL)
+    if (store.writer != NULL)
     {
-        free(read_buf);
-        free(parse_buf);
-        print_error("Can not allocate filename buffer: %s.", strerror(ENOMEM));
-        return EXIT_FAILURE;
+        writer_free(&writer);
     }
-
-    /* Initialize the file descriptor set. */
-    FD_ZERO(&set);
-    FD_SET(socket_fd, &set);
-
-    result = EXIT_FAILURE;
-    current_write_pos = parse_buf;
-    amount = 0;
-
-    while (!finished)
+    if (store.cache != NULL)
     {
-        if (!eof)
-        {
-            /* Initialize the timeout data structure. */
-            timeout.tv_sec = SOCKET_TIMEOUT;
-            timeout.tv_usec = 0;
-            /* wait a user defined time for socket to become ready */
-            ready = select(socket_fd + 1, &set, NULL, NULL, &timeout);
-            if (ready < 0)
-            {
-                /* can not handle errors or signals here */
-                print_error(strerror(errno));
-                finished = true;
-                continue;
-            }
-            if (ready == 0)
-            {
-                /* timeout */
-                print_error("Timeout on receiving response.");
-                finished = true;
-                continue;
-            }
-
-            read_count = read(socket_fd, read_buf, read_size);
-            if (read_count == -1)
-            {
-                print_error("read failed: %s", strerror(errno));
-                finished = true;
-                continue;
-            }
-            if (check_further_file)
-            {
-                check_further_file = false;
-                if (read_count == 0)
-                {
-                    finished = true;
-                    /* this is the end of the while loop */
-                    /* everything ok, so set the server status as result */
-                    if (!received_html)
-                    {
-                        /* no html file received */
-                        result = EXIT_FAILURE;
-                    }
-                    else
-                    {
-                        result = server_status;
-                    }
-                    continue;
-                }
-                else
-                {
-                    expect_file = true;
-                    store_file = false;
-                    search_filename = true;
-                    written = 0;
-                }
-            }
-            amount += read_count;
-            if (read_count == 0)
-            {
-                finished = true;
-                eof = true;
-                /* end of file reached */
-            }
-            VERBOSE("Received %ld bytes.", (long ) read_count);
-            buffer_full = eof || (amount >= read_size);
-            if (read_count > 0)
-            {
-                /* copy the read bytes into the parse buffer */
-                memcpy(current_write_pos, read_buf, read_count);
-                current_write_pos += read_count;
-            }
-        }
-        if (expect_status)
-        {
-            if (receive_status)
-            {
-                VERBOSE("Receiving status.");
-                receive_status = false;
-            }
-            if (!buffer_full)
-            {
-                if (amount < (strlen(GET_STATUS) + 2))
-                {
-                    /* message is too short */
-                    continue;
-                }
-            }
-            /* it must contain the status= string now */
-            if (check_text(amount, GET_STATUS, parse_buf) != EXIT_SUCCESS)
-            {
-                finished = true;
-                continue;
-            }
-            /* search for line feed */
-            search = parse_buf + strlen(GET_STATUS);
-            found = search_terminator(search, parse_buf + amount);
-            if (found == search)
-            {
-                finished = true;
-                print_error("Malformed response (status).");
-                continue;
-            }
-            if (found == (parse_buf + amount))
-            {
-                if (buffer_full)
-                {
-                    /* not found */
-                    finished = true;
-                    print_error("Malformed response (no status terminator).");
-                    continue;
-                }
-                else
-                {
-                    /* not found */
-                    continue;
-                }
-            }
-            if (convert_server_status(search, found, &server_status) !=
-                EXIT_SUCCESS)
-            {
-                finished = true;
-                continue;
-            }
-            expect_status = false;
-            VERBOSE("Received status %d.", server_status);
-            expect_file = true;
-            move = (found - parse_buf + 1);
-            if (move > 0)
-            {
-                memmove(parse_buf, found + 1, amount - move);
-                amount -= move;
-                current_write_pos = parse_buf + amount;
-                buffer_full = eof || (amount >= read_size);
-            }
-            if (!buffer_full)
-            {
-                if (!eof && (amount == 0))
-                {
-                    continue;
-                }
-            }
-        }
-
-        if (expect_file)
+        /* the index is kept even if the response failed after some files */
+        if (cache_save(&cache) < 0)
         {
-            if (search_filename)
-            {
-                if (!buffer_full)
-                {
-                    if (amount < (strlen(GET_FILE) + 2))
-                    {
-                        /* message is too short */
-                        continue;
-                    }
-                }
-
-                /* it must contain the file= string now */
-                if (check_text(amount, GET_FILE, parse_buf) != EXIT_SUCCESS)
-                {
-                    finished = true;
-                    continue;
-                }
-                search_filename = false;
-                move = strlen(GET_FILE);
-
-                memmove(parse_buf, parse_buf + move, amount - move);
-                amount -= move;
-                current_write_pos = parse_buf + amount;
-                buffer_full = eof || (amount >= read_size);
-                search_end = true;
-            }
-            if (search_end)
-            {
-                /* search for line feed */
-                if (EXIT_SUCCESS
-                        != search_end_marker(&found, parse_buf, amount,
-                                buffer_full))
-                {
-                    finished = true;
-                    continue;
-                }
-                if (found == NULL)
-                {
-                    continue;
-                }
-                search_end = false;
-                /* make 0 string */
-                *found = 0;
-                search_end = false;
-                /* get filename now */
-                if (found >= (parse_buf + read_size))
-                {
-                    /* filename too long, can not store it */
-                    print_error("Filename too long.");
-                    finished = true;
-                    continue;
-                }
-                strcpy(filename_buf, parse_buf);
-                move = strlen(filename_buf) + 1;
-                memmove(parse_buf, parse_buf + move, amount - move);
-                amount -= move;
-                current_write_pos = parse_buf + amount;
-                buffer_full = eof || (amount >= read_size);
-                search_len = true;
-            }
-            if (search_len)
-            {
-                if (amount < (strlen(GET_LEN) + 2))
-                {
-                    /* message is too short */
-                    continue;
-                }
-                /* it must contain the file= string now */
-
-                if (check_text(amount, GET_LEN, parse_buf) != EXIT_SUCCESS)
-                {
-                    finished = true;
-                    continue;
-                }
-                search_len = false;
-                move = strlen(GET_LEN);
-
-                memmove(parse_buf, parse_buf + move, amount - move);
-                amount -= move;
-                current_write_pos = parse_buf + amount;
-                buffer_full = eof || (amount >= read_size);
-                search_end2 = true;
-            }
-            if (search_end2)
-            {
-                if (EXIT_SUCCESS
-                        != search_end_marker(&found, parse_buf, amount,
-                                buffer_full))
-                {
-                    finished = true;
-                    continue;
-                }
-                if (found == NULL)
-                {
-                    continue;
-                }
-                /* get file size now */
-                if (convert_file_size(parse_buf, found, &file_size) !=
-                    EXIT_SUCCESS)
-                {
-                    finished = true;
-                    continue;
-                }
-                move = found - parse_buf + 1;
-                memmove(parse_buf, found + 1, amount - move);
-                amount -= move;
-                current_write_pos = parse_buf + amount;
-                buffer_full = eof || (amount >= read_size);
-                search_end2 = false;
-                store_file = true;
-            }
-            if (store_file)
-            {
-                if (store == NULL)
-                {
-                    store = fopen(filename_buf, "w+");
-                    if (NULL == store)
-                    {
-                        print_error("Can not create file %s", filename_buf);
-                        finished = true;
-                        continue;
-                    }
-                }
-                if (file_size == 0)
-                {
-                    if (0 != fclose(store))
-                    {
-                        print_error("Can not close file: %s",
-                                strerror(errno));
-                    }
-                    else
-                    {
-                        if (!received_html)
-                        {
-                            filename_len = strlen(filename_buf);
-                            if (filename_len >= html_extension)
-                            {
-                                received_html = 0 == strcasecmp(
-                                    HTML_FILE,
-                                    filename_buf + filename_len - html_extension);
-                            }
-                        }
-                        VERBOSE("File %s stored.", filename_buf);
-                    }
-                    store = NULL;
-                    if (amount > 0)
-                    {
-                        expect_file = true;
-                        store_file = false;
-                        search_filename = true;
-                        written = 0;
-                    }
-                    else
-                    {
-                        check_further_file = true;
-                    }
-                    continue;
-                }
-                if (eof)
-                {
-                    if (amount == 0)
-                    {
-                        print_error("Too less data found for file %s.",
-                            filename_buf);
-                        finished = true;
-                        continue;
-                    }
-                    to_file = amount < (file_size - written) ?
-                        amount : (file_size - written);
-                    file_written = fwrite(parse_buf, sizeof(char), to_file,
-                            store);
-                    if (file_written < to_file)
-                    {
-                        print_error("Error on writing file %s",
-                            filename_buf);
-                        finished = true;
-                        continue;
-                    }
-                    written += file_written;
-                    if ((long) written < file_size)
-                    {
-                        /* sorry this is too less data */
-                        print_error("Too less data for file %s",
-                            filename_buf);
-                        finished = true;
-                        continue;
-                    }
-                    if (0 != fclose(store))
-                    {
-                        print_error("Can not close file: %s",
-                                strerror(errno));
-                    }
-                    else
-                    {
-                        if (!received_html)
-                        {
-                            filename_len = strlen(filename_buf);
-                            if (filename_len >= html_extension)
-                            {
-                                received_html = 0 == strcasecmp(
-                                    HTML_FILE,
-                                    filename_buf + filename_len - html_extension);
-                            }
-                        }
-                        VERBOSE("File %s stored.", filename_buf);
-                    }
-                    store = NULL;
-                    memmove(parse_buf, parse_buf + file_written,
-                            amount - file_written);
-                    amount -= file_written;
-                    current_write_pos = parse_buf + amount;
-                    buffer_full = eof || (amount >= read_size);
-                    if (amount > 0)
-                    {
-                        expect_file = true;
-                        store_file = false;
-                        search_filename = true;
-                        written = 0;
-                        continue;
-                    }
-                    finished = true;
-                    /* set result of server */
-                    if (!received_html)
-                    {
-                        /* no html file received */
-                        result = EXIT_FAILURE;
-                    }
-                    else
-                    {
-                        result = server_status;
-                    }
-                }
-                else
-                {
-                    if (amount == 0)
-                    {
-                        continue;
-                    }
-                    to_file =
-                            amount < (file_size - written) ?
-                                    amount : (file_size - written);
-                    file_written = fwrite(parse_buf, sizeof(char), to_file,
-                            store);
-                    if (file_written < to_file)
-                    {
-                        print_error("Error on writing file %s",
-                                filename_buf);
-                        finished = true;
-                        continue;
-                    }
-                    written += file_written;
-                    if ((long) written == file_size)
-                    {
-                        if (0 != fclose(store))
-                        {
-                            print_error("Can not close file: %s",
-                                    strerror(errno));
-                        }
-                        else
-                        {
-                            if (!received_html)
-                            {
-                                filename_len = strlen(filename_buf);
-                                if (filename_len >= html_extension)
-                                {
-                                    received_html = 0 == strcasecmp(
-                                        HTML_FILE,
-                                        filename_buf + filename_len - html_extension);
-                                }
-                            }
-                            VERBOSE("File %s stored.", filename_buf);
-                        }
-                        store = NULL;
-                    }
-                    memmove(parse_buf, parse_buf + file_written,
-                            amount - file_written);
-                    amount -= file_written;
-                    current_write_pos = parse_buf + amount;
-                    buffer_full = eof || (amount >= read_size);
-                    if (store == NULL)
-                    {
-                        if (amount > 0)
-                        {
-                            expect_file = true;
-                            store_file = false;
-                            search_filename = true;
-                            written = 0;
-                            continue;
-                        }
-                        else
-                        {
-                            /* see for further file */
-                            check_further_file = true;
-                        }
-                    }
-                    continue;
-                }
-            }
+            print_error("Could not write index %s: %s.", cache_path,
+                    strerror(errno));
         }
+        cache_free(&cache);
     }
-    free(read_buf);
-    free(parse_buf);
-    free(filename_buf);
-    if (store != NULL)
+    if ((request.message_fd > STDIN_FILENO) && (close(request.message_fd) < 0))
     {
-        if (0 != fclose(store))
-        {
-            print_error("Can not close file: %s", strerror(errno));
-        }
+        print_error("Could not close message: %s", strerror(errno));
     }
-
     return result;
 
 }
 
 /**
- * /brief Search the terminator character.
+ * \brief Connects to the first address answering (Happy Eyeballs).
  *
- * /param found return value pointer where the terminator has been found
- *      or NULL if not found
- * /param parse_buf where to search the terminator.
- * /param amount of data to be tested.
- * /param buffer_full indicates if the read buffer is full.
+ * The connection attempts of a struct race are waited for by poll().
  *
- * /return EXIT_SUCCESS if found or too less data, EXIT_FAILURE if terminator
- *      is at wrong position or not contained if buffer is full.
+ * \param addr_result the addresses of the server.
+ * \param winner where to put the address connected to.
+ * \return non-blocking connect socket, -1 if no address could be connected.
  */
-int search_end_marker(char** found, char* parse_buf, int amount,
-bool buffer_full)
+static int connect_server(const struct addrinfo* addr_result,
+        const struct addrinfo** winner)
 {
-    char* search;
-    char* terminator;
+    struct race race;
+    int socket_fd = -1;
+    int result;
 
-    /* search for line feed */
-    search = parse_buf;
-    terminator = search_terminator(search, parse_buf + amount);
-    if (terminator == search)
+    if (race_init(&race, addr_result, SOCKET_TIMEOUT * MS_PER_SECOND) < 0)
     {
-        print_error("Malformed response.");
-        return EXIT_FAILURE;
+        print_error("Can not allocate connection attempts: %s.",
+                strerror(ENOMEM));
+        return -1;
     }
-    if (terminator == (parse_buf + amount))
+    while ((result = race_advance(&race, &socket_fd)) == 0)
     {
-        /* not found */
-        if (buffer_full)
+        if ((poll(race.attempts, race.next, race_timeout(&race)) < 0) &&
+                (errno != EINTR))
         {
-            /* it must contain the terminator in this case */
-            print_error("Malformed response.");
-            return EXIT_FAILURE;
+            print_error("poll() failed: %s.", strerror(errno));
+            break;
         }
-        /* see if there is further data */
-        *found = NULL;
-        return EXIT_SUCCESS;
     }
-    /* make 0 string */
-    *terminator = 0;
-    *found = terminator;
-    return EXIT_SUCCESS;
+    if (result < 0)
+    {
+        VERBOSE("Connection attempts failed: %s.", strerror(race.error));
+    }
+    *winner = race.winner;
+    race_free(&race);
+    return socket_fd;
 }
 
 /**
- * \brief searches the terminator character.
+ * /brief Takes the message of the request from the arguments.
  *
- * \param start where to start the search.
- * \param end marker not considered to be a valid position.
+ * The message is posted as it is, unless SMC_MESSAGE_SOURCE=file: then it
+ * names the file the message is streamed from, "-" stands for stdin.
  *
- * \return pointer to FIELD_TERMINATOR on success, or end when not found.
+ * /param message to be shown in bulletin board.
+ * /param request where to put the message or the file holding it.
+ *
+ * /return EXIT_SUCCESS on success, else EXIT_FAILURE.
  */
-static char* search_terminator(char* start, char* end)
+static int open_message(const char* message, struct post_request* request)
 {
-    char* search = start;
+    const char* source = getenv(MESSAGE_SOURCE_VARIABLE);
 
-    while (search < end)
+    request->message = NULL;
+    request->message_fd = -1;
+    if ((source == NULL) || (strcmp(source, MESSAGE_SOURCE_FILE) != 0))
     {
-        if (*search == FIELD_TERMINATOR)
-        {
-            break;
-        }
-        ++search;
+        request->message = message;
     }
-    return search;
-
+    else if (strcmp(message, MESSAGE_STDIN) == 0)
+    {
+        request->message_fd = STDIN_FILENO;
+    }
+    else if ((request->message_fd = open(message, O_RDONLY | O_CLOEXEC)) < 0)
+    {
+        print_error("Could not open message %s: %s.", message,
+                strerror(errno));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
 }
 
 /**
- * \brief searches the terminator character.
+ * /brief Sends the request and reads the response by a post.
  *
- * \param start where to start the number begins.
- * \param end marker contains newline.
- * \server_status converted server status as number.
+ * The post does the non-blocking I/O, this function waits a user defined
+ * time for the socket whenever the post has to.
  *
- * \return EXIT_SUCCESS if server status was converted, else EXIT_FAILURE.
+ * /param post started on a connected socket.
+ * /param store receiving the files of the response.
+ *
+ * /return EXIT_SUCCESS on success, else error status from server.
  */
-static int convert_server_status(char* start, char* end, int* server_status)
+static int run_post(struct post* post, struct store* store)
 {
-    long int result;
-    char* end_strtol;
+    struct pollfd poll_fd;
+    int ready;
 
-    *end = '\0'; /* make a string for strtol function */
-    errno = 0;
-    result = strtol(start, &end_strtol, INPUT_NUM_BASE);
-    if ((errno == ERANGE && (result == LONG_MAX || result == LONG_MIN))
-            || (errno != 0 && result == 0))
+    VERBOSE("Send request.");
+    poll_fd.fd = post->fd;
+    while (post_advance(post) < POST_DONE)
     {
-        print_error("Can not convert server status (%s).", strerror(errno));
-        return EXIT_FAILURE;
+        poll_fd.events = post_events(post);
+        ready = poll(&poll_fd, 1, SOCKET_TIMEOUT * MS_PER_SECOND);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            print_error(strerror(errno));
+            return EXIT_FAILURE;
+        }
+        if (ready == 0)
+        {
+            print_error(post->state == POST_RECEIVING ?
+                    "Timeout on receiving response." :
+                    "Timeout on sending request.");
+            return EXIT_FAILURE;
+        }
     }
+    VERBOSE("Sent %lu bytes, received %lu bytes in %ld reads, buffer %zu "
+            "bytes.", (unsigned long) post->sent,
+            (unsigned long) post->received, post->reads, post->parser.size);
 
-    if (end_strtol == start)
+    if (post->state == POST_FAILED)
     {
-        print_error("No digits were found.");
+        /* an empty error means the store failed */
+        print_error("%s", post->error[0] != '\0' ? post->error :
+                store->error);
         return EXIT_FAILURE;
     }
-
-    if (result < INT_MIN || result > INT_MAX)
-    {
-        print_error("Server status exceeds int size: %l.", result);
-        /* make result clearly a failure */
-        *server_status = EXIT_FAILURE;
-    }
-    else
+    VERBOSE("Stored %ld files, %ld of them unchanged.", store->files,
+            store->unchanged);
+    if (!store->received_html)
     {
-        *server_status = (int) result;
+        print_error("No html file received.");
+        return EXIT_FAILURE;
     }
-
-    return EXIT_SUCCESS;
+    VERBOSE("Received status %d.", post->parser.status);
+    return post->parser.status;
 }
 
 /**
- * \brief searches the terminator character.
+ * \brief Decides how many threads write the received files.
  *
- * \param start where to start the number begins.
- * \param end marker contains newline.
- * \size converted size as result.
+ * SMC_WRITERS sets the number, else the files are written by writer threads
+ * if the working directory is on a network filesystem, and directly, maybe
+ * spliced from the socket, if not.
  *
- * \return EXIT_SUCCESS if file size was converted, else EXIT_FAILURE.
+ * \return number of writer threads, 0 to write the files directly.
  */
-static int convert_file_size(char* start, char* end, long* size)
+static int writer_threads(void)
 {
-    long result;
-    char* end_strtol;
+    const char* setting = getenv(WRITERS_VARIABLE);
+    struct statfs info;
+    char* end_ptr;
+    long threads;
 
-    *end = '\0'; /* make a string for strtol function */
-    errno = 0;
-    result = strtol(start, &end_strtol, INPUT_NUM_BASE);
-    if ((errno == ERANGE && (result == LONG_MAX || result == LONG_MIN))
-            || (errno != 0 && result == 0))
+    if (setting != NULL)
     {
-        print_error("Can not convert file size (%s).", strerror(errno));
-        return EXIT_FAILURE;
+        errno = 0;
+        threads = strtol(setting, &end_ptr, INPUT_NUM_BASE);
+        if ((errno == 0) && (end_ptr != setting) && (*end_ptr == '\0') &&
+                (threads >= 0) && (threads <= MAX_WRITER_THREADS))
+        {
+            return (int) threads;
+        }
+        VERBOSE("Ignoring invalid %s=%s.", WRITERS_VARIABLE, setting);
     }
-
-    if (end_strtol == start)
+    if (statfs(".", &info) < 0)
     {
-        print_error("No digits were found.");
-        return EXIT_FAILURE;
+        return 0;
     }
-
-    if (result < 0)
+    switch ((unsigned long) info.f_type)
     {
-        print_error("File size is negative: %l.", result);
-        return EXIT_FAILURE;
+    case NFS_SUPER_MAGIC:
+    case SMB_SUPER_MAGIC:
+    case SMB2_SUPER_MAGIC:
+    case CIFS_SUPER_MAGIC:
+    case CEPH_SUPER_MAGIC:
+    case AFS_SUPER_MAGIC:
+    case AFS_FS_MAGIC:
+    case CODA_SUPER_MAGIC:
+    case V9FS_MAGIC:
+    case FUSE_SUPER_MAGIC:
+        return WRITER_THREADS;
+    default:
+        return 0;
     }
-    *size = result;
-
-    return EXIT_SUCCESS;
 }
 
 /**
- * /brief Checks if response field is correct.
+ * \brief Opens the archive the received files are streamed to.
+ *
+ * "-" streams them to stdout, the verbose output goes to stderr then.
  *
- * /param amount of bytes in parse_buf.
- * /param text to be checked against parse_buf.
- * /param parse_buf where to find text.
+ * \param archive path of the archive, created or truncated, or "-".
  *
- * /return EXIT_SUCCESS if text is in response, else EXIT_FAILURE.
+ * \return EXIT_SUCCESS on success, else EXIT_FAILURE.
  */
-int check_text(size_t amount, char* text, char* parse_buf)
+static int open_archive(const char* archive)
 {
-    size_t len;
-    len = strlen(text);
-
-    /* it must contain the status= string now */
-    if (amount < (len + 2))
+    if (strcmp(archive, ARCHIVE_STDOUT) == 0)
     {
-        /* message is too short */
-        print_error("Malformed response (too short %s).", text);
-        EXIT_FAILURE;
+        sarchive_fd = STDOUT_FILENO;
+        sverbose_stream = stderr;
+        return EXIT_SUCCESS;
     }
-    if (strncmp(text, parse_buf, len) != 0)
+    sarchive_fd = open(archive, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+            ARCHIVE_MODE);
+    if (sarchive_fd < 0)
     {
-        print_error("Malformed response (no %s).", text);
-        EXIT_FAILURE;
+        print_error("Could not create archive %s: %s.", archive,
+                strerror(errno));
+        return EXIT_FAILURE;
     }
     return EXIT_SUCCESS;
 }
-
@@ -0,0 +1,1111 @@
+/**
+ * @file simple_message_client_agent.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, agent posting messages for local callers.
+ *
+ * The agent listens on a Unix socket. A caller connects, writes a request in
+ * the format of the server,
+ *
+ *     user=alice\n[img=http://host/a.png\n]message
+ *
+ * and shuts down writing. The agent queues the request and replies one line,
+ * status=<status of the server> or error=<description>, once it is posted.
+ * A caller not interested in the result may close the socket right away.
+ *
+ * The addresses of the server are resolved once and kept for ADDRESS_TTL
+ * seconds, or until no address could be connected. The server reads a
+ * request up to the end of the connection, so a connection can not carry
+ * more than one post: the pool bounds the connections to the server open at
+ * the same time (-c) instead. Requests waiting for a connection are queued,
+ * and while -q callers are pending no further callers are accepted, so they
+ * wait in the backlog of the socket. Everything is driven by one epoll loop.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+/* accept4(), daemon() */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include "simple_message_client_connection.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* decimal format base for strtol */
+#define INPUT_NUM_BASE 10
+
+#define DEFAULT_CONNECTIONS 8
+#define MAX_CONNECTIONS 1024
+#define DEFAULT_QUEUE 256
+#define MAX_QUEUE 65536
+
+/* backlog of the Unix socket */
+#define LISTEN_BACKLOG 128
+
+/* the fields of a request, as sent to the server */
+#define SET_USER "user="
+#define SET_IMAGE "img="
+#define FIELD_TERMINATOR '\n'
+
+/* first buffer of a caller, kept for the next one */
+#define REQUEST_BUFFER 4096
+/* largest request accepted from a caller */
+#define REQUEST_LIMIT (16 * 1024 * 1024)
+
+/* longest reply line */
+#define REPLY_SIZE (POST_ERROR_SIZE + 16)
+
+/* how long the addresses of the server are kept in seconds */
+#define ADDRESS_TTL 60
+
+/* Timeout for a caller or connection making no progress in seconds */
+#define SOCKET_TIMEOUT 30
+
+/* longest wait of epoll, to check the timeouts */
+#define TICK_MS 1000
+/* pause of accepting when out of descriptors, unless a caller leaves first */
+#define ACCEPT_BACKOFF_MS 100
+
+#define MS_PER_SECOND 1000
+#define NS_PER_MS 1000000
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/** What an epoll event is for, the first member of its structure. */
+enum watch_kind
+{
+    WATCH_LISTEN,
+    WATCH_SIGNAL,
+    WATCH_CALLER,
+    WATCH_SLOT
+};
+
+/** The resolved addresses of the server, shared by the posts using them. */
+struct addresses
+{
+    /** from getaddrinfo() */
+    struct addrinfo* list;
+    /** when they were resolved, in ms */
+    long resolved_ms;
+    /** posts using them */
+    long users;
+    /** no address could be connected */
+    bool stale;
+};
+
+/** A local caller, from accepting it until its reply. */
+struct caller
+{
+    enum watch_kind kind;
+    /** connected Unix socket */
+    int fd;
+    /** the request read */
+    char* buffer;
+    /** size of buffer */
+    size_t size;
+    /** bytes read */
+    size_t length;
+    /** the parsed request, pointing into buffer */
+    struct post_request request;
+    /** next caller of the free list or the queue */
+    struct caller* next;
+    /** when reading the request times out, in ms */
+    long deadline_ms;
+    /** the request is still being read */
+    bool reading;
+};
+
+/** A connection of the pool posting the requests of callers. */
+struct slot
+{
+    enum watch_kind kind;
+    /** the post of the current request */
+    struct connection connection;
+    /** dropping the files of the response */
+    struct response_sink sink;
+    /** whose request is posted, NULL if the slot is idle */
+    struct caller* caller;
+    /** addresses in use */
+    struct addresses* addresses;
+};
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+static const char* sprogram_arg0 = NULL;
+
+static const char* sserver = NULL;
+static const char* sport = NULL;
+
+/** The current addresses of the server. */
+static struct addresses* saddresses = NULL;
+
+/** epoll instance driving the agent. */
+static int sepoll_fd = -1;
+/** The Unix socket and whether callers are accepted from it. */
+static int slisten_fd = -1;
+static bool slistening = false;
+static const enum watch_kind slisten_kind = WATCH_LISTEN;
+/** When accepting is resumed after running out of descriptors, 0 if not. */
+static long saccept_resume_ms = 0;
+/** signalfd of SIGINT and SIGTERM. */
+static int ssignal_fd = -1;
+static const enum watch_kind ssignal_kind = WATCH_SIGNAL;
+
+/** The pool. */
+static struct slot* sslots = NULL;
+static long sconnections = DEFAULT_CONNECTIONS;
+
+/** All callers, those not pending and those waiting for a connection. */
+static struct caller* scallers = NULL;
+static long spending_limit = DEFAULT_QUEUE;
+static struct caller* sfree = NULL;
+static struct caller* squeue_head = NULL;
+static struct caller* squeue_tail = NULL;
+
+/** Requests posted with status 0, and the others. */
+static long sposted = 0;
+static long sfailed = 0;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static void print_error(const char* message, ...);
+static void print_usage(FILE* stream, int exit_code);
+static long convert_number(const char* text, long lower, long upper,
+    const char* what);
+static int open_listen(const char* path);
+static int open_signals(void);
+static int set_listening(bool listening);
+static struct addresses* resolve(void);
+static void release_addresses(struct addresses* addresses);
+static void accept_callers(void);
+static void read_caller(struct caller* caller);
+static int parse_request(struct caller* caller);
+static void reply(struct caller* caller, const char* message, ...);
+static void dispatch(void);
+static void start_post(struct slot* slot, struct caller* caller);
+static void advance(struct slot* slot);
+static int next_timeout(void);
+static void finish(struct slot* slot, const char* error);
+static void check_timeouts(void);
+static int drop_begin(void* context, const char* name, long length);
+static int drop_content(void* context, const char* data, size_t length);
+static int drop_end(void* context);
+static long now_ms(void);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief the main method for the agent
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * \return success or failure.
+ * \retval EXIT_SUCCESS if stopped by SIGINT or SIGTERM.
+ * \retval EXIT_FAILURE on failure.
+ */
+int main(int argc, char* argv[])
+{
+    struct epoll_event events[MAX_CONNECTIONS];
+    struct signalfd_siginfo signal_info;
+    const char* path = NULL;
+    bool detach = false;
+    bool running = true;
+    void* data;
+    int ready;
+    int c;
+    long i;
+
+    sprogram_arg0 = argv[0];
+    while ((c = getopt(argc, argv, "s:p:l:c:q:dh")) != EOF)
+    {
+        switch (c)
+        {
+        case 's':
+            sserver = optarg;
+            break;
+        case 'p':
+            sport = optarg;
+            break;
+        case 'l':
+            path = optarg;
+            break;
+        case 'c':
+            sconnections = convert_number(optarg, 1, MAX_CONNECTIONS,
+                "number of connections");
+            break;
+        case 'q':
+            spending_limit = convert_number(optarg, 1, MAX_QUEUE,
+                "number of pending callers");
+            break;
+        case 'd':
+            detach = true;
+            break;
+        case 'h':
+            print_usage(stdout, EXIT_SUCCESS);
+            break;
+        default:
+            print_usage(stderr, EXIT_FAILURE);
+            break;
+        }
+    }
+    if ((sserver == NULL) || (sport == NULL) || (path == NULL) ||
+        (optind != argc))
+    {
+        print_usage(stderr, EXIT_FAILURE);
+    }
+
+    saddresses = resolve();
+    if (saddresses == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    sepoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    sslots = calloc((size_t) sconnections, sizeof(*sslots));
+    scallers = calloc((size_t) spending_limit, sizeof(*scallers));
+    if ((sepoll_fd < 0) || (sslots == NULL) || (scallers == NULL))
+    {
+        print_error("Could not set up the agent: %s.", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < sconnections; ++i)
+    {
+        if (connection_init(&sslots[i].connection, PATH_MAX, sepoll_fd,
+            &sslots[i]) < 0)
+        {
+            print_error("Could not set up the connections: %s.",
+                strerror(errno));
+            return EXIT_FAILURE;
+        }
+        sslots[i].kind = WATCH_SLOT;
+        sslots[i].sink.begin = drop_begin;
+        sslots[i].sink.content = drop_content;
+        sslots[i].sink.end = drop_end;
+        sslots[i].sink.context = &sslots[i];
+        sslots[i].sink.descriptor = NULL;
+    }
+    for (i = spending_limit - 1; i >= 0; --i)
+    {
+        scallers[i].kind = WATCH_CALLER;
+        scallers[i].fd = -1;
+        scallers[i].next = sfree;
+        sfree = &scallers[i];
+    }
+
+    if (open_listen(path) < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    /* the working directory is kept, path may be relative */
+    if (detach && (daemon(1, 0) < 0))
+    {
+        print_error("Could not detach: %s.", strerror(errno));
+        (void) unlink(path);
+        return EXIT_FAILURE;
+    }
+    /* epoll reports the signals of the process adding the signalfd */
+    if (open_signals() < 0)
+    {
+        (void) unlink(path);
+        return EXIT_FAILURE;
+    }
+
+    while (running)
+    {
+        ready = epoll_wait(sepoll_fd, events, MAX_CONNECTIONS,
+            next_timeout());
+        if ((ready < 0) && (errno != EINTR))
+        {
+            print_error("epoll_wait failed: %s.", strerror(errno));
+            break;
+        }
+        for (i = 0; i < ready; ++i)
+        {
+            data = events[i].data.ptr;
+            switch (*(const enum watch_kind*) data)
+            {
+            case WATCH_LISTEN:
+                accept_callers();
+                break;
+            case WATCH_SIGNAL:
+                if (read(ssignal_fd, &signal_info, sizeof(signal_info)) > 0)
+                {
+                    running = false;
+                }
+                break;
+            case WATCH_CALLER:
+                read_caller(data);
+                break;
+            case WATCH_SLOT:
+                advance(data);
+                break;
+            }
+        }
+        check_timeouts();
+        dispatch();
+    }
+
+    /* requests still pending are dropped, their callers see the socket closed */
+    (void) unlink(path);
+    (void) fprintf(stderr, "%s: %ld requests posted, %ld failed.\n",
+        sprogram_arg0, sposted, sfailed);
+    for (i = 0; i < sconnections; ++i)
+    {
+        connection_free(&sslots[i].connection);
+    }
+    for (i = 0; i < spending_limit; ++i)
+    {
+        if (scallers[i].fd >= 0)
+        {
+            (void) close(scallers[i].fd);
+        }
+        free(scallers[i].buffer);
+    }
+    free(sslots);
+    free(scallers);
+    freeaddrinfo(saddresses->list);
+    free(saddresses);
+    (void) close(slisten_fd);
+    (void) close(ssignal_fd);
+    (void) close(sepoll_fd);
+    return running ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Prints error message to stderr.
+ *
+ * A new line is printed after the message text automatically.
+ * Printout can be formatted like printf.
+ *
+ * \param message output on stderr.
+ *
+ * \return void
+ */
+static void print_error(const char* message, ...)
+{
+    va_list args;
+
+    /* do not handle return value of fprintf, because it makes no sense here */
+    (void) fprintf(stderr, "%s: ", sprogram_arg0);
+    va_start(args, message);
+    (void) vfprintf(stderr, message, args);
+    va_end(args);
+    (void) fprintf(stderr, "\n");
+}
+
+/**
+ * \brief Prints the usage and exits.
+ *
+ * \param stream where to put the usage output.
+ * \param exit_code to be set on exit.
+ */
+static void print_usage(FILE* stream, int exit_code)
+{
+    (void) fprintf(stream,
+        "usage: %s -s server -p port -l socket [-c connections] [-q pending] "
+        "[-d]\n"
+        "  -s <server>       fully qualified domain name or IP address of the "
+        "server\n"
+        "  -p <port>         well-known port of the server\n"
+        "  -l <socket>       path of the Unix socket the callers connect to\n"
+        "  -c <connections>  connections to the server at the same time [%d]\n"
+        "  -q <pending>      callers pending before no more are accepted "
+        "[%d]\n"
+        "  -d                detach and run in the background\n"
+        "  -h                this help\n", sprogram_arg0,
+        DEFAULT_CONNECTIONS, DEFAULT_QUEUE);
+    exit(exit_code);
+}
+
+/**
+ * \brief Converts a numeric command line argument.
+ *
+ * This functions exits when the argument is invalid.
+ *
+ * \param text the argument to be converted.
+ * \param lower smallest allowed value.
+ * \param upper greatest allowed value.
+ * \param what describes the argument in error messages.
+ * \return the converted number.
+ */
+static long convert_number(const char* text, long lower, long upper,
+    const char* what)
+{
+    char* end_ptr;
+    long number;
+
+    errno = 0;
+    number = strtol(text, &end_ptr, INPUT_NUM_BASE);
+    if ((errno != 0) || (end_ptr == text) || (*end_ptr != '\0') ||
+        (number < lower) || (number > upper))
+    {
+        print_error("Invalid %s %s.", what, text);
+        print_usage(stderr, EXIT_FAILURE);
+    }
+    return number;
+}
+
+/**
+ * \brief Opens the non-blocking Unix socket for the callers.
+ *
+ * \param path of the socket, a socket left behind is replaced, anything
+ *  else there is left alone.
+ * \return 0 on success, else -1.
+ */
+static int open_listen(const char* path)
+{
+    struct sockaddr_un address;
+    struct stat info;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        print_error("Socket path %s too long.", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+    /* a socket left behind by a previous run */
+    if (lstat(path, &info) == 0)
+    {
+        if (!S_ISSOCK(info.st_mode))
+        {
+            print_error("%s exists and is no socket.", path);
+            return -1;
+        }
+        (void) unlink(path);
+    }
+
+    slisten_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+        0);
+    if (slisten_fd < 0)
+    {
+        print_error("socket() failed: %s.", strerror(errno));
+        return -1;
+    }
+    if ((bind(slisten_fd, (struct sockaddr*) &address, sizeof(address)) < 0) ||
+        (listen(slisten_fd, LISTEN_BACKLOG) < 0))
+    {
+        print_error("Could not listen on %s: %s.", path, strerror(errno));
+        return -1;
+    }
+    return set_listening(true);
+}
+
+/**
+ * \brief Receives SIGINT and SIGTERM by a signalfd.
+ *
+ * SIGPIPE is ignored, callers may close their socket before the reply.
+ *
+ * \return 0 on success, else -1.
+ */
+static int open_signals(void)
+{
+    struct epoll_event event;
+    sigset_t mask;
+
+    (void) signal(SIGPIPE, SIG_IGN);
+    (void) sigemptyset(&mask);
+    (void) sigaddset(&mask, SIGINT);
+    (void) sigaddset(&mask, SIGTERM);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0)
+    {
+        print_error("sigprocmask() failed: %s.", strerror(errno));
+        return -1;
+    }
+    ssignal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (ssignal_fd < 0)
+    {
+        print_error("signalfd() failed: %s.", strerror(errno));
+        return -1;
+    }
+    event.events = EPOLLIN;
+    event.data.ptr = (void*) &ssignal_kind;
+    if (epoll_ctl(sepoll_fd, EPOLL_CTL_ADD, ssignal_fd, &event) < 0)
+    {
+        print_error("epoll_ctl failed: %s.", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Starts or stops accepting callers.
+ *
+ * While no callers are accepted they wait in the backlog of the socket, and
+ * once it is full their connect() blocks: the backpressure of the agent.
+ *
+ * \param listening whether callers are accepted.
+ * \return 0 on success, else -1.
+ */
+static int set_listening(bool listening)
+{
+    struct epoll_event event;
+
+    if (listening == slistening)
+    {
+        return 0;
+    }
+    event.events = EPOLLIN;
+    event.data.ptr = (void*) &slisten_kind;
+    if (epoll_ctl(sepoll_fd, listening ? EPOLL_CTL_ADD : EPOLL_CTL_DEL,
+        slisten_fd, &event) < 0)
+    {
+        print_error("epoll_ctl failed: %s.", strerror(errno));
+        return -1;
+    }
+    slistening = listening;
+    return 0;
+}
+
+/**
+ * \brief Resolves the addresses of the server.
+ *
+ * \return the addresses, NULL on error.
+ */
+static struct addresses* resolve(void)
+{
+    struct addrinfo hints;
+    struct addresses* addresses;
+    int result;
+
+    addresses = calloc(1, sizeof(*addresses));
+    if (addresses == NULL)
+    {
+        print_error("Could not resolve %s: %s.", sserver, strerror(errno));
+        return NULL;
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    result = getaddrinfo(sserver, sport, &hints, &addresses->list);
+    if (result != 0)
+    {
+        print_error("getaddrinfo: %s", gai_strerror(result));
+        free(addresses);
+        return NULL;
+    }
+    addresses->resolved_ms = now_ms();
+    return addresses;
+}
+
+/**
+ * \brief Releases addresses used by a post.
+ *
+ * Addresses replaced by newer ones are freed when their last post is done.
+ *
+ * \param addresses used.
+ */
+static void release_addresses(struct addresses* addresses)
+{
+    if ((--addresses->users == 0) && (addresses != saddresses))
+    {
+        freeaddrinfo(addresses->list);
+        free(addresses);
+    }
+}
+
+/**
+ * \brief Accepts the callers waiting, as long as fewer than -q are pending.
+ */
+static void accept_callers(void)
+{
+    struct epoll_event event;
+    struct caller* caller;
+    int fd;
+
+    while (sfree != NULL)
+    {
+        fd = accept4(slisten_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if ((errno == EMFILE) || (errno == ENFILE))
+            {
+                /* the caller stays in the backlog, which epoll reports on */
+                saccept_resume_ms = now_ms() + ACCEPT_BACKOFF_MS;
+                (void) set_listening(false);
+            }
+            else if ((errno != EAGAIN) && (errno != EWOULDBLOCK) &&
+                (errno != EINTR) && (errno != ECONNABORTED))
+            {
+                print_error("accept4() failed: %s.", strerror(errno));
+            }
+            return;
+        }
+        caller = sfree;
+        sfree = caller->next;
+        caller->fd = fd;
+        caller->length = 0;
+        caller->next = NULL;
+        caller->reading = true;
+        caller->deadline_ms = now_ms() + SOCKET_TIMEOUT * MS_PER_SECOND;
+        event.events = EPOLLIN;
+        event.data.ptr = caller;
+        if (epoll_ctl(sepoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+        {
+            reply(caller, "error=epoll_ctl failed: %s.", strerror(errno));
+        }
+    }
+    (void) set_listening(false);
+}
+
+/**
+ * \brief Reads the request of a caller, queueing it when complete.
+ *
+ * \param caller reading.
+ */
+static void read_caller(struct caller* caller)
+{
+    char* buffer;
+    size_t size;
+    ssize_t count;
+
+    for (;;)
+    {
+        /* one byte is kept to terminate the message */
+        if (caller->length + 1 >= caller->size)
+        {
+            size = caller->size == 0 ? REQUEST_BUFFER : caller->size * 2;
+            if (size > REQUEST_LIMIT)
+            {
+                reply(caller, "error=Request too large.");
+                return;
+            }
+            buffer = realloc(caller->buffer, size);
+            if (buffer == NULL)
+            {
+                reply(caller, "error=Out of memory.");
+                return;
+            }
+            caller->buffer = buffer;
+            caller->size = size;
+        }
+        count = read(caller->fd, caller->buffer + caller->length,
+            caller->size - caller->length - 1);
+        if (count > 0)
+        {
+            caller->length += (size_t) count;
+            continue;
+        }
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+            {
+                reply(caller, "error=Could not read request: %s.",
+                    strerror(errno));
+            }
+            return;
+        }
+        break;
+    }
+
+    /* the end of the request: only the reply is written to the socket */
+    caller->reading = false;
+    (void) epoll_ctl(sepoll_fd, EPOLL_CTL_DEL, caller->fd, NULL);
+    if (parse_request(caller) < 0)
+    {
+        reply(caller, "error=Invalid request.");
+        return;
+    }
+    if (squeue_tail == NULL)
+    {
+        squeue_head = caller;
+    }
+    else
+    {
+        squeue_tail->next = caller;
+    }
+    squeue_tail = caller;
+}
+
+/**
+ * \brief Splits the request of a caller into its fields.
+ *
+ * The lines of user and image are terminated in place.
+ *
+ * \param caller with the complete request.
+ * \return 0 on success, -1 if the request is invalid.
+ */
+static int parse_request(struct caller* caller)
+{
+    char* text = caller->buffer;
+    char* end;
+
+    memset(&caller->request, 0, sizeof(caller->request));
+    caller->request.message_fd = -1;
+    if (text == NULL)
+    {
+        return -1;
+    }
+    text[caller->length] = '\0';
+
+    if (strncmp(text, SET_USER, strlen(SET_USER)) != 0)
+    {
+        return -1;
+    }
+    text += strlen(SET_USER);
+    end = strchr(text, FIELD_TERMINATOR);
+    if (end == NULL)
+    {
+        return -1;
+    }
+    *end = '\0';
+    caller->request.user = text;
+    text = end + 1;
+
+    if (strncmp(text, SET_IMAGE, strlen(SET_IMAGE)) == 0)
+    {
+        text += strlen(SET_IMAGE);
+        end = strchr(text, FIELD_TERMINATOR);
+        if (end == NULL)
+        {
+            return -1;
+        }
+        *end = '\0';
+        caller->request.image = text;
+        text = end + 1;
+    }
+    caller->request.message = text;
+    return 0;
+}
+
+/**
+ * \brief Replies a line to a caller and releases it.
+ *
+ * The reply is not waited for: it fits into the empty socket buffer, and a
+ * caller which has gone away does not get it.
+ *
+ * Printout can be formatted like printf.
+ *
+ * \param caller pending.
+ * \param message the reply without the line terminator.
+ */
+static void reply(struct caller* caller, const char* message, ...)
+{
+    char line[REPLY_SIZE];
+    va_list args;
+    int length;
+
+    va_start(args, message);
+    length = vsnprintf(line, sizeof(line) - 1, message, args);
+    va_end(args);
+    if (length < 0)
+    {
+        length = 0;
+    }
+    else if ((size_t) length > sizeof(line) - 2)
+    {
+        length = (int) sizeof(line) - 2;
+    }
+    line[length++] = FIELD_TERMINATOR;
+    (void) send(caller->fd, line, (size_t) length,
+        MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    /* closing the socket removes it from epoll */
+    (void) close(caller->fd);
+    caller->fd = -1;
+    caller->reading = false;
+    if (caller->size > REQUEST_BUFFER)
+    {
+        free(caller->buffer);
+        caller->buffer = NULL;
+        caller->size = 0;
+    }
+    caller->next = sfree;
+    sfree = caller;
+    (void) set_listening(true);
+}
+
+/**
+ * \brief Hands the queued requests to the idle connections of the pool.
+ */
+static void dispatch(void)
+{
+    struct caller* caller;
+    long i;
+
+    for (i = 0; (i < sconnections) && (squeue_head != NULL); ++i)
+    {
+        /* a post failing at once leaves the slot idle for the next one */
+        while ((sslots[i].caller == NULL) && (squeue_head != NULL))
+        {
+            caller = squeue_head;
+            squeue_head = caller->next;
+            if (squeue_head == NULL)
+            {
+                squeue_tail = NULL;
+            }
+            caller->next = NULL;
+            start_post(&sslots[i], caller);
+        }
+    }
+}
+
+/**
+ * \brief Starts posting the request of a caller on an idle connection.
+ *
+ * The addresses are resolved again when they are older than ADDRESS_TTL or
+ * none of them could be connected; if that fails the old ones are kept.
+ *
+ * \param slot idle.
+ * \param caller whose request is posted.
+ */
+static void start_post(struct slot* slot, struct caller* caller)
+{
+    struct addresses* addresses;
+    struct addresses* old;
+    long now = now_ms();
+
+    if (saddresses->stale ||
+        (now - saddresses->resolved_ms >= ADDRESS_TTL * MS_PER_SECOND))
+    {
+        addresses = resolve();
+        if (addresses != NULL)
+        {
+            /* the old addresses stay until their last post is done */
+            old = saddresses;
+            saddresses = addresses;
+            if (old->users == 0)
+            {
+                freeaddrinfo(old->list);
+                free(old);
+            }
+        }
+        else
+        {
+            /* try again after ADDRESS_TTL */
+            saddresses->resolved_ms = now;
+            saddresses->stale = false;
+        }
+    }
+
+    slot->caller = caller;
+    slot->addresses = saddresses;
+    ++slot->addresses->users;
+    if (connection_start(&slot->connection, &caller->request, &slot->sink,
+        slot->addresses->list) < 0)
+    {
+        finish(slot, slot->connection.post.error);
+    }
+}
+
+/**
+ * \brief Advances the post of a slot whose socket is ready.
+ *
+ * \param slot posting.
+ */
+static void advance(struct slot* slot)
+{
+    enum post_state state = connection_advance(&slot->connection);
+
+    if (state == POST_DONE)
+    {
+        finish(slot, NULL);
+    }
+    else if (state == POST_FAILED)
+    {
+        finish(slot, slot->connection.post.error);
+    }
+}
+
+/**
+ * \brief Returns how long epoll may wait.
+ *
+ * \return ms until the first connection attempt is due, TICK_MS at most.
+ */
+static int next_timeout(void)
+{
+    int timeout = TICK_MS;
+    int due;
+    long i;
+
+    for (i = 0; i < sconnections; ++i)
+    {
+        due = sslots[i].caller != NULL ?
+            connection_timeout(&sslots[i].connection) : -1;
+        if ((due >= 0) && (due < timeout))
+        {
+            timeout = due;
+        }
+    }
+    return timeout;
+}
+
+/**
+ * \brief Replies the result of a post to its caller and idles the slot.
+ *
+ * When no address could be connected they are resolved again for the next
+ * post.
+ *
+ * \param slot posting.
+ * \param error describing why the post failed, NULL if it is done.
+ */
+static void finish(struct slot* slot, const char* error)
+{
+    int status = slot->connection.post.parser.status;
+
+    if (!slot->connection.connected)
+    {
+        slot->addresses->stale = true;
+    }
+    /* closing the sockets removes them from epoll */
+    connection_close(&slot->connection);
+    if (error != NULL)
+    {
+        ++sfailed;
+        reply(slot->caller, "error=%s", error[0] != '\0' ? error : "Failed.");
+    }
+    else
+    {
+        if (status == 0)
+        {
+            ++sposted;
+        }
+        else
+        {
+            ++sfailed;
+        }
+        reply(slot->caller, "status=%d", status);
+    }
+    release_addresses(slot->addresses);
+    slot->addresses = NULL;
+    slot->caller = NULL;
+}
+
+/**
+ * \brief Gives up callers and posts making no progress.
+ *
+ * Queued callers do not time out, they are bounded by -q. Accepting paused
+ * for want of descriptors is resumed, too.
+ */
+static void check_timeouts(void)
+{
+    long now = now_ms();
+    long i;
+
+    for (i = 0; i < spending_limit; ++i)
+    {
+        if (scallers[i].reading && (now >= scallers[i].deadline_ms))
+        {
+            reply(&scallers[i], "error=Timeout.");
+        }
+    }
+    for (i = 0; i < sconnections; ++i)
+    {
+        /* the next connection attempt is due */
+        if ((sslots[i].caller != NULL) &&
+            (connection_timeout(&sslots[i].connection) == 0))
+        {
+            advance(&sslots[i]);
+        }
+        if ((sslots[i].caller != NULL) &&
+            (now >= sslots[i].connection.deadline_ms))
+        {
+            finish(&sslots[i], "Timeout.");
+        }
+    }
+    if ((saccept_resume_ms != 0) && (now >= saccept_resume_ms))
+    {
+        saccept_resume_ms = 0;
+        (void) set_listening(sfree != NULL);
+    }
+}
+
+/**
+ * \brief Begins a file of a response, which is dropped.
+ *
+ * \param context will be ignored.
+ * \param name will be ignored.
+ * \param length will be ignored.
+ * \return 0.
+ */
+static int drop_begin(void* context, const char* name, long length)
+{
+    (void) context; /* pedantic */
+    (void) name;
+    (void) length;
+    return 0;
+}
+
+/**
+ * \brief Drops the content of a file.
+ *
+ * \param context will be ignored.
+ * \param data will be ignored.
+ * \param length will be ignored.
+ * \return 0.
+ */
+static int drop_content(void* context, const char* data, size_t length)
+{
+    (void) context; /* pedantic */
+    (void) data;
+    (void) length;
+    return 0;
+}
+
+/**
+ * \brief Completes a file.
+ *
+ * \param context will be ignored.
+ * \return 0.
+ */
+static int drop_end(void* context)
+{
+    (void) context; /* pedantic */
+    return 0;
+}
+
+/**
+ * \brief Returns the monotonic time.
+ *
+ * \return milliseconds since some unspecified start.
+ */
+static long now_ms(void)
+{
+    struct timespec now;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long) now.tv_sec * MS_PER_SECOND + now.tv_nsec / NS_PER_MS;
+}
+
+/* === EOF ================================================================== */
@@ -0,0 +1,861 @@
+/**
+ * @file simple_message_client_batch.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, posting a batch of messages.
+ *
+ * The records to be posted are read as JSON lines, one object per line
+ * with the strings "user", "message" and optionally "img", e.g.
+ *
+ *     {"user": "alice", "message": "hello", "img": "http://host/a.png"}
+ *
+ * The server is resolved once. Up to -c records are posted at the same time,
+ * each on its own connection, all driven by one epoll loop: every connection
+ * is a struct connection, raced to the addresses of the server and advanced
+ * whenever one of its sockets is ready. For every record a JSON line with its
+ * result is printed to stdout in the order the posts complete, the
+ * throughput of the batch to stderr at the end. The files of the responses
+ * are counted, not stored.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include "simple_message_client_connection.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* decimal format base for strtol */
+#define INPUT_NUM_BASE 10
+
+#define DEFAULT_CONNECTIONS 8
+#define MAX_CONNECTIONS 1024
+
+/* records read from stdin */
+#define RECORDS_STDIN "-"
+
+/* longest wait of epoll, to check the timeouts */
+#define TICK_MS 1000
+
+#define MS_PER_SECOND 1000
+#define NS_PER_MS 1000000
+#define BYTES_PER_MIB (1024.0 * 1024.0)
+
+/* first code point of the UTF-16 high and low surrogates */
+#define HIGH_SURROGATE 0xD800
+#define LOW_SURROGATE 0xDC00
+#define SURROGATE_END 0xE000
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/** A connection posting one record after the other. */
+struct slot
+{
+    /** the post of the current record */
+    struct connection connection;
+    /** counting the files of the response */
+    struct response_sink sink;
+    /** the current record, pointing into line */
+    struct post_request request;
+    /** line of the current record */
+    char* line;
+    /** size of line */
+    size_t line_size;
+    /** line number of the current record */
+    long record;
+    /** files of the response */
+    long files;
+    /** content bytes of the response */
+    uint64_t bytes;
+    /** when the record was started, in ms */
+    long start_ms;
+    /** a record is being posted */
+    bool active;
+};
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+static const char* sprogram_arg0 = NULL;
+
+/** The records. */
+static FILE* sinput = NULL;
+/** All records have been read. */
+static bool sinput_done = false;
+/** Lines read. */
+static long slines = 0;
+
+/** The addresses of the server. */
+static struct addrinfo* saddresses = NULL;
+/** epoll instance driving the posts. */
+static int sepoll_fd = -1;
+
+/** Records posted with status 0, and the others. */
+static long sposted = 0;
+static long sfailed = 0;
+/** Bytes received by all posts. */
+static uint64_t sreceived = 0;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static void print_error(const char* message, ...);
+static void print_usage(FILE* stream, int exit_code);
+static long convert_number(const char* text, long lower, long upper,
+    const char* what);
+static void start_next(struct slot* slot);
+static void advance(struct slot* slot);
+static int next_timeout(const struct slot* slots, long count);
+static void complete(struct slot* slot, const char* error);
+static void report(struct slot* slot, const char* error);
+static void print_json(const char* text);
+static int parse_record(char* text, struct post_request* request);
+static char* parse_string(char* text, char** value);
+static int parse_hex4(const char* text);
+static char* skip_space(char* text);
+static int count_begin(void* context, const char* name, long length);
+static int count_content(void* context, const char* data, size_t length);
+static int count_end(void* context);
+static long now_ms(void);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief the main method for the batch client
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * \return success or failure.
+ * \retval EXIT_SUCCESS if every record was posted with status 0.
+ * \retval EXIT_FAILURE on failure.
+ */
+int main(int argc, char* argv[])
+{
+    struct addrinfo hints;
+    struct epoll_event events[MAX_CONNECTIONS];
+    struct slot* slots;
+    const char* server = NULL;
+    const char* port = NULL;
+    const char* records = RECORDS_STDIN;
+    long connections = DEFAULT_CONNECTIONS;
+    long started;
+    long active;
+    long now;
+    double seconds;
+    int ready;
+    int result;
+    int c;
+    long i;
+
+    sprogram_arg0 = argv[0];
+    while ((c = getopt(argc, argv, "s:p:c:f:h")) != EOF)
+    {
+        switch (c)
+        {
+        case 's':
+            server = optarg;
+            break;
+        case 'p':
+            port = optarg;
+            break;
+        case 'c':
+            connections = convert_number(optarg, 1, MAX_CONNECTIONS,
+                "number of connections");
+            break;
+        case 'f':
+            records = optarg;
+            break;
+        case 'h':
+            print_usage(stdout, EXIT_SUCCESS);
+            break;
+        default:
+            print_usage(stderr, EXIT_FAILURE);
+            break;
+        }
+    }
+    if ((server == NULL) || (port == NULL) || (optind != argc))
+    {
+        print_usage(stderr, EXIT_FAILURE);
+    }
+
+    sinput = strcmp(records, RECORDS_STDIN) == 0 ? stdin :
+        fopen(records, "r");
+    if (sinput == NULL)
+    {
+        print_error("Could not open records %s: %s.", records,
+            strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    /* resolved once for all records */
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    result = getaddrinfo(server, port, &hints, &saddresses);
+    if (result != 0)
+    {
+        print_error("getaddrinfo: %s", gai_strerror(result));
+        return EXIT_FAILURE;
+    }
+
+    sepoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    slots = calloc((size_t) connections, sizeof(*slots));
+    if ((sepoll_fd < 0) || (slots == NULL))
+    {
+        print_error("Could not set up the connections: %s.", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < connections; ++i)
+    {
+        if (connection_init(&slots[i].connection, PATH_MAX, sepoll_fd,
+            &slots[i]) < 0)
+        {
+            print_error("Could not set up the connections: %s.",
+                strerror(errno));
+            return EXIT_FAILURE;
+        }
+        slots[i].sink.begin = count_begin;
+        slots[i].sink.content = count_content;
+        slots[i].sink.end = count_end;
+        slots[i].sink.context = &slots[i];
+        slots[i].sink.descriptor = NULL;
+    }
+
+    started = now_ms();
+    for (i = 0; i < connections; ++i)
+    {
+        start_next(&slots[i]);
+    }
+    do
+    {
+        ready = epoll_wait(sepoll_fd, events, (int) connections,
+            next_timeout(slots, connections));
+        if ((ready < 0) && (errno != EINTR))
+        {
+            print_error("epoll_wait failed: %s.", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        for (i = 0; i < ready; ++i)
+        {
+            advance(events[i].data.ptr);
+        }
+
+        now = now_ms();
+        active = 0;
+        for (i = 0; i < connections; ++i)
+        {
+            /* the next connection attempt is due */
+            if (slots[i].active &&
+                (connection_timeout(&slots[i].connection) == 0))
+            {
+                advance(&slots[i]);
+            }
+            if (slots[i].active &&
+                (now >= slots[i].connection.deadline_ms))
+            {
+                complete(&slots[i], "Timeout.");
+            }
+            active += slots[i].active ? 1 : 0;
+        }
+    } while (active > 0);
+
+    seconds = (double) (now_ms() - started) / MS_PER_SECOND;
+    if (seconds <= 0)
+    {
+        seconds = 1.0 / MS_PER_SECOND;
+    }
+    (void) fflush(stdout);
+    (void) fprintf(stderr, "%ld records: %ld posted, %ld failed in %.3f s, "
+        "%.1f records/s, %.2f MiB/s received\n", sposted + sfailed, sposted,
+        sfailed, seconds, (double) (sposted + sfailed) / seconds,
+        (double) sreceived / BYTES_PER_MIB / seconds);
+
+    for (i = 0; i < connections; ++i)
+    {
+        connection_free(&slots[i].connection);
+        free(slots[i].line);
+    }
+    free(slots);
+    freeaddrinfo(saddresses);
+    (void) close(sepoll_fd);
+    if (sinput != stdin)
+    {
+        (void) fclose(sinput);
+    }
+    return sfailed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ *
+ * \brief Prints error message to stderr.
+ *
+ * A new line is printed after the message text automatically.
+ * Printout can be formatted like printf.
+ *
+ * \param message output on stderr.
+ *
+ * \return void
+ */
+static void print_error(const char* message, ...)
+{
+    va_list args;
+
+    /* do not handle return value of fprintf, because it makes no sense here */
+    (void) fprintf(stderr, "%s: ", sprogram_arg0);
+    va_start(args, message);
+    (void) vfprintf(stderr, message, args);
+    va_end(args);
+    (void) fprintf(stderr, "\n");
+}
+
+/**
+ * \brief Prints the usage and exits.
+ *
+ * \param stream where to put the usage output.
+ * \param exit_code to be set on exit.
+ */
+static void print_usage(FILE* stream, int exit_code)
+{
+    (void) fprintf(stream,
+        "usage: %s -s server -p port [-c connections] [-f records]\n"
+        "  -s <server>       fully qualified domain name or IP address of the "
+        "server\n"
+        "  -p <port>         well-known port of the server\n"
+        "  -c <connections>  records posted at the same time [%d]\n"
+        "  -f <records>      JSON lines of user, message and img, - for stdin "
+        "[-]\n"
+        "  -h                this help\n", sprogram_arg0,
+        DEFAULT_CONNECTIONS);
+    exit(exit_code);
+}
+
+/**
+ * \brief Converts a numeric command line argument.
+ *
+ * This functions exits when the argument is invalid.
+ *
+ * \param text the argument to be converted.
+ * \param lower smallest allowed value.
+ * \param upper greatest allowed value.
+ * \param what describes the argument in error messages.
+ * \return the converted number.
+ */
+static long convert_number(const char* text, long lower, long upper,
+    const char* what)
+{
+    char* end_ptr;
+    long number;
+
+    errno = 0;
+    number = strtol(text, &end_ptr, INPUT_NUM_BASE);
+    if ((errno != 0) || (end_ptr == text) || (*end_ptr != '\0') ||
+        (number < lower) || (number > upper))
+    {
+        print_error("Invalid %s %s.", what, text);
+        print_usage(stderr, EXIT_FAILURE);
+    }
+    return number;
+}
+
+/**
+ * \brief Starts posting the next record on a connection.
+ *
+ * Records which can not be posted are reported at once. When there are no
+ * records left the slot stays idle.
+ *
+ * \param slot idle.
+ */
+static void start_next(struct slot* slot)
+{
+    slot->active = false;
+    while (!sinput_done)
+    {
+        if (getline(&slot->line, &slot->line_size, sinput) < 0)
+        {
+            if (ferror(sinput))
+            {
+                print_error("Could not read records: %s.", strerror(errno));
+            }
+            sinput_done = true;
+            break;
+        }
+        slot->record = ++slines;
+        if (*skip_space(slot->line) == '\0')
+        {
+            continue;
+        }
+        slot->files = 0;
+        slot->bytes = 0;
+        slot->start_ms = now_ms();
+        if (parse_record(slot->line, &slot->request) < 0)
+        {
+            report(slot, "Invalid record.");
+            continue;
+        }
+        if (connection_start(&slot->connection, &slot->request, &slot->sink,
+            saddresses) < 0)
+        {
+            connection_close(&slot->connection);
+            report(slot, slot->connection.post.error);
+            continue;
+        }
+        slot->active = true;
+        return;
+    }
+}
+
+/**
+ * \brief Advances the post of a slot whose socket is ready.
+ *
+ * \param slot active.
+ */
+static void advance(struct slot* slot)
+{
+    enum post_state state = connection_advance(&slot->connection);
+
+    if (state == POST_DONE)
+    {
+        complete(slot, NULL);
+    }
+    else if (state == POST_FAILED)
+    {
+        complete(slot, slot->connection.post.error);
+    }
+}
+
+/**
+ * \brief Returns how long epoll may wait.
+ *
+ * \param slots of the posts.
+ * \param count number of slots.
+ * \return ms until the first connection attempt is due, TICK_MS at most.
+ */
+static int next_timeout(const struct slot* slots, long count)
+{
+    int timeout = TICK_MS;
+    int due;
+    long i;
+
+    for (i = 0; i < count; ++i)
+    {
+        due = slots[i].active ? connection_timeout(&slots[i].connection) : -1;
+        if ((due >= 0) && (due < timeout))
+        {
+            timeout = due;
+        }
+    }
+    return timeout;
+}
+
+/**
+ * \brief Reports the result of a record and starts the next one.
+ *
+ * \param slot active.
+ * \param error describing why the record failed, NULL if the post is done.
+ */
+static void complete(struct slot* slot, const char* error)
+{
+    /* closing the sockets removes them from epoll */
+    connection_close(&slot->connection);
+    sreceived += slot->connection.post.received;
+    report(slot, error);
+    start_next(slot);
+}
+
+/**
+ * \brief Prints the result of a record as a JSON line.
+ *
+ * \param slot of the record.
+ * \param error describing why the record failed, NULL if the post is done.
+ */
+static void report(struct slot* slot, const char* error)
+{
+    int status = slot->connection.post.parser.status;
+
+    (void) printf("{\"record\": %ld, ", slot->record);
+    if (error != NULL)
+    {
+        ++sfailed;
+        (void) printf("\"error\": ");
+        print_json(error[0] != '\0' ? error : "Failed.");
+    }
+    else
+    {
+        if (status == 0)
+        {
+            ++sposted;
+        }
+        else
+        {
+            ++sfailed;
+        }
+        (void) printf("\"status\": %d, \"files\": %ld, \"bytes\": %lu",
+            status, slot->files, (unsigned long) slot->bytes);
+    }
+    (void) printf(", \"ms\": %ld}\n", now_ms() - slot->start_ms);
+}
+
+/**
+ * \brief Prints a JSON string to stdout.
+ *
+ * \param text to be printed.
+ */
+static void print_json(const char* text)
+{
+    (void) putchar('"');
+    for (; *text != '\0'; ++text)
+    {
+        if ((*text == '"') || (*text == '\\'))
+        {
+            (void) printf("\\%c", *text);
+        }
+        else if ((unsigned char) *text < ' ')
+        {
+            (void) printf("\\u%04x", (unsigned) (unsigned char) *text);
+        }
+        else
+        {
+            (void) putchar(*text);
+        }
+    }
+    (void) putchar('"');
+}
+
+/**
+ * \brief Parses a record, a JSON object of strings on one line.
+ *
+ * The strings are decoded in place. Members other than user, message and img
+ * are ignored, img may be null.
+ *
+ * \param text the line, changed by decoding.
+ * \param request where to put the record.
+ * \return 0 on success, -1 if the record is invalid.
+ */
+static int parse_record(char* text, struct post_request* request)
+{
+    char* key;
+    char* value;
+
+    memset(request, 0, sizeof(*request));
+    request->message_fd = -1;
+    text = skip_space(text);
+    if (*text++ != '{')
+    {
+        return -1;
+    }
+    text = skip_space(text);
+    while (*text != '}')
+    {
+        text = parse_string(text, &key);
+        if ((text == NULL) || (*(text = skip_space(text)) != ':'))
+        {
+            return -1;
+        }
+        text = skip_space(text + 1);
+        value = NULL;
+        if (*text == '"')
+        {
+            if ((text = parse_string(text, &value)) == NULL)
+            {
+                return -1;
+            }
+        }
+        else
+        {
+            /* a number or literal of a member ignored, or img null */
+            if ((strncmp(text, "null", strlen("null")) != 0) &&
+                ((strcmp(key, "user") == 0) ||
+                (strcmp(key, "message") == 0) || (strcmp(key, "img") == 0)))
+            {
+                return -1;
+            }
+            for (value = text; (*text != '\0') &&
+                (strchr("+-.0123456789Eaeflnrstu", *text) != NULL); ++text)
+            {
+            }
+            if (text == value)
+            {
+                return -1;
+            }
+            value = NULL;
+        }
+
+        if (strcmp(key, "user") == 0)
+        {
+            request->user = value;
+        }
+        else if (strcmp(key, "message") == 0)
+        {
+            request->message = value;
+        }
+        else if (strcmp(key, "img") == 0)
+        {
+            request->image = value;
+        }
+
+        text = skip_space(text);
+        if (*text == ',')
+        {
+            text = skip_space(text + 1);
+        }
+        else if (*text != '}')
+        {
+            return -1;
+        }
+    }
+    if (*skip_space(text + 1) != '\0')
+    {
+        return -1;
+    }
+    return (request->user != NULL) && (request->message != NULL) ? 0 : -1;
+}
+
+/**
+ * \brief Decodes a JSON string in place.
+ *
+ * \param text the opening quote.
+ * \param value where to put the decoded string, terminated by '\0'.
+ * \return the character after the closing quote, NULL if the string is
+ *  invalid.
+ */
+static char* parse_string(char* text, char** value)
+{
+    char* out;
+    int code;
+    int low;
+
+    if (*text != '"')
+    {
+        return NULL;
+    }
+    *value = out = ++text;
+    while (*text != '"')
+    {
+        if ((unsigned char) *text < ' ')
+        {
+            /* also the end of the line */
+            return NULL;
+        }
+        if (*text != '\\')
+        {
+            *out++ = *text++;
+            continue;
+        }
+        ++text;
+        switch (*text++)
+        {
+        case '"':
+            *out++ = '"';
+            break;
+        case '\\':
+            *out++ = '\\';
+            break;
+        case '/':
+            *out++ = '/';
+            break;
+        case 'b':
+            *out++ = '\b';
+            break;
+        case 'f':
+            *out++ = '\f';
+            break;
+        case 'n':
+            *out++ = '\n';
+            break;
+        case 'r':
+            *out++ = '\r';
+            break;
+        case 't':
+            *out++ = '\t';
+            break;
+        case 'u':
+            code = parse_hex4(text);
+            text += 4;
+            if ((code >= HIGH_SURROGATE) && (code < LOW_SURROGATE))
+            {
+                if ((text[0] != '\\') || (text[1] != 'u') ||
+                    ((low = parse_hex4(text + 2)) < LOW_SURROGATE) ||
+                    (low >= SURROGATE_END))
+                {
+                    return NULL;
+                }
+                text += 6;
+                code = 0x10000 + ((code - HIGH_SURROGATE) << 10) +
+                    (low - LOW_SURROGATE);
+            }
+            else if ((code <= 0) ||
+                ((code >= LOW_SURROGATE) && (code < SURROGATE_END)))
+            {
+                /* invalid, or a '\0' cutting the string short */
+                return NULL;
+            }
+            /* UTF-8, never longer than the escape sequence */
+            if (code < 0x80)
+            {
+                *out++ = (char) code;
+            }
+            else if (code < 0x800)
+            {
+                *out++ = (char) (0xC0 | (code >> 6));
+                *out++ = (char) (0x80 | (code & 0x3F));
+            }
+            else if (code < 0x10000)
+            {
+                *out++ = (char) (0xE0 | (code >> 12));
+                *out++ = (char) (0x80 | ((code >> 6) & 0x3F));
+                *out++ = (char) (0x80 | (code & 0x3F));
+            }
+            else
+            {
+                *out++ = (char) (0xF0 | (code >> 18));
+                *out++ = (char) (0x80 | ((code >> 12) & 0x3F));
+                *out++ = (char) (0x80 | ((code >> 6) & 0x3F));
+                *out++ = (char) (0x80 | (code & 0x3F));
+            }
+            break;
+        default:
+            return NULL;
+        }
+    }
+    *out = '\0';
+    return text + 1;
+}
+
+/**
+ * \brief Converts the four hex digits of a \\u escape.
+ *
+ * \param text the digits.
+ * \return the code unit, -1 if text are no four hex digits.
+ */
+static int parse_hex4(const char* text)
+{
+    int code = 0;
+    int i;
+
+    for (i = 0; i < 4; ++i)
+    {
+        code <<= 4;
+        if ((text[i] >= '0') && (text[i] <= '9'))
+        {
+            code += text[i] - '0';
+        }
+        else if ((text[i] >= 'a') && (text[i] <= 'f'))
+        {
+            code += text[i] - 'a' + 10;
+        }
+        else if ((text[i] >= 'A') && (text[i] <= 'F'))
+        {
+            code += text[i] - 'A' + 10;
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    return code;
+}
+
+/**
+ * \brief Skips JSON white space.
+ *
+ * \param text where to start.
+ * \return the first other character.
+ */
+static char* skip_space(char* text)
+{
+    while ((*text == ' ') || (*text == '\t') || (*text == '\n') ||
+        (*text == '\r'))
+    {
+        ++text;
+    }
+    return text;
+}
+
+/**
+ * \brief Counts a file of a response.
+ *
+ * \param context the struct slot.
+ * \param name will be ignored.
+ * \param length will be ignored.
+ * \return 0.
+ */
+static int count_begin(void* context, const char* name, long length)
+{
+    struct slot* slot = context;
+
+    (void) name; /* pedantic */
+    (void) length;
+    ++slot->files;
+    return 0;
+}
+
+/**
+ * \brief Counts the content of a file and drops it.
+ *
+ * \param context the struct slot.
+ * \param data will be ignored.
+ * \param length of data.
+ * \return 0.
+ */
+static int count_content(void* context, const char* data, size_t length)
+{
+    struct slot* slot = context;
+
+    (void) data; /* pedantic */
+    slot->bytes += length;
+    return 0;
+}
+
+/**
+ * \brief Completes a file.
+ *
+ * \param context will be ignored.
+ * \return 0.
+ */
+static int count_end(void* context)
+{
+    (void) context; /* pedantic */
+    return 0;
+}
+
+/**
+ * \brief Returns the monotonic time.
+ *
+ * \return milliseconds since some unspecified start.
+ */
+static long now_ms(void)
+{
+    struct timespec now;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long) now.tv_sec * MS_PER_SECOND + now.tv_nsec / NS_PER_MS;
+}
+
+/* === EOF ================================================================== */
@@ -0,0 +1,610 @@
+/**
+ * @file simple_message_client_bench.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, benchmark of the response parser.
+ *
+ * Generated responses of several shapes are fed in chunks of the read size
+ * to two parsers, both passing the file content to a sink which drops it:
+ *
+ *  - legacy: the former parser of the client, which copied every chunk read
+ *    into a parse buffer and moved the bytes left to its front after every
+ *    status=, file= and len= token and every piece of file content. It is
+ *    modelled here consuming everything it can before reading on, which is
+ *    a lower bound of its copying.
+ *  - cursor: struct response_parser, which advances a cursor instead.
+ *
+ * For each shape the bytes copied in user space per response byte and the
+ * time per response byte are printed. The copies by read() itself are the
+ * same for both and not counted. Then the time of the cursor parser is
+ * printed for each implementation of scan_newlines() the CPU supports.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include "simple_message_client_response.h"
+#include "simple_message_client_scan.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* decimal format base for strtol */
+#define INPUT_NUM_BASE 10
+
+/* the former read size of the client */
+#define DEFAULT_READ_SIZE PATH_MAX
+#define DEFAULT_ROUNDS 20
+#define MAX_ROUNDS 100000
+
+#define GET_STATUS "status="
+#define GET_FILE "file="
+#define GET_LEN "len="
+#define FIELD_TERMINATOR '\n'
+
+#define NS_PER_SECOND 1000000000.0
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/** Shape of a generated response. */
+struct shape
+{
+    /** printed name */
+    const char* name;
+    /** number of files */
+    long files;
+    /** size of the first file, the html page */
+    long page_size;
+    /** size of the other files */
+    long file_size;
+};
+
+/** Result of one parser on one shape. */
+struct result
+{
+    /** bytes copied in user space */
+    uint64_t copied;
+    /** content bytes passed to the sink */
+    uint64_t content;
+    /** seconds spent */
+    double seconds;
+};
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+static const char* sprogram_arg0 = NULL;
+
+/** The shapes measured. */
+static const struct shape sshapes[] =
+{
+    { "page 16 KiB", 1, 16384, 0 },
+    { "page + 4 images 256 KiB", 5, 4096, 262144 },
+    { "1000 files 100 B", 1000, 100, 100 },
+    { "10000 files 10 B", 10000, 10, 10 }
+};
+
+/** Content bytes passed to the sink of the cursor parser. */
+static uint64_t scontent = 0;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static void print_error(const char* message, ...);
+static void print_usage(FILE* stream, int exit_code);
+static long convert_number(const char* text, long lower, long upper,
+    const char* what);
+static char* build_response(const struct shape* shape, size_t* length);
+static int run_legacy(const char* response, size_t length, size_t read_size,
+    struct result* result);
+static size_t legacy_line(const char* buf, size_t amount);
+static int run_cursor(const char* response, size_t length, size_t read_size,
+    struct result* result);
+static int run_scans(size_t read_size, long rounds);
+static int count_begin(void* context, const char* name, long length);
+static int count_content(void* context, const char* data, size_t length);
+static int count_end(void* context);
+static double now(void);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief the main method for the benchmark
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * \return success or failure.
+ * \retval EXIT_SUCCESS if both parsers accepted every response.
+ * \retval EXIT_FAILURE on failure.
+ */
+int main(int argc, char* argv[])
+{
+    struct result legacy;
+    struct result cursor;
+    size_t read_size = DEFAULT_READ_SIZE;
+    long rounds = DEFAULT_ROUNDS;
+    size_t length;
+    char* response;
+    size_t i;
+    long round;
+    int c;
+
+    sprogram_arg0 = argv[0];
+    while ((c = getopt(argc, argv, "b:n:h")) != EOF)
+    {
+        switch (c)
+        {
+        case 'b':
+            read_size = (size_t) convert_number(optarg, 1, INT_MAX,
+                "read size");
+            break;
+        case 'n':
+            rounds = convert_number(optarg, 1, MAX_ROUNDS, "rounds");
+            break;
+        case 'h':
+            print_usage(stdout, EXIT_SUCCESS);
+            break;
+        default:
+            print_usage(stderr, EXIT_FAILURE);
+            break;
+        }
+    }
+    if (optind != argc)
+    {
+        print_usage(stderr, EXIT_FAILURE);
+    }
+
+    (void) printf("read size %zu bytes, %ld rounds\n", read_size, rounds);
+    (void) printf("%-26s %10s %14s %14s %10s %10s\n", "response", "bytes",
+        "legacy copy/B", "cursor copy/B", "legacy ns/B", "cursor ns/B");
+    for (i = 0; i < sizeof(sshapes) / sizeof(sshapes[0]); ++i)
+    {
+        response = build_response(&sshapes[i], &length);
+        if (response == NULL)
+        {
+            print_error("Can not allocate response: %s.", strerror(ENOMEM));
+            return EXIT_FAILURE;
+        }
+        memset(&legacy, 0, sizeof(legacy));
+        memset(&cursor, 0, sizeof(cursor));
+        for (round = 0; round < rounds; ++round)
+        {
+            if ((run_legacy(response, length, read_size, &legacy) < 0) ||
+                (run_cursor(response, length, read_size, &cursor) < 0))
+            {
+                print_error("Response %s not accepted.", sshapes[i].name);
+                free(response);
+                return EXIT_FAILURE;
+            }
+        }
+        if (legacy.content != cursor.content)
+        {
+            print_error("Parsers disagree on the content of %s.",
+                sshapes[i].name);
+            free(response);
+            return EXIT_FAILURE;
+        }
+        (void) printf("%-26s %10zu %14.3f %14.3f %10.3f %10.3f\n",
+            sshapes[i].name, length,
+            (double) legacy.copied / (double) (length * rounds),
+            (double) cursor.copied / (double) (length * rounds),
+            legacy.seconds * NS_PER_SECOND / (double) (length * rounds),
+            cursor.seconds * NS_PER_SECOND / (double) (length * rounds));
+        free(response);
+    }
+    return run_scans(read_size, rounds) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Prints error message to stderr.
+ *
+ * A new line is printed after the message text automatically.
+ * Printout can be formatted like printf.
+ *
+ * \param message output on stderr.
+ *
+ * \return void
+ */
+static void print_error(const char* message, ...)
+{
+    va_list args;
+
+    /* do not handle return value of fprintf, because it makes no sense here */
+    (void) fprintf(stderr, "%s: ", sprogram_arg0);
+    va_start(args, message);
+    (void) vfprintf(stderr, message, args);
+    va_end(args);
+    (void) fprintf(stderr, "\n");
+}
+
+/**
+ * \brief Prints the usage and exits.
+ *
+ * \param stream where to put the usage output.
+ * \param exit_code to be set on exit.
+ */
+static void print_usage(FILE* stream, int exit_code)
+{
+    (void) fprintf(stream,
+        "usage: %s [-b read size] [-n rounds]\n"
+        "  -b <read size>  bytes per read() [%d]\n"
+        "  -n <rounds>     parses per response and parser [%d]\n"
+        "  -h              this help\n", sprogram_arg0, DEFAULT_READ_SIZE,
+        DEFAULT_ROUNDS);
+    exit(exit_code);
+}
+
+/**
+ * \brief Converts a numeric command line argument.
+ *
+ * This functions exits when the argument is invalid.
+ *
+ * \param text the argument to be converted.
+ * \param lower smallest allowed value.
+ * \param upper greatest allowed value.
+ * \param what describes the argument in error messages.
+ * \return the converted number.
+ */
+static long convert_number(const char* text, long lower, long upper,
+    const char* what)
+{
+    char* end_ptr;
+    long number;
+
+    errno = 0;
+    number = strtol(text, &end_ptr, INPUT_NUM_BASE);
+    if ((errno != 0) || (end_ptr == text) || (*end_ptr != '\0') ||
+        (number < lower) || (number > upper))
+    {
+        print_error("Invalid %s %s.", what, text);
+        print_usage(stderr, EXIT_FAILURE);
+    }
+    return number;
+}
+
+/**
+ * \brief Generates a response.
+ *
+ * \param shape of the response.
+ * \param length where to put the length of the response.
+ * \return the response, NULL if out of memory.
+ */
+static char* build_response(const struct shape* shape, size_t* length)
+{
+    char* response;
+    size_t capacity;
+    size_t used;
+    long size;
+    long i;
+
+    capacity = (size_t) (shape->page_size + shape->file_size *
+        (shape->files - 1)) + (size_t) shape->files * 64 + 64;
+    response = malloc(capacity);
+    if (response == NULL)
+    {
+        return NULL;
+    }
+    used = (size_t) sprintf(response, GET_STATUS "0\n");
+    for (i = 0; i < shape->files; ++i)
+    {
+        size = i == 0 ? shape->page_size : shape->file_size;
+        used += (size_t) sprintf(response + used, i == 0 ?
+            GET_FILE "response.html\n" GET_LEN "%ld\n" :
+            GET_FILE "file_%ld.bin\n" GET_LEN "%ld\n", i == 0 ? size : i,
+            size);
+        memset(response + used, 'a' + (int) (i % 26), (size_t) size);
+        used += (size_t) size;
+    }
+    *length = used;
+    return response;
+}
+
+/**
+ * \brief Parses a response the way the former parser of the client did.
+ *
+ * \param response to be parsed.
+ * \param length of response.
+ * \param read_size bytes per read.
+ * \param result updated by the copies, content and time.
+ * \return 0 on success, -1 if the response is not accepted.
+ */
+static int run_legacy(const char* response, size_t length, size_t read_size,
+    struct result* result)
+{
+    enum response_state state = RESPONSE_STATUS;
+    char name[PATH_MAX];
+    char* parse_buf;
+    size_t amount = 0;
+    size_t offset = 0;
+    size_t chunk;
+    size_t move;
+    long remaining = 0;
+    double start = now();
+
+    /* a chunk and a line cut off before it */
+    parse_buf = malloc(2 * read_size + PATH_MAX);
+    if (parse_buf == NULL)
+    {
+        return -1;
+    }
+    while (1)
+    {
+        move = 0;
+        switch (state)
+        {
+        case RESPONSE_STATUS:
+            move = legacy_line(parse_buf, amount);
+            state = move > 0 ? RESPONSE_FILE : state;
+            break;
+        case RESPONSE_FILE:
+            /* the file= token and the name are consumed one after another */
+            if ((amount > strlen(GET_FILE)) &&
+                (move = legacy_line(parse_buf, amount)) > 0)
+            {
+                memmove(parse_buf, parse_buf + strlen(GET_FILE),
+                    amount - strlen(GET_FILE));
+                result->copied += amount - strlen(GET_FILE);
+                amount -= strlen(GET_FILE);
+                move -= strlen(GET_FILE);
+                memcpy(name, parse_buf, move - 1);
+                result->copied += move;
+                state = RESPONSE_LEN;
+            }
+            break;
+        case RESPONSE_LEN:
+            if ((amount > strlen(GET_LEN)) &&
+                (move = legacy_line(parse_buf, amount)) > 0)
+            {
+                memmove(parse_buf, parse_buf + strlen(GET_LEN),
+                    amount - strlen(GET_LEN));
+                result->copied += amount - strlen(GET_LEN);
+                amount -= strlen(GET_LEN);
+                move -= strlen(GET_LEN);
+                remaining = strtol(parse_buf, NULL, INPUT_NUM_BASE);
+                state = remaining > 0 ? RESPONSE_CONTENT : RESPONSE_FILE;
+            }
+            break;
+        case RESPONSE_CONTENT:
+        default:
+            move = amount < (size_t) remaining ? amount : (size_t) remaining;
+            (void) count_content(&result->content, parse_buf, move);
+            remaining -= (long) move;
+            state = remaining > 0 ? RESPONSE_CONTENT : RESPONSE_FILE;
+            break;
+        }
+        if (move > 0)
+        {
+            /* the bytes left are moved to the front */
+            memmove(parse_buf, parse_buf + move, amount - move);
+            result->copied += amount - move;
+            amount -= move;
+            continue;
+        }
+        if (offset == length)
+        {
+            break;
+        }
+        chunk = length - offset < read_size ? length - offset : read_size;
+        memcpy(parse_buf + amount, response + offset, chunk);
+        result->copied += chunk;
+        amount += chunk;
+        offset += chunk;
+    }
+    free(parse_buf);
+    result->seconds += now() - start;
+    return (state == RESPONSE_FILE) && (amount == 0) ? 0 : -1;
+}
+
+/**
+ * \brief Returns the length of the line at the front of the parse buffer.
+ *
+ * \param buf the parse buffer.
+ * \param amount bytes in buf.
+ * \return length including the terminator, 0 if the line is incomplete.
+ */
+static size_t legacy_line(const char* buf, size_t amount)
+{
+    const char* terminator = memchr(buf, FIELD_TERMINATOR, amount);
+
+    return terminator == NULL ? 0 : (size_t) (terminator - buf) + 1;
+}
+
+/**
+ * \brief Parses a response by struct response_parser.
+ *
+ * \param response to be parsed.
+ * \param length of response.
+ * \param read_size bytes per read.
+ * \param result updated by the copies, content and time.
+ * \return 0 on success, -1 if the response is not accepted.
+ */
+static int run_cursor(const char* response, size_t length, size_t read_size,
+    struct result* result)
+{
+    static const struct response_sink sink =
+    {
+        count_begin, count_content, count_end, &scontent, NULL
+    };
+    struct response_parser parser;
+    size_t offset = 0;
+    size_t room;
+    char* space;
+    int status;
+    double start = now();
+
+    /* sized like the client sizes it */
+    if (response_init(&parser, 2 * read_size, PATH_MAX) < 0)
+    {
+        return -1;
+    }
+    scontent = 0;
+    while (offset < length)
+    {
+        space = response_space(&parser, &room);
+        if (room > read_size)
+        {
+            room = read_size;
+        }
+        if (room > length - offset)
+        {
+            room = length - offset;
+        }
+        /* stands for read(), not counted */
+        memcpy(space, response + offset, room);
+        offset += room;
+        response_filled(&parser, room);
+        if (response_parse(&parser, &sink) < 0)
+        {
+            response_free(&parser);
+            return -1;
+        }
+    }
+    status = response_finish(&parser);
+    result->copied += parser.copied;
+    result->content += scontent;
+    response_free(&parser);
+    result->seconds += now() - start;
+    return status;
+}
+
+/**
+ * \brief Times the cursor parser with each implementation of the scan.
+ *
+ * \param read_size bytes per read.
+ * \param rounds parses per response and implementation.
+ * \return 0 on success, -1 on error.
+ */
+static int run_scans(size_t read_size, long rounds)
+{
+    enum scan_kind selected = scan_selected();
+    enum scan_kind kind;
+    struct result cursor;
+    size_t length;
+    char* response;
+    size_t i;
+    long round;
+
+    (void) printf("\nnewline scan, cursor ns/B, %s selected\n",
+        scan_name(selected));
+    (void) printf("%-26s", "response");
+    for (kind = SCAN_SCALAR; kind <= SCAN_AVX2; ++kind)
+    {
+        (void) printf(" %10s", scan_name(kind));
+    }
+    (void) printf("\n");
+    for (i = 0; i < sizeof(sshapes) / sizeof(sshapes[0]); ++i)
+    {
+        response = build_response(&sshapes[i], &length);
+        if (response == NULL)
+        {
+            print_error("Can not allocate response: %s.", strerror(ENOMEM));
+            return -1;
+        }
+        (void) printf("%-26s", sshapes[i].name);
+        for (kind = SCAN_SCALAR; kind <= SCAN_AVX2; ++kind)
+        {
+            if (scan_select(kind) < 0)
+            {
+                (void) printf(" %10s", "-");
+                continue;
+            }
+            memset(&cursor, 0, sizeof(cursor));
+            for (round = 0; round < rounds; ++round)
+            {
+                if (run_cursor(response, length, read_size, &cursor) < 0)
+                {
+                    print_error("Response %s not accepted.", sshapes[i].name);
+                    free(response);
+                    return -1;
+                }
+            }
+            (void) printf(" %10.3f", cursor.seconds * NS_PER_SECOND /
+                (double) (length * rounds));
+        }
+        (void) printf("\n");
+        free(response);
+    }
+    (void) scan_select(selected);
+    return 0;
+}
+
+/**
+ * \brief Starts a file, which is dropped.
+ *
+ * \param context will be ignored.
+ * \param name will be ignored.
+ * \param length will be ignored.
+ * \return 0.
+ */
+static int count_begin(void* context, const char* name, long length)
+{
+    (void) context; /* pedantic */
+    (void) name;
+    (void) length;
+    return 0;
+}
+
+/**
+ * \brief Counts the content of a file and drops it.
+ *
+ * \param context the uint64_t counting the content bytes.
+ * \param data will be ignored.
+ * \param length of data.
+ * \return 0.
+ */
+static int count_content(void* context, const char* data, size_t length)
+{
+    (void) data; /* pedantic */
+    *(uint64_t*) context += length;
+    return 0;
+}
+
+/**
+ * \brief Completes a file.
+ *
+ * \param context will be ignored.
+ * \return 0.
+ */
+static int count_end(void* context)
+{
+    (void) context; /* pedantic */
+    return 0;
+}
+
+/**
+ * \brief Returns the monotonic time.
+ *
+ * \return seconds since some unspecified start.
+ */
+static double now(void)
+{
+    struct timespec now;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) now.tv_sec + (double) now.tv_nsec / NS_PER_SECOND;
+}
+
+/* === EOF ================================================================== */
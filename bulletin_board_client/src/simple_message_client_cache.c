@@ -0,0 +1,357 @@
+/**
+ * @file simple_message_client_cache.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, index of the files stored before.
+ *
+ * The index has a line per file: its CRC-32C in hex, its length, the seconds
+ * and nanoseconds of its modification time and, after a single blank, its
+ * name. A file with a line terminator in its name is not indexed, it is
+ * written every time. A file on disk counts as the one in the index only if
+ * its length and modification time are still those in the index, so a file
+ * changed or removed by someone else is written again. The index is replaced
+ * by rename(), a reader sees the old or the new one.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+/* getline() */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include "simple_message_client_cache.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* entries allocated at first */
+#define INITIAL_ENTRIES 16
+
+/* permissions of the index, reduced by the umask */
+#define INDEX_MODE 0666
+
+/* room for ".<pid>.tmp" after the path of the temporary index */
+#define TEMP_SUFFIX_SIZE 32
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static struct cache_entry* find(const struct cache* cache, const char* name);
+static void parse_line(struct cache* cache, char* line);
+static int write_index(const struct cache* cache, int fd);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Reads the index of a directory.
+ *
+ * A missing index is an empty one, malformed lines are skipped.
+ *
+ * \param cache to be set up, freed by cache_free() even on error.
+ * \param dir_fd directory of the index and the files, AT_FDCWD for the
+ *  current one; stays owned by the caller.
+ * \param path of the index relative to dir_fd, must outlive the cache.
+ * \return 0 on success, -1 on error (see errno).
+ */
+int cache_load(struct cache* cache, int dir_fd, const char* path)
+{
+    FILE* index;
+    char* line = NULL;
+    size_t line_size = 0;
+    int fd;
+    int error;
+
+    memset(cache, 0, sizeof(*cache));
+    cache->dir_fd = dir_fd;
+    cache->path = path;
+    fd = openat(dir_fd, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return errno == ENOENT ? 0 : -1;
+    }
+    index = fdopen(fd, "r");
+    if (index == NULL)
+    {
+        error = errno;
+        (void) close(fd);
+        errno = error;
+        return -1;
+    }
+    for (;;)
+    {
+        errno = 0;
+        if (getline(&line, &line_size, index) < 0)
+        {
+            break;
+        }
+        parse_line(cache, line);
+    }
+    error = errno;
+    free(line);
+    (void) fclose(index);
+    cache->changed = false;
+    errno = error;
+    return error != 0 ? -1 : 0;
+}
+
+/**
+ * \brief Frees the entries of an index.
+ *
+ * \param cache loaded.
+ */
+void cache_free(struct cache* cache)
+{
+    size_t entry;
+
+    for (entry = 0; entry < cache->count; ++entry)
+    {
+        free(cache->entries[entry].name);
+    }
+    free(cache->entries);
+    cache->entries = NULL;
+    cache->count = 0;
+    cache->capacity = 0;
+}
+
+/**
+ * \brief Tells whether a file received is the same as the one on disk.
+ *
+ * \param cache loaded.
+ * \param name of the file.
+ * \param size of the content received.
+ * \param crc CRC-32C of the content received.
+ * \return true if the file on disk is as indexed and has that content.
+ */
+bool cache_unchanged(const struct cache* cache, const char* name,
+    uint64_t size, uint32_t crc)
+{
+    const struct cache_entry* entry = find(cache, name);
+    struct stat info;
+
+    if ((entry == NULL) || (entry->size != size) || (entry->crc != crc))
+    {
+        return false;
+    }
+    if ((fstatat(cache->dir_fd, name, &info, 0) < 0) ||
+        !S_ISREG(info.st_mode) || ((uint64_t) info.st_size != size))
+    {
+        return false;
+    }
+    return (info.st_mtim.tv_sec == entry->mtime.tv_sec) &&
+        (info.st_mtim.tv_nsec == entry->mtime.tv_nsec);
+}
+
+/**
+ * \brief Takes note of a file written.
+ *
+ * A name holding a line terminator can not be indexed and is left out.
+ *
+ * \param cache loaded.
+ * \param name of the file.
+ * \param size of its content.
+ * \param crc CRC-32C of its content.
+ * \param info of the file as written.
+ * \return 0 on success, -1 on error (see errno).
+ */
+int cache_put(struct cache* cache, const char* name, uint64_t size,
+    uint32_t crc, const struct stat* info)
+{
+    struct cache_entry* entry = find(cache, name);
+    struct cache_entry* entries;
+    size_t capacity;
+
+    if (strchr(name, '\n') != NULL)
+    {
+        return 0;
+    }
+    if (entry == NULL)
+    {
+        if (cache->count == cache->capacity)
+        {
+            capacity = cache->capacity == 0 ? INITIAL_ENTRIES :
+                2 * cache->capacity;
+            entries = realloc(cache->entries, capacity * sizeof(*entries));
+            if (entries == NULL)
+            {
+                return -1;
+            }
+            cache->entries = entries;
+            cache->capacity = capacity;
+        }
+        entry = &cache->entries[cache->count];
+        entry->name = strdup(name);
+        if (entry->name == NULL)
+        {
+            return -1;
+        }
+        ++cache->count;
+    }
+    entry->size = size;
+    entry->crc = crc;
+    entry->mtime = info->st_mtim;
+    cache->changed = true;
+    return 0;
+}
+
+/**
+ * \brief Writes the index if it changed.
+ *
+ * \param cache loaded.
+ * \return 0 on success, -1 on error (see errno).
+ */
+int cache_save(struct cache* cache)
+{
+    size_t temp_size = strlen(cache->path) + TEMP_SUFFIX_SIZE;
+    char* temp;
+    int fd;
+    int error;
+
+    if (!cache->changed)
+    {
+        return 0;
+    }
+    temp = malloc(temp_size);
+    if (temp == NULL)
+    {
+        return -1;
+    }
+    (void) snprintf(temp, temp_size, "%s.%ld.tmp", cache->path,
+        (long) getpid());
+    fd = openat(cache->dir_fd, temp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+        INDEX_MODE);
+    if (fd < 0)
+    {
+        error = errno;
+        free(temp);
+        errno = error;
+        return -1;
+    }
+    if ((write_index(cache, fd) < 0) ||
+        (renameat(cache->dir_fd, temp, cache->dir_fd, cache->path) < 0))
+    {
+        error = errno;
+        (void) unlinkat(cache->dir_fd, temp, 0);
+        free(temp);
+        errno = error;
+        return -1;
+    }
+    free(temp);
+    cache->changed = false;
+    return 0;
+}
+
+/**
+ * \brief Looks a file up.
+ *
+ * \param cache loaded.
+ * \param name of the file.
+ * \return its entry, NULL if none.
+ */
+static struct cache_entry* find(const struct cache* cache, const char* name)
+{
+    size_t entry;
+
+    for (entry = 0; entry < cache->count; ++entry)
+    {
+        if (strcmp(cache->entries[entry].name, name) == 0)
+        {
+            return &cache->entries[entry];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief Adds the entry of a line of the index.
+ *
+ * \param cache being loaded.
+ * \param line read, with or without its terminator.
+ */
+static void parse_line(struct cache* cache, char* line)
+{
+    struct stat info;
+    uint32_t crc;
+    uint64_t size;
+    long long seconds;
+    long nanoseconds;
+    int name_offset = -1;
+    size_t length;
+
+    /* a name may begin with blanks, only the separator is skipped */
+    if ((sscanf(line, "%" SCNx32 " %" SCNu64 " %lld %ld%n", &crc, &size,
+        &seconds, &nanoseconds, &name_offset) < 4) || (name_offset < 0) ||
+        (line[name_offset] != ' '))
+    {
+        return;
+    }
+    line += name_offset + 1;
+    length = strlen(line);
+    if ((length > 0) && (line[length - 1] == '\n'))
+    {
+        line[--length] = '\0';
+    }
+    if (length == 0)
+    {
+        return;
+    }
+    memset(&info, 0, sizeof(info));
+    info.st_mtim.tv_sec = (time_t) seconds;
+    info.st_mtim.tv_nsec = nanoseconds;
+    (void) cache_put(cache, line, size, crc, &info);
+}
+
+/**
+ * \brief Writes the entries into a new index and closes it.
+ *
+ * \param cache loaded.
+ * \param fd the new index, closed in any case.
+ * \return 0 on success, -1 on error (see errno).
+ */
+static int write_index(const struct cache* cache, int fd)
+{
+    const struct cache_entry* entry;
+    FILE* index;
+    int error;
+
+    index = fdopen(fd, "w");
+    if (index == NULL)
+    {
+        error = errno;
+        (void) close(fd);
+        errno = error;
+        return -1;
+    }
+    for (entry = cache->entries; entry < cache->entries + cache->count;
+        ++entry)
+    {
+        if (fprintf(index, "%08" PRIx32 " %" PRIu64 " %lld %ld %s\n",
+            entry->crc, entry->size, (long long) entry->mtime.tv_sec,
+            (long) entry->mtime.tv_nsec, entry->name) < 0)
+        {
+            error = errno;
+            (void) fclose(index);
+            errno = error;
+            return -1;
+        }
+    }
+    return fclose(index) == EOF ? -1 : 0;
+}
+
+/* === EOF ================================================================== */
@@ -0,0 +1,78 @@
+/**
+ * @file simple_message_client_cache.h
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, index of the files stored before.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_CACHE_H
+#define SIMPLE_MESSAGE_CLIENT_CACHE_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/** A file as it was stored. */
+struct cache_entry
+{
+    /** name of the file */
+    char* name;
+    /** its length */
+    uint64_t size;
+    /** CRC-32C of its content */
+    uint32_t crc;
+    /** its modification time, telling whether it was changed since */
+    struct timespec mtime;
+};
+
+/**
+ * Index of the files a store has written into a directory, kept in a text
+ * file there. It tells whether a file received is the same as the one on
+ * disk, which is then left alone.
+ */
+struct cache
+{
+    /** directory of the index and the files */
+    int dir_fd;
+    /** path of the index relative to dir_fd */
+    const char* path;
+    /** the files */
+    struct cache_entry* entries;
+    /** number of entries */
+    size_t count;
+    /** room for entries */
+    size_t capacity;
+    /** entries changed since the index was loaded */
+    bool changed;
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int cache_load(struct cache* cache, int dir_fd, const char* path);
+void cache_free(struct cache* cache);
+bool cache_unchanged(const struct cache* cache, const char* name,
+    uint64_t size, uint32_t crc);
+int cache_put(struct cache* cache, const char* name, uint64_t size,
+    uint32_t crc, const struct stat* info);
+int cache_save(struct cache* cache);
+
+#endif /* SIMPLE_MESSAGE_CLIENT_CACHE_H */
+
+/* === EOF ================================================================== */
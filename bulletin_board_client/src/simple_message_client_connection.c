@@ -0,0 +1,278 @@
+/**
+ * @file simple_message_client_connection.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, a post on its own connection driven by an epoll loop.
+ *
+ * The connection is raced to all addresses of the server: every attempt of
+ * the struct race is registered with epoll, so an address which does not
+ * answer is passed over after the attempt delay instead of holding the post
+ * until it times out. The socket of the attempt winning is kept registered
+ * and handed to the post.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include "simple_message_client_connection.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* Timeout for connecting or a post making no progress in seconds */
+#define SOCKET_TIMEOUT 30
+
+#define MS_PER_SECOND 1000
+#define NS_PER_MS 1000000
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static int fail(struct connection* connection, const char* message, ...);
+static int watch_attempts(struct connection* connection);
+static int watch(struct connection* connection);
+static long now_ms(void);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Sets up a connection.
+ *
+ * \param connection to be set up.
+ * \param name_size longest file name accepted, including the terminating '\0'.
+ * \param epoll_fd epoll instance the sockets are registered with.
+ * \param data epoll data of the sockets.
+ * \return 0 on success, -1 if out of memory.
+ */
+int connection_init(struct connection* connection, size_t name_size,
+        int epoll_fd, void* data)
+{
+    memset(connection, 0, sizeof(*connection));
+    connection->epoll_fd = epoll_fd;
+    connection->data = data;
+    return post_init(&connection->post, name_size);
+}
+
+/**
+ * \brief Closes a connection and releases it.
+ *
+ * \param connection set up.
+ */
+void connection_free(struct connection* connection)
+{
+    connection_close(connection);
+    post_free(&connection->post);
+}
+
+/**
+ * \brief Starts posting a request on a new connection.
+ *
+ * \param connection closed.
+ * \param request to be posted.
+ * \param sink receiving the files of the response.
+ * \param addresses of the server, must stay valid while connecting.
+ * \return 0 on success, -1 on error (see post.error).
+ */
+int connection_start(struct connection* connection,
+        const struct post_request* request, const struct response_sink* sink,
+        const struct addrinfo* addresses)
+{
+    connection->connected = false;
+    connection->watched = 0;
+    connection->events = 0;
+    connection->deadline_ms = now_ms() + SOCKET_TIMEOUT * MS_PER_SECOND;
+    if (post_start(&connection->post, request, sink) < 0)
+    {
+        return -1;
+    }
+    if (race_init(&connection->race, addresses,
+        SOCKET_TIMEOUT * MS_PER_SECOND) < 0)
+    {
+        return fail(connection, "Can not allocate connection attempts: %s",
+            strerror(ENOMEM));
+    }
+    connection->racing = true;
+    return connection_advance(connection) == POST_FAILED ? -1 : 0;
+}
+
+/**
+ * \brief Advances a connection whose socket is ready or whose timeout has
+ * passed.
+ *
+ * \param connection started.
+ * \return where the post is, see post.error if it failed.
+ */
+enum post_state connection_advance(struct connection* connection)
+{
+    int fd = -1;
+    int result;
+
+    if (connection->racing)
+    {
+        result = race_advance(&connection->race, &fd);
+        if (result == 0)
+        {
+            (void) watch_attempts(connection);
+            return connection->post.state;
+        }
+        connection->racing = false;
+        if (result < 0)
+        {
+            race_free(&connection->race);
+            (void) fail(connection, "Could not connect: %s",
+                strerror(connection->race.error));
+            return connection->post.state;
+        }
+        /* registered as an attempt already */
+        connection->connected = true;
+        connection->events = EPOLLOUT;
+        if (post_attach(&connection->post, fd) < 0)
+        {
+            return connection->post.state;
+        }
+    }
+    else if (post_advance(&connection->post) >= POST_DONE)
+    {
+        return connection->post.state;
+    }
+    connection->deadline_ms = now_ms() + SOCKET_TIMEOUT * MS_PER_SECOND;
+    (void) watch(connection);
+    return connection->post.state;
+}
+
+/**
+ * \brief Returns when a connection has to be advanced without an event.
+ *
+ * \param connection started.
+ * \return ms until the next connection attempt is due, -1 if none.
+ */
+int connection_timeout(const struct connection* connection)
+{
+    return connection->racing ? race_timeout(&connection->race) : -1;
+}
+
+/**
+ * \brief Closes the sockets of a connection, which removes them from epoll.
+ *
+ * \param connection with or without sockets.
+ */
+void connection_close(struct connection* connection)
+{
+    if (connection->racing)
+    {
+        race_free(&connection->race);
+        connection->racing = false;
+    }
+    post_close(&connection->post);
+    connection->events = 0;
+}
+
+/**
+ * \brief Lets the post of a connection fail.
+ *
+ * Printout can be formatted like printf.
+ *
+ * \param connection failing.
+ * \param message describing the failure.
+ * \return -1.
+ */
+static int fail(struct connection* connection, const char* message, ...)
+{
+    va_list args;
+
+    va_start(args, message);
+    (void) vsnprintf(connection->post.error, sizeof(connection->post.error),
+        message, args);
+    va_end(args);
+    connection->post.state = POST_FAILED;
+    return -1;
+}
+
+/**
+ * \brief Registers the connection attempts started since the last call.
+ *
+ * Attempts given up are closed by the race, which removes them from epoll.
+ *
+ * \param connection racing.
+ * \return 0 on success, -1 on error (see post.error).
+ */
+static int watch_attempts(struct connection* connection)
+{
+    struct epoll_event event;
+    int fd;
+
+    for (; connection->watched < connection->race.next; ++connection->watched)
+    {
+        fd = connection->race.attempts[connection->watched].fd;
+        if (fd < 0)
+        {
+            continue;
+        }
+        event.events = EPOLLOUT;
+        event.data.ptr = connection->data;
+        if (epoll_ctl(connection->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+        {
+            return fail(connection, "epoll_ctl failed: %s", strerror(errno));
+        }
+    }
+    return 0;
+}
+
+/**
+ * \brief Registers the socket of a post for the events it waits for.
+ *
+ * \param connection posting.
+ * \return 0 on success, -1 on error (see post.error).
+ */
+static int watch(struct connection* connection)
+{
+    struct epoll_event event;
+    short events = post_events(&connection->post);
+    int op = connection->events == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+
+    event.events = ((events & POLLIN) != 0 ? EPOLLIN : 0) |
+        ((events & POLLOUT) != 0 ? EPOLLOUT : 0);
+    event.data.ptr = connection->data;
+    if (event.events == connection->events)
+    {
+        return 0;
+    }
+    if (epoll_ctl(connection->epoll_fd, op, connection->post.fd, &event) < 0)
+    {
+        return fail(connection, "epoll_ctl failed: %s", strerror(errno));
+    }
+    connection->events = event.events;
+    return 0;
+}
+
+/**
+ * \brief Returns the monotonic time.
+ *
+ * \return milliseconds since some unspecified start.
+ */
+static long now_ms(void)
+{
+    struct timespec now;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long) now.tv_sec * MS_PER_SECOND + now.tv_nsec / NS_PER_MS;
+}
+
+/* === EOF ================================================================== */
@@ -0,0 +1,77 @@
+/**
+ * @file simple_message_client_connection.h
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, a post on its own connection driven by an epoll loop.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_CONNECTION_H
+#define SIMPLE_MESSAGE_CLIENT_CONNECTION_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <netdb.h>
+#include "simple_message_client_post.h"
+#include "simple_message_client_race.h"
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/**
+ * A post whose connection is raced to the addresses of the server, as
+ * simple_message_client does, with every socket registered with an epoll
+ * instance. The caller calls connection_advance() whenever one of them is
+ * ready, or connection_timeout() has passed, and gives the post up once
+ * deadline_ms has passed.
+ */
+struct connection
+{
+    /** the post */
+    struct post post;
+    /** the connection attempts, while connecting */
+    struct race race;
+    /** the race is in progress */
+    bool racing;
+    /** a connection was established */
+    bool connected;
+    /** attempts of the race registered with epoll */
+    size_t watched;
+    /** epoll instance of the sockets */
+    int epoll_fd;
+    /** epoll data of the sockets */
+    void* data;
+    /** epoll events registered for post.fd, 0 if it is not registered */
+    uint32_t events;
+    /** when the post times out without progress, in ms */
+    long deadline_ms;
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int connection_init(struct connection* connection, size_t name_size,
+    int epoll_fd, void* data);
+void connection_free(struct connection* connection);
+int connection_start(struct connection* connection,
+    const struct post_request* request, const struct response_sink* sink,
+    const struct addrinfo* addresses);
+enum post_state connection_advance(struct connection* connection);
+int connection_timeout(const struct connection* connection);
+void connection_close(struct connection* connection);
+
+#endif /* SIMPLE_MESSAGE_CLIENT_CONNECTION_H */
+
+/* === EOF ================================================================== */
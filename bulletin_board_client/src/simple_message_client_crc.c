@@ -0,0 +1,158 @@
+/**
+ * @file simple_message_client_crc.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, CRC-32C checksums of received files.
+ *
+ * CRC-32C (Castagnoli) is computed by the crc32 instruction of SSE4.2, eight
+ * bytes at a time, where the CPU has it, else a byte at a time from a table.
+ * Both give the same checksum, so an index written on one machine is valid
+ * on another. The implementation is chosen once when the program starts.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <string.h>
+#include "simple_message_client_crc.h"
+
+#if defined(__x86_64__)
+#define CRC_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* the Castagnoli polynomial, bit reversed */
+#define CRC_POLYNOMIAL 0x82F63B78U
+
+/* entries of the table, one per byte value */
+#define CRC_TABLE_SIZE 256
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static uint32_t crc_table(uint32_t crc, const char* data, size_t length);
+#ifdef CRC_X86
+static uint32_t crc_sse42(uint32_t crc, const char* data, size_t length);
+#endif
+static void select_at_start(void) __attribute__((constructor));
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+
+/** The remainder of each byte value, filled before main(). */
+static uint32_t stable[CRC_TABLE_SIZE];
+
+/** The implementation in use, set before main(). */
+static uint32_t (*scrc)(uint32_t crc, const char* data, size_t length) =
+    crc_table;
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Continues a checksum over more bytes.
+ *
+ * \param crc of the bytes before, 0 to start.
+ * \param data bytes to be added.
+ * \param length of data.
+ * \return the checksum of all bytes so far.
+ */
+uint32_t crc_update(uint32_t crc, const char* data, size_t length)
+{
+    return ~scrc(~crc, data, length);
+}
+
+/**
+ * \brief Adds bytes to a checksum a byte at a time.
+ *
+ * \param crc inverted checksum so far.
+ * \param data bytes to be added.
+ * \param length of data.
+ * \return the inverted checksum.
+ */
+static uint32_t crc_table(uint32_t crc, const char* data, size_t length)
+{
+    const unsigned char* byte = (const unsigned char*) data;
+
+    while (length-- > 0)
+    {
+        crc = stable[(crc ^ *byte++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef CRC_X86
+
+/**
+ * \brief Adds bytes to a checksum by the crc32 instruction.
+ *
+ * \param crc inverted checksum so far.
+ * \param data bytes to be added.
+ * \param length of data.
+ * \return the inverted checksum.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc_sse42(uint32_t crc, const char* data, size_t length)
+{
+    uint64_t wide = crc;
+    uint64_t word;
+
+    for (; length >= sizeof(word); length -= sizeof(word))
+    {
+        /* unaligned and without breaking strict aliasing */
+        memcpy(&word, data, sizeof(word));
+        wide = _mm_crc32_u64(wide, word);
+        data += sizeof(word);
+    }
+    crc = (uint32_t) wide;
+    while (length-- > 0)
+    {
+        crc = _mm_crc32_u8(crc, (unsigned char) *data++);
+    }
+    return crc;
+}
+
+#endif /* CRC_X86 */
+
+/**
+ * \brief Fills the table and chooses the fastest implementation before
+ * main().
+ */
+static void select_at_start(void)
+{
+    uint32_t crc;
+    int value;
+    int bit;
+
+    for (value = 0; value < CRC_TABLE_SIZE; ++value)
+    {
+        crc = (uint32_t) value;
+        for (bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc >> 1) ^ ((crc & 1) != 0 ? CRC_POLYNOMIAL : 0);
+        }
+        stable[value] = crc;
+    }
+#ifdef CRC_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        scrc = crc_sse42;
+    }
+#endif
+}
+
+/* === EOF ================================================================== */
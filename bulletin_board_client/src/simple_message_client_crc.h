@@ -0,0 +1,32 @@
+/**
+ * @file simple_message_client_crc.h
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, CRC-32C checksums of received files.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_CRC_H
+#define SIMPLE_MESSAGE_CLIENT_CRC_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+uint32_t crc_update(uint32_t crc, const char* data, size_t length);
+
+#endif /* SIMPLE_MESSAGE_CLIENT_CRC_H */
+
+/* === EOF ================================================================== */
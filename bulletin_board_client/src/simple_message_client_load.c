@@ -0,0 +1,829 @@
+/**
+ * @file simple_message_client_load.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, load generator for the bulletin board server.
+ *
+ * Every request posts a message like simple_message_client does and reads
+ * the response to its end, checking the status=, file= and len= records.
+ * The load is either closed-loop, where -c threads post one request after
+ * another, or open-loop with -r, where requests are scheduled at a fixed
+ * rate and spread over the threads. The latency of a scheduled request is
+ * measured from its scheduled start, not from the moment a thread got to
+ * it, so a server stalling the load generator shows up in the latency
+ * (no coordinated omission). Latencies go into log-linear histograms per
+ * thread, which are merged for the report.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "simple_message_client_response.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* decimal format base for strtol */
+#define INPUT_NUM_BASE 10
+
+#define DEFAULT_REQUESTS 1000
+#define DEFAULT_CONNECTIONS 8
+#define MAX_CONNECTIONS 1024
+#define MAX_RATE 1000000
+
+/* Defines for the request string literals */
+#define SET_USER "user="
+#define SET_IMAGE "img="
+
+/* Define for the request field terminator */
+#define FIELD_TERMINATOR '\n'
+
+/* receive buffer of a connection */
+#define RECEIVE_BUFFER 65536
+
+/* a scheduled request started later than this is counted as late, in ns */
+#define LATE_NS 1000000
+
+/* buckets of a histogram: linear ones, then sub-buckets per power of 2 */
+#define SUB_BUCKET_BITS 3
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define LINEAR_BITS (SUB_BUCKET_BITS + 1)
+#define LINEAR_BUCKETS (1 << LINEAR_BITS)
+#define BUCKETS (LINEAR_BUCKETS + 60 * SUB_BUCKETS)
+
+#define NS_PER_US 1000
+#define NS_PER_SECOND 1000000000
+#define BYTES_PER_MIB (1024.0 * 1024.0)
+#define PERCENT 100.0
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/** Log-linear histogram of latencies in us. */
+struct latency_histogram
+{
+    /** values per bucket */
+    uint64_t counts[BUCKETS];
+    /** number of values */
+    uint64_t count;
+    /** sum of the values */
+    uint64_t sum;
+    /** greatest value */
+    uint64_t max;
+};
+
+/** A load thread and what it measured. */
+struct load_thread
+{
+    /** the thread */
+    pthread_t thread;
+    /** latencies of the answered requests */
+    struct latency_histogram latencies;
+    /** requests answered with status 0 */
+    long done;
+    /** requests answered with another status */
+    long rejected;
+    /** requests failed: connect, I/O or a malformed response */
+    long failed;
+    /** scheduled requests started late */
+    long late;
+    /** response bytes received */
+    uint64_t bytes;
+};
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+static const char* sprogram_arg0 = NULL;
+
+/** Address of the server. */
+static struct sockaddr_storage saddress;
+/** Length of saddress. */
+static socklen_t saddress_length = 0;
+/** Request sent by every connection. */
+static char* srequest = NULL;
+/** Length of srequest. */
+static size_t srequest_length = 0;
+
+/** Requests of the run, 0 if the run is limited by sdeadline. */
+static long srequests = 0;
+/** End of a closed-loop run limited by time, in ns. */
+static uint64_t sdeadline = 0;
+/** Requests per second with an open loop, 0 for a closed loop. */
+static long srate = 0;
+/** Start of the run, in ns. */
+static uint64_t sstart = 0;
+/** Index of the next request. */
+static atomic_long snext;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static void print_error(const char* message, ...);
+static void print_usage(FILE* stream, int exit_code);
+static long convert_number(const char* text, long lower, long upper,
+    const char* what);
+static int resolve(const char* server, const char* port);
+static int build_request(const char* user, const char* image_url,
+    const char* message);
+static void* load_thread(void* arg);
+static bool next_request(uint64_t* scheduled);
+static int post_request(struct response_parser* parser, uint64_t* bytes);
+static int read_response(int socket_fd, struct response_parser* parser,
+    uint64_t* bytes);
+static int ignore_begin(void* context, const char* name, long length);
+static int ignore_content(void* context, const char* data, size_t length);
+static int ignore_end(void* context);
+static void histogram_record(struct latency_histogram* histogram,
+    uint64_t value);
+static void histogram_merge(struct latency_histogram* target,
+    const struct latency_histogram* source);
+static uint64_t histogram_percentile(const struct latency_histogram* histogram,
+    double percentile);
+static unsigned int bucket_of(uint64_t value);
+static uint64_t bucket_upper_bound(unsigned int bucket);
+static uint64_t now_ns(void);
+static void sleep_until(uint64_t time_ns);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief the main method for the load generator
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * \return success or failure.
+ * \retval EXIT_SUCCESS if no request failed.
+ * \retval EXIT_FAILURE on failure.
+ */
+int main(int argc, char* argv[])
+{
+    struct load_thread* threads;
+    struct latency_histogram latencies;
+    const char* server = NULL;
+    const char* port = NULL;
+    const char* user = "load";
+    const char* image_url = NULL;
+    const char* message = "load test message";
+    long connections = DEFAULT_CONNECTIONS;
+    long duration = 0;
+    long started;
+    long done = 0;
+    long rejected = 0;
+    long failed = 0;
+    long late = 0;
+    uint64_t bytes = 0;
+    double seconds;
+    long i;
+    int c;
+
+    sprogram_arg0 = argv[0];
+    srequests = DEFAULT_REQUESTS;
+    while ((c = getopt(argc, argv, "s:p:u:i:m:c:n:d:r:h")) != EOF)
+    {
+        switch (c)
+        {
+        case 's':
+            server = optarg;
+            break;
+        case 'p':
+            port = optarg;
+            break;
+        case 'u':
+            user = optarg;
+            break;
+        case 'i':
+            image_url = optarg;
+            break;
+        case 'm':
+            message = optarg;
+            break;
+        case 'c':
+            connections = convert_number(optarg, 1, MAX_CONNECTIONS,
+                "number of connections");
+            break;
+        case 'n':
+            srequests = convert_number(optarg, 1, LONG_MAX,
+                "number of requests");
+            duration = 0;
+            break;
+        case 'd':
+            duration = convert_number(optarg, 1, INT_MAX, "duration");
+            break;
+        case 'r':
+            srate = convert_number(optarg, 1, MAX_RATE, "rate");
+            break;
+        case 'h':
+            print_usage(stdout, EXIT_SUCCESS);
+            break;
+        default:
+            print_usage(stderr, EXIT_FAILURE);
+            break;
+        }
+    }
+    if ((server == NULL) || (port == NULL) || (optind != argc))
+    {
+        print_usage(stderr, EXIT_FAILURE);
+    }
+    if ((resolve(server, port) < 0) ||
+        (build_request(user, image_url, message) < 0))
+    {
+        return EXIT_FAILURE;
+    }
+
+    threads = calloc((size_t) connections, sizeof(*threads));
+    if (threads == NULL)
+    {
+        print_error("Can not allocate threads: %s.", strerror(ENOMEM));
+        free(srequest);
+        return EXIT_FAILURE;
+    }
+
+    sstart = now_ns();
+    if (duration > 0)
+    {
+        /* an open loop schedules the requests of the duration up front */
+        srequests = srate > 0 ? srate * duration : 0;
+        sdeadline = sstart + (uint64_t) duration * NS_PER_SECOND;
+    }
+    atomic_store(&snext, 0);
+    for (started = 0; started < connections; ++started)
+    {
+        if (pthread_create(&threads[started].thread, NULL, load_thread,
+            &threads[started]) != 0)
+        {
+            print_error("pthread_create() failed.");
+            break;
+        }
+    }
+    memset(&latencies, 0, sizeof(latencies));
+    for (i = 0; i < started; ++i)
+    {
+        (void) pthread_join(threads[i].thread, NULL);
+        histogram_merge(&latencies, &threads[i].latencies);
+        done += threads[i].done;
+        rejected += threads[i].rejected;
+        failed += threads[i].failed;
+        late += threads[i].late;
+        bytes += threads[i].bytes;
+    }
+    seconds = (double) (now_ns() - sstart) / NS_PER_SECOND;
+
+    if (srate > 0)
+    {
+        (void) printf("mode: open-loop rate: %ld req/s threads: %ld "
+            "late starts: %ld\n", srate, started, late);
+    }
+    else
+    {
+        (void) printf("mode: closed-loop connections: %ld\n", started);
+    }
+    (void) printf("requests: %ld ok: %ld status!=0: %ld failed: %ld\n",
+        done + rejected + failed, done, rejected, failed);
+    (void) printf("time: %.3f s throughput: %.1f req/s received: %.2f MiB/s\n",
+        seconds, (double) (done + rejected) / seconds,
+        (double) bytes / BYTES_PER_MIB / seconds);
+    (void) printf("latency us: p50 %llu p99 %llu p999 %llu max %llu "
+        "mean %.1f\n",
+        (unsigned long long) histogram_percentile(&latencies, 50.0),
+        (unsigned long long) histogram_percentile(&latencies, 99.0),
+        (unsigned long long) histogram_percentile(&latencies, 99.9),
+        (unsigned long long) latencies.max,
+        latencies.count > 0 ? (double) latencies.sum / latencies.count : 0.0);
+
+    free(threads);
+    free(srequest);
+    return (started == connections) && (failed == 0) ?
+        EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ *
+ * \brief Prints error message to stderr.
+ *
+ * A new line is printed after the message text automatically.
+ * Printout can be formatted like printf.
+ *
+ * \param message output on stderr.
+ *
+ * \return void
+ */
+static void print_error(const char* message, ...)
+{
+    va_list args;
+
+    /* do not handle return value of fprintf, because it makes no sense here */
+    (void) fprintf(stderr, "%s: ", sprogram_arg0);
+    va_start(args, message);
+    (void) vfprintf(stderr, message, args);
+    va_end(args);
+    (void) fprintf(stderr, "\n");
+}
+
+/**
+ * \brief Prints the usage and exits.
+ *
+ * \param stream where to put the usage output.
+ * \param exit_code to be set on exit.
+ */
+static void print_usage(FILE* stream, int exit_code)
+{
+    (void) fprintf(stream,
+        "usage: %s -s server -p port [-u user] [-i image URL] [-m message]\n"
+        "       [-c connections] [-n requests | -d seconds] [-r rate]\n"
+        "  -s <server>       full qualified domain name or IP address\n"
+        "  -p <port>         well-known port of the server\n"
+        "  -u <user>         name of the posting user\n"
+        "  -i <image URL>    URL pointing to an image\n"
+        "  -m <message>      message to be posted\n"
+        "  -c <connections>  concurrent connections or threads [%d, up to %d]\n"
+        "  -n <requests>     requests of the run [%d]\n"
+        "  -d <seconds>      duration of the run instead of -n\n"
+        "  -r <rate>         open loop with this many requests per second\n"
+        "  -h                this help\n", sprogram_arg0, DEFAULT_CONNECTIONS,
+        MAX_CONNECTIONS, DEFAULT_REQUESTS);
+    exit(exit_code);
+}
+
+/**
+ * \brief Converts a numeric command line argument.
+ *
+ * This functions exits when the argument is invalid.
+ *
+ * \param text the argument to be converted.
+ * \param lower smallest allowed value.
+ * \param upper greatest allowed value.
+ * \param what describes the argument in error messages.
+ * \return the converted number.
+ */
+static long convert_number(const char* text, long lower, long upper,
+    const char* what)
+{
+    char* end_ptr;
+    long number;
+
+    errno = 0;
+    number = strtol(text, &end_ptr, INPUT_NUM_BASE);
+    if ((errno != 0) || (end_ptr == text) || (*end_ptr != '\0') ||
+        (number < lower) || (number > upper))
+    {
+        print_error("Invalid %s %s.", what, text);
+        print_usage(stderr, EXIT_FAILURE);
+    }
+    return number;
+}
+
+/**
+ * \brief Resolves the server once for all requests.
+ *
+ * \param server name or address of the server.
+ * \param port of the server.
+ * \return 0 on success, else -1.
+ */
+static int resolve(const char* server, const char* port)
+{
+    struct addrinfo hints;
+    struct addrinfo* addr_result;
+    int info_result;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC; /* Allow IPv4 or IPv6 */
+    hints.ai_socktype = SOCK_STREAM; /* TCP socket */
+    hints.ai_protocol = IPPROTO_TCP;
+
+    info_result = getaddrinfo(server, port, &hints, &addr_result);
+    if (info_result != 0)
+    {
+        print_error("getaddrinfo: %s", gai_strerror(info_result));
+        return -1;
+    }
+    /* the first address is used, like the preferred one of the client */
+    memcpy(&saddress, addr_result->ai_addr, addr_result->ai_addrlen);
+    saddress_length = addr_result->ai_addrlen;
+    freeaddrinfo(addr_result);
+    return 0;
+}
+
+/**
+ * \brief Builds the request sent by every connection.
+ *
+ * \param user which wrote the message.
+ * \param image_url URL of image or NULL.
+ * \param message to be shown in bulletin board.
+ * \return 0 on success, else -1.
+ */
+static int build_request(const char* user, const char* image_url,
+    const char* message)
+{
+    int length;
+
+    length = snprintf(NULL, 0, "%s%s%c%s%s%s%s", SET_USER, user,
+        FIELD_TERMINATOR, image_url != NULL ? SET_IMAGE : "",
+        image_url != NULL ? image_url : "", image_url != NULL ? "\n" : "",
+        message);
+    if (length < 0)
+    {
+        print_error("Can not format request.");
+        return -1;
+    }
+    srequest = malloc((size_t) length + 1);
+    if (srequest == NULL)
+    {
+        print_error("Can not allocate request: %s.", strerror(ENOMEM));
+        return -1;
+    }
+    (void) snprintf(srequest, (size_t) length + 1, "%s%s%c%s%s%s%s", SET_USER,
+        user, FIELD_TERMINATOR, image_url != NULL ? SET_IMAGE : "",
+        image_url != NULL ? image_url : "", image_url != NULL ? "\n" : "",
+        message);
+    srequest_length = (size_t) length;
+    return 0;
+}
+
+/**
+ * \brief Posts requests until the run is over.
+ *
+ * \param arg the struct load_thread of this thread.
+ * \return NULL.
+ */
+static void* load_thread(void* arg)
+{
+    struct load_thread* self = arg;
+    struct response_parser parser;
+    uint64_t scheduled;
+    uint64_t bytes;
+    int status;
+
+    if (response_init(&parser, RECEIVE_BUFFER, PATH_MAX) < 0)
+    {
+        print_error("Can not allocate receive buffer: %s.", strerror(ENOMEM));
+        return NULL;
+    }
+    while (next_request(&scheduled))
+    {
+        if (srate > 0)
+        {
+            sleep_until(scheduled);
+            if (now_ns() - scheduled > LATE_NS)
+            {
+                ++self->late;
+            }
+        }
+        bytes = 0;
+        status = post_request(&parser, &bytes);
+        self->bytes += bytes;
+        if (status < 0)
+        {
+            ++self->failed;
+            continue;
+        }
+        histogram_record(&self->latencies, (now_ns() - scheduled) / NS_PER_US);
+        if (status == 0)
+        {
+            ++self->done;
+        }
+        else
+        {
+            ++self->rejected;
+        }
+    }
+    response_free(&parser);
+    return NULL;
+}
+
+/**
+ * \brief Takes the next request of the run.
+ *
+ * \param scheduled where to put the time the request is due, in ns.
+ * \return false if the run is over.
+ */
+static bool next_request(uint64_t* scheduled)
+{
+    long index = atomic_fetch_add(&snext, 1);
+
+    if (srate > 0)
+    {
+        /* the schedule does not depend on how fast the server answers */
+        *scheduled = sstart + (uint64_t) index * NS_PER_SECOND /
+            (uint64_t) srate;
+        return index < srequests;
+    }
+    *scheduled = now_ns();
+    return sdeadline > 0 ? *scheduled < sdeadline : index < srequests;
+}
+
+/**
+ * \brief Posts one request and reads the response to the end.
+ *
+ * \param parser for the response.
+ * \param bytes incremented by the response bytes received.
+ * \return status of the server, -1 on failure.
+ */
+static int post_request(struct response_parser* parser, uint64_t* bytes)
+{
+    size_t written = 0;
+    ssize_t count;
+    int socket_fd;
+    int status;
+
+    socket_fd = socket(saddress.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (socket_fd < 0)
+    {
+        return -1;
+    }
+    if (connect(socket_fd, (struct sockaddr*) &saddress, saddress_length) < 0)
+    {
+        (void) close(socket_fd);
+        return -1;
+    }
+    while (written < srequest_length)
+    {
+        count = send(socket_fd, srequest + written, srequest_length - written,
+            MSG_NOSIGNAL);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            (void) close(socket_fd);
+            return -1;
+        }
+        written += (size_t) count;
+    }
+    (void) shutdown(socket_fd, SHUT_WR); /* no more writes */
+
+    status = read_response(socket_fd, parser, bytes);
+    (void) close(socket_fd);
+    return status;
+}
+
+/**
+ * \brief Reads a response and checks its records.
+ *
+ * \param socket_fd connected socket, the request is sent.
+ * \param parser for the response, its buffers are reused.
+ * \param bytes incremented by the bytes received.
+ * \return status of the server, -1 if the response is malformed.
+ */
+static int read_response(int socket_fd, struct response_parser* parser,
+    uint64_t* bytes)
+{
+    static const struct response_sink sink =
+    {
+        ignore_begin, ignore_content, ignore_end, NULL, NULL
+    };
+    ssize_t read_count;
+    char* space;
+    size_t room;
+
+    response_reset(parser);
+    while (1)
+    {
+        space = response_space(parser, &room);
+        read_count = read(socket_fd, space, room);
+        if (read_count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        if (read_count == 0)
+        {
+            return response_finish(parser) == 0 ? parser->status : -1;
+        }
+        *bytes += (uint64_t) read_count;
+        response_filled(parser, (size_t) read_count);
+        if (response_parse(parser, &sink) < 0)
+        {
+            return -1;
+        }
+    }
+}
+
+/**
+ * \brief Starts a file of a response, which is not stored.
+ *
+ * \param context will be ignored.
+ * \param name will be ignored.
+ * \param length will be ignored.
+ * \return 0.
+ */
+static int ignore_begin(void* context, const char* name, long length)
+{
+    (void) context; /* pedantic */
+    (void) name;
+    (void) length;
+    return 0;
+}
+
+/**
+ * \brief Drops content of a file of a response.
+ *
+ * \param context will be ignored.
+ * \param data will be ignored.
+ * \param length will be ignored.
+ * \return 0.
+ */
+static int ignore_content(void* context, const char* data, size_t length)
+{
+    (void) context; /* pedantic */
+    (void) data;
+    (void) length;
+    return 0;
+}
+
+/**
+ * \brief Completes a file of a response.
+ *
+ * \param context will be ignored.
+ * \return 0.
+ */
+static int ignore_end(void* context)
+{
+    (void) context; /* pedantic */
+    return 0;
+}
+
+/**
+ * \brief Records a latency.
+ *
+ * \param histogram to be updated.
+ * \param value latency in us.
+ */
+static void histogram_record(struct latency_histogram* histogram,
+    uint64_t value)
+{
+    ++histogram->counts[bucket_of(value)];
+    ++histogram->count;
+    histogram->sum += value;
+    if (value > histogram->max)
+    {
+        histogram->max = value;
+    }
+}
+
+/**
+ * \brief Adds the latencies of a histogram to another one.
+ *
+ * \param target to be updated.
+ * \param source to be added.
+ */
+static void histogram_merge(struct latency_histogram* target,
+    const struct latency_histogram* source)
+{
+    unsigned int i;
+
+    for (i = 0; i < BUCKETS; ++i)
+    {
+        target->counts[i] += source->counts[i];
+    }
+    target->count += source->count;
+    target->sum += source->sum;
+    if (source->max > target->max)
+    {
+        target->max = source->max;
+    }
+}
+
+/**
+ * \brief Estimates a percentile of the recorded latencies.
+ *
+ * \param histogram to be evaluated.
+ * \param percentile between 0 and 100.
+ * \return upper bound of the bucket holding the percentile, at most the
+ *  greatest latency, 0 if empty.
+ */
+static uint64_t histogram_percentile(const struct latency_histogram* histogram,
+    double percentile)
+{
+    uint64_t rank;
+    uint64_t seen = 0;
+    uint64_t bound;
+    unsigned int i;
+
+    if (histogram->count == 0)
+    {
+        return 0;
+    }
+    rank = (uint64_t) (percentile / PERCENT * (double) histogram->count + 0.5);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+    for (i = 0; i < BUCKETS - 1; ++i)
+    {
+        seen += histogram->counts[i];
+        if (seen >= rank)
+        {
+            break;
+        }
+    }
+    bound = bucket_upper_bound(i);
+    return bound < histogram->max ? bound : histogram->max;
+}
+
+/**
+ * \brief Returns the bucket of a value.
+ *
+ * Values below LINEAR_BUCKETS get a bucket each, above every power of 2 is
+ * split into SUB_BUCKETS buckets, so the relative error stays below
+ * 1 / SUB_BUCKETS.
+ *
+ * \param value to be recorded.
+ * \return index into the counts of a histogram.
+ */
+static unsigned int bucket_of(uint64_t value)
+{
+    unsigned int exponent;
+
+    if (value < LINEAR_BUCKETS)
+    {
+        return (unsigned int) value;
+    }
+    exponent = 63 - (unsigned int) __builtin_clzll(value);
+    return LINEAR_BUCKETS + (exponent - LINEAR_BITS) * SUB_BUCKETS +
+        (unsigned int) ((value >> (exponent - SUB_BUCKET_BITS)) &
+        (SUB_BUCKETS - 1));
+}
+
+/**
+ * \brief Returns the greatest value recorded into a bucket.
+ *
+ * \param bucket index into the counts of a histogram.
+ * \return upper bound of the bucket.
+ */
+static uint64_t bucket_upper_bound(unsigned int bucket)
+{
+    unsigned int exponent;
+    uint64_t sub;
+
+    if (bucket < LINEAR_BUCKETS)
+    {
+        return bucket;
+    }
+    exponent = LINEAR_BITS + (bucket - LINEAR_BUCKETS) / SUB_BUCKETS;
+    sub = SUB_BUCKETS + (bucket - LINEAR_BUCKETS) % SUB_BUCKETS;
+    return ((sub + 1) << (exponent - SUB_BUCKET_BITS)) - 1;
+}
+
+/**
+ * \brief Returns the monotonic time.
+ *
+ * \return nanoseconds since some unspecified start.
+ */
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * NS_PER_SECOND + (uint64_t) now.tv_nsec;
+}
+
+/**
+ * \brief Sleeps until a point in time, returns at once if it has passed.
+ *
+ * \param time_ns monotonic time in ns.
+ */
+static void sleep_until(uint64_t time_ns)
+{
+    struct timespec until;
+
+    until.tv_sec = (time_t) (time_ns / NS_PER_SECOND);
+    until.tv_nsec = (long) (time_ns % NS_PER_SECOND);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) ==
+        EINTR)
+    {
+    }
+}
+
+/* === EOF ================================================================== */
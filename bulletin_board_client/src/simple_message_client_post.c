@@ -0,0 +1,841 @@
+/**
+ * @file simple_message_client_post.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, posting a message on a connection as a state machine.
+ *
+ * A post connects (or takes over a connected socket), sends the request
+ * gathered by sendmsg(), streams a message file by sendfile() or in chunks,
+ * shuts down its writing side and receives the response into a struct
+ * response_parser. Content of a large file is spliced from the socket to the
+ * file when the sink names one. All socket I/O is non-blocking: every step
+ * stops where it would block and resumes on the next post_advance(), so the
+ * caller decides whether to wait for one post or many.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+/* splice(), pipe2() */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include "simple_message_client_post.h"
+#include "simple_message_client_sigpipe.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define SET_USER "user="
+#define SET_IMAGE "img="
+
+/* Define for the request field terminator */
+#define FIELD_TERMINATOR '\n'
+
+/* bytes of a message file sent at once */
+#define MESSAGE_CHUNK 65536
+
+/* initial size of the receive buffer, and its cap for large files */
+#define RECEIVE_BUFFER 16384
+#define RECEIVE_BUFFER_MAX (4 * 1024 * 1024)
+
+/* content left of a file from which on it is spliced to the file */
+#define SPLICE_THRESHOLD RECEIVE_BUFFER
+/* bytes moved per splice() unless the pipe can be enlarged */
+#define SPLICE_CHUNK 65536
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static int fail(struct post* post, const char* message, ...);
+static int finish_connect(struct post* post);
+static int send_request(struct post* post);
+static int send_message(struct post* post);
+static ssize_t send_file(int socket_fd, int fd, size_t count);
+static void start_receiving(struct post* post);
+static int receive_response(struct post* post);
+static int read_content(struct post* post);
+static int splice_content(struct post* post, int file_fd);
+static int unsplice(struct post* post, size_t count);
+static int wait_writable(int fd);
+static int finish(struct post* post);
+static bool open_pipe(struct post* post);
+static void close_pipe(struct post* post);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Sets up a post.
+ *
+ * \param post to be set up.
+ * \param name_size longest file name accepted, including the terminating '\0'.
+ * \return 0 on success, -1 if out of memory.
+ */
+int post_init(struct post* post, size_t name_size)
+{
+    memset(post, 0, sizeof(*post));
+    post->fd = -1;
+    post->message_fd = -1;
+    post->pipe_fd[0] = -1;
+    post->pipe_fd[1] = -1;
+    post->pipe_size = SPLICE_CHUNK;
+    post->splice = true;
+    post->state = POST_DONE;
+    return response_init(&post->parser, RECEIVE_BUFFER, name_size);
+}
+
+/**
+ * \brief Releases a post and closes its socket.
+ *
+ * \param post to be released.
+ */
+void post_free(struct post* post)
+{
+    post_close(post);
+    close_pipe(post);
+    free(post->chunk);
+    post->chunk = NULL;
+    response_free(&post->parser);
+}
+
+/**
+ * \brief Prepares a post for a request.
+ *
+ * The message file, if any, stays open and owned by the caller.
+ *
+ * \param post to be prepared, with no socket.
+ * \param request to be posted.
+ * \param sink receiving the files of the response.
+ * \return 0 on success, -1 if request is not valid (see error).
+ */
+int post_start(struct post* post, const struct post_request* request,
+        const struct response_sink* sink)
+{
+    static const char terminator[] = { FIELD_TERMINATOR };
+    struct stat info;
+    int count = 0;
+
+    response_reset(&post->parser);
+    post->state = POST_CONNECTING;
+    post->sink = sink;
+    post->iov_first = 0;
+    post->message_fd = request->message_fd;
+    post->message_regular = false;
+    post->chunk_sent = 0;
+    post->chunk_length = 0;
+    post->sent = 0;
+    post->received = 0;
+    post->reads = 0;
+    post->error[0] = '\0';
+    if ((request->user == NULL) ||
+        ((request->message == NULL) == (request->message_fd < 0)))
+    {
+        return fail(post, "Request without user or message.");
+    }
+
+    post->iov[count].iov_base = (void*) SET_USER;
+    post->iov[count++].iov_len = strlen(SET_USER);
+    post->iov[count].iov_base = (void*) request->user;
+    post->iov[count++].iov_len = strlen(request->user);
+    post->iov[count].iov_base = (void*) terminator;
+    post->iov[count++].iov_len = sizeof(terminator);
+    if (request->image != NULL)
+    {
+        post->iov[count].iov_base = (void*) SET_IMAGE;
+        post->iov[count++].iov_len = strlen(SET_IMAGE);
+        post->iov[count].iov_base = (void*) request->image;
+        post->iov[count++].iov_len = strlen(request->image);
+        post->iov[count].iov_base = (void*) terminator;
+        post->iov[count++].iov_len = sizeof(terminator);
+    }
+    if (request->message != NULL)
+    {
+        post->iov[count].iov_base = (void*) request->message;
+        post->iov[count++].iov_len = strlen(request->message);
+    }
+    else
+    {
+        post->message_regular = (fstat(request->message_fd, &info) == 0) &&
+            S_ISREG(info.st_mode);
+    }
+    post->iov_count = count;
+    return 0;
+}
+
+/**
+ * \brief Starts connecting a prepared post to an address.
+ *
+ * \param post prepared by post_start().
+ * \param address of the server.
+ * \param address_length length of address.
+ * \return 0 on success, -1 on error (see error).
+ */
+int post_connect(struct post* post, const struct sockaddr* address,
+        socklen_t address_length)
+{
+    post_close(post);
+    post->fd = socket(address->sa_family,
+        SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (post->fd < 0)
+    {
+        return fail(post, "Could not create socket: %s", strerror(errno));
+    }
+    if (connect(post->fd, address, address_length) == 0)
+    {
+        post->state = POST_SENDING;
+    }
+    else if (errno == EINPROGRESS)
+    {
+        post->state = POST_CONNECTING;
+    }
+    else
+    {
+        return fail(post, "Could not connect: %s", strerror(errno));
+    }
+    return 0;
+}
+
+/**
+ * \brief Lets a prepared post send on a socket connected already.
+ *
+ * \param post prepared by post_start().
+ * \param fd connected socket, owned by the post from now on.
+ * \return 0 on success, -1 on error (see error).
+ */
+int post_attach(struct post* post, int fd)
+{
+    int flags;
+
+    post_close(post);
+    post->fd = fd;
+    flags = fcntl(fd, F_GETFL);
+    if ((flags < 0) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0))
+    {
+        return fail(post, "Could not set socket non-blocking: %s",
+            strerror(errno));
+    }
+    post->state = POST_SENDING;
+    return 0;
+}
+
+/**
+ * \brief Returns the events the post waits for on its socket.
+ *
+ * \param post in progress.
+ * \return POLLOUT or POLLIN, 0 if the post is done or failed.
+ */
+short post_events(const struct post* post)
+{
+    switch (post->state)
+    {
+    case POST_CONNECTING:
+    case POST_SENDING:
+        return POLLOUT;
+    case POST_RECEIVING:
+        return POLLIN;
+    case POST_DONE:
+    case POST_FAILED:
+    default:
+        return 0;
+    }
+}
+
+/**
+ * \brief Does as much of the post as possible without blocking.
+ *
+ * \param post in progress, its socket ready for post_events().
+ * \return the state of the post afterwards.
+ */
+enum post_state post_advance(struct post* post)
+{
+    int result;
+
+    do
+    {
+        switch (post->state)
+        {
+        case POST_CONNECTING:
+            result = finish_connect(post);
+            break;
+        case POST_SENDING:
+            result = send_request(post);
+            break;
+        case POST_RECEIVING:
+            result = receive_response(post);
+            break;
+        case POST_DONE:
+        case POST_FAILED:
+        default:
+            result = 0;
+            break;
+        }
+    } while (result > 0);
+    return post->state;
+}
+
+/**
+ * \brief Closes the socket of a post.
+ *
+ * \param post with or without socket.
+ */
+void post_close(struct post* post)
+{
+    if (post->fd >= 0)
+    {
+        (void) close(post->fd);
+        post->fd = -1;
+    }
+}
+
+/**
+ * \brief Lets a post fail.
+ *
+ * Printout can be formatted like printf. Bytes a failed splice left in the
+ * pipe are dropped with it, so they do not end up in the next file.
+ *
+ * \param post failing.
+ * \param message describing the failure.
+ * \return -1.
+ */
+static int fail(struct post* post, const char* message, ...)
+{
+    va_list args;
+
+    va_start(args, message);
+    (void) vsnprintf(post->error, sizeof(post->error), message, args);
+    va_end(args);
+    post->state = POST_FAILED;
+    close_pipe(post);
+    return -1;
+}
+
+/**
+ * \brief Checks whether a non-blocking connect() completed.
+ *
+ * \param post connecting.
+ * \return 1 if connected, 0 if still connecting, -1 on error.
+ */
+static int finish_connect(struct post* post)
+{
+    struct sockaddr_storage peer;
+    socklen_t peer_length = sizeof(peer);
+    int error = 0;
+    socklen_t error_length = sizeof(error);
+
+    if (getsockopt(post->fd, SOL_SOCKET, SO_ERROR, &error,
+        &error_length) < 0)
+    {
+        error = errno;
+    }
+    if (error != 0)
+    {
+        return fail(post, "Could not connect: %s", strerror(error));
+    }
+    if (getpeername(post->fd, (struct sockaddr*) &peer, &peer_length) < 0)
+    {
+        return errno == ENOTCONN ? 0 : fail(post, "Could not connect: %s",
+            strerror(errno));
+    }
+    post->state = POST_SENDING;
+    return 1;
+}
+
+/**
+ * \brief Sends the request, resuming partial writes.
+ *
+ * \param post sending.
+ * \return 1 if the request is sent, 0 if the socket is full, -1 on error.
+ */
+static int send_request(struct post* post)
+{
+    struct msghdr msg;
+    ssize_t written;
+    int result;
+
+    memset(&msg, 0, sizeof(msg));
+    while (post->iov_first < post->iov_count)
+    {
+        msg.msg_iov = post->iov + post->iov_first;
+        msg.msg_iovlen = (size_t) (post->iov_count - post->iov_first);
+        written = sendmsg(post->fd, &msg, MSG_NOSIGNAL |
+            (post->message_fd >= 0 ? MSG_MORE : 0));
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                return 0;
+            }
+            return fail(post, "Could not write request: %s", strerror(errno));
+        }
+        post->sent += (uint64_t) written;
+        /* skip the fields sent, the last one may be sent in part */
+        while ((post->iov_first < post->iov_count) &&
+            ((size_t) written >= post->iov[post->iov_first].iov_len))
+        {
+            written -= (ssize_t) post->iov[post->iov_first].iov_len;
+            ++post->iov_first;
+        }
+        if (post->iov_first < post->iov_count)
+        {
+            post->iov[post->iov_first].iov_base =
+                (char*) post->iov[post->iov_first].iov_base + written;
+            post->iov[post->iov_first].iov_len -= (size_t) written;
+        }
+    }
+
+    if (post->message_fd >= 0)
+    {
+        result = send_message(post);
+        if (result <= 0)
+        {
+            return result;
+        }
+        post->message_fd = -1;
+    }
+
+    if (shutdown(post->fd, SHUT_WR) != 0) /* no more writes */
+    {
+        return fail(post, "Could not shutdown write connection: %s",
+            strerror(errno));
+    }
+    start_receiving(post);
+    return 1;
+}
+
+/**
+ * \brief Streams the message from its file.
+ *
+ * A regular file is sent by sendfile() without passing through the client,
+ * anything else is copied through a buffer of fixed size.
+ *
+ * \param post sending.
+ * \return 1 if the message is sent, 0 if the socket is full, -1 on error.
+ */
+static int send_message(struct post* post)
+{
+    ssize_t count;
+
+    while (post->message_regular)
+    {
+        count = send_file(post->fd, post->message_fd, MESSAGE_CHUNK);
+        if (count > 0)
+        {
+            post->sent += (uint64_t) count;
+        }
+        else if (count == 0)
+        {
+            return 1;
+        }
+        else if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        {
+            return 0;
+        }
+        else if ((errno == EINVAL) || (errno == ENOSYS))
+        {
+            /* e.g. a file system without sendfile(), copy instead */
+            post->message_regular = false;
+        }
+        else if (errno != EINTR)
+        {
+            return fail(post, "Could not send message: %s", strerror(errno));
+        }
+    }
+
+    if ((post->chunk == NULL) &&
+        ((post->chunk = malloc(MESSAGE_CHUNK)) == NULL))
+    {
+        return fail(post, "Could not allocate message buffer: %s",
+            strerror(ENOMEM));
+    }
+    while (1)
+    {
+        if (post->chunk_sent == post->chunk_length)
+        {
+            count = read(post->message_fd, post->chunk, MESSAGE_CHUNK);
+            if (count == 0)
+            {
+                return 1;
+            }
+            if (count < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return fail(post, "Could not read message: %s",
+                    strerror(errno));
+            }
+            post->chunk_sent = 0;
+            post->chunk_length = (size_t) count;
+        }
+        count = send(post->fd, post->chunk + post->chunk_sent,
+            post->chunk_length - post->chunk_sent, MSG_NOSIGNAL);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                return 0;
+            }
+            return fail(post, "Could not write request: %s", strerror(errno));
+        }
+        post->chunk_sent += (size_t) count;
+        post->sent += (uint64_t) count;
+    }
+}
+
+/**
+ * \brief Sends from a file by sendfile(), without raising SIGPIPE.
+ *
+ * sendfile() has no MSG_NOSIGNAL, so SIGPIPE is held back meanwhile.
+ *
+ * \param socket_fd connected socket.
+ * \param fd file, sent from its offset.
+ * \param count bytes to be sent at most.
+ * \return as sendfile(), EPIPE if the server closed the connection.
+ */
+static ssize_t send_file(int socket_fd, int fd, size_t count)
+{
+    struct sigpipe guard;
+    ssize_t sent;
+
+    sigpipe_block(&guard);
+    sent = sendfile(socket_fd, fd, NULL, count);
+    sigpipe_restore(&guard, (sent < 0) && (errno == EPIPE));
+    return sent;
+}
+
+/**
+ * \brief Prepares receiving the response.
+ *
+ * The receive buffer may grow up to the receive buffer of the socket, as one
+ * read() does not return more than the kernel has buffered.
+ *
+ * \param post sent.
+ */
+static void start_receiving(struct post* post)
+{
+    int rcvbuf = 0;
+    socklen_t rcvbuf_len = sizeof(rcvbuf);
+
+    if (getsockopt(post->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+        &rcvbuf_len) < 0)
+    {
+        rcvbuf = 0;
+    }
+    response_limit(&post->parser, rcvbuf < RECEIVE_BUFFER_MAX ?
+        (size_t) rcvbuf : RECEIVE_BUFFER_MAX);
+    post->state = POST_RECEIVING;
+}
+
+/**
+ * \brief Receives the response.
+ *
+ * \param post receiving.
+ * \return 1 if the post is done, 0 if the socket is empty, -1 on error.
+ */
+static int receive_response(struct post* post)
+{
+    const struct response_sink* sink = post->sink;
+    int file_fd;
+    int result;
+
+    while (post->state == POST_RECEIVING)
+    {
+        file_fd = -1;
+        if (post->splice && (sink->descriptor != NULL) &&
+            (response_unread(&post->parser) >= SPLICE_THRESHOLD))
+        {
+            file_fd = sink->descriptor(sink->context);
+        }
+        if ((file_fd >= 0) && ((post->pipe_fd[0] >= 0) || open_pipe(post)))
+        {
+            result = splice_content(post, file_fd);
+        }
+        else
+        {
+            result = read_content(post);
+        }
+        if (result <= 0)
+        {
+            return result;
+        }
+    }
+    return 1;
+}
+
+/**
+ * \brief Reads into the receive buffer and parses what arrived.
+ *
+ * \param post receiving.
+ * \return 1 on progress, 0 if the socket is empty, -1 on error.
+ */
+static int read_content(struct post* post)
+{
+    ssize_t read_count;
+    size_t room;
+    char* space;
+
+    space = response_space(&post->parser, &room);
+    read_count = read(post->fd, space, room);
+    if (read_count < 0)
+    {
+        if (errno == EINTR)
+        {
+            return 1;
+        }
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        {
+            return 0;
+        }
+        return fail(post, "read failed: %s", strerror(errno));
+    }
+    if (read_count == 0)
+    {
+        return finish(post);
+    }
+    ++post->reads;
+    post->received += (uint64_t) read_count;
+    response_filled(&post->parser, (size_t) read_count);
+    if (response_parse(&post->parser, post->sink) < 0)
+    {
+        return fail(post, "%s", post->parser.error != NULL ?
+            post->parser.error : "");
+    }
+    return 1;
+}
+
+/**
+ * \brief Moves content of the current file from the socket to the file.
+ *
+ * The bytes are spliced into the pipe and from there into the file, so they
+ * are not copied to user space. If the file can not be spliced to, the bytes
+ * in the pipe are passed to the parser and splicing is given up.
+ *
+ * \param post receiving, within the content of a file.
+ * \param file_fd the file.
+ * \return 1 on progress, 0 if the socket is empty, -1 on error.
+ */
+static int splice_content(struct post* post, int file_fd)
+{
+    size_t count = (size_t) response_unread(&post->parser);
+    ssize_t received;
+    ssize_t moved;
+    size_t left;
+    struct sigpipe guard;
+
+    if (count > post->pipe_size)
+    {
+        count = post->pipe_size;
+    }
+    received = splice(post->fd, NULL, post->pipe_fd[1], NULL, count,
+        SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (received < 0)
+    {
+        if (errno == EINTR)
+        {
+            return 1;
+        }
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        {
+            return 0;
+        }
+        return fail(post, "splice failed: %s", strerror(errno));
+    }
+    if (received == 0)
+    {
+        return finish(post);
+    }
+    ++post->reads;
+    post->received += (uint64_t) received;
+
+    for (left = (size_t) received; left > 0; left -= (size_t) moved)
+    {
+        /* the file may be a pipe, as the archive of simple_message_client */
+        sigpipe_block(&guard);
+        moved = splice(post->pipe_fd[0], NULL, file_fd, NULL, left,
+            SPLICE_F_MOVE);
+        sigpipe_restore(&guard, (moved < 0) && (errno == EPIPE));
+        if (moved >= 0)
+        {
+            continue;
+        }
+        if (errno == EINTR)
+        {
+            moved = 0;
+            continue;
+        }
+        /* a pipe to a pipe is non-blocking if either is, as ours is */
+        if ((errno == EAGAIN) && (wait_writable(file_fd) == 0))
+        {
+            moved = 0;
+            continue;
+        }
+        if (errno != EINVAL)
+        {
+            return fail(post, "Error on writing file %s: %s",
+                post->parser.name, strerror(errno));
+        }
+        /* the file system does not support splice() */
+        if (response_skip(&post->parser, (size_t) received - left,
+            post->sink) < 0)
+        {
+            return fail(post, "");
+        }
+        return unsplice(post, left);
+    }
+    if (response_skip(&post->parser, (size_t) received, post->sink) < 0)
+    {
+        return fail(post, "");
+    }
+    return 1;
+}
+
+/**
+ * \brief Waits until a file can be written to, as a write() to it would.
+ *
+ * \param fd the file.
+ * \return 0 when it is writable, -1 on error (see errno).
+ */
+static int wait_writable(int fd)
+{
+    struct pollfd poll_fd;
+
+    poll_fd.fd = fd;
+    poll_fd.events = POLLOUT;
+    while (poll(&poll_fd, 1, -1) < 0)
+    {
+        if (errno != EINTR)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * \brief Passes the bytes left in the pipe to the parser and gives up
+ * splicing.
+ *
+ * \param post receiving.
+ * \param count bytes in the pipe.
+ * \return 1 on success, -1 on error.
+ */
+static int unsplice(struct post* post, size_t count)
+{
+    ssize_t read_count;
+    size_t room;
+    char* space;
+
+    while (count > 0)
+    {
+        space = response_space(&post->parser, &room);
+        read_count = read(post->pipe_fd[0], space, room < count ? room : count);
+        if (read_count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return fail(post, "read failed: %s", strerror(errno));
+        }
+        response_filled(&post->parser, (size_t) read_count);
+        count -= (size_t) read_count;
+        if (response_parse(&post->parser, post->sink) < 0)
+        {
+            return fail(post, "%s", post->parser.error != NULL ?
+                post->parser.error : "");
+        }
+    }
+    close_pipe(post);
+    post->splice = false;
+    return 1;
+}
+
+/**
+ * \brief Completes the post at the end of the response.
+ *
+ * \param post receiving.
+ * \return 1 if the response is complete, -1 if not.
+ */
+static int finish(struct post* post)
+{
+    if (response_finish(&post->parser) < 0)
+    {
+        return fail(post, "%s", post->parser.error);
+    }
+    post->state = POST_DONE;
+    return 1;
+}
+
+/**
+ * \brief Opens the pipe for splicing, as large as the receive buffer may
+ * grow.
+ *
+ * \param post receiving.
+ * \return true if the pipe is open, false if splicing is given up.
+ */
+static bool open_pipe(struct post* post)
+{
+    int pipe_size;
+
+    if (pipe2(post->pipe_fd, O_CLOEXEC | O_NONBLOCK) < 0)
+    {
+        post->pipe_fd[0] = -1;
+        post->pipe_fd[1] = -1;
+        post->splice = false;
+        return false;
+    }
+    pipe_size = fcntl(post->pipe_fd[1], F_SETPIPE_SZ,
+        (int) post->parser.limit);
+    if (pipe_size > SPLICE_CHUNK)
+    {
+        /* as much per splice() as per read() of a grown buffer */
+        post->pipe_size = (size_t) pipe_size;
+    }
+    return true;
+}
+
+/**
+ * \brief Closes the pipe used for splicing.
+ *
+ * \param post with or without pipe.
+ */
+static void close_pipe(struct post* post)
+{
+    if (post->pipe_fd[0] >= 0)
+    {
+        (void) close(post->pipe_fd[0]);
+        (void) close(post->pipe_fd[1]);
+        post->pipe_fd[0] = -1;
+        post->pipe_fd[1] = -1;
+    }
+}
+
+/* === EOF ================================================================== */
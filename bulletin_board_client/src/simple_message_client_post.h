@@ -0,0 +1,135 @@
+/**
+ * @file simple_message_client_post.h
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, posting a message on a connection as a state machine.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_POST_H
+#define SIMPLE_MESSAGE_CLIENT_POST_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include "simple_message_client_response.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* user=, img= and message with their prefixes and terminators */
+#define POST_FIELDS 7
+
+/* size of the error description of a post */
+#define POST_ERROR_SIZE 160
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/**
+ * Where a post is.
+ */
+enum post_state
+{
+    POST_CONNECTING = 0,  /**< non-blocking connect() pending */
+    POST_SENDING,         /**< request being sent */
+    POST_RECEIVING,       /**< response being received */
+    POST_DONE,            /**< response complete, see parser.status */
+    POST_FAILED           /**< see error */
+};
+
+/**
+ * A message to be posted. The strings must stay valid until the post is
+ * done.
+ */
+struct post_request
+{
+    /** user name */
+    const char* user;
+    /** URL of an image, NULL if none */
+    const char* image;
+    /** the message, NULL if read from message_fd */
+    const char* message;
+    /** file or stream holding the message, -1 if message is given */
+    int message_fd;
+};
+
+/**
+ * One message posted on one connection: the request is sent and the response
+ * received by non-blocking I/O, post_advance() doing as much as possible
+ * whenever the socket is ready for post_events(). Any number of posts can be
+ * driven by one poll() or epoll loop.
+ */
+struct post
+{
+    /** where the post is */
+    enum post_state state;
+    /** connected socket, -1 if none */
+    int fd;
+    /** the request fields */
+    struct iovec iov[POST_FIELDS];
+    /** first field not sent completely */
+    int iov_first;
+    /** number of fields */
+    int iov_count;
+    /** message streamed after the fields, -1 if none */
+    int message_fd;
+    /** message_fd is tried with sendfile() */
+    bool message_regular;
+    /** buffer streaming the message, allocated on first use */
+    char* chunk;
+    /** bytes of chunk sent */
+    size_t chunk_sent;
+    /** bytes in chunk */
+    size_t chunk_length;
+    /** parser of the response */
+    struct response_parser parser;
+    /** receiving the files of the response */
+    const struct response_sink* sink;
+    /** pipe splicing content to the files, -1 if not open */
+    int pipe_fd[2];
+    /** bytes moved per splice() */
+    size_t pipe_size;
+    /** splice() may be used */
+    bool splice;
+    /** bytes of the request sent */
+    uint64_t sent;
+    /** bytes of the response received */
+    uint64_t received;
+    /** read() and splice() calls returning data */
+    long reads;
+    /** describes the failure, empty if the sink reported it */
+    char error[POST_ERROR_SIZE];
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int post_init(struct post* post, size_t name_size);
+void post_free(struct post* post);
+int post_start(struct post* post, const struct post_request* request,
+    const struct response_sink* sink);
+int post_connect(struct post* post, const struct sockaddr* address,
+    socklen_t address_length);
+int post_attach(struct post* post, int fd);
+short post_events(const struct post* post);
+enum post_state post_advance(struct post* post);
+void post_close(struct post* post);
+
+#endif /* SIMPLE_MESSAGE_CLIENT_POST_H */
+
+/* === EOF ================================================================== */
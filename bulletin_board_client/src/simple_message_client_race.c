@@ -0,0 +1,338 @@
+/**
+ * @file simple_message_client_race.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, racing connection attempts to the addresses of a server.
+ *
+ * The addresses are tried in the order of getaddrinfo(), but alternating
+ * between IPv6 and IPv4 (RFC 8305). Every RACE_ATTEMPT_DELAY ms, or as soon
+ * as an attempt fails, a non-blocking connect() to the next address is
+ * started while the earlier ones are still pending. The first connection
+ * established wins, all others are closed. So an address not answering
+ * delays the connection by the attempt delay instead of a TCP timeout.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include "simple_message_client_race.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* Delay between connection attempts to the next address in ms (RFC 8305) */
+#define RACE_ATTEMPT_DELAY 250
+
+#define MS_PER_SECOND 1000
+#define NS_PER_MS 1000000
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static size_t interleave(const struct addrinfo* addresses,
+    const struct addrinfo** order);
+static const struct addrinfo* next_of_family(const struct addrinfo* info,
+    int family, bool same);
+static int start_attempt(const struct addrinfo* info);
+static int check_attempt(int fd);
+static long now_ms(void);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Sets up a race, no attempt is started yet.
+ *
+ * \param race to be set up.
+ * \param addresses of the server, must stay valid during the race.
+ * \param timeout_ms how long the race may take.
+ * \return 0 on success, -1 if out of memory.
+ */
+int race_init(struct race* race, const struct addrinfo* addresses,
+        int timeout_ms)
+{
+    const struct addrinfo* info;
+    size_t count = 0;
+    size_t i;
+
+    memset(race, 0, sizeof(*race));
+    for (info = addresses; info != NULL; info = info->ai_next)
+    {
+        ++count;
+    }
+    race->order = malloc((count > 0 ? count : 1) * sizeof(*race->order));
+    race->attempts = malloc((count > 0 ? count : 1) *
+        sizeof(*race->attempts));
+    if ((race->order == NULL) || (race->attempts == NULL))
+    {
+        race_free(race);
+        errno = ENOMEM;
+        return -1;
+    }
+    race->count = count > 0 ? interleave(addresses, race->order) : 0;
+    for (i = 0; i < race->count; ++i)
+    {
+        /* poll() skips negative descriptors */
+        race->attempts[i].fd = -1;
+        race->attempts[i].events = POLLOUT;
+        race->attempts[i].revents = 0;
+    }
+    race->next_start_ms = now_ms();
+    race->deadline_ms = race->next_start_ms + timeout_ms;
+    race->error = ENOENT;
+    return 0;
+}
+
+/**
+ * \brief Closes the attempts still pending and releases a race.
+ *
+ * \param race to be released.
+ */
+void race_free(struct race* race)
+{
+    size_t i;
+
+    for (i = 0; (race->attempts != NULL) && (i < race->count); ++i)
+    {
+        if (race->attempts[i].fd >= 0)
+        {
+            (void) close(race->attempts[i].fd);
+            race->attempts[i].fd = -1;
+        }
+    }
+    free(race->order);
+    free(race->attempts);
+    race->order = NULL;
+    race->attempts = NULL;
+    race->count = 0;
+}
+
+/**
+ * \brief Checks the attempts and starts the next ones due.
+ *
+ * \param race in progress.
+ * \param fd where to put the connected socket, non-blocking and owned by the
+ *  caller.
+ * \return 1 if connected, 0 if still racing, -1 if every attempt failed or
+ *  the race timed out (see race->error).
+ */
+int race_advance(struct race* race, int* fd)
+{
+    long now = now_ms();
+    int error;
+    size_t i;
+
+    for (i = 0; i < race->next; ++i)
+    {
+        if (race->attempts[i].fd < 0)
+        {
+            continue;
+        }
+        error = check_attempt(race->attempts[i].fd);
+        if (error == EINPROGRESS)
+        {
+            continue;
+        }
+        if (error == 0)
+        {
+            *fd = race->attempts[i].fd;
+            race->attempts[i].fd = -1;
+            race->winner = race->order[i];
+            /* the losers */
+            race_free(race);
+            return 1;
+        }
+        race->error = error;
+        (void) close(race->attempts[i].fd);
+        race->attempts[i].fd = -1;
+        --race->active;
+        /* a failed attempt starts the next one right away */
+        race->next_start_ms = now;
+    }
+
+    while ((race->next < race->count) &&
+        ((now >= race->next_start_ms) || (race->active == 0)))
+    {
+        race->attempts[race->next].fd = start_attempt(race->order[race->next]);
+        if (race->attempts[race->next].fd >= 0)
+        {
+            ++race->active;
+            race->next_start_ms = now + RACE_ATTEMPT_DELAY;
+        }
+        else
+        {
+            race->error = errno;
+        }
+        ++race->next;
+    }
+
+    if (race->active == 0)
+    {
+        /* every address failed */
+        return -1;
+    }
+    if (now >= race->deadline_ms)
+    {
+        race->error = ETIMEDOUT;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Returns how long to wait for the attempts at most.
+ *
+ * \param race in progress.
+ * \return ms until the next attempt is due or the race times out.
+ */
+int race_timeout(const struct race* race)
+{
+    long until = (race->next < race->count) &&
+        (race->next_start_ms < race->deadline_ms) ? race->next_start_ms :
+        race->deadline_ms;
+    long now = now_ms();
+
+    return until > now ? (int) (until - now) : 0;
+}
+
+/**
+ * \brief Orders the addresses alternating between the address families.
+ *
+ * The family of the first address comes first, the order of getaddrinfo()
+ * is kept within each family.
+ *
+ * \param addresses of the server, at least one.
+ * \param order where to put the addresses, room for all of them.
+ * \return number of addresses.
+ */
+static size_t interleave(const struct addrinfo* addresses,
+        const struct addrinfo** order)
+{
+    int family = addresses->ai_family;
+    const struct addrinfo* first = addresses;
+    const struct addrinfo* other = next_of_family(addresses, family, false);
+    bool take_first = true;
+    size_t count = 0;
+
+    while ((first != NULL) || (other != NULL))
+    {
+        if ((take_first && (first != NULL)) || (other == NULL))
+        {
+            order[count++] = first;
+            first = next_of_family(first->ai_next, family, true);
+        }
+        else
+        {
+            order[count++] = other;
+            other = next_of_family(other->ai_next, family, false);
+        }
+        take_first = !take_first;
+    }
+    return count;
+}
+
+/**
+ * \brief Finds the next address of or not of a family.
+ *
+ * \param info where to start searching.
+ * \param family address family.
+ * \param same true to find the family, false to find any other.
+ * \return the address found, NULL if none.
+ */
+static const struct addrinfo* next_of_family(const struct addrinfo* info,
+        int family, bool same)
+{
+    while ((info != NULL) && ((info->ai_family == family) != same))
+    {
+        info = info->ai_next;
+    }
+    return info;
+}
+
+/**
+ * \brief Starts a non-blocking connect() to an address.
+ *
+ * \param info the address.
+ * \return socket connecting or connected, -1 if the attempt failed at once.
+ */
+static int start_attempt(const struct addrinfo* info)
+{
+    int socket_fd;
+    int error;
+
+    socket_fd = socket(info->ai_family,
+        info->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, info->ai_protocol);
+    if (socket_fd == -1)
+    {
+        return -1;
+    }
+    /* a connection established at once is found by check_attempt() */
+    if ((connect(socket_fd, info->ai_addr, info->ai_addrlen) == 0) ||
+        (errno == EINPROGRESS))
+    {
+        return socket_fd;
+    }
+    error = errno;
+    (void) close(socket_fd);
+    errno = error;
+    return -1;
+}
+
+/**
+ * \brief Checks whether an attempt connected.
+ *
+ * \param fd socket of the attempt.
+ * \return 0 if connected, EINPROGRESS if pending, else the error.
+ */
+static int check_attempt(int fd)
+{
+    struct sockaddr_storage peer;
+    socklen_t peer_length = sizeof(peer);
+    int error = 0;
+    socklen_t error_length = sizeof(error);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_length) < 0)
+    {
+        return errno;
+    }
+    if (error != 0)
+    {
+        return error;
+    }
+    if (getpeername(fd, (struct sockaddr*) &peer, &peer_length) < 0)
+    {
+        return errno == ENOTCONN ? EINPROGRESS : errno;
+    }
+    return 0;
+}
+
+/**
+ * \brief Returns the monotonic time.
+ *
+ * \return milliseconds since some unspecified start.
+ */
+static long now_ms(void)
+{
+    struct timespec now;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long) now.tv_sec * MS_PER_SECOND + now.tv_nsec / NS_PER_MS;
+}
+
+/* === EOF ================================================================== */
@@ -0,0 +1,69 @@
+/**
+ * @file simple_message_client_race.h
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, racing connection attempts to the addresses of a server.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_RACE_H
+#define SIMPLE_MESSAGE_CLIENT_RACE_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <poll.h>
+#include <netdb.h>
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/**
+ * Connection attempts to all addresses of a server (Happy Eyeballs, RFC
+ * 8305). The attempts are non-blocking: the caller waits for any of the
+ * sockets in attempts to become writable, or for race_timeout(), and calls
+ * race_advance() then.
+ */
+struct race
+{
+    /** the addresses, alternating between the address families */
+    const struct addrinfo** order;
+    /** the attempt of each address, fd -1 if none is pending */
+    struct pollfd* attempts;
+    /** number of addresses */
+    size_t count;
+    /** next address to be tried */
+    size_t next;
+    /** attempts pending */
+    size_t active;
+    /** when the next attempt is started, in ms */
+    long next_start_ms;
+    /** when the race is given up, in ms */
+    long deadline_ms;
+    /** address connected to, NULL until then */
+    const struct addrinfo* winner;
+    /** errno of the last attempt failed */
+    int error;
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int race_init(struct race* race, const struct addrinfo* addresses,
+    int timeout_ms);
+void race_free(struct race* race);
+int race_advance(struct race* race, int* fd);
+int race_timeout(const struct race* race);
+
+#endif /* SIMPLE_MESSAGE_CLIENT_RACE_H */
+
+/* === EOF ================================================================== */
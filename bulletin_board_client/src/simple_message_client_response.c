@@ -0,0 +1,501 @@
+/**
+ * @file simple_message_client_response.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, parser of the responses of the bulletin board server.
+ *
+ * A response is a status= line followed by files, each a file= and a len=
+ * line and len bytes of content, up to the end of the stream. The caller
+ * reads into the space the parser offers and lets it parse what arrived.
+ * Lines are consumed by advancing a cursor and file content is passed to
+ * the sink straight from the receive buffer, so nothing is moved when a
+ * field has been consumed. Once the cursor reaches the end of the bytes
+ * received the buffer is rewound for free; only a line cut off at the end of
+ * a full buffer has to be moved to its front. While a file is longer than the
+ * buffer, the drained buffer is replaced by one twice as large, up to a limit
+ * set by the caller, so large files are received with fewer reads.
+ *
+ * Line terminators are found by scan_newlines(): the RESPONSE_WINDOW bytes
+ * from the first line not found yet are marked at once, and the following
+ * lines are taken from the marks as long as they lie in the window. A window
+ * is valid until the bytes of the buffer are moved or overwritten.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include "simple_message_client_response.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* decimal format base for strtol */
+#define INPUT_NUM_BASE 10
+
+#define GET_STATUS "status="
+#define GET_FILE "file="
+#define GET_LEN "len="
+
+/* longest status= or len= line: the prefix and a long in decimal */
+#define MAX_NUMBER_LINE 32
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static int parse_line(struct response_parser* parser, char* line,
+    size_t length, const struct response_sink* sink);
+static int parse_number(const char* text, long lower, long upper,
+    long* number);
+static int complete_file(struct response_parser* parser,
+    const struct response_sink* sink);
+static char* find_terminator(struct response_parser* parser);
+static void grow(struct response_parser* parser);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Sets up a parser for a response.
+ *
+ * \param parser to be set up.
+ * \param size of the receive buffer, holds at least the longest file= line.
+ * \param name_size longest file name accepted, including the terminating '\0'.
+ * \return 0 on success, -1 if out of memory.
+ */
+int response_init(struct response_parser* parser, size_t size,
+        size_t name_size)
+{
+    memset(parser, 0, sizeof(*parser));
+    if (size < name_size + sizeof(GET_FILE) + MAX_NUMBER_LINE)
+    {
+        size = name_size + sizeof(GET_FILE) + MAX_NUMBER_LINE;
+    }
+    parser->buf = malloc(size);
+    parser->name = malloc(name_size);
+    if ((parser->buf == NULL) || (parser->name == NULL))
+    {
+        response_free(parser);
+        errno = ENOMEM;
+        return -1;
+    }
+    parser->size = size;
+    parser->limit = size;
+    parser->name_size = name_size;
+    response_reset(parser);
+    return 0;
+}
+
+/**
+ * \brief Prepares a parser for the next response, keeping its buffers.
+ *
+ * \param parser to be reset.
+ */
+void response_reset(struct response_parser* parser)
+{
+    parser->state = RESPONSE_STATUS;
+    parser->begin = 0;
+    parser->end = 0;
+    parser->window = 0;
+    parser->window_end = 0;
+    parser->name[0] = '\0';
+    parser->status = 0;
+    parser->remaining = 0;
+    parser->files = 0;
+    parser->copied = 0;
+    parser->error = NULL;
+}
+
+/**
+ * \brief Releases the buffers of a parser.
+ *
+ * \param parser to be released.
+ */
+void response_free(struct response_parser* parser)
+{
+    free(parser->buf);
+    free(parser->name);
+    parser->buf = NULL;
+    parser->name = NULL;
+}
+
+/**
+ * \brief Lets the receive buffer grow for long file content.
+ *
+ * \param parser of the response.
+ * \param limit size the buffer may grow to, it never shrinks below its size.
+ */
+void response_limit(struct response_parser* parser, size_t limit)
+{
+    parser->limit = limit > parser->size ? limit : parser->size;
+}
+
+/**
+ * \brief Offers the space to receive the next bytes into.
+ *
+ * \param parser of the response.
+ * \param room where to put the size of the space.
+ * \return start of the space, never NULL with a room of at least one byte.
+ */
+char* response_space(struct response_parser* parser, size_t* room)
+{
+    if (parser->begin == parser->end)
+    {
+        /* everything consumed, start over at the front */
+        parser->begin = 0;
+        parser->end = 0;
+        parser->window_end = parser->window;
+        if ((parser->state == RESPONSE_CONTENT) &&
+            ((size_t) parser->remaining > parser->size))
+        {
+            grow(parser);
+        }
+    }
+    else if ((parser->end == parser->size) && (parser->begin > 0))
+    {
+        /* a line is cut off at the end of the buffer */
+        memmove(parser->buf, parser->buf + parser->begin,
+            parser->end - parser->begin);
+        parser->copied += parser->end - parser->begin;
+        parser->end -= parser->begin;
+        parser->begin = 0;
+        parser->window_end = parser->window;
+    }
+    *room = parser->size - parser->end;
+    return parser->buf + parser->end;
+}
+
+/**
+ * \brief Takes note of the bytes received into the space offered.
+ *
+ * \param parser of the response.
+ * \param count bytes received.
+ */
+void response_filled(struct response_parser* parser, size_t count)
+{
+    parser->end += count;
+}
+
+/**
+ * \brief Parses the bytes received so far.
+ *
+ * \param parser of the response.
+ * \param sink receiving the files.
+ * \return 0 if more bytes are needed, -1 on error: parser->error describes a
+ *  malformed response, it is NULL if the sink failed (which reports itself).
+ */
+int response_parse(struct response_parser* parser,
+        const struct response_sink* sink)
+{
+    char* line;
+    char* terminator;
+    size_t take;
+
+    while (parser->begin < parser->end)
+    {
+        if (parser->state == RESPONSE_CONTENT)
+        {
+            take = parser->end - parser->begin;
+            if ((long) take > parser->remaining)
+            {
+                take = (size_t) parser->remaining;
+            }
+            if (sink->content(sink->context, parser->buf + parser->begin,
+                take) < 0)
+            {
+                return -1;
+            }
+            parser->begin += take;
+            parser->remaining -= (long) take;
+            if ((parser->remaining == 0) && (complete_file(parser, sink) < 0))
+            {
+                return -1;
+            }
+            continue;
+        }
+
+        line = parser->buf + parser->begin;
+        terminator = find_terminator(parser);
+        if (terminator == NULL)
+        {
+            if (parser->end - parser->begin > parser->name_size +
+                sizeof(GET_FILE) + MAX_NUMBER_LINE)
+            {
+                parser->error = "Malformed response (line too long).";
+                return -1;
+            }
+            return 0;
+        }
+        parser->begin += (size_t) (terminator - line) + 1;
+        *terminator = '\0';
+        if (parse_line(parser, line, (size_t) (terminator - line), sink) < 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * \brief Checks the response ended between two files.
+ *
+ * \param parser of the response.
+ * \return 0 if the response is complete, else -1 (see parser->error).
+ */
+int response_finish(struct response_parser* parser)
+{
+    if ((parser->state != RESPONSE_FILE) || (parser->begin != parser->end))
+    {
+        parser->error = parser->state == RESPONSE_CONTENT ?
+            "Too less data for file." : "Malformed response (incomplete).";
+        return -1;
+    }
+    if (parser->files == 0)
+    {
+        parser->error = "Malformed response (no file).";
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Returns the content of the current file not received yet.
+ *
+ * The caller may move these bytes from the stream to the file itself, e.g.
+ * by splice(), and report them by response_skip().
+ *
+ * \param parser of the response.
+ * \return bytes of content not received yet, 0 if the buffer still holds
+ *  bytes to be parsed or no content is expected.
+ */
+long response_unread(const struct response_parser* parser)
+{
+    if ((parser->state != RESPONSE_CONTENT) || (parser->begin != parser->end))
+    {
+        return 0;
+    }
+    return parser->remaining;
+}
+
+/**
+ * \brief Takes note of content the caller moved past the parser.
+ *
+ * \param parser of the response.
+ * \param count content bytes moved, at most response_unread().
+ * \param sink receiving the files, told when the file is complete.
+ * \return 0 on success, -1 on error.
+ */
+int response_skip(struct response_parser* parser, size_t count,
+        const struct response_sink* sink)
+{
+    parser->remaining -= (long) count;
+    if (parser->remaining == 0)
+    {
+        return complete_file(parser, sink);
+    }
+    return 0;
+}
+
+/**
+ * \brief Parses a status=, file= or len= line.
+ *
+ * \param parser of the response.
+ * \param line without its terminator, terminated by '\0'.
+ * \param length of line.
+ * \param sink receiving the files.
+ * \return 0 on success, -1 on error.
+ */
+static int parse_line(struct response_parser* parser, char* line,
+        size_t length, const struct response_sink* sink)
+{
+    long number;
+
+    switch (parser->state)
+    {
+    case RESPONSE_STATUS:
+        if ((strncmp(line, GET_STATUS, strlen(GET_STATUS)) != 0) ||
+            (parse_number(line + strlen(GET_STATUS), INT_MIN, INT_MAX,
+            &number) < 0))
+        {
+            parser->error = "Malformed response (status).";
+            return -1;
+        }
+        parser->status = (int) number;
+        parser->state = RESPONSE_FILE;
+        return 0;
+    case RESPONSE_FILE:
+        if ((strncmp(line, GET_FILE, strlen(GET_FILE)) != 0) ||
+            (length == strlen(GET_FILE)))
+        {
+            parser->error = "Malformed response (file).";
+            return -1;
+        }
+        length -= strlen(GET_FILE);
+        if (length >= parser->name_size)
+        {
+            parser->error = "Filename too long.";
+            return -1;
+        }
+        /* the line may be moved before the file starts, keep the name */
+        memcpy(parser->name, line + strlen(GET_FILE), length + 1);
+        parser->copied += length + 1;
+        parser->state = RESPONSE_LEN;
+        return 0;
+    case RESPONSE_LEN:
+        if ((strncmp(line, GET_LEN, strlen(GET_LEN)) != 0) ||
+            (parse_number(line + strlen(GET_LEN), 0, LONG_MAX, &number) < 0))
+        {
+            parser->error = "Malformed response (len).";
+            return -1;
+        }
+        if (sink->begin(sink->context, parser->name, number) < 0)
+        {
+            return -1;
+        }
+        parser->remaining = number;
+        parser->state = RESPONSE_CONTENT;
+        return number == 0 ? complete_file(parser, sink) : 0;
+    case RESPONSE_CONTENT:
+    default:
+        parser->error = "Malformed response.";
+        return -1;
+    }
+}
+
+/**
+ * \brief Converts a number of a line.
+ *
+ * \param text the number, terminated by '\0'.
+ * \param lower smallest allowed value.
+ * \param upper greatest allowed value.
+ * \param number where to put the number.
+ * \return 0 on success, -1 if text is no number in the range.
+ */
+static int parse_number(const char* text, long lower, long upper,
+        long* number)
+{
+    char* end_ptr;
+
+    errno = 0;
+    *number = strtol(text, &end_ptr, INPUT_NUM_BASE);
+    if ((errno != 0) || (end_ptr == text) || (*end_ptr != '\0') ||
+        (*number < lower) || (*number > upper))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Completes the current file.
+ *
+ * \param parser of the response.
+ * \param sink receiving the files.
+ * \return 0 on success, -1 on error.
+ */
+static int complete_file(struct response_parser* parser,
+        const struct response_sink* sink)
+{
+    if (sink->end(sink->context) < 0)
+    {
+        return -1;
+    }
+    ++parser->files;
+    parser->state = RESPONSE_FILE;
+    return 0;
+}
+
+/**
+ * \brief Finds the terminator of the line at the cursor.
+ *
+ * The bytes after the window are scanned when the line goes on past it, so
+ * every byte is scanned once however the line is cut into reads.
+ *
+ * \param parser of the response.
+ * \return the terminator, NULL if the bytes received hold none.
+ */
+static char* find_terminator(struct response_parser* parser)
+{
+    size_t from = parser->begin;
+    size_t index;
+    size_t word;
+    uint64_t mask;
+
+    for (;;)
+    {
+        if ((from < parser->window) || (from >= parser->window_end))
+        {
+            if (from >= parser->end)
+            {
+                return NULL;
+            }
+            parser->window = from;
+            parser->window_end = parser->end - from > RESPONSE_WINDOW ?
+                from + RESPONSE_WINDOW : parser->end;
+            scan_newlines(parser->buf + from, parser->window_end - from,
+                parser->newlines);
+        }
+        index = from - parser->window;
+        for (word = index / SCAN_BLOCK;
+            word * SCAN_BLOCK < parser->window_end - parser->window; ++word)
+        {
+            mask = parser->newlines[word];
+            if (word == index / SCAN_BLOCK)
+            {
+                /* the lines before the cursor */
+                mask &= ~(uint64_t) 0 << (index % SCAN_BLOCK);
+            }
+            if (mask != 0)
+            {
+                return parser->buf + parser->window + word * SCAN_BLOCK +
+                    (size_t) __builtin_ctzll(mask);
+            }
+        }
+        from = parser->window_end;
+    }
+}
+
+/**
+ * \brief Replaces the drained receive buffer by a larger one.
+ *
+ * The size is doubled until the content still expected fits or the limit is
+ * reached. Without memory the buffer is kept as it is.
+ *
+ * \param parser of the response.
+ */
+static void grow(struct response_parser* parser)
+{
+    size_t size = parser->size;
+    char* buf;
+
+    while ((size < (size_t) parser->remaining) && (size < parser->limit))
+    {
+        size = size > parser->limit / 2 ? parser->limit : 2 * size;
+    }
+    if (size == parser->size)
+    {
+        return;
+    }
+    /* nothing to keep, so no realloc() copying the old content */
+    buf = malloc(size);
+    if (buf != NULL)
+    {
+        free(parser->buf);
+        parser->buf = buf;
+        parser->size = size;
+    }
+}
+
+/* === EOF ================================================================== */
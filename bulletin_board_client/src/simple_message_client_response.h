@@ -0,0 +1,133 @@
+/**
+ * @file simple_message_client_response.h
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, parser of the responses of the bulletin board server.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_RESPONSE_H
+#define SIMPLE_MESSAGE_CLIENT_RESPONSE_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "simple_message_client_scan.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* bytes after the cursor whose line terminators are marked at once */
+#define RESPONSE_WINDOW 512
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/**
+ * What the parser expects next.
+ */
+enum response_state
+{
+    RESPONSE_STATUS = 0,  /**< status= line */
+    RESPONSE_FILE,        /**< file= line or the end of the response */
+    RESPONSE_LEN,         /**< len= line */
+    RESPONSE_CONTENT      /**< content of a file */
+};
+
+/**
+ * Receives the files of a response. Every callback but descriptor returns 0
+ * to go on or -1 to abort the parsing, after reporting what went wrong.
+ */
+struct response_sink
+{
+    /** a file starts, with its name and its length from len= */
+    int (*begin)(void* context, const char* name, long length);
+    /** content of the current file, pointing into the receive buffer */
+    int (*content)(void* context, const char* data, size_t length);
+    /** the current file is complete */
+    int (*end)(void* context);
+    /** passed to the callbacks */
+    void* context;
+    /**
+     * file the content of the current file may be spliced to instead of
+     * calling content, -1 if none; NULL if content is always called
+     */
+    int (*descriptor)(void* context);
+};
+
+/**
+ * Parser working on a cursor over its receive buffer: a field is consumed by
+ * advancing the cursor, the buffer is rewound when it has been consumed
+ * completely. Only a line cut off at the end of a full buffer is moved to its
+ * front, file content is never moved. The buffer grows up to its limit while
+ * the content still expected by len= does not fit into it. The terminators of
+ * a window of the buffer are marked by one scan, so the lines of the small
+ * files following each other in it are found without searching again.
+ */
+struct response_parser
+{
+    /** what is expected next */
+    enum response_state state;
+    /** receive buffer */
+    char* buf;
+    /** size of buf */
+    size_t size;
+    /** size buf may grow to while long file content is received */
+    size_t limit;
+    /** cursor, first byte not consumed yet */
+    size_t begin;
+    /** end of the bytes received */
+    size_t end;
+    /** start of the window in buf */
+    size_t window;
+    /** end of the bytes of the window scanned, window if it is empty */
+    size_t window_end;
+    /** the line terminators of the window, one bit per byte */
+    uint64_t newlines[RESPONSE_WINDOW / SCAN_BLOCK];
+    /** name of the current file */
+    char* name;
+    /** size of name including the terminating '\0' */
+    size_t name_size;
+    /** status of the server */
+    int status;
+    /** content bytes of the current file still expected */
+    long remaining;
+    /** files completed */
+    long files;
+    /** bytes copied by the parser: lines moved and file names */
+    uint64_t copied;
+    /** describes a malformed response, NULL if none */
+    const char* error;
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int response_init(struct response_parser* parser, size_t size,
+    size_t name_size);
+void response_reset(struct response_parser* parser);
+void response_free(struct response_parser* parser);
+void response_limit(struct response_parser* parser, size_t limit);
+char* response_space(struct response_parser* parser, size_t* room);
+void response_filled(struct response_parser* parser, size_t count);
+int response_parse(struct response_parser* parser,
+    const struct response_sink* sink);
+int response_finish(struct response_parser* parser);
+long response_unread(const struct response_parser* parser);
+int response_skip(struct response_parser* parser, size_t count,
+    const struct response_sink* sink);
+
+#endif /* SIMPLE_MESSAGE_CLIENT_RESPONSE_H */
+
+/* === EOF ================================================================== */
@@ -0,0 +1,334 @@
+/**
+ * @file simple_message_client_scan.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, scanning received bytes for line terminators.
+ *
+ * A block of received bytes is turned into a mask with one bit per byte, set
+ * for every FIELD_TERMINATOR, so the lines of a block are found by counting
+ * trailing zeros instead of searching the bytes again for each line. On x86
+ * the bytes are compared 32 at a time by AVX2 or 16 at a time by SSE2,
+ * elsewhere eight at a time in a 64 bit word. The implementation is chosen
+ * once when the program starts, by what the CPU supports.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <string.h>
+#include "simple_message_client_scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* Define for the response field terminator */
+#define FIELD_TERMINATOR '\n'
+
+/* every byte of a 64 bit word */
+#define BYTES_01 0x0101010101010101ULL
+#define BYTES_7F 0x7F7F7F7F7F7F7F7FULL
+#define BYTES_80 0x8080808080808080ULL
+/* gathers the lowest bit of each byte into the highest byte */
+#define GATHER_BITS 0x0102040810204080ULL
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static void scan_scalar(const char* data, size_t length, uint64_t* masks);
+static uint64_t scan_block_scalar(const char* block);
+#ifdef SCAN_X86
+static void scan_sse2(const char* data, size_t length, uint64_t* masks);
+static void scan_avx2(const char* data, size_t length, uint64_t* masks);
+#endif
+static void scan_tail(const char* data, size_t length, uint64_t* masks,
+    uint64_t (*block)(const char* block));
+static void select_at_start(void) __attribute__((constructor));
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+
+/** The implementation in use, set before main(). */
+static void (*sscan)(const char* data, size_t length, uint64_t* masks) =
+    scan_scalar;
+static enum scan_kind sselected = SCAN_SCALAR;
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Marks the line terminators of a block of bytes.
+ *
+ * \param data bytes to be scanned.
+ * \param length of data.
+ * \param masks where to put one bit per byte, bit i of word w for byte
+ *  w * SCAN_BLOCK + i; room for (length + SCAN_BLOCK - 1) / SCAN_BLOCK
+ *  words. The bits after length are cleared.
+ */
+void scan_newlines(const char* data, size_t length, uint64_t* masks)
+{
+    sscan(data, length, masks);
+}
+
+/**
+ * \brief Chooses the implementation of scan_newlines().
+ *
+ * Not thread-safe, meant for benchmarks before any scanning.
+ *
+ * \param kind the implementation, SCAN_AUTO for the fastest one supported.
+ * \return 0 on success, -1 if the CPU does not support it.
+ */
+int scan_select(enum scan_kind kind)
+{
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (kind == SCAN_AUTO)
+    {
+        kind = __builtin_cpu_supports("avx2") ? SCAN_AVX2 :
+            __builtin_cpu_supports("sse2") ? SCAN_SSE2 : SCAN_SCALAR;
+    }
+    switch (kind)
+    {
+    case SCAN_AVX2:
+        if (!__builtin_cpu_supports("avx2"))
+        {
+            return -1;
+        }
+        sscan = scan_avx2;
+        break;
+    case SCAN_SSE2:
+        if (!__builtin_cpu_supports("sse2"))
+        {
+            return -1;
+        }
+        sscan = scan_sse2;
+        break;
+    case SCAN_SCALAR:
+    case SCAN_AUTO:
+    default:
+        kind = SCAN_SCALAR;
+        sscan = scan_scalar;
+        break;
+    }
+#else
+    if ((kind != SCAN_AUTO) && (kind != SCAN_SCALAR))
+    {
+        return -1;
+    }
+    kind = SCAN_SCALAR;
+    sscan = scan_scalar;
+#endif
+    sselected = kind;
+    return 0;
+}
+
+/**
+ * \brief Names an implementation.
+ *
+ * \param kind the implementation.
+ * \return its name.
+ */
+const char* scan_name(enum scan_kind kind)
+{
+    switch (kind)
+    {
+    case SCAN_SCALAR:
+        return "scalar";
+    case SCAN_SSE2:
+        return "sse2";
+    case SCAN_AVX2:
+        return "avx2";
+    case SCAN_AUTO:
+    default:
+        return "auto";
+    }
+}
+
+/**
+ * \brief Returns the implementation in use.
+ *
+ * \return SCAN_SCALAR, SCAN_SSE2 or SCAN_AVX2.
+ */
+enum scan_kind scan_selected(void)
+{
+    return sselected;
+}
+
+/**
+ * \brief Marks the line terminators eight bytes at a time.
+ *
+ * \param data bytes to be scanned.
+ * \param length of data.
+ * \param masks where to put the bits.
+ */
+static void scan_scalar(const char* data, size_t length, uint64_t* masks)
+{
+    size_t done;
+
+    for (done = 0; done + SCAN_BLOCK <= length; done += SCAN_BLOCK)
+    {
+        *masks++ = scan_block_scalar(data + done);
+    }
+    scan_tail(data + done, length - done, masks, scan_block_scalar);
+}
+
+/**
+ * \brief Marks the line terminators of one block in 64 bit words.
+ *
+ * A byte equal to the terminator is a zero byte after the XOR, which is
+ * found without carries between the bytes, so there are no false positives.
+ *
+ * \param block SCAN_BLOCK bytes.
+ * \return the mask of the block.
+ */
+static uint64_t scan_block_scalar(const char* block)
+{
+    uint64_t mask = 0;
+    uint64_t word;
+    uint64_t zero;
+    int i;
+
+    for (i = 0; i < SCAN_BLOCK; i += (int) sizeof(word))
+    {
+        /* unaligned and without breaking strict aliasing */
+        memcpy(&word, block + i, sizeof(word));
+        word ^= BYTES_01 * (unsigned char) FIELD_TERMINATOR;
+        /* the high bit of every byte which was zero */
+        zero = ~(((word & BYTES_7F) + BYTES_7F) | word | BYTES_7F);
+        /* little endian: byte j of the word is byte i + j of the block */
+        mask |= (((zero >> 7) * GATHER_BITS) >> 56) << i;
+    }
+    return mask;
+}
+
+#ifdef SCAN_X86
+
+/**
+ * \brief Marks the line terminators of one block by SSE2.
+ *
+ * \param block SCAN_BLOCK bytes.
+ * \return the mask of the block.
+ */
+__attribute__((target("sse2")))
+static uint64_t scan_block_sse2(const char* block)
+{
+    const __m128i terminator = _mm_set1_epi8(FIELD_TERMINATOR);
+    uint64_t mask = 0;
+    int i;
+
+    for (i = 0; i < SCAN_BLOCK; i += (int) sizeof(__m128i))
+    {
+        mask |= (uint64_t) (uint16_t) _mm_movemask_epi8(_mm_cmpeq_epi8(
+            _mm_loadu_si128((const __m128i*) (block + i)), terminator)) << i;
+    }
+    return mask;
+}
+
+/**
+ * \brief Marks the line terminators 16 bytes at a time.
+ *
+ * \param data bytes to be scanned.
+ * \param length of data.
+ * \param masks where to put the bits.
+ */
+__attribute__((target("sse2")))
+static void scan_sse2(const char* data, size_t length, uint64_t* masks)
+{
+    size_t done;
+
+    for (done = 0; done + SCAN_BLOCK <= length; done += SCAN_BLOCK)
+    {
+        *masks++ = scan_block_sse2(data + done);
+    }
+    scan_tail(data + done, length - done, masks, scan_block_sse2);
+}
+
+/**
+ * \brief Marks the line terminators of one block by AVX2.
+ *
+ * \param block SCAN_BLOCK bytes.
+ * \return the mask of the block.
+ */
+__attribute__((target("avx2")))
+static uint64_t scan_block_avx2(const char* block)
+{
+    const __m256i terminator = _mm256_set1_epi8(FIELD_TERMINATOR);
+    uint32_t low;
+    uint32_t high;
+
+    low = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+        _mm256_loadu_si256((const __m256i*) block), terminator));
+    high = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+        _mm256_loadu_si256((const __m256i*) (block + sizeof(__m256i))),
+        terminator));
+    return (uint64_t) high << 32 | low;
+}
+
+/**
+ * \brief Marks the line terminators 32 bytes at a time.
+ *
+ * \param data bytes to be scanned.
+ * \param length of data.
+ * \param masks where to put the bits.
+ */
+__attribute__((target("avx2")))
+static void scan_avx2(const char* data, size_t length, uint64_t* masks)
+{
+    size_t done;
+
+    for (done = 0; done + SCAN_BLOCK <= length; done += SCAN_BLOCK)
+    {
+        *masks++ = scan_block_avx2(data + done);
+    }
+    scan_tail(data + done, length - done, masks, scan_block_avx2);
+}
+
+#endif /* SCAN_X86 */
+
+/**
+ * \brief Marks the line terminators of the last, partial block.
+ *
+ * The bytes are copied into a zeroed block first, nothing after data is read.
+ *
+ * \param data bytes to be scanned.
+ * \param length of data, less than SCAN_BLOCK.
+ * \param masks where to put the bits.
+ * \param block scanning a complete block.
+ */
+static void scan_tail(const char* data, size_t length, uint64_t* masks,
+    uint64_t (*block)(const char* block))
+{
+    char tail[SCAN_BLOCK];
+
+    if (length == 0)
+    {
+        return;
+    }
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, data, length);
+    *masks = block(tail);
+}
+
+/**
+ * \brief Chooses the fastest implementation before main().
+ */
+static void select_at_start(void)
+{
+    (void) scan_select(SCAN_AUTO);
+}
+
+/* === EOF ================================================================== */
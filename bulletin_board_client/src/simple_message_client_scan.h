@@ -0,0 +1,58 @@
+/**
+ * @file simple_message_client_scan.h
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, scanning received bytes for line terminators.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_SCAN_H
+#define SIMPLE_MESSAGE_CLIENT_SCAN_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* bytes described by one word of a newline mask */
+#define SCAN_BLOCK 64
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/**
+ * Implementations of scan_newlines(). By default the fastest one the CPU
+ * supports is chosen when the program starts.
+ */
+enum scan_kind
+{
+    SCAN_AUTO = 0,  /**< the fastest one supported */
+    SCAN_SCALAR,    /**< eight bytes at a time in a 64 bit word */
+    SCAN_SSE2,      /**< 16 bytes at a time */
+    SCAN_AVX2       /**< 32 bytes at a time */
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+void scan_newlines(const char* data, size_t length, uint64_t* masks);
+int scan_select(enum scan_kind kind);
+const char* scan_name(enum scan_kind kind);
+enum scan_kind scan_selected(void);
+
+#endif /* SIMPLE_MESSAGE_CLIENT_SCAN_H */
+
+/* === EOF ================================================================== */
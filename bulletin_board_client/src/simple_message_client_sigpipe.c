@@ -0,0 +1,75 @@
+/**
+ * @file simple_message_client_sigpipe.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, writing to sockets and pipes without raising SIGPIPE.
+ *
+ * A write failing with EPIPE raises SIGPIPE in the thread, which is blocked
+ * and so stays pending until sigtimedwait() takes it. A SIGPIPE pending
+ * before belongs to the program and is left for it.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "simple_message_client_sigpipe.h"
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Blocks SIGPIPE in the calling thread.
+ *
+ * \param guard where to keep the signal mask.
+ */
+void sigpipe_block(struct sigpipe* guard)
+{
+    sigset_t pipe_set;
+    sigset_t pending;
+
+    (void) sigemptyset(&pipe_set);
+    (void) sigaddset(&pipe_set, SIGPIPE);
+    (void) pthread_sigmask(SIG_BLOCK, &pipe_set, &guard->old_set);
+    guard->was_pending = (sigpending(&pending) == 0) &&
+        (sigismember(&pending, SIGPIPE) == 1);
+}
+
+/**
+ * \brief Takes back a SIGPIPE raised and restores the signal mask.
+ *
+ * errno is kept.
+ *
+ * \param guard of sigpipe_block().
+ * \param raised whether the write failed with EPIPE.
+ */
+void sigpipe_restore(struct sigpipe* guard, bool raised)
+{
+    static const struct timespec no_wait = { 0, 0 };
+    sigset_t pipe_set;
+    int error = errno;
+
+    if (raised && !guard->was_pending)
+    {
+        (void) sigemptyset(&pipe_set);
+        (void) sigaddset(&pipe_set, SIGPIPE);
+        while ((sigtimedwait(&pipe_set, NULL, &no_wait) < 0) &&
+            (errno == EINTR))
+        {
+        }
+    }
+    (void) pthread_sigmask(SIG_SETMASK, &guard->old_set, NULL);
+    errno = error;
+}
+
+/* === EOF ================================================================== */
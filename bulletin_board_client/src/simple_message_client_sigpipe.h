@@ -0,0 +1,51 @@
+/**
+ * @file simple_message_client_sigpipe.h
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, writing to sockets and pipes without raising SIGPIPE.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_SIGPIPE_H
+#define SIMPLE_MESSAGE_CLIENT_SIGPIPE_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdbool.h>
+#include <signal.h>
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/**
+ * SIGPIPE held back in the calling thread around a write with no
+ * MSG_NOSIGNAL (sendfile(), splice(), writev() to a pipe). A library must
+ * not change the disposition of the signal, so it is blocked instead and
+ * one raised by the write is taken back.
+ */
+struct sigpipe
+{
+    /** signal mask before sigpipe_block() */
+    sigset_t old_set;
+    /** SIGPIPE was pending already, it is not taken back then */
+    bool was_pending;
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+void sigpipe_block(struct sigpipe* guard);
+void sigpipe_restore(struct sigpipe* guard, bool raised);
+
+#endif /* SIMPLE_MESSAGE_CLIENT_SIGPIPE_H */
+
+/* === EOF ================================================================== */
@@ -0,0 +1,560 @@
+/**
+ * @file simple_message_client_store.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, storing the files of a response.
+ *
+ * Each file is created relative to the directory of the store, so stores of
+ * different posts do not depend on the working directory of the process.
+ * Once len= is known the blocks of the file are reserved by fallocate(), its
+ * size growing with the content written. A store offloaded to a struct
+ * writer hands the files to its threads instead, and learns whether they
+ * were written when it is closed. A store streaming an archive writes the
+ * header of each file as soon as its length is known, then its content
+ * straight from the receive buffer (or spliced from the socket) and at last
+ * the zero bytes up to the next block, together with the next header, so
+ * nothing is copied and a file costs one write more than its content.
+ *
+ * A store checking a struct cache writes each file as an unnamed file in the
+ * directory (O_TMPFILE), taking its CRC-32C on the way. Once complete, a
+ * file the same as the one indexed is dropped, so neither the file nor its
+ * modification time change; any other replaces its target by rename(), so
+ * a reader sees the old or the new content and never a part of it.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+/* fallocate() */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include "simple_message_client_store.h"
+#include "simple_message_client_crc.h"
+#include "simple_message_client_sigpipe.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define HTML_FILE ".html"
+
+/* permissions of a stored file, reduced by the umask */
+#define STORE_MODE 0666
+
+/* name of a file before it replaces the one received: pid and file number */
+#define TEMP_FORMAT ".smc.%ld.%ld.tmp"
+/* path naming an unnamed file by its descriptor */
+#define PROC_FD_FORMAT "/proc/self/fd/%d"
+#define PROC_FD_SIZE 32
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static int store_begin(void* context, const char* name, long length);
+static int store_content(void* context, const char* data, size_t length);
+static int store_end(void* context);
+static int store_descriptor(void* context);
+static int archive_begin(struct store* store, const char* name, long length);
+static int open_temporary(struct store* store);
+static int replace(struct store* store);
+static void discard(struct store* store);
+static int write_all(int fd, struct iovec* parts, int count);
+static int fail(struct store* store, const char* message, ...);
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+
+/** Padding of the archive and its trailer. */
+static const char szeros[TAR_BLOCK];
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Sets up a store and the sink to pass to the parser.
+ *
+ * \param store to be set up.
+ * \param dir_fd directory the files are created in, AT_FDCWD for the
+ *  current one; stays owned by the caller.
+ * \param sink where to put the sink of the store.
+ */
+void store_init(struct store* store, int dir_fd, struct response_sink* sink)
+{
+    memset(store, 0, sizeof(*store));
+    store->dir_fd = dir_fd;
+    store->fd = -1;
+    store->archive_fd = -1;
+    sink->begin = store_begin;
+    sink->content = store_content;
+    sink->end = store_end;
+    sink->context = store;
+    sink->descriptor = store_descriptor;
+}
+
+/**
+ * \brief Lets writer threads write the files from now on.
+ *
+ * \param store set up, without a file open.
+ * \param writer running, must outlive the store.
+ */
+void store_offload(struct store* store, struct writer* writer)
+{
+    store->writer = writer;
+}
+
+/**
+ * \brief Streams the files into a tar archive from now on.
+ *
+ * \param store set up, without a file open and not offloaded.
+ * \param archive_fd where the archive is written to, a file or a pipe;
+ *  stays owned by the caller.
+ */
+void store_archive(struct store* store, int archive_fd)
+{
+    store->archive_fd = archive_fd;
+    store->archive_time = time(NULL);
+}
+
+/**
+ * \brief Leaves the files unchanged since they were indexed alone from now
+ * on.
+ *
+ * \param store set up, without a file open and neither offloaded nor
+ *  archiving.
+ * \param cache loaded, must outlive the store; the caller saves it after
+ *  store_close().
+ */
+void store_cache(struct store* store, struct cache* cache)
+{
+    store->cache = cache;
+}
+
+/**
+ * \brief Closes a file left incomplete.
+ *
+ * An offloaded store waits until the writer has closed all its files. An
+ * archive is ended by its trailer, unless a file of it is incomplete, so a
+ * broken response does not leave an archive looking complete. A file
+ * checked against a cache is dropped, its target is left as it was.
+ *
+ * \param store with or without a file open.
+ * \return 0 on success, -1 on error (see error).
+ */
+int store_close(struct store* store)
+{
+    struct iovec parts[TAR_TRAILER_BLOCKS + 1];
+    int part;
+    int close_result;
+
+    if (store->archive_fd >= 0)
+    {
+        if (store->archiving)
+        {
+            return 0;
+        }
+        parts[0].iov_base = (void*) szeros;
+        parts[0].iov_len = store->padding;
+        for (part = 1; part <= TAR_TRAILER_BLOCKS; ++part)
+        {
+            parts[part].iov_base = (void*) szeros;
+            parts[part].iov_len = sizeof(szeros);
+        }
+        store->padding = 0;
+        if (write_all(store->archive_fd, parts, TAR_TRAILER_BLOCKS + 1) < 0)
+        {
+            return fail(store, "Error on writing archive: %s",
+                strerror(errno));
+        }
+        return 0;
+    }
+    if (store->writer != NULL)
+    {
+        if (store->file != NULL)
+        {
+            writer_close(store->writer, store->file);
+            store->file = NULL;
+        }
+        return writer_wait(store->writer, &store->status, store->error,
+            sizeof(store->error));
+    }
+    if (store->fd < 0)
+    {
+        return 0;
+    }
+    if (store->cache != NULL)
+    {
+        discard(store);
+        return 0;
+    }
+    close_result = close(store->fd);
+    store->fd = -1;
+    return close_result < 0 ? fail(store, "Can not close file: %s",
+        strerror(errno)) : 0;
+}
+
+/**
+ * \brief Creates a file of the response.
+ *
+ * \param context the struct store.
+ * \param name of the file.
+ * \param length of the file from len=.
+ * \return 0 on success, else -1.
+ */
+static int store_begin(void* context, const char* name, long length)
+{
+    struct store* store = context;
+
+    store->name = name;
+    if (store->archive_fd >= 0)
+    {
+        return archive_begin(store, name, length);
+    }
+    if (store->writer != NULL)
+    {
+        store->file = writer_open(store->writer, &store->status,
+            store->dir_fd, name, length);
+        return store->file == NULL ? fail(store, "Can not create file %s: %s",
+            name, strerror(errno)) : 0;
+    }
+    if (store->cache != NULL)
+    {
+        store->fd = open_temporary(store);
+    }
+    else
+    {
+        store->fd = openat(store->dir_fd, name,
+            O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, STORE_MODE);
+    }
+    if (store->fd < 0)
+    {
+        return fail(store, "Can not create file %s: %s", name,
+            strerror(errno));
+    }
+    /* reserve the blocks at once, the size grows with the content written */
+    if (length > 0)
+    {
+        (void) fallocate(store->fd, FALLOC_FL_KEEP_SIZE, 0, length);
+    }
+    return 0;
+}
+
+/**
+ * \brief Writes content of the current file.
+ *
+ * \param context the struct store.
+ * \param data content, pointing into the receive buffer.
+ * \param length of data.
+ * \return 0 on success, else -1.
+ */
+static int store_content(void* context, const char* data, size_t length)
+{
+    struct store* store = context;
+    struct iovec part;
+
+    if (store->writer != NULL)
+    {
+        writer_write(store->writer, store->file, data, length);
+        return 0;
+    }
+    if (store->cache != NULL)
+    {
+        store->crc = crc_update(store->crc, data, length);
+        store->written += length;
+    }
+    part.iov_base = (void*) data;
+    part.iov_len = length;
+    if (store->archive_fd >= 0)
+    {
+        return write_all(store->archive_fd, &part, 1) < 0 ?
+            fail(store, "Error on writing archive: %s", strerror(errno)) : 0;
+    }
+    return write_all(store->fd, &part, 1) < 0 ?
+        fail(store, "Error on writing file %s: %s", store->name,
+        strerror(errno)) : 0;
+}
+
+/**
+ * \brief Closes the current file.
+ *
+ * \param context the struct store.
+ * \return 0 on success, else -1.
+ */
+static int store_end(void* context)
+{
+    struct store* store = context;
+    size_t html_extension = strlen(HTML_FILE);
+    size_t filename_len;
+
+    if (store->archive_fd >= 0)
+    {
+        store->archiving = false;
+    }
+    else if (store->writer != NULL)
+    {
+        writer_close(store->writer, store->file);
+        store->file = NULL;
+    }
+    else if (store->cache != NULL)
+    {
+        if (replace(store) < 0)
+        {
+            return -1;
+        }
+    }
+    else if (store_close(store) < 0)
+    {
+        return -1;
+    }
+    ++store->files;
+    filename_len = strlen(store->name);
+    if ((filename_len >= html_extension) && (strcasecmp(HTML_FILE,
+        store->name + filename_len - html_extension) == 0))
+    {
+        store->received_html = true;
+    }
+    return 0;
+}
+
+/**
+ * \brief Names the file the content may be spliced to.
+ *
+ * \param context the struct store.
+ * \return the current file or the archive, -1 if the file is written by
+ *  the writer or its checksum is taken.
+ */
+static int store_descriptor(void* context)
+{
+    const struct store* store = context;
+
+    if (store->cache != NULL)
+    {
+        return -1;
+    }
+    return store->archiving ? store->archive_fd : store->fd;
+}
+
+/**
+ * \brief Creates the file a file of the response is written to before it
+ * replaces its target.
+ *
+ * The file has no name if the file system supports O_TMPFILE, else it gets
+ * a temporary one.
+ *
+ * \param store checking a cache.
+ * \return the file, -1 on error (see errno).
+ */
+static int open_temporary(struct store* store)
+{
+    int fd;
+
+    store->crc = 0;
+    store->written = 0;
+    store->temp[0] = '\0';
+    fd = openat(store->dir_fd, ".", O_TMPFILE | O_WRONLY | O_CLOEXEC,
+        STORE_MODE);
+    if (fd >= 0)
+    {
+        return fd;
+    }
+    (void) snprintf(store->temp, sizeof(store->temp), TEMP_FORMAT,
+        (long) getpid(), store->files);
+    fd = openat(store->dir_fd, store->temp,
+        O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, STORE_MODE);
+    if (fd < 0)
+    {
+        store->temp[0] = '\0';
+    }
+    return fd;
+}
+
+/**
+ * \brief Puts a complete file in place of its target, unless it is the same.
+ *
+ * \param store checking a cache, with the file complete.
+ * \return 0 on success, else -1.
+ */
+static int replace(struct store* store)
+{
+    char path[PROC_FD_SIZE];
+    struct stat info;
+    int close_result;
+
+    if (cache_unchanged(store->cache, store->name, store->written,
+        store->crc))
+    {
+        ++store->unchanged;
+        discard(store);
+        return 0;
+    }
+    if (store->temp[0] == '\0')
+    {
+        /* an unnamed file gets a name only now */
+        (void) snprintf(store->temp, sizeof(store->temp), TEMP_FORMAT,
+            (long) getpid(), store->files);
+        (void) snprintf(path, sizeof(path), PROC_FD_FORMAT, store->fd);
+        if (linkat(AT_FDCWD, path, store->dir_fd, store->temp,
+            AT_SYMLINK_FOLLOW) < 0)
+        {
+            store->temp[0] = '\0';
+            (void) fail(store, "Can not create file %s: %s", store->name,
+                strerror(errno));
+            discard(store);
+            return -1;
+        }
+    }
+    /* a network file system may report failed writes only on close() */
+    close_result = close(store->fd);
+    store->fd = -1;
+    if ((close_result < 0) ||
+        (fstatat(store->dir_fd, store->temp, &info, 0) < 0) ||
+        (renameat(store->dir_fd, store->temp, store->dir_fd, store->name) < 0))
+    {
+        (void) fail(store, "Can not replace file %s: %s", store->name,
+            strerror(errno));
+        discard(store);
+        return -1;
+    }
+    store->temp[0] = '\0';
+    if (cache_put(store->cache, store->name, store->written, store->crc,
+        &info) < 0)
+    {
+        return fail(store, "Can not index file %s: %s", store->name,
+            strerror(errno));
+    }
+    return 0;
+}
+
+/**
+ * \brief Drops the file written instead of the target.
+ *
+ * \param store checking a cache.
+ */
+static void discard(struct store* store)
+{
+    if (store->fd >= 0)
+    {
+        (void) close(store->fd);
+        store->fd = -1;
+    }
+    if (store->temp[0] != '\0')
+    {
+        (void) unlinkat(store->dir_fd, store->temp, 0);
+        store->temp[0] = '\0';
+    }
+}
+
+/**
+ * \brief Starts a file in the archive.
+ *
+ * The padding of the previous file goes out with the headers of this one.
+ *
+ * \param store streaming an archive.
+ * \param name of the file.
+ * \param length of the file from len=.
+ * \return 0 on success, else -1.
+ */
+static int archive_begin(struct store* store, const char* name, long length)
+{
+    char headers[TAR_HEADERS_SIZE];
+    struct iovec parts[2];
+    size_t size;
+
+    size = tar_headers(headers, sizeof(headers), name, (uint64_t) length,
+        store->archive_time);
+    if (size == 0)
+    {
+        return fail(store, "Filename too long for the archive: %s", name);
+    }
+    parts[0].iov_base = (void*) szeros;
+    parts[0].iov_len = store->padding;
+    parts[1].iov_base = headers;
+    parts[1].iov_len = size;
+    if (write_all(store->archive_fd, parts, 2) < 0)
+    {
+        return fail(store, "Error on writing archive: %s", strerror(errno));
+    }
+    store->padding = tar_padding((uint64_t) length);
+    store->archiving = true;
+    return 0;
+}
+
+/**
+ * \brief Writes all parts, however many writes it takes.
+ *
+ * The archive may be a pipe, so SIGPIPE is held back meanwhile.
+ *
+ * \param fd written to.
+ * \param parts to be written, consumed.
+ * \param count of parts.
+ * \return 0 on success, -1 on error (see errno).
+ */
+static int write_all(int fd, struct iovec* parts, int count)
+{
+    struct sigpipe guard;
+    ssize_t written;
+
+    while (count > 0)
+    {
+        sigpipe_block(&guard);
+        written = writev(fd, parts, count);
+        sigpipe_restore(&guard, (written < 0) && (errno == EPIPE));
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        while ((count > 0) && ((size_t) written >= parts->iov_len))
+        {
+            written -= (ssize_t) parts->iov_len;
+            ++parts;
+            --count;
+        }
+        if (count > 0)
+        {
+            parts->iov_base = (char*) parts->iov_base + written;
+            parts->iov_len -= (size_t) written;
+        }
+    }
+    return 0;
+}
+
+/**
+ * \brief Takes note why storing failed.
+ *
+ * Printout can be formatted like printf.
+ *
+ * \param store failing.
+ * \param message describing the failure.
+ * \return -1.
+ */
+static int fail(struct store* store, const char* message, ...)
+{
+    va_list args;
+
+    va_start(args, message);
+    (void) vsnprintf(store->error, sizeof(store->error), message, args);
+    va_end(args);
+    return -1;
+}
+
+/* === EOF ================================================================== */
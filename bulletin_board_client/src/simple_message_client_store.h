@@ -0,0 +1,101 @@
+/**
+ * @file simple_message_client_store.h
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, storing the files of a response.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_STORE_H
+#define SIMPLE_MESSAGE_CLIENT_STORE_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdbool.h>
+/* AT_FDCWD */
+#include <fcntl.h>
+#include "simple_message_client_response.h"
+#include "simple_message_client_writer.h"
+#include "simple_message_client_tar.h"
+#include "simple_message_client_cache.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* size of the error description of a store */
+#define STORE_ERROR_SIZE 160
+
+/* size of the name of a file before it replaces the one received */
+#define STORE_TEMP_SIZE 48
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/**
+ * Sink storing the files of a response in a directory, or streaming them
+ * into a tar archive. Large file content may be spliced to the files or the
+ * archive, unless the files are written by a struct writer or checked
+ * against a struct cache.
+ */
+struct store
+{
+    /** directory the files are created in, AT_FDCWD for the current one */
+    int dir_fd;
+    /** file being written, -1 if none or written by the writer */
+    int fd;
+    /** writer threads writing the files, NULL to write them directly */
+    struct writer* writer;
+    /** file handed over to the writer, NULL if none */
+    struct writer_file* file;
+    /** the files handed over to the writer */
+    struct writer_status status;
+    /** archive the files are streamed to instead, -1 if none */
+    int archive_fd;
+    /** modification time of the archived files */
+    time_t archive_time;
+    /** zero bytes owed to the archive after the content of the last file */
+    size_t padding;
+    /** a file of the archive has been begun and not ended */
+    bool archiving;
+    /** index of the files stored before, NULL to write every file */
+    struct cache* cache;
+    /** CRC-32C of the current file so far */
+    uint32_t crc;
+    /** bytes of the current file so far */
+    uint64_t written;
+    /** name of the current file until it replaces its target, empty if none */
+    char temp[STORE_TEMP_SIZE];
+    /** files left alone as they were unchanged */
+    long unchanged;
+    /** name of the file */
+    const char* name;
+    /** files stored */
+    long files;
+    /** an html file has been stored */
+    bool received_html;
+    /** describes why storing failed, empty if it did not */
+    char error[STORE_ERROR_SIZE];
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+void store_init(struct store* store, int dir_fd, struct response_sink* sink);
+void store_offload(struct store* store, struct writer* writer);
+void store_archive(struct store* store, int archive_fd);
+void store_cache(struct store* store, struct cache* cache);
+int store_close(struct store* store);
+
+#endif /* SIMPLE_MESSAGE_CLIENT_STORE_H */
+
+/* === EOF ================================================================== */
@@ -0,0 +1,269 @@
+/**
+ * @file simple_message_client_tar.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, headers of a tar archive.
+ *
+ * The files are written as POSIX ustar entries. A name longer than the 100
+ * bytes of a ustar header, or a length beyond its 11 octal digits, is put
+ * into a pax extended header before the entry, as POSIX.1-2001 defines it;
+ * the ustar header then holds the name cut off. GNU tar, bsdtar and cpio -H
+ * ustar read both.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "simple_message_client_tar.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* fields of a ustar header: offset and size */
+#define NAME_OFFSET 0
+#define NAME_SIZE 100
+#define MODE_OFFSET 100
+#define MODE_SIZE 8
+#define UID_OFFSET 108
+#define GID_OFFSET 116
+#define ID_SIZE 8
+#define SIZE_OFFSET 124
+#define SIZE_SIZE 12
+#define MTIME_OFFSET 136
+#define MTIME_SIZE 12
+#define CHKSUM_OFFSET 148
+#define CHKSUM_SIZE 8
+#define TYPEFLAG_OFFSET 156
+#define MAGIC_OFFSET 257
+#define VERSION_OFFSET 263
+
+#define MAGIC "ustar"
+#define VERSION "00"
+
+/* type of a regular file and of a pax extended header */
+#define TYPE_FILE '0'
+#define TYPE_PAX 'x'
+
+/* permissions of an archived file */
+#define FILE_MODE 0644
+
+/* name of the pax extended headers */
+#define PAX_NAME "PaxHeader"
+
+/* the largest length 11 octal digits hold */
+#define MAX_USTAR_LENGTH 077777777777ULL
+
+/* decimal digits of a 64 bit number */
+#define NUMBER_SIZE 21
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static void fill_header(char* header, const char* name, uint64_t length,
+    time_t mtime, char type);
+static void put_octal(char* field, size_t size, uint64_t value);
+static size_t pax_record(char* records, size_t room, const char* keyword,
+    const char* value);
+static size_t digits(size_t number);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Builds the headers of a file.
+ *
+ * \param headers where to put the headers.
+ * \param size of headers, TAR_HEADERS_SIZE suits a name of up to about
+ *  1000 bytes.
+ * \param name of the file.
+ * \param length of the content of the file.
+ * \param mtime modification time of the file.
+ * \return bytes of the headers, a multiple of TAR_BLOCK; 0 if they do not
+ *  fit into headers.
+ */
+size_t tar_headers(char* headers, size_t size, const char* name,
+    uint64_t length, time_t mtime)
+{
+    char number[NUMBER_SIZE];
+    size_t records = 0;
+    size_t record;
+    size_t extended;
+
+    if (size < TAR_BLOCK)
+    {
+        return 0;
+    }
+    if ((strlen(name) <= NAME_SIZE) && (length <= MAX_USTAR_LENGTH))
+    {
+        fill_header(headers, name, length, mtime, TYPE_FILE);
+        return TAR_BLOCK;
+    }
+
+    /* the records follow the extended header, the entry follows them */
+    if (size < 3 * TAR_BLOCK)
+    {
+        return 0;
+    }
+    if (strlen(name) > NAME_SIZE)
+    {
+        record = pax_record(headers + TAR_BLOCK, size - 2 * TAR_BLOCK, "path",
+            name);
+        if (record == 0)
+        {
+            return 0;
+        }
+        records += record;
+    }
+    if (length > MAX_USTAR_LENGTH)
+    {
+        (void) snprintf(number, sizeof(number), "%llu",
+            (unsigned long long) length);
+        record = pax_record(headers + TAR_BLOCK + records,
+            size - 2 * TAR_BLOCK - records, "size", number);
+        if (record == 0)
+        {
+            return 0;
+        }
+        records += record;
+        /* pax readers take the size from the record */
+        length = 0;
+    }
+    extended = TAR_BLOCK + records + tar_padding(records);
+    if (extended + TAR_BLOCK > size)
+    {
+        return 0;
+    }
+    memset(headers + TAR_BLOCK + records, 0, tar_padding(records));
+    fill_header(headers, PAX_NAME, records, mtime, TYPE_PAX);
+    fill_header(headers + extended, name, length, mtime, TYPE_FILE);
+    return extended + TAR_BLOCK;
+}
+
+/**
+ * \brief Tells how much padding follows the content of a file.
+ *
+ * \param length of the content.
+ * \return zero bytes up to the next block.
+ */
+size_t tar_padding(uint64_t length)
+{
+    return (size_t) ((TAR_BLOCK - length % TAR_BLOCK) % TAR_BLOCK);
+}
+
+/**
+ * \brief Fills a ustar header.
+ *
+ * \param header TAR_BLOCK bytes.
+ * \param name of the entry, cut off after NAME_SIZE bytes.
+ * \param length of the content, at most MAX_USTAR_LENGTH.
+ * \param mtime modification time.
+ * \param type of the entry.
+ */
+static void fill_header(char* header, const char* name, uint64_t length,
+    time_t mtime, char type)
+{
+    const unsigned char* byte;
+    unsigned long checksum = 0;
+    size_t name_length = strlen(name);
+
+    memset(header, 0, TAR_BLOCK);
+    memcpy(header + NAME_OFFSET, name,
+        name_length < NAME_SIZE ? name_length : NAME_SIZE);
+    put_octal(header + MODE_OFFSET, MODE_SIZE, FILE_MODE);
+    put_octal(header + UID_OFFSET, ID_SIZE, 0);
+    put_octal(header + GID_OFFSET, ID_SIZE, 0);
+    put_octal(header + SIZE_OFFSET, SIZE_SIZE, length);
+    put_octal(header + MTIME_OFFSET, MTIME_SIZE,
+        mtime > 0 ? (uint64_t) mtime : 0);
+    header[TYPEFLAG_OFFSET] = type;
+    memcpy(header + MAGIC_OFFSET, MAGIC, sizeof(MAGIC));
+    memcpy(header + VERSION_OFFSET, VERSION, strlen(VERSION));
+
+    /* the checksum is taken with its own field filled by spaces */
+    memset(header + CHKSUM_OFFSET, ' ', CHKSUM_SIZE);
+    for (byte = (const unsigned char*) header;
+        byte < (const unsigned char*) header + TAR_BLOCK; ++byte)
+    {
+        checksum += *byte;
+    }
+    (void) snprintf(header + CHKSUM_OFFSET, CHKSUM_SIZE - 1, "%06lo",
+        checksum);
+}
+
+/**
+ * \brief Puts a number into an octal field of a header.
+ *
+ * \param field of the header.
+ * \param size of the field, the last byte is the terminating '\0'.
+ * \param value fitting into size - 1 octal digits.
+ */
+static void put_octal(char* field, size_t size, uint64_t value)
+{
+    size_t digit;
+
+    field[size - 1] = '\0';
+    for (digit = size - 1; digit > 0; --digit)
+    {
+        field[digit - 1] = (char) ('0' + (value & 7));
+        value >>= 3;
+    }
+}
+
+/**
+ * \brief Writes a pax record "<length> <keyword>=<value>\n".
+ *
+ * \param records where to put the record.
+ * \param room bytes available at records.
+ * \param keyword of the record.
+ * \param value of the record.
+ * \return length of the record, 0 if it does not fit.
+ */
+static size_t pax_record(char* records, size_t room, const char* keyword,
+    const char* value)
+{
+    /* the length counts its own digits */
+    size_t rest = strlen(keyword) + strlen(value) + 3;
+    size_t length = rest + digits(rest);
+
+    if (digits(length) > digits(rest))
+    {
+        ++length;
+    }
+    if (length >= room)
+    {
+        return 0;
+    }
+    (void) snprintf(records, room, "%zu %s=%s\n", length, keyword, value);
+    return length;
+}
+
+/**
+ * \brief Counts the decimal digits of a number.
+ *
+ * \param number to be written.
+ * \return its digits.
+ */
+static size_t digits(size_t number)
+{
+    size_t count = 1;
+
+    while (number >= 10)
+    {
+        number /= 10;
+        ++count;
+    }
+    return count;
+}
+
+/* === EOF ================================================================== */
@@ -0,0 +1,48 @@
+/**
+ * @file simple_message_client_tar.h
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, headers of a tar archive.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_TAR_H
+#define SIMPLE_MESSAGE_CLIENT_TAR_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* size of a header, the content is padded to a multiple of it */
+#define TAR_BLOCK 512
+
+/* zero blocks ending an archive */
+#define TAR_TRAILER_BLOCKS 2
+
+/* room for the headers of a file with a name of up to about 1000 bytes */
+#define TAR_HEADERS_SIZE (4 * TAR_BLOCK)
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+size_t tar_headers(char* headers, size_t size, const char* name,
+    uint64_t length, time_t mtime);
+size_t tar_padding(uint64_t length);
+
+#endif /* SIMPLE_MESSAGE_CLIENT_TAR_H */
+
+/* === EOF ================================================================== */
@@ -0,0 +1,535 @@
+/**
+ * @file simple_message_client_writer.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, writing received files on threads of their own.
+ *
+ * On network filesystems a write() may wait for the server and a close()
+ * flushes the whole file, tens of milliseconds during which the socket is
+ * not read and the send buffer of the bulletin board server fills up. So the
+ * receiving thread only copies the content into buffers of a pool and queues
+ * them; writer threads open, write and close the files. All jobs of a file go
+ * to the same thread, in order, and consecutive files to different threads,
+ * so a file is closed while the next one is written. A failure is kept in
+ * the status of the owner of the file and reported by writer_wait().
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+/* fallocate() */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "simple_message_client_writer.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* permissions of a stored file, reduced by the umask */
+#define STORE_MODE 0666
+
+/* fewest buffers: one being filled and one being written */
+#define MIN_BUFFERS 2
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/** A buffer of the pool, queued as a job for a writer thread. */
+struct writer_job
+{
+    /** next job of the pool or queue */
+    struct writer_job* next;
+    /** the file */
+    struct writer_file* file;
+    /** the buffer, WRITER_BUFFER bytes */
+    char* data;
+    /** bytes in data */
+    size_t length;
+    /** data holds the name of the file to be opened */
+    bool open;
+    /** the file is closed after data has been written */
+    bool close;
+};
+
+/** A file handed over to a writer thread. */
+struct writer_file
+{
+    /** directory the file is created in */
+    int dir_fd;
+    /** the file, -1 until opened or if that failed */
+    int fd;
+    /** length from len=, reserved when the file is opened */
+    long length;
+    /** queue of the thread writing the file */
+    struct writer_queue* queue;
+    /** buffer being filled by the receiving thread, NULL if none */
+    struct writer_job* current;
+    /** whom a failure is reported to */
+    struct writer_status* status;
+    /** opening or writing failed, the rest of the file is dropped */
+    bool failed;
+};
+
+/** What a writer thread is given. */
+struct writer_start
+{
+    struct writer* writer;
+    struct writer_queue* queue;
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static void* run_thread(void* argument);
+static void run_job(struct writer* writer, struct writer_job* job);
+static struct writer_job* take_buffer(struct writer* writer);
+static void submit(struct writer* writer, struct writer_job* job);
+static void report(struct writer* writer, struct writer_file* file,
+    const char* message, ...);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Starts the writer threads.
+ *
+ * \param writer to be set up.
+ * \param threads number of writer threads, at least one.
+ * \param queued_bytes how many bytes may be queued at most, rounded to
+ *  buffers.
+ * \return 0 on success, -1 on error (see errno).
+ */
+int writer_init(struct writer* writer, int threads, size_t queued_bytes)
+{
+    struct writer_start* start;
+    size_t buffers = queued_bytes / WRITER_BUFFER;
+    size_t i;
+    int error;
+
+    memset(writer, 0, sizeof(*writer));
+    if (buffers < MIN_BUFFERS)
+    {
+        buffers = MIN_BUFFERS;
+    }
+    writer->queues = calloc((size_t) threads, sizeof(*writer->queues));
+    writer->jobs = calloc(buffers, sizeof(*writer->jobs));
+    writer->memory = malloc(buffers * WRITER_BUFFER);
+    if ((writer->queues == NULL) || (writer->jobs == NULL) ||
+        (writer->memory == NULL))
+    {
+        free(writer->queues);
+        free(writer->jobs);
+        free(writer->memory);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (i = 0; i < buffers; ++i)
+    {
+        writer->jobs[i].data = writer->memory + i * WRITER_BUFFER;
+        writer->jobs[i].next = writer->pool;
+        writer->pool = &writer->jobs[i];
+    }
+    (void) pthread_mutex_init(&writer->lock, NULL);
+    (void) pthread_cond_init(&writer->space, NULL);
+    (void) pthread_cond_init(&writer->closed, NULL);
+
+    for (; writer->threads < threads; ++writer->threads)
+    {
+        start = malloc(sizeof(*start));
+        if (start == NULL)
+        {
+            writer_free(writer);
+            errno = ENOMEM;
+            return -1;
+        }
+        start->writer = writer;
+        start->queue = &writer->queues[writer->threads];
+        (void) pthread_cond_init(&start->queue->ready, NULL);
+        error = pthread_create(&start->queue->thread, NULL, run_thread,
+            start);
+        if (error != 0)
+        {
+            (void) pthread_cond_destroy(&start->queue->ready);
+            free(start);
+            writer_free(writer);
+            errno = error;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * \brief Waits for the jobs queued and stops the writer threads.
+ *
+ * \param writer set up by writer_init().
+ */
+void writer_free(struct writer* writer)
+{
+    int i;
+
+    (void) pthread_mutex_lock(&writer->lock);
+    writer->stopping = true;
+    for (i = 0; i < writer->threads; ++i)
+    {
+        (void) pthread_cond_signal(&writer->queues[i].ready);
+    }
+    (void) pthread_mutex_unlock(&writer->lock);
+    for (i = 0; i < writer->threads; ++i)
+    {
+        (void) pthread_join(writer->queues[i].thread, NULL);
+        (void) pthread_cond_destroy(&writer->queues[i].ready);
+    }
+    (void) pthread_cond_destroy(&writer->closed);
+    (void) pthread_cond_destroy(&writer->space);
+    (void) pthread_mutex_destroy(&writer->lock);
+    free(writer->queues);
+    free(writer->jobs);
+    free(writer->memory);
+    memset(writer, 0, sizeof(*writer));
+}
+
+/**
+ * \brief Hands a file over to the next writer thread.
+ *
+ * \param writer running.
+ * \param status of the owner of the file, counting it as pending.
+ * \param dir_fd directory the file is created in.
+ * \param name of the file, shorter than WRITER_BUFFER.
+ * \param length of the file from len=.
+ * \return the file, NULL on error (see errno).
+ */
+struct writer_file* writer_open(struct writer* writer,
+        struct writer_status* status, int dir_fd, const char* name,
+        long length)
+{
+    struct writer_file* file;
+    struct writer_job* job;
+    size_t name_length = strlen(name) + 1;
+
+    if (name_length > WRITER_BUFFER)
+    {
+        errno = ENAMETOOLONG;
+        return NULL;
+    }
+    file = malloc(sizeof(*file));
+    if (file == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+    file->dir_fd = dir_fd;
+    file->fd = -1;
+    file->length = length;
+    file->current = NULL;
+    file->status = status;
+    file->failed = false;
+
+    job = take_buffer(writer);
+    (void) pthread_mutex_lock(&writer->lock);
+    file->queue = &writer->queues[writer->next];
+    writer->next = (writer->next + 1) % writer->threads;
+    ++status->pending;
+    (void) pthread_mutex_unlock(&writer->lock);
+
+    job->file = file;
+    memcpy(job->data, name, name_length);
+    job->length = name_length;
+    job->open = true;
+    submit(writer, job);
+    return file;
+}
+
+/**
+ * \brief Queues content of a file.
+ *
+ * The content is copied, so the caller may reuse its buffer at once. Waits
+ * while all buffers of the pool are queued.
+ *
+ * \param writer running.
+ * \param file opened by writer_open().
+ * \param data content.
+ * \param length of data.
+ */
+void writer_write(struct writer* writer, struct writer_file* file,
+        const char* data, size_t length)
+{
+    struct writer_job* job;
+    size_t take;
+
+    while (length > 0)
+    {
+        if (file->current == NULL)
+        {
+            file->current = take_buffer(writer);
+            file->current->file = file;
+        }
+        job = file->current;
+        take = WRITER_BUFFER - job->length;
+        if (take > length)
+        {
+            take = length;
+        }
+        memcpy(job->data + job->length, data, take);
+        job->length += take;
+        data += take;
+        length -= take;
+        if (job->length == WRITER_BUFFER)
+        {
+            file->current = NULL;
+            submit(writer, job);
+        }
+    }
+}
+
+/**
+ * \brief Queues the close of a file, after its content.
+ *
+ * The file must not be used any more, it is released by its writer thread.
+ *
+ * \param writer running.
+ * \param file opened by writer_open().
+ */
+void writer_close(struct writer* writer, struct writer_file* file)
+{
+    struct writer_job* job = file->current;
+
+    if (job == NULL)
+    {
+        job = take_buffer(writer);
+        job->file = file;
+    }
+    file->current = NULL;
+    job->close = true;
+    submit(writer, job);
+}
+
+/**
+ * \brief Waits until all files of an owner are closed.
+ *
+ * \param writer running.
+ * \param status of the owner.
+ * \param error where to put the first failure.
+ * \param error_size size of error.
+ * \return 0 if all files were written, -1 on failure.
+ */
+int writer_wait(struct writer* writer, struct writer_status* status,
+        char* error, size_t error_size)
+{
+    int result = 0;
+
+    (void) pthread_mutex_lock(&writer->lock);
+    while (status->pending > 0)
+    {
+        (void) pthread_cond_wait(&writer->closed, &writer->lock);
+    }
+    if (status->error[0] != '\0')
+    {
+        (void) snprintf(error, error_size, "%s", status->error);
+        result = -1;
+    }
+    (void) pthread_mutex_unlock(&writer->lock);
+    return result;
+}
+
+/**
+ * \brief Does the jobs of one queue until the writer stops.
+ *
+ * \param argument the struct writer_start, freed.
+ * \return NULL.
+ */
+static void* run_thread(void* argument)
+{
+    struct writer_start* start = argument;
+    struct writer* writer = start->writer;
+    struct writer_queue* queue = start->queue;
+    struct writer_job* job;
+
+    free(start);
+    (void) pthread_mutex_lock(&writer->lock);
+    for (;;)
+    {
+        while ((queue->head == NULL) && !writer->stopping)
+        {
+            (void) pthread_cond_wait(&queue->ready, &writer->lock);
+        }
+        job = queue->head;
+        if (job == NULL)
+        {
+            break;
+        }
+        queue->head = job->next;
+        if (queue->head == NULL)
+        {
+            queue->tail = NULL;
+        }
+        (void) pthread_mutex_unlock(&writer->lock);
+        run_job(writer, job);
+        (void) pthread_mutex_lock(&writer->lock);
+    }
+    (void) pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+/**
+ * \brief Opens, writes or closes a file and returns the buffer to the pool.
+ *
+ * \param writer running.
+ * \param job taken from the queue, returned to the pool.
+ */
+static void run_job(struct writer* writer, struct writer_job* job)
+{
+    struct writer_file* file = job->file;
+    const char* data = job->data;
+    size_t length = job->length;
+    ssize_t written;
+    bool close_file = job->close;
+
+    if (job->open)
+    {
+        file->fd = openat(file->dir_fd, data,
+            O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, STORE_MODE);
+        if (file->fd < 0)
+        {
+            report(writer, file, "Can not create file %s: %s", data,
+                strerror(errno));
+        }
+        else if (file->length > 0)
+        {
+            /* reserve the blocks at once, the size grows with the content */
+            (void) fallocate(file->fd, FALLOC_FL_KEEP_SIZE, 0, file->length);
+        }
+        length = 0;
+    }
+    while ((length > 0) && !file->failed)
+    {
+        written = write(file->fd, data, length);
+        if (written < 0)
+        {
+            if (errno != EINTR)
+            {
+                report(writer, file, "Error on writing file: %s",
+                    strerror(errno));
+            }
+            continue;
+        }
+        data += written;
+        length -= (size_t) written;
+    }
+    if (close_file && (file->fd >= 0) && (close(file->fd) < 0))
+    {
+        report(writer, file, "Can not close file: %s", strerror(errno));
+    }
+
+    (void) pthread_mutex_lock(&writer->lock);
+    job->length = 0;
+    job->open = false;
+    job->close = false;
+    job->file = NULL;
+    job->next = writer->pool;
+    writer->pool = job;
+    (void) pthread_cond_signal(&writer->space);
+    if (close_file)
+    {
+        --file->status->pending;
+        (void) pthread_cond_broadcast(&writer->closed);
+    }
+    (void) pthread_mutex_unlock(&writer->lock);
+    if (close_file)
+    {
+        free(file);
+    }
+}
+
+/**
+ * \brief Takes a buffer from the pool, waiting until one is returned.
+ *
+ * \param writer running.
+ * \return an empty buffer.
+ */
+static struct writer_job* take_buffer(struct writer* writer)
+{
+    struct writer_job* job;
+
+    (void) pthread_mutex_lock(&writer->lock);
+    while (writer->pool == NULL)
+    {
+        (void) pthread_cond_wait(&writer->space, &writer->lock);
+    }
+    job = writer->pool;
+    writer->pool = job->next;
+    (void) pthread_mutex_unlock(&writer->lock);
+    job->next = NULL;
+    return job;
+}
+
+/**
+ * \brief Queues a job for the thread of its file.
+ *
+ * \param writer running.
+ * \param job to be done.
+ */
+static void submit(struct writer* writer, struct writer_job* job)
+{
+    struct writer_queue* queue = job->file->queue;
+
+    job->next = NULL;
+    (void) pthread_mutex_lock(&writer->lock);
+    if (queue->tail == NULL)
+    {
+        queue->head = job;
+    }
+    else
+    {
+        queue->tail->next = job;
+    }
+    queue->tail = job;
+    (void) pthread_cond_signal(&queue->ready);
+    (void) pthread_mutex_unlock(&writer->lock);
+}
+
+/**
+ * \brief Takes note that a file failed, the rest of it is dropped.
+ *
+ * Only the first failure of an owner is kept. Printout can be formatted like
+ * printf.
+ *
+ * \param writer running.
+ * \param file failing.
+ * \param message describing the failure.
+ */
+static void report(struct writer* writer, struct writer_file* file,
+    const char* message, ...)
+{
+    va_list args;
+
+    file->failed = true;
+    (void) pthread_mutex_lock(&writer->lock);
+    if (file->status->error[0] == '\0')
+    {
+        va_start(args, message);
+        (void) vsnprintf(file->status->error, sizeof(file->status->error),
+            message, args);
+        va_end(args);
+    }
+    (void) pthread_mutex_unlock(&writer->lock);
+}
+
+/* === EOF ================================================================== */
@@ -0,0 +1,109 @@
+/**
+ * @file simple_message_client_writer.h
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, writing received files on threads of their own.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+#ifndef SIMPLE_MESSAGE_CLIENT_WRITER_H
+#define SIMPLE_MESSAGE_CLIENT_WRITER_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* size of the error description of a writer status */
+#define WRITER_ERROR_SIZE 160
+
+/* bytes of each buffer of the pool */
+#define WRITER_BUFFER 65536
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+struct writer_job;
+struct writer_file;
+
+/** Queue of the jobs of one writer thread. */
+struct writer_queue
+{
+    /** the thread */
+    pthread_t thread;
+    /** first job to be done, NULL if none */
+    struct writer_job* head;
+    /** last job to be done */
+    struct writer_job* tail;
+    /** signalled when a job is queued */
+    pthread_cond_t ready;
+};
+
+/**
+ * Writer threads taking the disk I/O off the thread receiving the files. The
+ * content is copied into buffers of a pool and queued; each file is written,
+ * in order, by one thread, the files are spread over the threads. When all
+ * buffers are queued the receiving thread waits, which caps the bytes queued.
+ */
+struct writer
+{
+    /** guards everything below and the writer status of every file */
+    pthread_mutex_t lock;
+    /** signalled when a buffer is returned to the pool */
+    pthread_cond_t space;
+    /** signalled when a file is closed */
+    pthread_cond_t closed;
+    /** one queue per thread */
+    struct writer_queue* queues;
+    /** number of threads */
+    int threads;
+    /** thread of the next file opened */
+    int next;
+    /** buffers free */
+    struct writer_job* pool;
+    /** all jobs and their buffers */
+    struct writer_job* jobs;
+    char* memory;
+    /** the threads are told to stop once their queue is empty */
+    bool stopping;
+};
+
+/** What happened to the files of one owner, guarded by the writer lock. */
+struct writer_status
+{
+    /** files opened and not closed yet */
+    long pending;
+    /** the first failure, empty if none */
+    char error[WRITER_ERROR_SIZE];
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int writer_init(struct writer* writer, int threads, size_t queued_bytes);
+void writer_free(struct writer* writer);
+struct writer_file* writer_open(struct writer* writer,
+    struct writer_status* status, int dir_fd, const char* name, long length);
+void writer_write(struct writer* writer, struct writer_file* file,
+    const char* data, size_t length);
+void writer_close(struct writer* writer, struct writer_file* file);
+int writer_wait(struct writer* writer, struct writer_status* status,
+    char* error, size_t error_size);
+
+#endif /* SIMPLE_MESSAGE_CLIENT_WRITER_H */
+
+/* === EOF ================================================================== */
@@ -0,0 +1,55 @@
+/**
+ * @file smc.h
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Client, interface of libsmc, the client as a library.
+ *
+ * libsmc posts messages to a bulletin board server without blocking and
+ * without global state, so a program can post any number of messages at
+ * the same time from its own event loop:
+ *
+ *  - struct race connects to the first address of the server answering,
+ *  - struct post sends a request on the connection and receives the
+ *    response, passing each file to a struct response_sink,
+ *  - struct store is a sink storing the files in a directory, optionally
+ *    leaving the disk I/O to the threads of a struct writer, or streaming
+ *    them into a tar archive,
+ *  - struct cache indexes the files a store wrote, so a store checking it
+ *    leaves files received unchanged alone and replaces the others
+ *    atomically.
+ *
+ * Every step is driven by the readiness of descriptors the caller waits for:
+ * the sockets of race->attempts, race_timeout() and post_events(). Errors are
+ * described in the structures, nothing is printed and nothing exits. Only an
+ * offloaded store waits: while the writer has queued all its buffers, and in
+ * store_close() until its files are written.
+ *
+ * No write raises SIGPIPE, so a server or an archive reader closing early is
+ * an error like any other; the disposition of SIGPIPE is left to the caller.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+#ifndef SMC_H
+#define SMC_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include "simple_message_client_response.h"
+#include "simple_message_client_post.h"
+#include "simple_message_client_race.h"
+#include "simple_message_client_store.h"
+#include "simple_message_client_writer.h"
+#include "simple_message_client_tar.h"
+#include "simple_message_client_cache.h"
+#include "simple_message_client_crc.h"
+
+#endif /* SMC_H */
+
+/* === EOF ================================================================== */
@@ -20,6 +20,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <assert.h>
+#include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/wait.h>
 #include <netdb.h>
@@ -29,6 +30,7 @@
 #include <limits.h>
 #include <stdarg.h>
 #include <getopt.h>
+#include "simple_message_server.h"
 
 /*
  * ---------------------------------------------------------------- defines --
@@ -37,13 +39,20 @@
 /* decimal format base for strtol */
 #define INPUT_NUM_BASE 10
 
-#define BUSINESS_LOGIC "simple_message_server_logic"
-#define BUSINESS_LOGIC_PATH "/usr/local/bin/simple_message_server_logic"
-
 #define LOWER_PORT_RANGE 0
 #define UPPER_PORT_RANGE 65535
-/* handle up to max connections */
-#define MAX_CONNECTION 15
+/* default length of the accept queue, the kernel caps it at somaxconn */
+#define DEFAULT_BACKLOG SOMAXCONN
+#define MAX_BACKLOG 65535
+/* default wait of a queued connection for a child in milliseconds */
+#define DEFAULT_QUEUE_WAIT 1000
+#define MAX_QUEUE_WAIT 60000
+/* default upper bound of the worker pool as multiple of its minimum size */
+#define WORKER_GROWTH_FACTOR 4
+/* period of the housekeeping in milliseconds */
+#define HOUSEKEEPING_MS 1000
+/* default number of threads serving a plugin */
+#define PLUGIN_THREADS 8
 
 /*
  * ---------------------------------------------------------------- globals --
@@ -53,17 +62,30 @@
  * ----------------------------------------------------------------- static --
  */
 static const char* sprogram_arg0 = NULL;
+/** Business logic executed per connection. */
+static const char* slogic_path = BUSINESS_LOGIC_PATH;
+
+/** Waits for the children by signalfd. */
+static struct reactor_handler schildren;
+/** Accepts the connections on the listening socket. */
+static struct reactor_handler slistener;
+/** Periodic housekeeping. */
+static struct reactor_handler shousekeeping;
 
 /*
  * ------------------------------------------------------------- prototypes --
  */
-static void print_error(const char* message, ...);
 static void print_usage(FILE* file, const char* message, int exit_code);
-static void param_check(int argc, const char* const argv[], uint16_t* port_nr);
-static int register_signal_handler(void);
-static void kill_child_handler(int signal);
-static int setup_connection(uint16_t port_nr);
+static void param_check(int argc, const char* const argv[],
+    struct server_config* config);
+static long convert_number(const char* text, long lower, long upper,
+    const char* what);
+static int register_child_handler(void);
+static bool reap_children(struct reactor_handler* handler, uint32_t events);
 static int do_connection(int socket_fd);
+static void accept_connection(struct reactor_handler* handler,
+    int connection_fd);
+static bool housekeeping(struct reactor_handler* handler, uint32_t events);
 /*
  * -------------------------------------------------------------- functions --
  */
@@ -81,20 +103,58 @@ static int do_connection(int socket_fd);
  */
 int main(int argc, const char* const argv[])
 {
-    /* server port with type short int which is needed by the htons function */
-    uint16_t server_port;
+    struct server_config config;
     int socket_fd;
 
     sprogram_arg0 = argv[0];  /* must contain the filename anyway */
 
-    /* calling the getopt function to get server_port*/
-    param_check(argc, argv, &server_port);
+    /* calling the getopt function to get the server configuration */
+    param_check(argc, argv, &config);
+    slogic_path = config.logic;
 
-    if ((socket_fd = setup_connection(server_port)) < 0)
+    /* the metrics are shared with all processes forked from here on */
+    if (metrics_init(&config) < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    /* with acceptors, the rest of main() runs in every acceptor */
+    socket_fd = config.acceptors > 0 ? do_acceptors(&config) :
+        setup_connection(config.port, config.backlog, false);
+    if (socket_fd < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    if ((reactor_init(config.io_uring) < 0) || (register_child_handler() < 0) ||
+        (metrics_serve() < 0))
+    {
+        (void) close(socket_fd);
+        return EXIT_FAILURE;
+    }
+    /* without the warm pool every connection is served by fork and exec */
+    if ((config.warm > 0) && (warm_init(socket_fd, config.warm) < 0))
+    {
+        print_error("Warm pool not available, continue without it.");
+    }
+    if (((config.plugin != NULL) && (plugin_load(config.plugin) < 0)) ||
+        (admission_init(socket_fd, &config) < 0) || (children_init() < 0))
     {
+        (void) close(socket_fd);
         return EXIT_FAILURE;
     }
-    if (register_signal_handler() < 0)
+    if (config.workers > 0)
+    {
+        if (do_worker_pool(socket_fd, &config) < 0)
+        {
+            return EXIT_FAILURE;
+        }
+        assert(0);
+        return EXIT_SUCCESS;
+    }
+    /* workers are forked without threads, so start them only now */
+    if ((plugin_loaded() && (plugin_start_threads(config.threads) < 0)) ||
+        ((config.framed != NULL) &&
+        (framed_start(socket_fd, config.framed, config.framed_workers) < 0)) ||
+        (config.relay && (relay_start(socket_fd, config.threads) < 0)))
     {
         (void) close(socket_fd);
         return EXIT_FAILURE;
@@ -120,7 +180,7 @@ int main(int argc, const char* const argv[])
  *
  * \return void
  */
-static void print_error(const char* message, ...)
+void print_error(const char* message, ...)
 {
     va_list args;
 
@@ -155,7 +215,30 @@ static void print_usage(FILE* stream, const char* command, int exit_code)
     }
     written = fprintf(stream,
             "  -p, --port <port>       well-known port of the server [%d..%d]\n"
-            "  -h, --help\n", LOWER_PORT_RANGE, UPPER_PORT_RANGE);
+            "  -w, --workers <n>       pre-fork a pool of at least n workers [1..%d],\n"
+            "                          each one is replaced by the business logic of\n"
+            "                          its connection unless -l serves it in-process\n"
+            "  -W, --max-workers <n>   the worker pool grows up to n workers (needs -w)\n"
+            "  -e, --warm <n>          keep n business logics parked [1..%d]\n"
+            "                          (not with -w)\n"
+            "  -l, --plugin <path>     serve by a business logic plugin in-process\n"
+            "  -t, --threads <n>       threads serving the plugin or relaying [1..%d]\n"
+            "  -a, --acceptors <n>     n pinned acceptors with SO_REUSEPORT [1..%d]\n"
+            "  -s, --steer             keep connections on the receiving CPU\n"
+            "  -b, --backlog <n>       length of the accept queue [1..%d]\n"
+            "  -m, --max-children <n>  serve n connections at the same time [1..%d],\n"
+            "                          not with -l, -f or -r\n"
+            "  -o, --overload <policy> queue or reject beyond max children\n"
+            "  -q, --queue-wait <ms>   shed a queued connection after ms [1..%d]\n"
+            "  -f, --framed <command>  serve by persistent framed logic workers\n"
+            "  -F, --framed-workers <n> number of framed workers [1..%d]\n"
+            "  -u, --io-uring          drive the event loop by io_uring\n"
+            "  -r, --relay             relay the business logic output by splice()\n"
+            "  -M, --metrics <port|path> serve metrics on an admin port or socket\n"
+            "  -L, --logic <path>      business logic to execute [%s]\n"
+            "  -h, --help\n", LOWER_PORT_RANGE, UPPER_PORT_RANGE, MAX_WORKERS,
+            MAX_WARM, MAX_THREADS, MAX_ACCEPTORS, MAX_BACKLOG, MAX_CHILDREN,
+            MAX_QUEUE_WAIT, MAX_FRAMED, BUSINESS_LOGIC_PATH);
     if (written < 0)
     {
         print_error(strerror(errno));
@@ -173,61 +256,149 @@ static void print_usage(FILE* stream, const char* command, int exit_code)
  *
  * \param argc the number of arguments.
  * \param argv the arguments itself (including the program name in argv[0]).
- * \param port_nr resulting port number for further usage.
+ * \param config resulting server configuration for further usage.
  *
  */
-static void param_check(int argc, const char* const argv[], uint16_t* port_nr)
+static void param_check(int argc, const char* const argv[],
+        struct server_config* config)
 {
-    char* end_ptr;
-    long int port_nr_convert;
     int c;
     const char* port = NULL;
 
     struct option long_options[] =
     {
         {"port", 1, NULL, 'p'},
+        {"workers", 1, NULL, 'w'},
+        {"max-workers", 1, NULL, 'W'},
+        {"warm", 1, NULL, 'e'},
+        {"plugin", 1, NULL, 'l'},
+        {"threads", 1, NULL, 't'},
+        {"acceptors", 1, NULL, 'a'},
+        {"steer", 0, NULL, 's'},
+        {"backlog", 1, NULL, 'b'},
+        {"max-children", 1, NULL, 'm'},
+        {"overload", 1, NULL, 'o'},
+        {"queue-wait", 1, NULL, 'q'},
+        {"framed", 1, NULL, 'f'},
+        {"framed-workers", 1, NULL, 'F'},
+        {"io-uring", 0, NULL, 'u'},
+        {"relay", 0, NULL, 'r'},
+        {"metrics", 1, NULL, 'M'},
+        {"logic", 1, NULL, 'L'},
         {"help", 0, NULL, 'h'},
         {0, 0, 0, 0}
     };
 
+    memset(config, 0, sizeof(*config));
+    config->threads = PLUGIN_THREADS;
+    config->backlog = DEFAULT_BACKLOG;
+    config->overload = OVERLOAD_QUEUE;
+    config->queue_wait = DEFAULT_QUEUE_WAIT;
+    config->logic = BUSINESS_LOGIC_PATH;
+    /* one cache-warm framed worker per core */
+    config->framed_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if ((config->framed_workers < 1) || (config->framed_workers > MAX_FRAMED))
+    {
+        config->framed_workers = config->framed_workers < 1 ? 1 : MAX_FRAMED;
+    }
+
     opterr = 0;
     if (argc < 2)
     {
         print_usage(stderr, argv[0], EXIT_FAILURE);
     }
 
-    while ((c = getopt_long(argc, (char** const) argv, "p:h", long_options,
+    while ((c = getopt_long(argc, (char** const) argv, "p:w:W:e:l:t:a:sb:m:o:q:f:F:urM:L:h", long_options,
             NULL)) != EOF)
     {
         switch (c)
         {
         case 'p':
             port = optarg;
-            if (optarg != NULL)
+            /* set resulting port number */
+            config->port = (uint16_t) convert_number(optarg, LOWER_PORT_RANGE,
+                    UPPER_PORT_RANGE, "port number");
+            break;
+        case 'w':
+            config->workers = convert_number(optarg, 1, MAX_WORKERS,
+                    "number of workers");
+            break;
+        case 'W':
+            config->max_workers = convert_number(optarg, 1, MAX_WORKERS,
+                    "maximum number of workers");
+            break;
+        case 'e':
+            config->warm = convert_number(optarg, 1, MAX_WARM,
+                    "number of parked business logics");
+            break;
+        case 'l':
+            config->plugin = optarg;
+            break;
+        case 't':
+            config->threads = convert_number(optarg, 1, MAX_THREADS,
+                    "number of threads");
+            break;
+        case 'a':
+            config->acceptors = convert_number(optarg, 1, MAX_ACCEPTORS,
+                    "number of acceptors");
+            break;
+        case 's':
+            config->steer = true;
+            break;
+        case 'b':
+            config->backlog = (int) convert_number(optarg, 1, MAX_BACKLOG,
+                    "backlog");
+            break;
+        case 'm':
+            config->max_children = convert_number(optarg, 1, MAX_CHILDREN,
+                    "maximum number of children");
+            break;
+        case 'o':
+            if (strcmp(optarg, "queue") == 0)
+            {
+                config->overload = OVERLOAD_QUEUE;
+            }
+            else if (strcmp(optarg, "reject") == 0)
+            {
+                config->overload = OVERLOAD_REJECT;
+            }
+            else
+            {
+                print_error("Unknown overload policy %s.", optarg);
+                print_usage(stderr, sprogram_arg0, EXIT_FAILURE);
+            }
+            break;
+        case 'q':
+            config->queue_wait = convert_number(optarg, 1, MAX_QUEUE_WAIT,
+                    "queue wait");
+            break;
+        case 'f':
+            config->framed = optarg;
+            break;
+        case 'F':
+            config->framed_workers = convert_number(optarg, 1, MAX_FRAMED,
+                    "number of framed workers");
+            break;
+        case 'u':
+            config->io_uring = true;
+            break;
+        case 'r':
+            config->relay = true;
+            break;
+        case 'M':
+            /* a path names a Unix socket, else it is a port */
+            if (strchr(optarg, '/') != NULL)
             {
-                port_nr_convert = strtol(optarg, &end_ptr, INPUT_NUM_BASE);
-                if ((errno == ERANGE &&
-                        (port_nr_convert == LONG_MAX || port_nr_convert == LONG_MIN))
-                    || (errno != 0 && port_nr_convert == 0))
-                {
-                    print_error("Can not convert port number (%s).", strerror(errno));
-                    print_usage(stderr, sprogram_arg0, EXIT_FAILURE);
-                }
-
-                if (end_ptr == optarg)
-                {
-                    print_error("No digits were found.");
-                    print_usage(stderr, sprogram_arg0, EXIT_FAILURE);
-                }
-
-                if (port_nr_convert < LOWER_PORT_RANGE || port_nr_convert > UPPER_PORT_RANGE)
-                {
-                    print_error("Port number out of range.");
-                    print_usage(stderr, sprogram_arg0, EXIT_FAILURE);
-                }
-                /* set resulting port number */
-                *port_nr = (uint16_t) port_nr_convert;
+                config->metrics_path = optarg;
             }
+            else
+            {
+                config->metrics_port = (uint16_t) convert_number(optarg, 1,
+                        UPPER_PORT_RANGE, "metrics port");
+            }
+            break;
+        case 'L':
+            config->logic = optarg;
             break;
         case 'h':
             /* when the usage message is requested, program will exit afterwards */
@@ -235,7 +406,7 @@ static void param_check(int argc, const char* const argv[], uint16_t* port_nr)
             break;
         case '?':
         default:
-            /* occurs, when other arguments than -p or -h are passed */
+            /* occurs, when other arguments than the known options are passed */
             print_usage(stderr, sprogram_arg0, EXIT_FAILURE);
             break;
         }
@@ -246,61 +417,181 @@ static void param_check(int argc, const char* const argv[], uint16_t* port_nr)
     {
         print_usage(stderr, sprogram_arg0, EXIT_FAILURE);
     }
+
+    if ((config->max_workers > 0) && (config->workers == 0))
+    {
+        print_error("A maximum number of workers requires -w.");
+        print_usage(stderr, sprogram_arg0, EXIT_FAILURE);
+    }
+
+    if (config->workers > 0)
+    {
+        if (config->max_workers == 0)
+        {
+            config->max_workers = config->workers * WORKER_GROWTH_FACTOR;
+            if (config->max_workers > MAX_WORKERS)
+            {
+                config->max_workers = MAX_WORKERS;
+            }
+        }
+        if (config->max_workers < config->workers)
+        {
+            print_error("Maximum number of workers is less than %ld.",
+                    config->workers);
+            print_usage(stderr, sprogram_arg0, EXIT_FAILURE);
+        }
+    }
+
+    /* the workers execute the business logic, only the master hands off */
+    if ((config->warm > 0) && (config->workers > 0))
+    {
+        print_error("A warm pool can not be combined with -w.");
+        print_usage(stderr, sprogram_arg0, EXIT_FAILURE);
+    }
+
+    if ((config->framed != NULL) &&
+        ((config->workers > 0) || (config->warm > 0) || (config->plugin != NULL)))
+    {
+        print_error("Framed workers can not be combined with -w, -e or -l.");
+        print_usage(stderr, sprogram_arg0, EXIT_FAILURE);
+    }
+
+    if (config->relay && ((config->workers > 0) || (config->warm > 0) ||
+        (config->plugin != NULL) || (config->framed != NULL)))
+    {
+        print_error("Relaying can not be combined with -w, -e, -l or -f.");
+        print_usage(stderr, sprogram_arg0, EXIT_FAILURE);
+    }
+
+    /* threads serve those connections, they have a bounded queue of their own */
+    if ((config->max_children > 0) && ((config->plugin != NULL) ||
+        (config->framed != NULL) || config->relay))
+    {
+        print_error("A maximum number of children can not be combined with "
+                "-l, -f or -r.");
+        print_usage(stderr, sprogram_arg0, EXIT_FAILURE);
+    }
+
+    if ((config->metrics_port != 0) && (config->metrics_port == config->port))
+    {
+        print_error("Metrics port must differ from the port of the server.");
+        print_usage(stderr, sprogram_arg0, EXIT_FAILURE);
+    }
+
+    /* the business logic is not executed with -l or -f */
+    if ((config->plugin == NULL) && (config->framed == NULL) &&
+        (access(config->logic, X_OK) < 0))
+    {
+        print_error("Can not execute business logic %s (%s).", config->logic,
+                strerror(errno));
+        print_usage(stderr, sprogram_arg0, EXIT_FAILURE);
+    }
+
+    if (config->steer && (config->acceptors == 0))
+    {
+        print_error("Steering requires acceptors.");
+        print_usage(stderr, sprogram_arg0, EXIT_FAILURE);
+    }
     return;
 }
 
 /**
- * \brief Install signal handler for waiting on child processes.
+ * \brief Converts a numeric command line argument.
+ *
+ * This functions calls exit indirectly when the argument is invalid.
  *
- * If the functions fails then errno is set to EINVAL, see sigaction.
+ * \param text the argument to be converted.
+ * \param lower smallest allowed value.
+ * \param upper greatest allowed value.
+ * \param what describes the argument in error messages.
  *
- * \return 0 if sighandler was installed, else -1 on failure.
+ * \return the converted number.
  */
-int register_signal_handler(void)
+static long convert_number(const char* text, long lower, long upper,
+        const char* what)
 {
-    struct sigaction sig;
-    sig.sa_handler = kill_child_handler;
-    /*
-     * excludes all signals from the signal handler mask.
-     * Return value can be ignored, is always 0.
-     */
-    (void) sigemptyset(&sig.sa_mask);
-    sig.sa_flags = SA_RESTART; /* see beej, Restart syscall on signal return. */
+    char* end_ptr;
+    long int number;
 
     errno = 0;
-    return sigaction(SIGCHLD, &sig, NULL);
+    number = strtol(text, &end_ptr, INPUT_NUM_BASE);
+    if ((errno == ERANGE && (number == LONG_MAX || number == LONG_MIN))
+        || (errno != 0 && number == 0))
+    {
+        print_error("Can not convert %s (%s).", what, strerror(errno));
+        print_usage(stderr, sprogram_arg0, EXIT_FAILURE);
+    }
+
+    if (end_ptr == text)
+    {
+        print_error("No digits were found.");
+        print_usage(stderr, sprogram_arg0, EXIT_FAILURE);
+    }
+
+    if (number < lower || number > upper)
+    {
+        print_error("The %s is out of range.", what);
+        print_usage(stderr, sprogram_arg0, EXIT_FAILURE);
+    }
+    return number;
+}
+
+/**
+ * \brief Redirects SIGCHLD to the reactor for waiting on child processes.
+ *
+ * \return 0 if the handler was registered, else -1 on failure.
+ */
+static int register_child_handler(void)
+{
+    sigset_t mask;
+
+    /* Return value can be ignored, is always 0. */
+    (void) sigemptyset(&mask);
+    (void) sigaddset(&mask, SIGCHLD);
+
+    schildren.callback = reap_children;
+    return reactor_add_signals(&schildren, &mask);
 }
 
 /**
  * \brief Wait for all my children to be killed otherwise they will be zombies.
  *
- * \param signal of child will be ignored.
+ * \param handler the signalfd handler for SIGCHLD.
+ * \param events will be ignored.
+ * \return false, all children have been waited for.
  */
-static void kill_child_handler(int signal)
+static bool reap_children(struct reactor_handler* handler, uint32_t events)
 {
-    int saved_errno;
+    struct rusage usage;
+    pid_t pid;
+    int status;
+
+    (void) events; /* pedantic */
+    reactor_drain(handler);
     /*
-     * waitpid waits for information about child-processes
-     * status is requested for any child process
-     * not interested in status of child process.
+     * wait4 waits for information about child-processes
+     * status and resource usage are requested for any child process
+     * for the lifecycle accounting.
      * WNOHANG makes this function non-blocking
      */
-    (void) signal; /* pedantic */
-    // waitpid() might overwrite errno, so we save and restore it:
-    saved_errno = errno;
-    while (waitpid((pid_t) (WAIT_ANY), NULL, WNOHANG) > 0)
+    while ((pid = wait4((pid_t) (WAIT_ANY), &status, WNOHANG, &usage)) > 0)
     {
+        pool_reaped(pid);
+        admission_reaped(pid);
+        children_reaped(pid, status, &usage);
     }
-    errno = saved_errno;
+    return false;
 }
 
 /**
  * \brief Setup the connection for a tcp socket.
  *
  * \param port_nr where this server listens.
+ * \param backlog length of the accept queue.
+ * \param reuse_port whether further sockets may bind the same port.
  * \return On success a valid socket descriptor or -1 in case of failure.
  */
-static int setup_connection(uint16_t port_nr)
+int setup_connection(uint16_t port_nr, int backlog, bool reuse_port)
 {
     int socket_fd;
     /* set SO_REUSEADDR on a socket to true (1) */
@@ -322,6 +613,14 @@ static int setup_connection(uint16_t port_nr)
        return -1;
     }
 
+    if (reuse_port && (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT,
+            (char*)&optval, sizeof(optval)) < 0))
+    {
+       print_error("setsockopt(SO_REUSEPORT) failed.");
+       (void) close(socket_fd);
+       return -1;
+    }
+
     memset(&serveraddr, 0, sizeof(serveraddr));
     serveraddr.sin_family = AF_INET;
     /* port number must be converted to network byte order */
@@ -336,7 +635,7 @@ static int setup_connection(uint16_t port_nr)
          return -1;
       }
 
-    if (listen(socket_fd, MAX_CONNECTION) < 0)
+    if (listen(socket_fd, backlog) < 0)
     {
         print_error("listen() failed.");
         (void) close(socket_fd);
@@ -355,87 +654,194 @@ static int setup_connection(uint16_t port_nr)
  */
 static int do_connection(int socket_fd)
 {
-    int pid;
-    struct sockaddr_storage addr_inf;
-    socklen_t socklen = sizeof(addr_inf);
-    int connection_fd;
-    int written;
+    int flags;
 
-    while (1)
+    /* accept() must not block when the backlog is drained */
+    flags = fcntl(socket_fd, F_GETFL);
+    if ((flags < 0) || (fcntl(socket_fd, F_SETFL, flags | O_NONBLOCK) < 0))
     {
-        if ((connection_fd = accept(socket_fd, (struct sockaddr*) &addr_inf, &socklen)) < 0)
-        {
-            print_error("accept() failed.\n");
-            continue;
-        }
+        print_error("fcntl() failed: %s.", strerror(errno));
+        (void) close(socket_fd);
+        return -1;
+    }
+
+    slistener.fd = socket_fd;
+    shousekeeping.callback = housekeeping;
+    if ((reactor_add_accept(&slistener, accept_connection) < 0) ||
+        (reactor_add_timer(&shousekeeping, HOUSEKEEPING_MS) < 0))
+    {
+        (void) close(socket_fd);
+        return -1;
+    }
+
+    (void) reactor_run();
+    (void) close(socket_fd);
+    return -1;
+}
+
+/**
+ * \brief Serves a connection accepted by the reactor.
+ *
+ * The accepted sockets stay blocking, they become stdin and stdout of the
+ * business logic.
+ *
+ * \param handler the listening socket handler.
+ * \param connection_fd connect socket.
+ */
+static void accept_connection(struct reactor_handler* handler,
+        int connection_fd)
+{
+    (void) handler; /* pedantic */
+    /* a failed fork() drops this connection only */
+    admission_accepted(connection_fd);
+}
+
+/**
+ * \brief Periodic housekeeping of the server.
+ *
+ * Refills the warm pool if that failed before and retries accepting, since
+ * the edge of the listening socket or the multishot accept is lost if
+ * accept() failed.
+ *
+ * \param handler the timer handler.
+ * \param events will be ignored.
+ * \return false.
+ */
+static bool housekeeping(struct reactor_handler* handler, uint32_t events)
+{
+    (void) events; /* pedantic */
+    reactor_drain(handler);
+    warm_refill(slistener.fd);
+    reactor_schedule(&slistener);
+    return false;
+}
+
+/**
+ * \brief Starts the business logic for an accepted connection.
+ *
+ * A loaded plugin or a framed worker serves the connection on one of the
+ * serving threads. Otherwise a parked business logic takes the connection
+ * if the warm pool has one, else a child process is forked which executes
+ * the business logic.
+ *
+ * \param socket_fd listening socket.
+ * \param connection_fd connect socket, closed by this function.
+ * \return process id of the child serving the connection, 0 if it is
+ *  served by a thread, -1 if fork() failed.
+ */
+pid_t dispatch_connection(int socket_fd, int connection_fd)
+{
+    pid_t pid;
+
+    if (threads_dispatch(connection_fd) == 0)
+    {
+        return 0;
+    }
+    /* no serving threads in the master of the pool, fork below */
+    if (!plugin_loaded() && ((pid = warm_handoff(connection_fd)) > 0))
+    {
+        (void) metrics_started(connection_fd);
+        children_started(pid, connection_fd);
+        reactor_close(connection_fd);
+        /* the client is served already, so refill the pool now */
+        warm_refill(socket_fd);
+        return pid;
+    }
 
-        if ((pid = fork()) < 0)
+    if ((pid = children_fork(connection_fd)) < 0)
+    {
+        print_error("fork() failed.");
+        (void) close(connection_fd);
+        return -1;
+    }
+    /* code, executed by the child process */
+    if (pid == 0)
+    {
+        if (plugin_loaded())
         {
-            print_error("fork() failed.");
+            reactor_child();
             (void) close(socket_fd);
-            (void) close(connection_fd);
-            return -1;
+            plugin_serve(connection_fd);
+            exit(EXIT_SUCCESS);
         }
-        /* code, executed by the child process */
-        if (pid == 0)
-        {
-            written = fprintf(stdout, "fork() successful.");
-            if (written < 0)
-            {
-                print_error(strerror(errno));
-            }
+        exec_business_logic(socket_fd, connection_fd);
+    }
+    /* code, executed by the server process */
+    /*
+     * if an error occurs when trying to close the connect socket in
+     * the parent process, it can be ignored
+     */
+    reactor_close(connection_fd);
+    return pid;
+}
 
-            /* child process doesn't need listening socket */
-            if (close(socket_fd) != 0)
-            {
-                print_error("Child process could not close listening socket.");
-                (void) close(connection_fd);
-                exit(EXIT_FAILURE);
-            }
+/**
+ * \brief Returns the business logic executed per connection.
+ *
+ * \return path given by -L, else BUSINESS_LOGIC_PATH.
+ */
+const char* business_logic_path(void)
+{
+    return slogic_path;
+}
 
-            /* redirect stdin and stdout to connect socket */
-            if ((dup2(connection_fd, STDIN_FILENO) == -1) || (
-                    dup2(connection_fd, STDOUT_FILENO) == -1))
-            {
-                print_error("Child process dup failed.\n");
-                (void) close(connection_fd); /* in case of error no handling */
-                exit(EXIT_FAILURE);
-            }
+/**
+ * \brief Replaces the calling child process by the business logic.
+ *
+ * The connect socket becomes stdin and stdout of the business logic.
+ * This function never returns, on failure the child process exits.
+ *
+ * \param socket_fd listening socket, not needed by the child.
+ * \param connection_fd connect socket of the client.
+ */
+void exec_business_logic(int socket_fd, int connection_fd)
+{
+    int written;
 
-            /* After dup, connection_fd is no longer needed */
-            if (close(connection_fd) != 0)
-            {
-                print_error("Child process could not close connect socket.\n");
-                exit(EXIT_FAILURE);
-            }
+    reactor_child();
+    (void) metrics_started(connection_fd);
 
-            /*
-             * this should overlay the simple_message_server_logic
-             * over the child process
-             */
-            if (execl(BUSINESS_LOGIC_PATH, BUSINESS_LOGIC, NULL) < 0)
-            {
-                print_error("Could not start server business logic.\n");
-                exit(EXIT_FAILURE);
-            }
-            assert(0);  /*never come here after successful execl */
-            exit(EXIT_FAILURE);
-        }
-        else
-        {
-            /* code, executed by the server process */
-            /* in the parent */
-            /*
-             * if an error occurs when trying to close the listening socket in
-             * the parent process, it can be ignored
-             */
-            (void) close(connection_fd);
-        }
+    written = fprintf(stdout, "fork() successful.");
+    if (written < 0)
+    {
+        print_error(strerror(errno));
     }
 
-    /* never come here */
-    assert(0);
-    return EXIT_FAILURE;
+    /* child process doesn't need listening socket */
+    if (close(socket_fd) != 0)
+    {
+        print_error("Child process could not close listening socket.");
+        (void) close(connection_fd);
+        exit(EXIT_FAILURE);
+    }
+
+    /* redirect stdin and stdout to connect socket */
+    if ((dup2(connection_fd, STDIN_FILENO) == -1) || (
+            dup2(connection_fd, STDOUT_FILENO) == -1))
+    {
+        print_error("Child process dup failed.\n");
+        (void) close(connection_fd); /* in case of error no handling */
+        exit(EXIT_FAILURE);
+    }
+
+    /* After dup, connection_fd is no longer needed */
+    if (close(connection_fd) != 0)
+    {
+        print_error("Child process could not close connect socket.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    /*
+     * this should overlay the simple_message_server_logic
+     * over the child process
+     */
+    if (execl(slogic_path, BUSINESS_LOGIC, NULL) < 0)
+    {
+        print_error("Could not start server business logic.\n");
+        exit(EXIT_FAILURE);
+    }
+    assert(0);  /*never come here after successful execl */
+    exit(EXIT_FAILURE);
 }
 
 /* === EOF ================================================================== */
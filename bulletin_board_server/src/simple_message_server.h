@@ -0,0 +1,289 @@
+/**
+ * @file simple_message_server.h
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, declarations shared between the server modules.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_H
+#define SIMPLE_MESSAGE_SERVER_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define BUSINESS_LOGIC "simple_message_server_logic"
+#define BUSINESS_LOGIC_PATH "/usr/local/bin/simple_message_server_logic"
+
+/* warm start library preloaded into parked business logic processes */
+#define WARMSTART_LIBRARY "simple_message_server_warmstart.so"
+/* environment variable passing the control socket to the warm start */
+#define WARMSTART_ENV "SMS_WARMSTART_FD"
+/* environment variable passing LD_PRELOAD of the server to the warm start */
+#define WARMSTART_PRELOAD_ENV "SMS_WARMSTART_PRELOAD"
+
+/* upper bound for the pre-forked worker pool */
+#define MAX_WORKERS 1024
+/* upper bound for parked business logic processes */
+#define MAX_WARM 1024
+/* upper bound for threads serving a plugin */
+#define MAX_THREADS 1024
+/* upper bound for acceptor processes */
+#define MAX_ACCEPTORS 1024
+/* upper bound for business logic children serving connections */
+#define MAX_CHILDREN 65536
+/* upper bound for framed logic workers */
+#define MAX_FRAMED 1024
+
+/* buckets of a histogram: linear ones, then sub-buckets per power of 2 */
+#define HISTOGRAM_SUB_BUCKETS 8
+#define HISTOGRAM_LINEAR (2 * HISTOGRAM_SUB_BUCKETS)
+#define HISTOGRAM_BUCKETS (HISTOGRAM_LINEAR + 60 * HISTOGRAM_SUB_BUCKETS)
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/**
+ * What happens to connections accepted beyond the limit of children.
+ */
+enum overload_policy
+{
+    OVERLOAD_QUEUE = 0,   /**< wait for a child, shed after the queue wait */
+    OVERLOAD_REJECT       /**< shed right away */
+};
+
+/**
+ * Why a connection was shed.
+ */
+enum shed_reason
+{
+    SHED_REJECTED = 0,    /**< limit reached with OVERLOAD_REJECT */
+    SHED_QUEUE_FULL,      /**< no room to wait for a child */
+    SHED_TIMED_OUT,       /**< waited longer than the queue wait */
+    SHED_REASONS          /**< number of reasons */
+};
+
+/**
+ * Counters of the metrics, kept per worker.
+ */
+enum metric_counter
+{
+    METRIC_ACCEPTED = 0,       /**< connections accepted */
+    METRIC_FORKED,             /**< children forked for a connection */
+    METRIC_HANDED_OFF,         /**< connections handed to a parked child */
+    METRIC_THREADED,           /**< connections served by a thread */
+    METRIC_SHED_REJECTED,      /**< shed per enum shed_reason, in its order */
+    METRIC_SHED_QUEUE_FULL,
+    METRIC_SHED_TIMED_OUT,
+    METRIC_EXITED,             /**< children exited with status 0 */
+    METRIC_FAILED,             /**< children exited with another status */
+    METRIC_KILLED,             /**< children terminated by a signal */
+    METRIC_BYTES_RECEIVED,     /**< request bytes seen by the server */
+    METRIC_BYTES_SENT,         /**< response bytes seen by the server */
+    METRIC_COUNTERS            /**< number of counters */
+};
+
+/**
+ * Histograms of the metrics, kept per worker.
+ */
+enum metric_histogram
+{
+    METRIC_ACCEPT_TO_EXEC = 0, /**< accept until the business logic runs, us */
+    METRIC_EXEC_DURATION,      /**< business logic serving a connection, us */
+    METRIC_CHILD_LIFETIME,     /**< accept until the child is reaped, us */
+    METRIC_CHILD_CPU,          /**< CPU time of a child, us */
+    METRIC_CHILD_MAXRSS,       /**< peak resident set size of a child, KiB */
+    METRIC_REQUEST_BYTES,      /**< size of a request */
+    METRIC_RESPONSE_BYTES,     /**< size of a response */
+    METRIC_HISTOGRAMS          /**< number of histograms */
+};
+
+/**
+ * Runtime configuration of the server, assembled from the command line.
+ */
+struct server_config
+{
+    /** well-known port of the server */
+    uint16_t port;
+    /** pre-forked workers kept at least, 0 means fork per connection */
+    long workers;
+    /** the worker pool never grows beyond this size */
+    long max_workers;
+    /** parked business logic processes, 0 means no warm pool */
+    long warm;
+    /** business logic plugin, NULL means the business logic is executed */
+    const char* plugin;
+    /** threads serving the plugin or relaying the business logic */
+    long threads;
+    /** acceptors with a SO_REUSEPORT listener each, 0 means one listener */
+    long acceptors;
+    /** steer connections to the acceptor on the receiving CPU */
+    bool steer;
+    /** length of the accept queue of the listening socket */
+    int backlog;
+    /** children serving connections at the same time, 0 means no limit */
+    long max_children;
+    /** handling of connections beyond max_children */
+    enum overload_policy overload;
+    /** milliseconds a connection waits for a child with OVERLOAD_QUEUE */
+    long queue_wait;
+    /** command starting a framed logic worker, NULL means no workers */
+    const char* framed;
+    /** number of framed logic workers */
+    long framed_workers;
+    /** drive the event loop by io_uring instead of epoll */
+    bool io_uring;
+    /** relay the output of the business logic through the server */
+    bool relay;
+    /** admin port serving the metrics, 0 if none or metrics_path is set */
+    uint16_t metrics_port;
+    /** Unix socket serving the metrics, NULL if none */
+    const char* metrics_path;
+    /** business logic executed per connection */
+    const char* logic;
+};
+
+/**
+ * Log-linear histogram of uint64_t values, see
+ * simple_message_server_histogram.c. Zero-initialized it is empty.
+ */
+struct histogram
+{
+    /** values per bucket */
+    _Atomic uint64_t counts[HISTOGRAM_BUCKETS];
+    /** number of values */
+    _Atomic uint64_t count;
+    /** sum of the values */
+    _Atomic uint64_t sum;
+};
+
+struct reactor_handler;
+
+/**
+ * Serves one connection taken from the queue of the serving threads.
+ */
+typedef void (*threads_serve_t)(void* context, int connection_fd);
+
+/**
+ * Called by the reactor with the epoll events of the handler's descriptor.
+ * Returns true if the handler has to be called again without waiting.
+ */
+typedef bool (*reactor_callback_t)(struct reactor_handler* handler,
+    uint32_t events);
+
+/**
+ * Called by the reactor with each connection accepted on a listening socket
+ * registered by reactor_add_accept().
+ */
+typedef void (*reactor_accept_t)(struct reactor_handler* handler,
+    int connection_fd);
+
+/**
+ * A file descriptor registered with the reactor.
+ */
+struct reactor_handler
+{
+    /** the descriptor waited for */
+    int fd;
+    /** called when the descriptor is ready */
+    reactor_callback_t callback;
+    /** called with accepted connections, NULL if not a listening socket */
+    reactor_accept_t on_accept;
+    /** private to the reactor: registered events */
+    uint32_t events;
+    /** private to the reactor: io_uring slot, -1 if not registered */
+    int slot;
+    /** private to the reactor: an io_uring request is in flight */
+    bool armed;
+    /** private to the reactor: scheduled to be called again */
+    bool pending;
+    /** private to the reactor: next scheduled handler */
+    struct reactor_handler* next_pending;
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+void print_error(const char* message, ...);
+int setup_connection(uint16_t port_nr, int backlog, bool reuse_port);
+int do_acceptors(const struct server_config* config);
+void exec_business_logic(int socket_fd, int connection_fd);
+const char* business_logic_path(void);
+pid_t dispatch_connection(int socket_fd, int connection_fd);
+int do_worker_pool(int socket_fd, const struct server_config* config);
+void pool_reaped(pid_t pid);
+int warm_init(int socket_fd, long size);
+void warm_refill(int socket_fd);
+pid_t warm_handoff(int connection_fd);
+int plugin_load(const char* path);
+void plugin_unload(void);
+bool plugin_loaded(void);
+int plugin_start_threads(long threads);
+void plugin_serve(int connection_fd);
+int threads_start(threads_serve_t serve, void* context);
+int threads_dispatch(int connection_fd);
+int framed_start(int socket_fd, const char* command, long workers);
+int relay_start(int socket_fd, long threads);
+int children_init(void);
+pid_t children_fork(int connection_fd);
+void children_started(pid_t pid, int connection_fd);
+void children_adopted(pid_t pid, const struct sockaddr_in* peer,
+    uint64_t accepted_us, uint64_t start_us);
+void children_reaped(pid_t pid, int status, const struct rusage* usage);
+int metrics_init(const struct server_config* config);
+void metrics_attach_acceptor(long index);
+void metrics_attach_worker(long index);
+int metrics_serve(void);
+void metrics_accepted(int connection_fd);
+uint64_t metrics_accepted_at(int connection_fd);
+uint64_t metrics_started(int connection_fd);
+void metrics_count(enum metric_counter counter, uint64_t amount);
+void metrics_record(enum metric_histogram histogram, uint64_t value);
+const struct histogram* metrics_histogram(enum metric_histogram histogram);
+uint64_t metrics_now_us(void);
+void histogram_record(struct histogram* histogram, uint64_t value);
+unsigned int histogram_bucket(uint64_t value);
+uint64_t histogram_upper_bound(unsigned int bucket);
+uint64_t histogram_percentile(const struct histogram* histogram,
+    double percentile);
+int admission_init(int socket_fd, const struct server_config* config);
+void admission_accepted(int connection_fd);
+void admission_reaped(pid_t pid);
+void admission_reject(int connection_fd, enum shed_reason reason);
+int reactor_init(bool io_uring);
+int reactor_add(struct reactor_handler* handler, uint32_t events);
+int reactor_remove(struct reactor_handler* handler);
+int reactor_add_accept(struct reactor_handler* handler,
+    reactor_accept_t on_accept);
+void reactor_close(int fd);
+int reactor_add_timer(struct reactor_handler* handler, long interval_ms);
+int reactor_set_timer(const struct reactor_handler* handler, long interval_ms);
+int reactor_add_signals(struct reactor_handler* handler, const sigset_t* mask);
+void reactor_drain(const struct reactor_handler* handler);
+void reactor_schedule(struct reactor_handler* handler);
+void reactor_child(void);
+int reactor_run(void);
+
+#endif /* SIMPLE_MESSAGE_SERVER_H */
+
+/* === EOF ================================================================== */
@@ -0,0 +1,364 @@
+/**
+ * @file simple_message_server_acceptor.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, acceptor processes sharded by SO_REUSEPORT.
+ *
+ * Every acceptor gets a listening socket of its own, all bound to the same
+ * port with SO_REUSEPORT, so the kernel distributes the incoming connections
+ * over the acceptors instead of queueing them on one socket. Each acceptor
+ * is pinned to a CPU and runs the complete server (event loop, worker pool,
+ * warm pool, plugin) for its shard. With steering, a classic BPF program
+ * selects the listener of the acceptor pinned to the CPU which received the
+ * connection, so the connection is served on that CPU.
+ *
+ * The master keeps all listening sockets open, so the reuseport group and
+ * the order of its sockets never change, and restarts acceptors which die.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+/* sched_setaffinity() */
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <linux/filter.h>
+#include "simple_message_server.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* an acceptor dying faster than this in seconds is restarted with delay */
+#define ACCEPTOR_MIN_LIFETIME 1
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/** An acceptor process and its shard. */
+struct acceptor
+{
+    /** process id, 0 if not running */
+    pid_t pid;
+    /** listening socket of the shard */
+    int socket_fd;
+    /** CPU the acceptor is pinned to, -1 if not pinned */
+    int cpu;
+    /** when the acceptor was started */
+    time_t started;
+};
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+
+/** All acceptors, indexed like their sockets in the reuseport group. */
+static struct acceptor* sacceptors = NULL;
+/** Number of acceptors. */
+static long sacceptor_count = 0;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static void assign_cpus(void);
+static int attach_steering(void);
+static int start_acceptor(long index);
+static int supervise_acceptors(void);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Starts the acceptor processes.
+ *
+ * Returns in every acceptor with the listening socket of its shard. In the
+ * master it only returns on failure.
+ *
+ * \param config with the port, the number of acceptors and steering.
+ * \return listening socket of the acceptor, -1 on failure.
+ */
+int do_acceptors(const struct server_config* config)
+{
+    long i;
+    int socket_fd;
+
+    sacceptors = calloc((size_t) config->acceptors, sizeof(*sacceptors));
+    if (sacceptors == NULL)
+    {
+        print_error("Can not allocate acceptors: %s.", strerror(ENOMEM));
+        return -1;
+    }
+
+    /* the listen() order determines the index in the reuseport group */
+    for (sacceptor_count = 0; sacceptor_count < config->acceptors;
+        ++sacceptor_count)
+    {
+        socket_fd = setup_connection(config->port, config->backlog, true);
+        if (socket_fd < 0)
+        {
+            break;
+        }
+        sacceptors[sacceptor_count].socket_fd = socket_fd;
+    }
+    if (sacceptor_count < config->acceptors)
+    {
+        for (i = 0; i < sacceptor_count; ++i)
+        {
+            (void) close(sacceptors[i].socket_fd);
+        }
+        return -1;
+    }
+
+    assign_cpus();
+    if (config->steer && (attach_steering() < 0))
+    {
+        print_error("Steering not available, connections are hashed.");
+    }
+
+    for (i = 0; i < sacceptor_count; ++i)
+    {
+        socket_fd = start_acceptor(i);
+        if (socket_fd >= 0)
+        {
+            /* the new acceptor */
+            return socket_fd;
+        }
+    }
+    return supervise_acceptors();
+}
+
+/**
+ * \brief Pins the acceptors round robin to the CPUs the server may use.
+ */
+static void assign_cpus(void)
+{
+    cpu_set_t allowed;
+    int cpus[CPU_SETSIZE];
+    int cpu_count = 0;
+    int cpu;
+    long i;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+    {
+        print_error("sched_getaffinity() failed: %s.", strerror(errno));
+        for (i = 0; i < sacceptor_count; ++i)
+        {
+            sacceptors[i].cpu = -1;
+        }
+        return;
+    }
+    for (cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (CPU_ISSET(cpu, &allowed))
+        {
+            cpus[cpu_count++] = cpu;
+        }
+    }
+    for (i = 0; i < sacceptor_count; ++i)
+    {
+        sacceptors[i].cpu = cpus[i % cpu_count];
+    }
+}
+
+/**
+ * \brief Attaches the steering program to the reuseport group.
+ *
+ * The program loads the CPU which received the connection and returns the
+ * index of the first acceptor pinned to it. For a CPU without an acceptor
+ * it returns an invalid index, then the kernel falls back to hashing.
+ *
+ * \return 0 on success, else -1.
+ */
+static int attach_steering(void)
+{
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+    struct sock_filter* code;
+    struct sock_fprog program;
+    unsigned short length = 0;
+    long i;
+    long j;
+    int result;
+
+    /* ld cpu, then per acceptor jeq + ret, finally ret for other CPUs */
+    if (2 * sacceptor_count + 2 > BPF_MAXINSNS)
+    {
+        print_error("Too many acceptors for a steering program.");
+        return -1;
+    }
+    code = calloc((size_t) (2 * sacceptor_count + 2), sizeof(*code));
+    if (code == NULL)
+    {
+        print_error("Can not allocate steering program: %s.",
+            strerror(ENOMEM));
+        return -1;
+    }
+
+    code[length++] = (struct sock_filter)
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+    for (i = 0; i < sacceptor_count; ++i)
+    {
+        /* CPUs with several acceptors are steered to the first one */
+        for (j = 0; (j < i) && (sacceptors[j].cpu != sacceptors[i].cpu); ++j)
+        {
+        }
+        if ((sacceptors[i].cpu < 0) || (j < i))
+        {
+            continue;
+        }
+        code[length++] = (struct sock_filter)
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (unsigned) sacceptors[i].cpu,
+                0, 1);
+        code[length++] = (struct sock_filter)
+            BPF_STMT(BPF_RET | BPF_K, (unsigned) i);
+    }
+    code[length++] = (struct sock_filter)
+        BPF_STMT(BPF_RET | BPF_K, (unsigned) sacceptor_count);
+
+    program.len = length;
+    program.filter = code;
+    /* the program applies to the whole group */
+    result = setsockopt(sacceptors[0].socket_fd, SOL_SOCKET,
+        SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program));
+    if (result < 0)
+    {
+        print_error("setsockopt(SO_ATTACH_REUSEPORT_CBPF) failed: %s.",
+            strerror(errno));
+    }
+    free(code);
+    return result < 0 ? -1 : 0;
+#else
+    print_error("SO_ATTACH_REUSEPORT_CBPF not supported.");
+    return -1;
+#endif
+}
+
+/**
+ * \brief Forks an acceptor.
+ *
+ * \param index of the acceptor.
+ * \return in the new acceptor its listening socket, in the master -1.
+ */
+static int start_acceptor(long index)
+{
+    struct acceptor* acceptor = &sacceptors[index];
+    cpu_set_t cpu;
+    pid_t master = getpid();
+    pid_t pid;
+    long i;
+
+    if ((pid = fork()) < 0)
+    {
+        print_error("fork() failed: %s.", strerror(errno));
+        return -1;
+    }
+    if (pid > 0)
+    {
+        acceptor->pid = pid;
+        acceptor->started = time(NULL);
+        return -1;
+    }
+
+    /* the acceptors must not survive the master */
+    if ((prctl(PR_SET_PDEATHSIG, SIGTERM) < 0) || (getppid() != master))
+    {
+        _exit(EXIT_FAILURE);
+    }
+    metrics_attach_acceptor(index);
+    for (i = 0; i < sacceptor_count; ++i)
+    {
+        if (i != index)
+        {
+            (void) close(sacceptors[i].socket_fd);
+        }
+    }
+    if (acceptor->cpu >= 0)
+    {
+        CPU_ZERO(&cpu);
+        CPU_SET(acceptor->cpu, &cpu);
+        if (sched_setaffinity(0, sizeof(cpu), &cpu) < 0)
+        {
+            print_error("sched_setaffinity() failed: %s.", strerror(errno));
+        }
+    }
+    return acceptor->socket_fd;
+}
+
+/**
+ * \brief Restarts acceptors which terminated.
+ *
+ * This function waits for the acceptors in a loop, so in the master it
+ * should never exit.
+ *
+ * \return in a restarted acceptor its listening socket, in the master -1
+ *  in case of a 'weird' program execution.
+ */
+static int supervise_acceptors(void)
+{
+    pid_t pid;
+    long i;
+    int socket_fd;
+
+    while (1)
+    {
+        pid = waitpid((pid_t) (WAIT_ANY), NULL, 0);
+        if (pid < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            print_error("waitpid() failed: %s.", strerror(errno));
+            return -1;
+        }
+        for (i = 0; (i < sacceptor_count) && (sacceptors[i].pid != pid); ++i)
+        {
+        }
+        if (i == sacceptor_count)
+        {
+            continue;
+        }
+
+        print_error("Acceptor %ld terminated, restarting it.", i);
+        if (time(NULL) - sacceptors[i].started < ACCEPTOR_MIN_LIFETIME)
+        {
+            /* do not spin on an acceptor which fails right away */
+            (void) sleep(ACCEPTOR_MIN_LIFETIME);
+        }
+        sacceptors[i].pid = 0;
+        while (sacceptors[i].pid == 0)
+        {
+            socket_fd = start_acceptor(i);
+            if (socket_fd >= 0)
+            {
+                return socket_fd;
+            }
+            if (sacceptors[i].pid == 0)
+            {
+                /* fork() failed, try again later */
+                (void) sleep(ACCEPTOR_MIN_LIFETIME);
+            }
+        }
+    }
+}
+
+/* === EOF ================================================================== */
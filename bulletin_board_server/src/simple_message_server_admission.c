@@ -0,0 +1,555 @@
+/**
+ * @file simple_message_server_admission.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, admission control of accepted connections.
+ *
+ * The number of business logic children serving connections at the same
+ * time is limited. A connection accepted beyond the limit either waits in a
+ * bounded queue for a child to terminate, or is shed right away: the server
+ * answers it itself with a canned busy response, without forking. Shed
+ * connections are counted and reported periodically.
+ *
+ * A shed connection is not closed before the client has sent its request,
+ * because closing a socket with unread data resets the connection and the
+ * client would lose the busy response.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "simple_message_server.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* accepted connections waiting for a child at most */
+#define ADMISSION_QUEUE 1024
+/* shed connections waiting for the end of their request at most */
+#define ADMISSION_LINGER 1024
+/* period of the admission timer while connections wait, in ms */
+#define ADMISSION_TICK_MS 10
+/* a shed connection waits for the end of its request at most ms */
+#define ADMISSION_LINGER_MS 1000
+/* period of reporting shed connections in milliseconds */
+#define ADMISSION_REPORT_MS 1000
+
+/* canned response for shed connections */
+#define BUSY_STATUS 2
+#define BUSY_FILE "vcs_tcpip_bulletin_board_response.html"
+#define BUSY_PAGE "<html><body><h1>Server busy</h1>" \
+    "<p>The bulletin board is overloaded, please try again later.</p>" \
+    "</body></html>\n"
+
+#define MS_PER_SECOND 1000
+#define NS_PER_MS 1000000
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/** A connection waiting for a child. */
+struct queued_connection
+{
+    /** connect socket */
+    int connection_fd;
+    /** shed when still queued at this time, in ms */
+    long deadline;
+};
+
+/** A shed connection waiting for the end of the request. */
+struct lingering_connection
+{
+    /** reads the rest of the request, must be the first member */
+    struct reactor_handler handler;
+    /** closed when still lingering at this time, in ms */
+    long deadline;
+    /** whether the entry is used */
+    bool used;
+};
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+
+/** Server configuration with the limits and the policy. */
+static const struct server_config* sconfig = NULL;
+/** Listening socket, closed in the children. */
+static int ssocket_fd = -1;
+/** Serves the queue and reports the counters. */
+static struct reactor_handler stimer;
+/** Current period of stimer in ms. */
+static long stimer_ms = 0;
+
+/** Process ids of children serving a connection, open addressing. */
+static pid_t* sin_flight = NULL;
+/** Size of sin_flight, a power of 2. */
+static size_t sin_flight_size = 0;
+/** Number of children serving a connection. */
+static long sin_flight_count = 0;
+
+/** Ring buffer of queued connections. */
+static struct queued_connection squeue[ADMISSION_QUEUE];
+/** Index of the oldest queued connection. */
+static size_t squeue_head = 0;
+/** Number of queued connections. */
+static size_t squeue_count = 0;
+
+/** Shed connections waiting for the end of the request. */
+static struct lingering_connection slingering[ADMISSION_LINGER];
+/** Number of used entries in slingering. */
+static size_t slingering_count = 0;
+
+/** Connections shed per enum shed_reason, updated by plugin threads too. */
+static atomic_ulong sshed[SHED_REASONS];
+/** Counters at the previous report. */
+static unsigned long sreported[SHED_REASONS];
+/** Time of the previous report in ms. */
+static long slast_report = 0;
+
+/** The canned busy response. */
+static char sbusy_response[sizeof(BUSY_FILE) + sizeof(BUSY_PAGE) + 64];
+/** Length of the canned busy response. */
+static size_t sbusy_length = 0;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static bool admission_tick(struct reactor_handler* handler, uint32_t events);
+static void admit_connection(int connection_fd);
+static void admit_queued(void);
+static void shed_connection(int connection_fd, enum shed_reason reason);
+static void send_busy(int connection_fd, enum shed_reason reason);
+static bool drain_request(int connection_fd);
+static bool linger_read(struct reactor_handler* handler, uint32_t events);
+static void linger_close(struct lingering_connection* lingering);
+static void report_shed(void);
+static void arm_timer(void);
+static long now_ms(void);
+static void track_child(pid_t pid);
+static bool untrack_child(pid_t pid);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Sets up the admission control.
+ *
+ * \param socket_fd listening socket.
+ * \param config with max_children, the overload policy and the queue wait.
+ * \return 0 on success, else -1.
+ */
+int admission_init(int socket_fd, const struct server_config* config)
+{
+    int length;
+
+    sconfig = config;
+    ssocket_fd = socket_fd;
+    length = snprintf(sbusy_response, sizeof(sbusy_response),
+        "status=%d\nfile=%s\nlen=%lu\n%s", BUSY_STATUS, BUSY_FILE,
+        (unsigned long) strlen(BUSY_PAGE), BUSY_PAGE);
+    if ((length < 0) || ((size_t) length >= sizeof(sbusy_response)))
+    {
+        print_error("Busy response too long.");
+        return -1;
+    }
+    sbusy_length = (size_t) length;
+    slast_report = now_ms();
+
+    if (config->max_children > 0)
+    {
+        /* at most half full, so probing stays short */
+        for (sin_flight_size = 1;
+            sin_flight_size < 2 * (size_t) config->max_children;
+            sin_flight_size *= 2)
+        {
+        }
+        sin_flight = calloc(sin_flight_size, sizeof(*sin_flight));
+        if (sin_flight == NULL)
+        {
+            print_error("Can not allocate admission table: %s.",
+                strerror(ENOMEM));
+            return -1;
+        }
+    }
+
+    stimer.callback = admission_tick;
+    stimer_ms = ADMISSION_REPORT_MS;
+    return reactor_add_timer(&stimer, stimer_ms);
+}
+
+/**
+ * \brief Admits, queues or sheds an accepted connection.
+ *
+ * \param connection_fd connect socket, owned by this function.
+ */
+void admission_accepted(int connection_fd)
+{
+    metrics_accepted(connection_fd);
+    admit_connection(connection_fd);
+}
+
+/**
+ * \brief Accounts a terminated child and admits a queued connection.
+ *
+ * Called for every reaped child, which may be no business logic at all.
+ *
+ * \param pid process id of the terminated child.
+ */
+void admission_reaped(pid_t pid)
+{
+    if ((sin_flight != NULL) && untrack_child(pid))
+    {
+        admit_queued();
+    }
+}
+
+/**
+ * \brief Answers a connection with the canned busy response and closes it.
+ *
+ * Thread-safe, for the plugin threads. The request is read as far as it has
+ * arrived already.
+ *
+ * \param connection_fd connect socket, closed by this function.
+ * \param reason why the connection is shed.
+ */
+void admission_reject(int connection_fd, enum shed_reason reason)
+{
+    send_busy(connection_fd, reason);
+    (void) drain_request(connection_fd);
+    (void) close(connection_fd);
+}
+
+/**
+ * \brief Sheds queued connections which waited too long and reports.
+ *
+ * \param handler the admission timer.
+ * \param events will be ignored.
+ * \return false.
+ */
+static bool admission_tick(struct reactor_handler* handler, uint32_t events)
+{
+    long now;
+    size_t i;
+
+    (void) events; /* pedantic */
+    reactor_drain(handler);
+
+    now = now_ms();
+    while ((squeue_count > 0) && (squeue[squeue_head].deadline <= now))
+    {
+        shed_connection(squeue[squeue_head].connection_fd, SHED_TIMED_OUT);
+        squeue_head = (squeue_head + 1) % ADMISSION_QUEUE;
+        --squeue_count;
+    }
+    for (i = 0; (i < ADMISSION_LINGER) && (slingering_count > 0); ++i)
+    {
+        if (slingering[i].used && (slingering[i].deadline <= now))
+        {
+            linger_close(&slingering[i]);
+        }
+    }
+    if (now - slast_report >= ADMISSION_REPORT_MS)
+    {
+        slast_report = now;
+        report_shed();
+    }
+    arm_timer();
+    return false;
+}
+
+/**
+ * \brief Admits, queues or sheds a connection.
+ *
+ * \param connection_fd connect socket, owned by this function.
+ */
+static void admit_connection(int connection_fd)
+{
+    pid_t pid;
+
+    if ((sconfig->max_children == 0) ||
+        (sin_flight_count < sconfig->max_children))
+    {
+        pid = dispatch_connection(ssocket_fd, connection_fd);
+        if ((pid > 0) && (sin_flight != NULL))
+        {
+            track_child(pid);
+        }
+        return;
+    }
+
+    if (sconfig->overload == OVERLOAD_REJECT)
+    {
+        shed_connection(connection_fd, SHED_REJECTED);
+    }
+    else if (squeue_count == ADMISSION_QUEUE)
+    {
+        shed_connection(connection_fd, SHED_QUEUE_FULL);
+    }
+    else
+    {
+        squeue[(squeue_head + squeue_count) % ADMISSION_QUEUE] =
+            (struct queued_connection) {connection_fd,
+                now_ms() + sconfig->queue_wait};
+        ++squeue_count;
+        arm_timer();
+    }
+}
+
+/**
+ * \brief Dispatches queued connections as long as children are available.
+ */
+static void admit_queued(void)
+{
+    int connection_fd;
+
+    while ((squeue_count > 0) && (sin_flight_count < sconfig->max_children))
+    {
+        connection_fd = squeue[squeue_head].connection_fd;
+        squeue_head = (squeue_head + 1) % ADMISSION_QUEUE;
+        --squeue_count;
+        admit_connection(connection_fd);
+    }
+    arm_timer();
+}
+
+/**
+ * \brief Sheds a connection in the event loop.
+ *
+ * The connection is closed after the end of the request, or at once if too
+ * many shed connections are lingering already.
+ *
+ * \param connection_fd connect socket, owned by this function.
+ * \param reason why the connection is shed.
+ */
+static void shed_connection(int connection_fd, enum shed_reason reason)
+{
+    struct lingering_connection* lingering = NULL;
+    size_t i;
+
+    send_busy(connection_fd, reason);
+    if (!drain_request(connection_fd) ||
+        (slingering_count == ADMISSION_LINGER))
+    {
+        (void) close(connection_fd);
+        return;
+    }
+    for (i = 0; slingering[i].used; ++i)
+    {
+    }
+    lingering = &slingering[i];
+    lingering->handler.fd = connection_fd;
+    lingering->handler.callback = linger_read;
+    lingering->deadline = now_ms() + ADMISSION_LINGER_MS;
+    if (reactor_add(&lingering->handler, EPOLLIN | EPOLLRDHUP) < 0)
+    {
+        (void) close(connection_fd);
+        return;
+    }
+    lingering->used = true;
+    ++slingering_count;
+    arm_timer();
+}
+
+/**
+ * \brief Counts a shed connection and sends the busy response.
+ *
+ * \param connection_fd connect socket.
+ * \param reason why the connection is shed.
+ */
+static void send_busy(int connection_fd, enum shed_reason reason)
+{
+    atomic_fetch_add(&sshed[reason], 1);
+    metrics_count((enum metric_counter) (METRIC_SHED_REJECTED + reason), 1);
+    metrics_count(METRIC_BYTES_SENT, sbusy_length);
+
+    /* the send buffer of a new connection takes the response at once */
+    (void) send(connection_fd, sbusy_response, sbusy_length,
+        MSG_DONTWAIT | MSG_NOSIGNAL);
+    (void) shutdown(connection_fd, SHUT_WR);
+}
+
+/**
+ * \brief Reads and discards the request as far as it has arrived.
+ *
+ * \param connection_fd connect socket.
+ * \return true if the rest of the request is still to come.
+ */
+static bool drain_request(int connection_fd)
+{
+    char discard[BUFSIZ];
+    ssize_t read_count;
+
+    do
+    {
+        read_count = recv(connection_fd, discard, sizeof(discard),
+            MSG_DONTWAIT);
+    } while ((read_count > 0) || ((read_count < 0) && (errno == EINTR)));
+    return (read_count < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK));
+}
+
+/**
+ * \brief Reads the rest of the request of a shed connection.
+ *
+ * \param handler of the lingering connection.
+ * \param events will be ignored.
+ * \return false.
+ */
+static bool linger_read(struct reactor_handler* handler, uint32_t events)
+{
+    (void) events; /* pedantic */
+    if (!drain_request(handler->fd))
+    {
+        linger_close((struct lingering_connection*) handler);
+    }
+    return false;
+}
+
+/**
+ * \brief Closes a lingering connection.
+ *
+ * \param lingering the connection.
+ */
+static void linger_close(struct lingering_connection* lingering)
+{
+    (void) reactor_remove(&lingering->handler);
+    (void) close(lingering->handler.fd);
+    lingering->used = false;
+    --slingering_count;
+    arm_timer();
+}
+
+/**
+ * \brief Reports the connections shed since the previous report.
+ */
+static void report_shed(void)
+{
+    unsigned long current[SHED_REASONS];
+    unsigned long total = 0;
+    int i;
+
+    for (i = 0; i < SHED_REASONS; ++i)
+    {
+        current[i] = atomic_load(&sshed[i]);
+        total += current[i] - sreported[i];
+    }
+    if (total == 0)
+    {
+        return;
+    }
+    print_error("Overload: %lu connections shed (rejected %lu, queue full "
+        "%lu, timed out %lu), %lu shed in total.", total,
+        current[SHED_REJECTED] - sreported[SHED_REJECTED],
+        current[SHED_QUEUE_FULL] - sreported[SHED_QUEUE_FULL],
+        current[SHED_TIMED_OUT] - sreported[SHED_TIMED_OUT],
+        current[SHED_REJECTED] + current[SHED_QUEUE_FULL] +
+        current[SHED_TIMED_OUT]);
+    memcpy(sreported, current, sizeof(sreported));
+}
+
+/**
+ * \brief Runs the admission timer often only while connections wait.
+ *
+ * Queued and lingering connections have deadlines to be kept, else the
+ * timer only has to report.
+ */
+static void arm_timer(void)
+{
+    long interval_ms = (squeue_count > 0) || (slingering_count > 0) ?
+        ADMISSION_TICK_MS : ADMISSION_REPORT_MS;
+
+    if ((interval_ms != stimer_ms) && (reactor_set_timer(&stimer,
+        interval_ms) == 0))
+    {
+        stimer_ms = interval_ms;
+    }
+}
+
+/**
+ * \brief Reads the monotonic clock.
+ *
+ * \return milliseconds since an arbitrary point in time.
+ */
+static long now_ms(void)
+{
+    struct timespec now;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long) now.tv_sec * MS_PER_SECOND + now.tv_nsec / NS_PER_MS;
+}
+
+/**
+ * \brief Adds a child serving a connection to the table.
+ *
+ * \param pid process id of the child.
+ */
+static void track_child(pid_t pid)
+{
+    size_t i = (size_t) pid & (sin_flight_size - 1);
+
+    while (sin_flight[i] != 0)
+    {
+        i = (i + 1) & (sin_flight_size - 1);
+    }
+    sin_flight[i] = pid;
+    ++sin_flight_count;
+}
+
+/**
+ * \brief Removes a child from the table.
+ *
+ * \param pid process id of the child.
+ * \return true if the child served a connection.
+ */
+static bool untrack_child(pid_t pid)
+{
+    size_t mask = sin_flight_size - 1;
+    size_t i = (size_t) pid & mask;
+    size_t hole;
+    size_t home;
+
+    while ((sin_flight[i] != 0) && (sin_flight[i] != pid))
+    {
+        i = (i + 1) & mask;
+    }
+    if (sin_flight[i] == 0)
+    {
+        return false;
+    }
+    --sin_flight_count;
+
+    /* move following entries up, so no probe sequence is broken */
+    hole = i;
+    sin_flight[hole] = 0;
+    for (i = (hole + 1) & mask; sin_flight[i] != 0; i = (i + 1) & mask)
+    {
+        home = (size_t) sin_flight[i] & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            sin_flight[hole] = sin_flight[i];
+            sin_flight[i] = 0;
+            hole = i;
+        }
+    }
+    return true;
+}
+
+/* === EOF ================================================================== */
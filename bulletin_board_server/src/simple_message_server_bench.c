@@ -0,0 +1,653 @@
+/**
+ * @file simple_message_server_bench.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, benchmark of the event loop.
+ *
+ * Starts the server given after "--" with "-p port" appended and runs a
+ * closed-loop load against it: every connection posts a message, closes its
+ * sending side and reads the response to the end. The first run measures
+ * the requests per second, a second run counts the system calls of the
+ * event loop per request by tracing the main thread of the server with
+ * ptrace. Children and serving threads are not traced, so the count shows
+ * what the event loop itself costs, e.g.:
+ *
+ *   simple_message_server_bench -p 6823 -- ./simple_message_server \
+ *       -l ./simple_message_server_echo.so
+ *   simple_message_server_bench -p 6823 -- ./simple_message_server -u \
+ *       -l ./simple_message_server_echo.so
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ptrace.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* decimal format base for strtol */
+#define INPUT_NUM_BASE 10
+
+#define DEFAULT_REQUESTS 2000
+#define DEFAULT_CONNECTIONS 8
+#define MAX_CONNECTIONS 1024
+/* time the server gets to listen, in milliseconds */
+#define STARTUP_MS 5000
+#define STARTUP_RETRY_MS 10
+
+#define NS_PER_MS 1000000
+#define NS_PER_SECOND 1000000000.0
+
+/* each system call stops the tracee on entry and on exit */
+#define STOPS_PER_SYSCALL 2
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/** Result of one run. */
+struct run_result
+{
+    /** requests answered completely */
+    long done;
+    /** requests failed */
+    long failed;
+    /** duration of the run in seconds */
+    double seconds;
+};
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+static const char* sprogram_arg0 = NULL;
+
+/** Address of the server. */
+static struct sockaddr_in saddress;
+/** Request sent by every connection. */
+static const char srequest[] = "user=bench\nbenchmark message\n";
+/** Requests left to be started in the current run. */
+static atomic_long sremaining;
+/** Requests answered in the current run. */
+static atomic_long sdone;
+/** Requests failed in the current run. */
+static atomic_long sfailed;
+/** The load of the current run is done. */
+static atomic_bool sload_done;
+/** The tracer has detached from the server. */
+static atomic_bool stracer_done;
+/** Thread tracing the server. */
+static pthread_t stracer;
+/** Load threads of the current run. */
+static pthread_t sthreads[MAX_CONNECTIONS];
+/** Number of load threads of the current run. */
+static long sthread_count = 0;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static void print_error(const char* message, ...);
+static void print_usage(FILE* stream, int exit_code);
+static long convert_number(const char* text, long lower, long upper,
+    const char* what);
+static pid_t start_server(char* const command[], uint16_t port);
+static int wait_listening(void);
+static int run_load(long requests, long connections, pid_t traced,
+    struct run_result* result, long* syscalls);
+static void join_load(void);
+static void* load_thread(void* arg);
+static void* wait_load(void* arg);
+static int post_request(void);
+static long trace_syscalls(pid_t pid);
+static void wake_tracer(int signal_number);
+static double now(void);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief the main method for the benchmark
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * \return success or failure.
+ * \retval EXIT_SUCCESS if both runs answered every request.
+ * \retval EXIT_FAILURE on failure.
+ */
+int main(int argc, char* argv[])
+{
+    struct run_result result;
+    long requests = DEFAULT_REQUESTS;
+    long connections = DEFAULT_CONNECTIONS;
+    long port = -1;
+    long syscalls = 0;
+    bool failed = false;
+    pid_t server;
+    int c;
+
+    sprogram_arg0 = argv[0];
+    while ((c = getopt(argc, argv, "p:n:c:h")) != EOF)
+    {
+        switch (c)
+        {
+        case 'p':
+            port = convert_number(optarg, 1, UINT16_MAX, "port number");
+            break;
+        case 'n':
+            requests = convert_number(optarg, 1, LONG_MAX, "number of requests");
+            break;
+        case 'c':
+            connections = convert_number(optarg, 1, MAX_CONNECTIONS,
+                "number of connections");
+            break;
+        case 'h':
+            print_usage(stdout, EXIT_SUCCESS);
+            break;
+        default:
+            print_usage(stderr, EXIT_FAILURE);
+            break;
+        }
+    }
+    if ((port < 0) || (optind >= argc))
+    {
+        print_usage(stderr, EXIT_FAILURE);
+    }
+
+    memset(&saddress, 0, sizeof(saddress));
+    saddress.sin_family = AF_INET;
+    saddress.sin_port = htons((uint16_t) port);
+    saddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    server = start_server(&argv[optind], (uint16_t) port);
+    if (server < 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    /* warm up and measure the rate without the tracer slowing the server */
+    if (run_load(requests, connections, 0, &result, NULL) < 0)
+    {
+        failed = true;
+    }
+    else
+    {
+        (void) printf("requests: %ld connections: %ld failed: %ld "
+            "time: %.3f s rate: %.1f req/s\n", result.done, connections,
+            result.failed, result.seconds, result.done / result.seconds);
+        failed = result.failed > 0;
+    }
+
+    if (!failed)
+    {
+        if (run_load(requests, connections, server, &result, &syscalls) < 0)
+        {
+            failed = true;
+        }
+        else
+        {
+            (void) printf("event loop syscalls: %ld per request: %.2f\n",
+                syscalls, result.done > 0 ? (double) syscalls / result.done : 0.0);
+            failed = result.failed > 0;
+        }
+    }
+
+    (void) kill(server, SIGTERM);
+    (void) waitpid(server, NULL, 0);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Prints error message to stderr.
+ *
+ * A new line is printed after the message text automatically.
+ * Printout can be formatted like printf.
+ *
+ * \param message output on stderr.
+ *
+ * \return void
+ */
+static void print_error(const char* message, ...)
+{
+    va_list args;
+
+    /* do not handle return value of fprintf, because it makes no sense here */
+    (void) fprintf(stderr, "%s: ", sprogram_arg0);
+    va_start(args, message);
+    (void) vfprintf(stderr, message, args);
+    va_end(args);
+    (void) fprintf(stderr, "\n");
+}
+
+/**
+ * \brief Prints the usage and exits.
+ *
+ * \param stream where to put the usage output.
+ * \param exit_code to be set on exit.
+ */
+static void print_usage(FILE* stream, int exit_code)
+{
+    (void) fprintf(stream,
+        "usage: %s -p port [-n requests] [-c connections] -- server [args]\n"
+        "  -p <port>         port the server is started on\n"
+        "  -n <requests>     requests per run [%d]\n"
+        "  -c <connections>  concurrent connections [%d, up to %d]\n"
+        "  -h                this help\n", sprogram_arg0, DEFAULT_REQUESTS,
+        DEFAULT_CONNECTIONS, MAX_CONNECTIONS);
+    exit(exit_code);
+}
+
+/**
+ * \brief Converts a numeric command line argument.
+ *
+ * This functions exits when the argument is invalid.
+ *
+ * \param text the argument to be converted.
+ * \param lower smallest allowed value.
+ * \param upper greatest allowed value.
+ * \param what describes the argument in error messages.
+ * \return the converted number.
+ */
+static long convert_number(const char* text, long lower, long upper,
+    const char* what)
+{
+    char* end_ptr;
+    long number;
+
+    errno = 0;
+    number = strtol(text, &end_ptr, INPUT_NUM_BASE);
+    if ((errno != 0) || (end_ptr == text) || (*end_ptr != '\0') ||
+        (number < lower) || (number > upper))
+    {
+        print_error("Invalid %s %s.", what, text);
+        print_usage(stderr, EXIT_FAILURE);
+    }
+    return number;
+}
+
+/**
+ * \brief Starts the server and waits until it listens.
+ *
+ * \param command of the server, NULL terminated.
+ * \param port appended as "-p port".
+ * \return process id of the server, -1 on failure.
+ */
+static pid_t start_server(char* const command[], uint16_t port)
+{
+    char port_text[sizeof("65535")];
+    char** args;
+    size_t count;
+    pid_t pid;
+
+    for (count = 0; command[count] != NULL; ++count)
+    {
+    }
+    args = calloc(count + 3, sizeof(*args));
+    if (args == NULL)
+    {
+        print_error("Can not allocate arguments: %s.", strerror(ENOMEM));
+        return -1;
+    }
+    (void) snprintf(port_text, sizeof(port_text), "%u", (unsigned int) port);
+    memcpy(args, command, count * sizeof(*args));
+    args[count] = "-p";
+    args[count + 1] = port_text;
+
+    if ((pid = fork()) < 0)
+    {
+        print_error("fork() failed: %s.", strerror(errno));
+        free(args);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        (void) execvp(args[0], args);
+        print_error("Can not execute %s: %s.", args[0], strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+    free(args);
+
+    if (wait_listening() < 0)
+    {
+        print_error("Server does not listen on port %u.", (unsigned int) port);
+        (void) kill(pid, SIGTERM);
+        (void) waitpid(pid, NULL, 0);
+        return -1;
+    }
+    return pid;
+}
+
+/**
+ * \brief Waits until the server accepts connections.
+ *
+ * \return 0 if the server listens, -1 after STARTUP_MS.
+ */
+static int wait_listening(void)
+{
+    struct timespec retry = {0, STARTUP_RETRY_MS * NS_PER_MS};
+    int waited;
+    int fd;
+
+    for (waited = 0; waited < STARTUP_MS; waited += STARTUP_RETRY_MS)
+    {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+        {
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr*) &saddress, sizeof(saddress)) == 0)
+        {
+            /* an empty request, the server copes with it */
+            (void) close(fd);
+            return 0;
+        }
+        (void) close(fd);
+        (void) nanosleep(&retry, NULL);
+    }
+    return -1;
+}
+
+/**
+ * \brief Posts requests from concurrent connections until all are done.
+ *
+ * \param requests number of requests.
+ * \param connections number of concurrent connections.
+ * \param traced server to be traced, 0 for none.
+ * \param result of the run.
+ * \param syscalls where to put the system calls of the traced server.
+ * \return 0 on success, -1 on failure.
+ */
+static int run_load(long requests, long connections, pid_t traced,
+    struct run_result* result, long* syscalls)
+{
+    struct sigaction action;
+    pthread_t waiter;
+    double start;
+
+    atomic_store(&sremaining, requests);
+    atomic_store(&sdone, 0);
+    atomic_store(&sfailed, 0);
+    atomic_store(&sload_done, false);
+    atomic_store(&stracer_done, false);
+
+    start = now();
+    for (sthread_count = 0; sthread_count < connections; ++sthread_count)
+    {
+        if (pthread_create(&sthreads[sthread_count], NULL, load_thread,
+            NULL) != 0)
+        {
+            print_error("pthread_create() failed.");
+            break;
+        }
+    }
+    if (sthread_count == 0)
+    {
+        return -1;
+    }
+
+    if (traced == 0)
+    {
+        join_load();
+    }
+    else
+    {
+        /* SIGUSR1 wakes the tracer from waitpid() when the load is done */
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = wake_tracer;
+        (void) sigemptyset(&action.sa_mask);
+        (void) sigaction(SIGUSR1, &action, NULL);
+        stracer = pthread_self();
+        if (pthread_create(&waiter, NULL, wait_load, NULL) != 0)
+        {
+            print_error("pthread_create() failed.");
+            join_load();
+            return -1;
+        }
+        *syscalls = trace_syscalls(traced);
+        atomic_store(&stracer_done, true);
+        (void) pthread_join(waiter, NULL);
+        if (*syscalls < 0)
+        {
+            return -1;
+        }
+    }
+
+    result->seconds = now() - start;
+    result->done = atomic_load(&sdone);
+    result->failed = atomic_load(&sfailed);
+    return 0;
+}
+
+/**
+ * \brief Waits for the load threads of the current run.
+ */
+static void join_load(void)
+{
+    long i;
+
+    for (i = 0; i < sthread_count; ++i)
+    {
+        (void) pthread_join(sthreads[i], NULL);
+    }
+}
+
+/**
+ * \brief Posts requests one after another until none are left.
+ *
+ * \param arg will be ignored.
+ * \return NULL.
+ */
+static void* load_thread(void* arg)
+{
+    (void) arg; /* pedantic */
+    while (atomic_fetch_sub(&sremaining, 1) > 0)
+    {
+        if (post_request() == 0)
+        {
+            atomic_fetch_add(&sdone, 1);
+        }
+        else
+        {
+            atomic_fetch_add(&sfailed, 1);
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief Waits for the load threads and stops the tracer.
+ *
+ * The tracer may miss a wakeup while it is not waiting, so it is woken
+ * until it has detached.
+ *
+ * \param arg will be ignored.
+ * \return NULL.
+ */
+static void* wait_load(void* arg)
+{
+    struct timespec retry = {0, STARTUP_RETRY_MS * NS_PER_MS};
+
+    (void) arg; /* pedantic */
+    join_load();
+    atomic_store(&sload_done, true);
+    while (!atomic_load(&stracer_done))
+    {
+        (void) pthread_kill(stracer, SIGUSR1);
+        (void) nanosleep(&retry, NULL);
+    }
+    return NULL;
+}
+
+/**
+ * \brief Posts one request and reads the response to the end.
+ *
+ * \return 0 on success, -1 on failure.
+ */
+static int post_request(void)
+{
+    char buf[BUFSIZ];
+    size_t written = 0;
+    ssize_t count;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*) &saddress, sizeof(saddress)) < 0)
+    {
+        (void) close(fd);
+        return -1;
+    }
+    while (written < sizeof(srequest) - 1)
+    {
+        count = send(fd, srequest + written, sizeof(srequest) - 1 - written,
+            MSG_NOSIGNAL);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            (void) close(fd);
+            return -1;
+        }
+        written += (size_t) count;
+    }
+    (void) shutdown(fd, SHUT_WR);
+
+    while ((count = read(fd, buf, sizeof(buf))) != 0)
+    {
+        if ((count < 0) && (errno != EINTR))
+        {
+            (void) close(fd);
+            return -1;
+        }
+    }
+    (void) close(fd);
+    return 0;
+}
+
+/**
+ * \brief Counts the system calls of the main thread of the server.
+ *
+ * Attaches to the server, lets it run from system call stop to system call
+ * stop until the load is done and detaches again.
+ *
+ * \param pid of the server.
+ * \return number of system calls, -1 on failure.
+ */
+static long trace_syscalls(pid_t pid)
+{
+    long stops = 0;
+    int signal_number = 0;
+    int status;
+
+    if ((ptrace(PTRACE_SEIZE, pid, NULL, (void*) PTRACE_O_TRACESYSGOOD) < 0) ||
+        (ptrace(PTRACE_INTERRUPT, pid, NULL, NULL) < 0))
+    {
+        print_error("ptrace() failed: %s.", strerror(errno));
+        return -1;
+    }
+
+    while (1)
+    {
+        if (waitpid(pid, &status, __WALL) < 0)
+        {
+            if (errno != EINTR)
+            {
+                print_error("waitpid() failed: %s.", strerror(errno));
+                return -1;
+            }
+            if (atomic_load(&sload_done))
+            {
+                /* detaching needs a stopped tracee */
+                (void) ptrace(PTRACE_INTERRUPT, pid, NULL, NULL);
+            }
+            continue;
+        }
+        if (!WIFSTOPPED(status))
+        {
+            print_error("Server terminated.");
+            return -1;
+        }
+
+        signal_number = 0;
+        if (WSTOPSIG(status) == (SIGTRAP | 0x80))
+        {
+            ++stops;
+        }
+        else if ((status >> 16) != PTRACE_EVENT_STOP)
+        {
+            /* a signal for the server, deliver it */
+            signal_number = WSTOPSIG(status);
+        }
+
+        if (atomic_load(&sload_done))
+        {
+            break;
+        }
+        if (ptrace(PTRACE_SYSCALL, pid, NULL,
+            (void*) (long) signal_number) < 0)
+        {
+            print_error("ptrace() failed: %s.", strerror(errno));
+            return -1;
+        }
+    }
+
+    (void) ptrace(PTRACE_DETACH, pid, NULL, (void*) (long) signal_number);
+    return stops / STOPS_PER_SYSCALL;
+}
+
+/**
+ * \brief Interrupts waitpid() of the tracer.
+ *
+ * \param signal_number will be ignored.
+ */
+static void wake_tracer(int signal_number)
+{
+    (void) signal_number; /* pedantic */
+}
+
+/**
+ * \brief Returns the monotonic time.
+ *
+ * \return seconds since some unspecified start.
+ */
+static double now(void)
+{
+    struct timespec time;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec + time.tv_nsec / NS_PER_SECOND;
+}
+
+/* === EOF ================================================================== */
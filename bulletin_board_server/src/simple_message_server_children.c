@@ -0,0 +1,463 @@
+/**
+ * @file simple_message_server_children.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, lifecycle accounting of the business logic children.
+ *
+ * Every child serving a connection is kept in a table with its start time
+ * and the address of its client until it is reaped by the event loop. Then
+ * its wall time, CPU time, peak memory and exit status are recorded into the
+ * metrics of the process, which are reported periodically too. Children
+ * running longer than CHILDREN_SLOW_MS are reported one by one with their
+ * client, to spot slow business logic runs.
+ *
+ * Children are forked by the event loop and by the relaying threads, so the
+ * table is protected by a mutex. A child is entered while the mutex is held
+ * across fork(), so it can not be reaped before it is in the table.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "simple_message_server.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* initial size of the table, a power of 2 */
+#define CHILDREN_TABLE 256
+/* period of the report in milliseconds */
+#define CHILDREN_REPORT_MS 60000
+/* children running longer are reported one by one, in milliseconds */
+#define CHILDREN_SLOW_MS 5000
+
+/* exit statuses counted one by one, greater ones are counted together */
+#define EXIT_CODES 4
+/* signals counted one by one */
+#define SIGNALS 65
+
+#define US_PER_SECOND 1000000
+#define US_PER_MS 1000
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/** A child serving a connection. */
+struct child_entry
+{
+    /** process id, 0 if the entry is free */
+    pid_t pid;
+    /** port of the client, network byte order */
+    in_port_t peer_port;
+    /** address of the client, network byte order */
+    in_addr_t peer_addr;
+    /** start of serving the connection, as by metrics_now_us() */
+    uint64_t start_us;
+    /** accept of the connection, as by metrics_now_us() */
+    uint64_t accepted_us;
+};
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+
+/** Protects the table. */
+static pthread_mutex_t stable_lock = PTHREAD_MUTEX_INITIALIZER;
+/** Live children, open addressing by pid. */
+static struct child_entry* stable = NULL;
+/** Size of stable, a power of 2. */
+static size_t stable_size = 0;
+/** Number of live children in stable. */
+static size_t stable_count = 0;
+
+/** Reports the histograms. */
+static struct reactor_handler sreport;
+
+/** Children exited with status 0 .. EXIT_CODES - 1, and greater. */
+static uint64_t sexit_codes[EXIT_CODES + 1];
+/** Children killed per signal. */
+static uint64_t ssignals[SIGNALS];
+/** Children reaped at the previous report. */
+static uint64_t sreported = 0;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static int enter_child(pid_t pid, int connection_fd, uint64_t start_us);
+static void insert_entry(const struct child_entry* entry);
+static struct child_entry* find_child(pid_t pid);
+static void remove_child(struct child_entry* entry);
+static int grow_table(void);
+static bool report_children(struct reactor_handler* handler,
+    uint32_t events);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Sets up the table and the periodic report.
+ *
+ * \return 0 on success, else -1.
+ */
+int children_init(void)
+{
+    if (grow_table() < 0)
+    {
+        return -1;
+    }
+    sreport.callback = report_children;
+    return reactor_add_timer(&sreport, CHILDREN_REPORT_MS);
+}
+
+/**
+ * \brief Forks a child serving a connection and enters it into the table.
+ *
+ * \param connection_fd connect socket of the client.
+ * \return like fork().
+ */
+pid_t children_fork(int connection_fd)
+{
+    uint64_t start_us = metrics_now_us();
+    pid_t pid;
+
+    (void) pthread_mutex_lock(&stable_lock);
+    pid = fork();
+    if (pid > 0)
+    {
+        metrics_count(METRIC_FORKED, 1);
+        (void) enter_child(pid, connection_fd, start_us);
+    }
+    /* the child only inherits the locked mutex, it never uses it */
+    if (pid != 0)
+    {
+        (void) pthread_mutex_unlock(&stable_lock);
+    }
+    return pid;
+}
+
+/**
+ * \brief Enters a running child, which now serves a connection.
+ *
+ * Must be called on the thread reaping the children.
+ *
+ * \param pid of the child.
+ * \param connection_fd connect socket of the client.
+ */
+void children_started(pid_t pid, int connection_fd)
+{
+    uint64_t start_us = metrics_now_us();
+
+    metrics_count(METRIC_HANDED_OFF, 1);
+    (void) pthread_mutex_lock(&stable_lock);
+    (void) enter_child(pid, connection_fd, start_us);
+    (void) pthread_mutex_unlock(&stable_lock);
+}
+
+/**
+ * \brief Enters a reaped pool worker which executed the business logic.
+ *
+ * Must be called on the thread reaping the children, right before
+ * children_reaped().
+ *
+ * \param pid of the worker.
+ * \param peer client of the connection.
+ * \param accepted_us accept of the connection, 0 if unknown.
+ * \param start_us start of serving the connection.
+ */
+void children_adopted(pid_t pid, const struct sockaddr_in* peer,
+    uint64_t accepted_us, uint64_t start_us)
+{
+    struct child_entry entry;
+
+    entry.pid = pid;
+    entry.peer_port = peer->sin_port;
+    entry.peer_addr = peer->sin_addr.s_addr;
+    entry.start_us = start_us;
+    entry.accepted_us = (accepted_us == 0) || (accepted_us > start_us) ?
+        start_us : accepted_us;
+    (void) pthread_mutex_lock(&stable_lock);
+    if ((2 * (stable_count + 1) <= stable_size) || (grow_table() == 0))
+    {
+        insert_entry(&entry);
+    }
+    (void) pthread_mutex_unlock(&stable_lock);
+}
+
+/**
+ * \brief Accounts a reaped child.
+ *
+ * Children which did not serve a connection, e.g. workers, are ignored.
+ *
+ * \param pid of the child.
+ * \param status as returned by wait4().
+ * \param usage as returned by wait4().
+ */
+void children_reaped(pid_t pid, int status, const struct rusage* usage)
+{
+    char address[INET_ADDRSTRLEN];
+    struct child_entry* entry;
+    struct in_addr peer;
+    uint64_t now = metrics_now_us();
+    uint64_t wall_us;
+    uint64_t lifetime_us;
+    in_port_t port;
+    int code;
+
+    (void) pthread_mutex_lock(&stable_lock);
+    entry = find_child(pid);
+    if (entry == NULL)
+    {
+        (void) pthread_mutex_unlock(&stable_lock);
+        return;
+    }
+    wall_us = now - entry->start_us;
+    lifetime_us = now - entry->accepted_us;
+    peer.s_addr = entry->peer_addr;
+    port = entry->peer_port;
+    remove_child(entry);
+    (void) pthread_mutex_unlock(&stable_lock);
+
+    metrics_record(METRIC_EXEC_DURATION, wall_us);
+    metrics_record(METRIC_CHILD_LIFETIME, lifetime_us);
+    metrics_record(METRIC_CHILD_CPU,
+        (uint64_t) (usage->ru_utime.tv_sec + usage->ru_stime.tv_sec) *
+        US_PER_SECOND +
+        (uint64_t) (usage->ru_utime.tv_usec + usage->ru_stime.tv_usec));
+    metrics_record(METRIC_CHILD_MAXRSS, (uint64_t) usage->ru_maxrss);
+    if (WIFEXITED(status))
+    {
+        code = WEXITSTATUS(status);
+        ++sexit_codes[code < EXIT_CODES ? code : EXIT_CODES];
+        metrics_count(code == 0 ? METRIC_EXITED : METRIC_FAILED, 1);
+    }
+    else if (WIFSIGNALED(status))
+    {
+        if (WTERMSIG(status) < SIGNALS)
+        {
+            ++ssignals[WTERMSIG(status)];
+        }
+        metrics_count(METRIC_KILLED, 1);
+    }
+
+    if (wall_us >= (uint64_t) CHILDREN_SLOW_MS * US_PER_MS)
+    {
+        print_error("Slow business logic %ld for %s:%u: %.3f s.", (long) pid,
+            inet_ntop(AF_INET, &peer, address, sizeof(address)) != NULL ?
+            address : "?", (unsigned int) ntohs(port),
+            (double) wall_us / US_PER_SECOND);
+    }
+}
+
+/**
+ * \brief Enters a child into the table, the mutex is held.
+ *
+ * \param pid of the child.
+ * \param connection_fd connect socket of the client.
+ * \param start_us start of serving the connection.
+ * \return 0 on success, -1 if the table can not grow.
+ */
+static int enter_child(pid_t pid, int connection_fd, uint64_t start_us)
+{
+    struct sockaddr_in peer;
+    socklen_t length = sizeof(peer);
+    struct child_entry entry;
+
+    /* at most half full, so probing stays short */
+    if ((2 * (stable_count + 1) > stable_size) && (grow_table() < 0))
+    {
+        return -1;
+    }
+    memset(&peer, 0, sizeof(peer));
+    (void) getpeername(connection_fd, (struct sockaddr*) &peer, &length);
+
+    entry.pid = pid;
+    entry.peer_port = peer.sin_port;
+    entry.peer_addr = peer.sin_addr.s_addr;
+    entry.start_us = start_us;
+    /* the accept time is unknown for connections not accepted here */
+    entry.accepted_us = metrics_accepted_at(connection_fd);
+    if ((entry.accepted_us == 0) || (entry.accepted_us > start_us))
+    {
+        entry.accepted_us = start_us;
+    }
+    insert_entry(&entry);
+    return 0;
+}
+
+/**
+ * \brief Inserts an entry into a table with room for it.
+ *
+ * \param entry of the child.
+ */
+static void insert_entry(const struct child_entry* entry)
+{
+    size_t i;
+
+    for (i = (size_t) entry->pid & (stable_size - 1); stable[i].pid != 0;
+        i = (i + 1) & (stable_size - 1))
+    {
+    }
+    stable[i] = *entry;
+    ++stable_count;
+}
+
+/**
+ * \brief Looks a child up, the mutex is held.
+ *
+ * \param pid of the child.
+ * \return its entry, NULL if not found.
+ */
+static struct child_entry* find_child(pid_t pid)
+{
+    size_t i;
+
+    if (stable == NULL)
+    {
+        return NULL;
+    }
+    for (i = (size_t) pid & (stable_size - 1); stable[i].pid != 0;
+        i = (i + 1) & (stable_size - 1))
+    {
+        if (stable[i].pid == pid)
+        {
+            return &stable[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief Removes a child, the mutex is held.
+ *
+ * Following entries are shifted back, so no tombstones are needed.
+ *
+ * \param entry of the child.
+ */
+static void remove_child(struct child_entry* entry)
+{
+    size_t mask = stable_size - 1;
+    size_t hole = (size_t) (entry - stable);
+    size_t i = hole;
+    size_t home;
+
+    while (1)
+    {
+        i = (i + 1) & mask;
+        if (stable[i].pid == 0)
+        {
+            break;
+        }
+        home = (size_t) stable[i].pid & mask;
+        /* move the entry if its home is not between the hole and itself */
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            stable[hole] = stable[i];
+            hole = i;
+        }
+    }
+    stable[hole].pid = 0;
+    --stable_count;
+}
+
+/**
+ * \brief Doubles the table, the mutex is held.
+ *
+ * \return 0 on success, else -1.
+ */
+static int grow_table(void)
+{
+    struct child_entry* old = stable;
+    size_t old_size = stable_size;
+    size_t i;
+
+    stable_size = old_size == 0 ? CHILDREN_TABLE : 2 * old_size;
+    stable = calloc(stable_size, sizeof(*stable));
+    if (stable == NULL)
+    {
+        print_error("Can not allocate children table: %s.", strerror(ENOMEM));
+        stable = old;
+        stable_size = old_size;
+        return -1;
+    }
+    stable_count = 0;
+    for (i = 0; i < old_size; ++i)
+    {
+        if (old[i].pid != 0)
+        {
+            insert_entry(&old[i]);
+        }
+    }
+    free(old);
+    return 0;
+}
+
+/**
+ * \brief Reports the metrics of the children reaped so far.
+ *
+ * \param handler the report timer.
+ * \param events will be ignored.
+ * \return false.
+ */
+static bool report_children(struct reactor_handler* handler, uint32_t events)
+{
+    const struct histogram* wall_us = metrics_histogram(METRIC_EXEC_DURATION);
+    const struct histogram* cpu_us = metrics_histogram(METRIC_CHILD_CPU);
+    const struct histogram* maxrss_kb = metrics_histogram(METRIC_CHILD_MAXRSS);
+    uint64_t reaped;
+    size_t live;
+
+    (void) events; /* pedantic */
+    reactor_drain(handler);
+    reaped = atomic_load_explicit(&wall_us->count, memory_order_relaxed);
+    if (reaped == sreported)
+    {
+        return false;
+    }
+    sreported = reaped;
+    (void) pthread_mutex_lock(&stable_lock);
+    live = stable_count;
+    (void) pthread_mutex_unlock(&stable_lock);
+
+    print_error("Children: %llu reaped, %lu running, "
+        "wall p50 %llu us p99 %llu us max %llu us, "
+        "cpu p50 %llu us p99 %llu us, maxrss p50 %llu KiB p99 %llu KiB, "
+        "exit 0: %llu, 1: %llu, 2: %llu, 3: %llu, other: %llu, "
+        "SIGKILL: %llu, SIGSEGV: %llu, SIGPIPE: %llu.",
+        (unsigned long long) reaped, (unsigned long) live,
+        (unsigned long long) histogram_percentile(wall_us, 50.0),
+        (unsigned long long) histogram_percentile(wall_us, 99.0),
+        (unsigned long long) histogram_percentile(wall_us, 100.0),
+        (unsigned long long) histogram_percentile(cpu_us, 50.0),
+        (unsigned long long) histogram_percentile(cpu_us, 99.0),
+        (unsigned long long) histogram_percentile(maxrss_kb, 50.0),
+        (unsigned long long) histogram_percentile(maxrss_kb, 99.0),
+        (unsigned long long) sexit_codes[0], (unsigned long long) sexit_codes[1],
+        (unsigned long long) sexit_codes[2], (unsigned long long) sexit_codes[3],
+        (unsigned long long) sexit_codes[EXIT_CODES],
+        (unsigned long long) ssignals[SIGKILL],
+        (unsigned long long) ssignals[SIGSEGV],
+        (unsigned long long) ssignals[SIGPIPE]);
+    return false;
+}
+
+/* === EOF ================================================================== */
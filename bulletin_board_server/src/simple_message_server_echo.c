@@ -0,0 +1,145 @@
+/**
+ * @file simple_message_server_echo.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, example business logic plugin.
+ *
+ * Answers every request with status 0 and a bulletin board page which shows
+ * the posted request. It serves as reference implementation of the plugin
+ * ABI in simple_message_server_plugin.h.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "simple_message_server_plugin.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+#define RESPONSE_FILE "vcs_tcpip_bulletin_board_response.html"
+#define PAGE_HEAD "<html><body><pre>\n"
+#define PAGE_TAIL "</pre></body></html>\n"
+
+/* requests are cut off at this size, the rest is read and dropped */
+#define MAX_REQUEST 4096
+#define DROP_SIZE 4096
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static int echo_request(void* state, const struct sms_reader* reader,
+    const struct sms_writer* writer);
+
+/*
+ * ---------------------------------------------------------------- globals --
+ */
+
+/** Entry points of this plugin. */
+const struct sms_plugin sms_plugin =
+{
+    SMS_PLUGIN_ABI_VERSION,
+    "echo",
+    NULL,
+    echo_request,
+    NULL
+};
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Answers a request with a page showing the request.
+ *
+ * Markup characters of the request are escaped. The request is read up to
+ * its end even beyond MAX_REQUEST, as the frame contract demands, so no
+ * unread input makes close() reset the connection before the client has
+ * the response.
+ *
+ * \param state will be ignored.
+ * \param reader source of the request.
+ * \param writer sink of the response.
+ * \return 0 on success, else -1.
+ */
+static int echo_request(void* state, const struct sms_reader* reader,
+    const struct sms_writer* writer)
+{
+    char request[MAX_REQUEST];
+    char drop[DROP_SIZE];
+    char page[sizeof(PAGE_HEAD) + sizeof(PAGE_TAIL) + 5 * MAX_REQUEST];
+    char header[sizeof(RESPONSE_FILE) + 64];
+    size_t amount = 0;
+    size_t page_len;
+    ssize_t read_count;
+    int header_len;
+    size_t i;
+
+    (void) state; /* pedantic */
+    do
+    {
+        if (amount < sizeof(request))
+        {
+            read_count = reader->read(reader, request + amount,
+                sizeof(request) - amount);
+        }
+        else
+        {
+            read_count = reader->read(reader, drop, sizeof(drop));
+        }
+        if (read_count < 0)
+        {
+            return -1;
+        }
+        amount += amount < sizeof(request) ? (size_t) read_count : 0;
+    } while (read_count > 0);
+
+    page_len = strlen(PAGE_HEAD);
+    memcpy(page, PAGE_HEAD, page_len);
+    for (i = 0; i < amount; ++i)
+    {
+        switch (request[i])
+        {
+        case '<':
+            memcpy(page + page_len, "&lt;", 4);
+            page_len += 4;
+            break;
+        case '>':
+            memcpy(page + page_len, "&gt;", 4);
+            page_len += 4;
+            break;
+        case '&':
+            memcpy(page + page_len, "&amp;", 5);
+            page_len += 5;
+            break;
+        default:
+            page[page_len++] = request[i];
+            break;
+        }
+    }
+    memcpy(page + page_len, PAGE_TAIL, strlen(PAGE_TAIL));
+    page_len += strlen(PAGE_TAIL);
+
+    header_len = snprintf(header, sizeof(header), "status=0\nfile=%s\nlen=%lu\n",
+        RESPONSE_FILE, (unsigned long) page_len);
+    if ((header_len < 0) ||
+        (writer->write(writer, header, (size_t) header_len) < 0) ||
+        (writer->write(writer, page, page_len) < 0))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/* === EOF ================================================================== */
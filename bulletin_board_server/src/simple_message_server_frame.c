@@ -0,0 +1,180 @@
+/**
+ * @file simple_message_server_frame.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, records of the framed worker protocol.
+ *
+ * Used by the server and by the framed worker host alike.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <arpa/inet.h>
+#include "simple_message_server_frame.h"
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Writes a record.
+ *
+ * \param fd stream to the peer.
+ * \param type record type.
+ * \param body of the record, may be NULL if length is 0.
+ * \param length of the body, at most SMS_FRAME_MAX_LENGTH.
+ * \return 0 on success, -1 on error with errno set.
+ */
+int frame_write(int fd, unsigned int type, const void* body, size_t length)
+{
+    struct sms_frame_header header;
+    struct iovec iov[2];
+    struct msghdr msg;
+    ssize_t written;
+
+    if (length > SMS_FRAME_MAX_LENGTH)
+    {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    memset(&header, 0, sizeof(header));
+    header.version = SMS_FRAME_VERSION;
+    header.type = (uint8_t) type;
+    header.length = htonl((uint32_t) length);
+
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = (void*) body;
+    iov[1].iov_len = length;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = length > 0 ? 2 : 1;
+
+    while (msg.msg_iovlen > 0)
+    {
+        /* a dead peer must not kill the process by SIGPIPE */
+        written = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if ((written < 0) && (errno == ENOTSOCK))
+        {
+            written = writev(fd, msg.msg_iov, (int) msg.msg_iovlen);
+        }
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        /* skip what has been written, the rest is sent again */
+        while ((msg.msg_iovlen > 0) &&
+            ((size_t) written >= msg.msg_iov[0].iov_len))
+        {
+            written -= (ssize_t) msg.msg_iov[0].iov_len;
+            ++msg.msg_iov;
+            --msg.msg_iovlen;
+        }
+        if (msg.msg_iovlen > 0)
+        {
+            msg.msg_iov[0].iov_base = (char*) msg.msg_iov[0].iov_base + written;
+            msg.msg_iov[0].iov_len -= (size_t) written;
+        }
+    }
+    return 0;
+}
+
+/**
+ * \brief Reads and checks the header of the next record.
+ *
+ * \param fd stream from the peer.
+ * \param type where to put the record type.
+ * \param length where to put the length of the body.
+ * \return 1 on success, 0 at end of file before the record, -1 on error or
+ *  if the header is malformed.
+ */
+int frame_read_header(int fd, unsigned int* type, size_t* length)
+{
+    struct sms_frame_header header;
+    size_t amount = 0;
+    ssize_t read_count;
+
+    while (amount < sizeof(header))
+    {
+        read_count = read(fd, (char*) &header + amount,
+            sizeof(header) - amount);
+        if (read_count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        if (read_count == 0)
+        {
+            /* end of file within the header is an error */
+            errno = EPROTO;
+            return amount == 0 ? 0 : -1;
+        }
+        amount += (size_t) read_count;
+    }
+
+    *type = header.type;
+    *length = ntohl(header.length);
+    if ((header.version != SMS_FRAME_VERSION) || (header.reserved != 0) ||
+        (*length > SMS_FRAME_MAX_LENGTH))
+    {
+        errno = EPROTO;
+        return -1;
+    }
+    return 1;
+}
+
+/**
+ * \brief Reads the body of a record.
+ *
+ * \param fd stream from the peer.
+ * \param body where to put the body.
+ * \param length of the body as read with frame_read_header().
+ * \return 0 on success, -1 on error or at end of file.
+ */
+int frame_read_body(int fd, void* body, size_t length)
+{
+    size_t amount = 0;
+    ssize_t read_count;
+
+    while (amount < length)
+    {
+        read_count = read(fd, (char*) body + amount, length - amount);
+        if (read_count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        if (read_count == 0)
+        {
+            errno = EPROTO;
+            return -1;
+        }
+        amount += (size_t) read_count;
+    }
+    return 0;
+}
+
+/* === EOF ================================================================== */
@@ -0,0 +1,83 @@
+/**
+ * @file simple_message_server_frame.h
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, protocol between the server and framed logic workers.
+ *
+ * A framed worker is a long-lived process serving one request after the
+ * other. It reads records from stdin and writes records to stdout, both a
+ * stream socket to the server. Every record is a struct sms_frame_header
+ * followed by length bytes of body.
+ *
+ * For every client the server sends the request (user=, img=, message) in
+ * SMS_FRAME_REQUEST records, terminated by an empty SMS_FRAME_REQUEST_END.
+ * The worker answers with the response (status=, file=, len=, file content)
+ * in SMS_FRAME_RESPONSE records, terminated by an empty
+ * SMS_FRAME_RESPONSE_END, and waits for the next request. The worker has
+ * to read the complete request before it writes the response. A worker
+ * which breaks the protocol is killed and restarted. At end of file on
+ * stdin the worker exits.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_FRAME_H
+#define SIMPLE_MESSAGE_SERVER_FRAME_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* version of this protocol, sent in every record */
+#define SMS_FRAME_VERSION 1
+
+/* maximum body length of a record */
+#define SMS_FRAME_MAX_LENGTH 65536
+
+/* record types */
+#define SMS_FRAME_REQUEST 1
+#define SMS_FRAME_REQUEST_END 2
+#define SMS_FRAME_RESPONSE 3
+#define SMS_FRAME_RESPONSE_END 4
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/**
+ * Header of a record.
+ */
+struct sms_frame_header
+{
+    /** SMS_FRAME_VERSION */
+    uint8_t version;
+    /** one of the record types */
+    uint8_t type;
+    /** must be 0 */
+    uint16_t reserved;
+    /** length of the body in network byte order */
+    uint32_t length;
+};
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int frame_write(int fd, unsigned int type, const void* body, size_t length);
+int frame_read_header(int fd, unsigned int* type, size_t* length);
+int frame_read_body(int fd, void* body, size_t length);
+
+#endif /* SIMPLE_MESSAGE_SERVER_FRAME_H */
+
+/* === EOF ================================================================== */
@@ -0,0 +1,342 @@
+/**
+ * @file simple_message_server_framed.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, persistent framed logic workers.
+ *
+ * A fixed set of long-lived logic workers is started once. Each worker is
+ * owned by a serving thread, which relays the request of a client to its
+ * worker in the records of simple_message_server_frame.h and streams the
+ * framed response back to the client. So the start-up of a process is paid
+ * once per worker instead of once per connection. A worker which dies or
+ * breaks the protocol is killed and restarted.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "simple_message_server.h"
+#include "simple_message_server_frame.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* timeout for a stalled client or a hanging worker in seconds */
+#define FRAMED_IO_TIMEOUT 30
+
+/* exit code of a worker which could not be executed */
+#define EXEC_FAILED 127
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/** A framed logic worker, owned by one serving thread. */
+struct framed_worker
+{
+    /** process id, 0 if not running */
+    pid_t pid;
+    /** server end of the stream to the worker, -1 if not running */
+    int fd;
+};
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+
+/** Command starting a worker, run by /bin/sh. */
+static const char* scommand = NULL;
+/** Listening socket, not passed to the workers. */
+static int ssocket_fd = -1;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static int spawn_worker(struct framed_worker* worker);
+static void stop_worker(struct framed_worker* worker);
+static void serve_framed(void* context, int connection_fd);
+static int relay_request(int worker_fd, int connection_fd, char* buf,
+    uint64_t* received);
+static int relay_response(int worker_fd, int connection_fd, char* buf,
+    uint64_t* sent);
+static void set_timeouts(int fd);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Starts the framed workers and their serving threads.
+ *
+ * \param socket_fd listening socket, not passed to the workers.
+ * \param command starting a worker, run by /bin/sh.
+ * \param workers number of workers.
+ * \return 0 if at least one worker is served, else -1.
+ */
+int framed_start(int socket_fd, const char* command, long workers)
+{
+    struct framed_worker* worker;
+    long started = 0;
+    long i;
+
+    scommand = command;
+    ssocket_fd = socket_fd;
+    for (i = 0; i < workers; ++i)
+    {
+        worker = calloc(1, sizeof(*worker));
+        if (worker == NULL)
+        {
+            print_error("Can not allocate worker: %s.", strerror(ENOMEM));
+            break;
+        }
+        worker->fd = -1;
+        if (spawn_worker(worker) < 0)
+        {
+            free(worker);
+            break;
+        }
+        if (threads_start(serve_framed, worker) < 0)
+        {
+            stop_worker(worker);
+            free(worker);
+            break;
+        }
+        ++started;
+    }
+    return started > 0 ? 0 : -1;
+}
+
+/**
+ * \brief Starts a worker connected by a stream socket on stdin and stdout.
+ *
+ * Called from serving threads too, so the child only uses async-signal-safe
+ * functions until execl().
+ *
+ * \param worker not running.
+ * \return 0 on success, else -1.
+ */
+static int spawn_worker(struct framed_worker* worker)
+{
+    int stream[2];
+    pid_t pid;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, stream) < 0)
+    {
+        print_error("socketpair() failed: %s.", strerror(errno));
+        return -1;
+    }
+    if ((pid = fork()) < 0)
+    {
+        print_error("fork() failed: %s.", strerror(errno));
+        (void) close(stream[0]);
+        (void) close(stream[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        reactor_child();
+        (void) close(ssocket_fd);
+        if ((dup2(stream[1], STDIN_FILENO) == -1) ||
+            (dup2(stream[1], STDOUT_FILENO) == -1))
+        {
+            _exit(EXEC_FAILED);
+        }
+        (void) execl("/bin/sh", "sh", "-c", scommand, (char*) NULL);
+        _exit(EXEC_FAILED);
+    }
+
+    (void) close(stream[1]);
+    set_timeouts(stream[0]);
+    worker->pid = pid;
+    worker->fd = stream[0];
+    return 0;
+}
+
+/**
+ * \brief Kills a worker, it is reaped by the event loop.
+ *
+ * \param worker running.
+ */
+static void stop_worker(struct framed_worker* worker)
+{
+    (void) kill(worker->pid, SIGKILL);
+    (void) close(worker->fd);
+    worker->pid = 0;
+    worker->fd = -1;
+}
+
+/**
+ * \brief Serves a queued connection by the worker of this thread.
+ *
+ * \param context the struct framed_worker of this thread.
+ * \param connection_fd connect socket, closed by this function.
+ */
+static void serve_framed(void* context, int connection_fd)
+{
+    struct framed_worker* worker = context;
+    char buf[SMS_FRAME_MAX_LENGTH];
+    uint64_t received = 0;
+    uint64_t sent = 0;
+    uint64_t start_us;
+
+    if ((worker->fd < 0) && (spawn_worker(worker) < 0))
+    {
+        (void) close(connection_fd);
+        return;
+    }
+    start_us = metrics_started(connection_fd);
+    set_timeouts(connection_fd);
+
+    if ((relay_request(worker->fd, connection_fd, buf, &received) < 0) ||
+        (relay_response(worker->fd, connection_fd, buf, &sent) < 0))
+    {
+        print_error("Framed worker %ld failed: %s, restarting it.",
+            (long) worker->pid, strerror(errno));
+        stop_worker(worker);
+        /* restart right away, so the next client finds it warm */
+        (void) spawn_worker(worker);
+    }
+    (void) close(connection_fd);
+
+    metrics_record(METRIC_EXEC_DURATION, metrics_now_us() - start_us);
+    metrics_count(METRIC_BYTES_RECEIVED, received);
+    metrics_count(METRIC_BYTES_SENT, sent);
+    metrics_record(METRIC_REQUEST_BYTES, received);
+    metrics_record(METRIC_RESPONSE_BYTES, sent);
+}
+
+/**
+ * \brief Relays the request of the client to the worker.
+ *
+ * A client which fails or stalls ends its request early, the worker gets
+ * the request end in any case.
+ *
+ * \param worker_fd stream to the worker.
+ * \param connection_fd connect socket.
+ * \param buf of SMS_FRAME_MAX_LENGTH bytes.
+ * \param received incremented by the bytes read from the client.
+ * \return 0 on success, -1 if the worker failed.
+ */
+static int relay_request(int worker_fd, int connection_fd, char* buf,
+    uint64_t* received)
+{
+    ssize_t read_count;
+
+    while (1)
+    {
+        read_count = read(connection_fd, buf, SMS_FRAME_MAX_LENGTH);
+        if ((read_count < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        if (read_count <= 0)
+        {
+            break;
+        }
+        *received += (uint64_t) read_count;
+        if (frame_write(worker_fd, SMS_FRAME_REQUEST, buf,
+            (size_t) read_count) < 0)
+        {
+            return -1;
+        }
+    }
+    return frame_write(worker_fd, SMS_FRAME_REQUEST_END, NULL, 0);
+}
+
+/**
+ * \brief Streams the response of the worker to the client.
+ *
+ * The response is read up to its end even if the client went away, so the
+ * worker is ready for the next request. Every record is sent with MSG_MORE,
+ * so the short header records of the worker do not leave as small
+ * segments of their own; closing the connection sends the rest.
+ *
+ * \param worker_fd stream from the worker.
+ * \param connection_fd connect socket.
+ * \param buf of SMS_FRAME_MAX_LENGTH bytes.
+ * \param sent incremented by the bytes sent to the client.
+ * \return 0 on success, -1 if the worker failed.
+ */
+static int relay_response(int worker_fd, int connection_fd, char* buf,
+    uint64_t* sent)
+{
+    bool client_alive = true;
+    unsigned int type;
+    size_t length;
+    size_t written;
+    ssize_t sent_count;
+    int result;
+
+    while (1)
+    {
+        result = frame_read_header(worker_fd, &type, &length);
+        if (result == 0)
+        {
+            /* the worker died */
+            errno = EPIPE;
+        }
+        if (result <= 0)
+        {
+            return -1;
+        }
+        if ((type == SMS_FRAME_RESPONSE_END) && (length == 0))
+        {
+            return 0;
+        }
+        if ((type != SMS_FRAME_RESPONSE) ||
+            (frame_read_body(worker_fd, buf, length) < 0))
+        {
+            errno = EPROTO;
+            return -1;
+        }
+
+        written = 0;
+        while (client_alive && (written < length))
+        {
+            sent_count = send(connection_fd, buf + written, length - written,
+                MSG_NOSIGNAL | MSG_MORE);
+            if (sent_count >= 0)
+            {
+                written += (size_t) sent_count;
+                *sent += (uint64_t) sent_count;
+            }
+            else if (errno != EINTR)
+            {
+                client_alive = false;
+            }
+        }
+    }
+}
+
+/**
+ * \brief Sets the receive and send timeouts of a socket.
+ *
+ * \param fd the socket.
+ */
+static void set_timeouts(int fd)
+{
+    struct timeval timeout;
+
+    timeout.tv_sec = FRAMED_IO_TIMEOUT;
+    timeout.tv_usec = 0;
+    (void) setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    (void) setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+/* === EOF ================================================================== */
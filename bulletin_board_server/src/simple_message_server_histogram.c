@@ -0,0 +1,142 @@
+/**
+ * @file simple_message_server_histogram.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, log-linear histograms.
+ *
+ * Values below HISTOGRAM_LINEAR get a bucket each, above every power of 2 is
+ * split into HISTOGRAM_SUB_BUCKETS buckets, so any value is recorded with a
+ * relative error below 1 / HISTOGRAM_SUB_BUCKETS over the whole range of
+ * uint64_t in a fixed, small array. Recording is a few atomic increments,
+ * so histograms may be shared between threads without a lock.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "simple_message_server.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* log2 of HISTOGRAM_SUB_BUCKETS */
+#define SUB_BUCKET_BITS 3
+/* log2 of HISTOGRAM_LINEAR */
+#define LINEAR_BITS (SUB_BUCKET_BITS + 1)
+
+#define PERCENT 100.0
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Records a value.
+ *
+ * \param histogram to be updated.
+ * \param value to be recorded.
+ */
+void histogram_record(struct histogram* histogram, uint64_t value)
+{
+    atomic_fetch_add_explicit(&histogram->counts[histogram_bucket(value)], 1,
+        memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->sum, value, memory_order_relaxed);
+}
+
+/**
+ * \brief Returns the bucket of a value.
+ *
+ * \param value to be recorded.
+ * \return index into the counts of a histogram.
+ */
+unsigned int histogram_bucket(uint64_t value)
+{
+    unsigned int exponent;
+
+    if (value < HISTOGRAM_LINEAR)
+    {
+        return (unsigned int) value;
+    }
+    exponent = 63 - (unsigned int) __builtin_clzll(value);
+    return HISTOGRAM_LINEAR + (exponent - LINEAR_BITS) * HISTOGRAM_SUB_BUCKETS +
+        (unsigned int) ((value >> (exponent - SUB_BUCKET_BITS)) &
+        (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/**
+ * \brief Returns the greatest value recorded into a bucket.
+ *
+ * \param bucket index into the counts of a histogram.
+ * \return upper bound of the bucket.
+ */
+uint64_t histogram_upper_bound(unsigned int bucket)
+{
+    unsigned int exponent;
+    uint64_t sub;
+
+    if (bucket < HISTOGRAM_LINEAR)
+    {
+        return bucket;
+    }
+    exponent = LINEAR_BITS + (bucket - HISTOGRAM_LINEAR) / HISTOGRAM_SUB_BUCKETS;
+    sub = HISTOGRAM_SUB_BUCKETS + (bucket - HISTOGRAM_LINEAR) %
+        HISTOGRAM_SUB_BUCKETS;
+    return ((sub + 1) << (exponent - SUB_BUCKET_BITS)) - 1;
+}
+
+/**
+ * \brief Estimates a percentile of the recorded values.
+ *
+ * \param histogram to be evaluated.
+ * \param percentile between 0 and 100.
+ * \return upper bound of the bucket holding the percentile, 0 if empty.
+ */
+uint64_t histogram_percentile(const struct histogram* histogram,
+    double percentile)
+{
+    uint64_t total = 0;
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t rank;
+    uint64_t seen = 0;
+    unsigned int i;
+
+    /* a snapshot, recording may go on meanwhile */
+    for (i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+        counts[i] = atomic_load_explicit(&histogram->counts[i],
+            memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+    rank = (uint64_t) (percentile / PERCENT * (double) total + 0.5);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+    for (i = 0; i < HISTOGRAM_BUCKETS; ++i)
+    {
+        seen += counts[i];
+        if (seen >= rank)
+        {
+            break;
+        }
+    }
+    return histogram_upper_bound(i < HISTOGRAM_BUCKETS ? i :
+        HISTOGRAM_BUCKETS - 1);
+}
+
+/* === EOF ================================================================== */
@@ -0,0 +1,928 @@
+/**
+ * @file simple_message_server_metrics.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, counters and histograms served in Prometheus text format.
+ *
+ * Every process of the server (the event loop, each acceptor and each pool
+ * worker) updates its own slot of a shared mapping, so recording is a few
+ * relaxed atomic increments without a lock and without a system call. The
+ * business logic children record the accept to exec time into the slot of
+ * their parent right before execl(). The slots are mapped before anything
+ * is forked, so any process can read all of them.
+ *
+ * The metrics are served on an admin port or a Unix socket, which is
+ * accepted by the event loop of every process running one. A scrape is
+ * answered with HTTP/1.0 if it starts with "GET ", else with the bare text,
+ * so "curl http://host:port/metrics" and "nc -U path" both work. Counters
+ * are reported per process, histograms summed over all processes.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include "simple_message_server.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* connect sockets with an accept time stamp, greater ones are not timed */
+#define METRICS_FDS 65536
+/* length of the name of a slot */
+#define METRICS_NAME 32
+
+/* scrapes served at the same time, further ones are closed */
+#define ADMIN_CONNECTIONS 16
+/* bytes of a scrape request read at most */
+#define ADMIN_REQUEST 1024
+/* length of the accept queue of the admin socket */
+#define ADMIN_BACKLOG 16
+/* period of the admin timer in milliseconds */
+#define ADMIN_TICK_MS 1000
+/* a scrape is closed after this time in milliseconds */
+#define ADMIN_TIMEOUT_MS 5000
+
+#define US_PER_SECOND 1000000
+#define NS_PER_US 1000
+#define US_PER_MS 1000
+#define BYTES_PER_KIB 1024
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/** The metrics of one process, in the shared mapping. */
+struct metrics_slot
+{
+    /** whether a process has attached to the slot */
+    atomic_bool used;
+    /** label of the process, written before used is set */
+    char name[METRICS_NAME];
+    /** values per enum metric_counter */
+    _Atomic uint64_t counters[METRIC_COUNTERS];
+    /** histograms per enum metric_histogram */
+    struct histogram histograms[METRIC_HISTOGRAMS];
+};
+
+/** How a metric is exposed. */
+struct metric_info
+{
+    /** metric name, entries of the same name follow each other */
+    const char* name;
+    /** additional label, NULL if none */
+    const char* label;
+    /** help text */
+    const char* help;
+    /** exposed value is recorded value * multiplier / divisor */
+    uint64_t multiplier;
+    /** 1 for integer values, else US_PER_SECOND */
+    uint64_t divisor;
+};
+
+/** State of a scrape. */
+enum admin_state
+{
+    ADMIN_READING = 0,   /**< reading the request */
+    ADMIN_WRITING,       /**< sending the response */
+    ADMIN_DRAINING       /**< response sent, waiting for the client to close */
+};
+
+/** A scrape of the metrics. */
+struct admin_connection
+{
+    /** the connect socket, must be the first member */
+    struct reactor_handler handler;
+    /** what the connection waits for */
+    enum admin_state state;
+    /** the request so far, NUL terminated */
+    char request[ADMIN_REQUEST + 1];
+    /** bytes in request */
+    size_t request_length;
+    /** the response, allocated */
+    char* response;
+    /** bytes in response */
+    size_t response_length;
+    /** bytes of response sent */
+    size_t sent;
+    /** closed when still open at this time, in us */
+    uint64_t deadline;
+    /** whether the entry is used */
+    bool used;
+};
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+
+/** Exposition of the counters, per enum metric_counter. */
+static const struct metric_info scounter_info[METRIC_COUNTERS] =
+{
+    {"sms_connections_accepted_total", NULL,
+        "Connections accepted.", 1, 1},
+    {"sms_children_forked_total", NULL,
+        "Business logic children forked for a connection.", 1, 1},
+    {"sms_connections_handed_off_total", NULL,
+        "Connections handed to a parked business logic.", 1, 1},
+    {"sms_connections_threaded_total", NULL,
+        "Connections served by a plugin, framed or relaying thread.", 1, 1},
+    {"sms_connections_shed_total", "reason=\"rejected\"",
+        "Connections answered busy by the admission control.", 1, 1},
+    {"sms_connections_shed_total", "reason=\"queue_full\"", NULL, 1, 1},
+    {"sms_connections_shed_total", "reason=\"timed_out\"", NULL, 1, 1},
+    {"sms_children_reaped_total", "status=\"success\"",
+        "Business logic children reaped, by exit status.", 1, 1},
+    {"sms_children_reaped_total", "status=\"failure\"", NULL, 1, 1},
+    {"sms_children_reaped_total", "status=\"signal\"", NULL, 1, 1},
+    {"sms_received_bytes_total", NULL,
+        "Request bytes read by the server itself.", 1, 1},
+    {"sms_sent_bytes_total", NULL,
+        "Response bytes sent by the server itself.", 1, 1}
+};
+
+/** Exposition of the histograms, per enum metric_histogram. */
+static const struct metric_info shistogram_info[METRIC_HISTOGRAMS] =
+{
+    {"sms_accept_to_exec_seconds", NULL,
+        "Accept of a connection until its business logic runs.",
+        1, US_PER_SECOND},
+    {"sms_exec_duration_seconds", NULL,
+        "Business logic serving a connection.", 1, US_PER_SECOND},
+    {"sms_child_lifetime_seconds", NULL,
+        "Accept of a connection until its business logic child is reaped.",
+        1, US_PER_SECOND},
+    {"sms_child_cpu_seconds", NULL,
+        "User and system CPU time of a business logic child.",
+        1, US_PER_SECOND},
+    {"sms_child_maxrss_bytes", NULL,
+        "Peak resident set size of a business logic child.",
+        BYTES_PER_KIB, 1},
+    {"sms_request_bytes", NULL,
+        "Size of a request read by the server itself.", 1, 1},
+    {"sms_response_bytes", NULL,
+        "Size of a response sent by the server itself.", 1, 1}
+};
+
+/** All slots, shared by all processes. */
+static struct metrics_slot* sslots = NULL;
+/** Number of slots. */
+static size_t sslot_count = 0;
+/** Slots per acceptor: its event loop and its pool workers. */
+static size_t sgroup_size = 1;
+/** Slot of the calling process. */
+static struct metrics_slot* sslot = NULL;
+/** Whether the server runs acceptors. */
+static bool sacceptors = false;
+/** Acceptor of the calling process, 0 without acceptors. */
+static long sacceptor = 0;
+
+/** Accept time per connect socket in us, 0 if unknown. */
+static uint64_t* saccepted = NULL;
+
+/** Listening admin socket, -1 if the metrics are not served. */
+static struct reactor_handler slistener = { .fd = -1 };
+/** Closes stalled scrapes and retries accepting. */
+static struct reactor_handler stimer;
+/** Scrapes in progress. */
+static struct admin_connection sadmin[ADMIN_CONNECTIONS];
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static void attach_slot(size_t index, const char* name);
+static int open_admin_socket(const struct server_config* config);
+static void admin_accept(struct reactor_handler* handler, int connection_fd);
+static bool admin_ready(struct reactor_handler* handler, uint32_t events);
+static bool admin_read(struct admin_connection* admin);
+static bool admin_write(struct admin_connection* admin);
+static bool admin_drain(struct admin_connection* admin);
+static void admin_close(struct admin_connection* admin);
+static bool admin_tick(struct reactor_handler* handler, uint32_t events);
+static int render_response(struct admin_connection* admin);
+static void render_metrics(FILE* out);
+static void render_counter(FILE* out, enum metric_counter counter);
+static void render_histogram(FILE* out, enum metric_histogram histogram);
+static void print_value(FILE* out, uint64_t value,
+    const struct metric_info* info);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Maps the slots and opens the admin socket.
+ *
+ * Must be called before any process of the server is forked.
+ *
+ * \param config with the acceptors, the pool size and the admin socket.
+ * \return 0 on success, else -1.
+ */
+int metrics_init(const struct server_config* config)
+{
+    size_t groups = config->acceptors > 0 ? (size_t) config->acceptors : 1;
+
+    sgroup_size = 1 + (config->workers > 0 ? (size_t) config->max_workers : 0);
+    sslot_count = groups * sgroup_size;
+    /* pages of slots never attached are never touched */
+    sslots = mmap(NULL, sslot_count * sizeof(*sslots), PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (sslots == MAP_FAILED)
+    {
+        sslots = NULL;
+        print_error("mmap() of metrics failed: %s.", strerror(errno));
+        return -1;
+    }
+    saccepted = calloc(METRICS_FDS, sizeof(*saccepted));
+    if (saccepted == NULL)
+    {
+        print_error("Can not allocate metrics: %s.", strerror(ENOMEM));
+        return -1;
+    }
+    /* the master of the acceptors records nothing */
+    sslot = &sslots[0];
+    sacceptors = config->acceptors > 0;
+    if (!sacceptors)
+    {
+        attach_slot(0, "main");
+    }
+    return open_admin_socket(config);
+}
+
+/**
+ * \brief Attaches a forked acceptor to its slot.
+ *
+ * \param index of the acceptor.
+ */
+void metrics_attach_acceptor(long index)
+{
+    char name[METRICS_NAME];
+
+    sacceptor = index;
+    (void) snprintf(name, sizeof(name), "acceptor%ld", index);
+    attach_slot((size_t) index * sgroup_size, name);
+}
+
+/**
+ * \brief Attaches a forked pool worker to its slot.
+ *
+ * \param index of the worker in the pool.
+ */
+void metrics_attach_worker(long index)
+{
+    char name[METRICS_NAME];
+
+    if (sacceptors)
+    {
+        (void) snprintf(name, sizeof(name), "acceptor%ld-worker%ld", sacceptor,
+            index);
+    }
+    else
+    {
+        (void) snprintf(name, sizeof(name), "worker%ld", index);
+    }
+    attach_slot((size_t) sacceptor * sgroup_size + 1 + (size_t) index, name);
+}
+
+/**
+ * \brief Serves the metrics by the event loop of the calling process.
+ *
+ * \return 0 on success or if the metrics are not served, else -1.
+ */
+int metrics_serve(void)
+{
+    if (slistener.fd < 0)
+    {
+        return 0;
+    }
+    stimer.callback = admin_tick;
+    if ((reactor_add_accept(&slistener, admin_accept) < 0) ||
+        (reactor_add_timer(&stimer, ADMIN_TICK_MS) < 0))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Counts an accepted connection and stamps its accept time.
+ *
+ * \param connection_fd connect socket.
+ */
+void metrics_accepted(int connection_fd)
+{
+    metrics_count(METRIC_ACCEPTED, 1);
+    if ((saccepted != NULL) && (connection_fd >= 0) && (connection_fd < METRICS_FDS))
+    {
+        saccepted[connection_fd] = metrics_now_us();
+    }
+}
+
+/**
+ * \brief Returns the accept time of a connection.
+ *
+ * \param connection_fd connect socket.
+ * \return accept time as by metrics_now_us(), 0 if unknown.
+ */
+uint64_t metrics_accepted_at(int connection_fd)
+{
+    if ((saccepted == NULL) || (connection_fd < 0) ||
+        (connection_fd >= METRICS_FDS))
+    {
+        return 0;
+    }
+    return saccepted[connection_fd];
+}
+
+/**
+ * \brief Records the accept to exec time of a connection starting now.
+ *
+ * Async-signal-safe, for forked children before execl().
+ *
+ * \param connection_fd connect socket.
+ * \return the current time as by metrics_now_us().
+ */
+uint64_t metrics_started(int connection_fd)
+{
+    uint64_t accepted = metrics_accepted_at(connection_fd);
+    uint64_t now = metrics_now_us();
+
+    if ((accepted != 0) && (now >= accepted))
+    {
+        metrics_record(METRIC_ACCEPT_TO_EXEC, now - accepted);
+    }
+    return now;
+}
+
+/**
+ * \brief Adds to a counter of the calling process.
+ *
+ * \param counter to be updated.
+ * \param amount to be added.
+ */
+void metrics_count(enum metric_counter counter, uint64_t amount)
+{
+    if (sslot != NULL)
+    {
+        atomic_fetch_add_explicit(&sslot->counters[counter], amount,
+            memory_order_relaxed);
+    }
+}
+
+/**
+ * \brief Records a value into a histogram of the calling process.
+ *
+ * \param histogram to be updated.
+ * \param value to be recorded.
+ */
+void metrics_record(enum metric_histogram histogram, uint64_t value)
+{
+    if (sslot != NULL)
+    {
+        histogram_record(&sslot->histograms[histogram], value);
+    }
+}
+
+/**
+ * \brief Returns a histogram of the calling process.
+ *
+ * \param histogram to be returned.
+ * \return the histogram, NULL before metrics_init().
+ */
+const struct histogram* metrics_histogram(enum metric_histogram histogram)
+{
+    return sslot != NULL ? &sslot->histograms[histogram] : NULL;
+}
+
+/**
+ * \brief Returns the monotonic time.
+ *
+ * \return microseconds since some unspecified start.
+ */
+uint64_t metrics_now_us(void)
+{
+    struct timespec now;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * US_PER_SECOND +
+        (uint64_t) now.tv_nsec / NS_PER_US;
+}
+
+/**
+ * \brief Makes a slot the one of the calling process.
+ *
+ * A restarted process takes over the counters of its predecessor.
+ *
+ * \param index of the slot.
+ * \param name label of the process.
+ */
+static void attach_slot(size_t index, const char* name)
+{
+    sslot = &sslots[index];
+    if (!atomic_load(&sslot->used))
+    {
+        (void) snprintf(sslot->name, sizeof(sslot->name), "%s", name);
+        atomic_store(&sslot->used, true);
+    }
+}
+
+/**
+ * \brief Opens the non-blocking admin socket, if configured.
+ *
+ * \param config with the admin port or the path of the Unix socket.
+ * \return 0 on success, else -1.
+ */
+static int open_admin_socket(const struct server_config* config)
+{
+    struct sockaddr_in inet_address;
+    struct sockaddr_un unix_address;
+    struct sockaddr* address;
+    struct stat info;
+    socklen_t length;
+    int optval = 1;
+    int fd;
+
+    if (config->metrics_path != NULL)
+    {
+        memset(&unix_address, 0, sizeof(unix_address));
+        unix_address.sun_family = AF_UNIX;
+        if (strlen(config->metrics_path) >= sizeof(unix_address.sun_path))
+        {
+            print_error("Metrics socket path %s too long.",
+                config->metrics_path);
+            return -1;
+        }
+        strcpy(unix_address.sun_path, config->metrics_path);
+        /* a socket left behind by a previous run, nothing else */
+        if (lstat(config->metrics_path, &info) == 0)
+        {
+            if (!S_ISSOCK(info.st_mode))
+            {
+                print_error("Metrics socket path %s exists and is no socket.",
+                    config->metrics_path);
+                return -1;
+            }
+            (void) unlink(config->metrics_path);
+        }
+        address = (struct sockaddr*) &unix_address;
+        length = sizeof(unix_address);
+    }
+    else if (config->metrics_port != 0)
+    {
+        memset(&inet_address, 0, sizeof(inet_address));
+        inet_address.sin_family = AF_INET;
+        inet_address.sin_port = htons(config->metrics_port);
+        inet_address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address = (struct sockaddr*) &inet_address;
+        length = sizeof(inet_address);
+    }
+    else
+    {
+        return 0;
+    }
+
+    fd = socket(address->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+        0);
+    if (fd < 0)
+    {
+        print_error("socket() of metrics failed: %s.", strerror(errno));
+        return -1;
+    }
+    if (((address->sa_family == AF_INET) &&
+        (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &optval,
+        sizeof(optval)) < 0)) || (bind(fd, address, length) < 0) ||
+        (listen(fd, ADMIN_BACKLOG) < 0))
+    {
+        print_error("Can not listen for metrics: %s.", strerror(errno));
+        (void) close(fd);
+        return -1;
+    }
+    slistener.fd = fd;
+    return 0;
+}
+
+/**
+ * \brief Starts a scrape on an accepted admin connection.
+ *
+ * \param handler the admin socket handler.
+ * \param connection_fd connect socket.
+ */
+static void admin_accept(struct reactor_handler* handler, int connection_fd)
+{
+    struct admin_connection* admin = NULL;
+    int flags;
+    size_t i;
+
+    (void) handler; /* pedantic */
+    for (i = 0; (i < ADMIN_CONNECTIONS) && (admin == NULL); ++i)
+    {
+        if (!sadmin[i].used)
+        {
+            admin = &sadmin[i];
+        }
+    }
+    flags = fcntl(connection_fd, F_GETFL);
+    if ((admin == NULL) || (flags < 0) ||
+        (fcntl(connection_fd, F_SETFL, flags | O_NONBLOCK) < 0))
+    {
+        (void) close(connection_fd);
+        return;
+    }
+
+    admin->handler.fd = connection_fd;
+    admin->handler.callback = admin_ready;
+    admin->state = ADMIN_READING;
+    admin->request_length = 0;
+    admin->response = NULL;
+    admin->deadline = metrics_now_us() + (uint64_t) ADMIN_TIMEOUT_MS * US_PER_MS;
+    if (reactor_add(&admin->handler,
+        EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET) < 0)
+    {
+        (void) close(connection_fd);
+        return;
+    }
+    admin->used = true;
+}
+
+/**
+ * \brief Advances a scrape as far as its socket allows.
+ *
+ * \param handler of the scrape.
+ * \param events will be ignored.
+ * \return false, the socket is drained or the scrape closed.
+ */
+static bool admin_ready(struct reactor_handler* handler, uint32_t events)
+{
+    struct admin_connection* admin = (struct admin_connection*) handler;
+    bool done = false;
+
+    (void) events; /* pedantic */
+    switch (admin->state)
+    {
+    case ADMIN_READING:
+        done = admin_read(admin);
+        break;
+    case ADMIN_WRITING:
+        done = admin_write(admin);
+        break;
+    case ADMIN_DRAINING:
+        done = admin_drain(admin);
+        break;
+    }
+    if (done)
+    {
+        admin_close(admin);
+    }
+    return false;
+}
+
+/**
+ * \brief Reads the request of a scrape up to its end.
+ *
+ * The end of the HTTP header, the end of the stream or a full buffer ends
+ * the request, then the response is rendered.
+ *
+ * \param admin the scrape.
+ * \return true if the scrape has to be closed.
+ */
+static bool admin_read(struct admin_connection* admin)
+{
+    ssize_t read_count;
+
+    while (admin->request_length < ADMIN_REQUEST)
+    {
+        read_count = recv(admin->handler.fd,
+            admin->request + admin->request_length,
+            ADMIN_REQUEST - admin->request_length, 0);
+        if (read_count == 0)
+        {
+            break;
+        }
+        if (read_count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return (errno != EAGAIN) && (errno != EWOULDBLOCK);
+        }
+        admin->request_length += (size_t) read_count;
+        admin->request[admin->request_length] = '\0';
+        if ((strstr(admin->request, "\r\n\r\n") != NULL) ||
+            (strstr(admin->request, "\n\n") != NULL))
+        {
+            break;
+        }
+    }
+    admin->request[admin->request_length] = '\0';
+    if (render_response(admin) < 0)
+    {
+        return true;
+    }
+    /* the socket is writable already, the edge may be gone */
+    admin->state = ADMIN_WRITING;
+    return admin_write(admin);
+}
+
+/**
+ * \brief Sends the response of a scrape as far as the socket takes it.
+ *
+ * \param admin the scrape.
+ * \return true if the scrape has to be closed.
+ */
+static bool admin_write(struct admin_connection* admin)
+{
+    ssize_t sent;
+
+    while (admin->sent < admin->response_length)
+    {
+        sent = send(admin->handler.fd, admin->response + admin->sent,
+            admin->response_length - admin->sent, MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return (errno != EAGAIN) && (errno != EWOULDBLOCK);
+        }
+        admin->sent += (size_t) sent;
+    }
+    free(admin->response);
+    admin->response = NULL;
+    /* closing with unread data would reset the connection */
+    (void) shutdown(admin->handler.fd, SHUT_WR);
+    admin->state = ADMIN_DRAINING;
+    return admin_drain(admin);
+}
+
+/**
+ * \brief Discards whatever the client sends until it closes.
+ *
+ * \param admin the scrape.
+ * \return true if the scrape has to be closed.
+ */
+static bool admin_drain(struct admin_connection* admin)
+{
+    char discard[BUFSIZ];
+    ssize_t read_count;
+
+    do
+    {
+        read_count = recv(admin->handler.fd, discard, sizeof(discard), 0);
+    } while ((read_count > 0) || ((read_count < 0) && (errno == EINTR)));
+    return (read_count == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK));
+}
+
+/**
+ * \brief Closes a scrape.
+ *
+ * \param admin the scrape.
+ */
+static void admin_close(struct admin_connection* admin)
+{
+    (void) reactor_remove(&admin->handler);
+    (void) close(admin->handler.fd);
+    free(admin->response);
+    admin->response = NULL;
+    admin->used = false;
+}
+
+/**
+ * \brief Closes stalled scrapes and retries accepting.
+ *
+ * The edge of the admin socket or the multishot accept is lost if accept()
+ * failed, so accepting is retried every tick.
+ *
+ * \param handler the admin timer.
+ * \param events will be ignored.
+ * \return false.
+ */
+static bool admin_tick(struct reactor_handler* handler, uint32_t events)
+{
+    uint64_t now = metrics_now_us();
+    size_t i;
+
+    (void) events; /* pedantic */
+    reactor_drain(handler);
+    for (i = 0; i < ADMIN_CONNECTIONS; ++i)
+    {
+        if (sadmin[i].used && (sadmin[i].deadline <= now))
+        {
+            admin_close(&sadmin[i]);
+        }
+    }
+    reactor_schedule(&slistener);
+    return false;
+}
+
+/**
+ * \brief Renders the response of a scrape.
+ *
+ * \param admin the scrape with its request.
+ * \return 0 on success, else -1.
+ */
+static int render_response(struct admin_connection* admin)
+{
+    char* body = NULL;
+    size_t body_length = 0;
+    char header[128];
+    FILE* out;
+    int header_length = 0;
+
+    out = open_memstream(&body, &body_length);
+    if (out == NULL)
+    {
+        print_error("open_memstream() failed: %s.", strerror(errno));
+        return -1;
+    }
+    render_metrics(out);
+    if (fclose(out) != 0)
+    {
+        free(body);
+        return -1;
+    }
+
+    if (strncmp(admin->request, "GET ", strlen("GET ")) == 0)
+    {
+        header_length = snprintf(header, sizeof(header),
+            "HTTP/1.0 200 OK\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: %lu\r\n"
+            "Connection: close\r\n\r\n", (unsigned long) body_length);
+        if ((header_length < 0) || ((size_t) header_length >= sizeof(header)))
+        {
+            free(body);
+            return -1;
+        }
+    }
+    admin->response = malloc((size_t) header_length + body_length);
+    if (admin->response == NULL)
+    {
+        print_error("Can not allocate metrics: %s.", strerror(ENOMEM));
+        free(body);
+        return -1;
+    }
+    memcpy(admin->response, header, (size_t) header_length);
+    memcpy(admin->response + header_length, body, body_length);
+    admin->response_length = (size_t) header_length + body_length;
+    admin->sent = 0;
+    free(body);
+    return 0;
+}
+
+/**
+ * \brief Writes all metrics in Prometheus text format.
+ *
+ * \param out where to write.
+ */
+static void render_metrics(FILE* out)
+{
+    int i;
+
+    for (i = 0; i < METRIC_COUNTERS; ++i)
+    {
+        render_counter(out, (enum metric_counter) i);
+    }
+    for (i = 0; i < METRIC_HISTOGRAMS; ++i)
+    {
+        render_histogram(out, (enum metric_histogram) i);
+    }
+}
+
+/**
+ * \brief Writes a counter per process.
+ *
+ * \param out where to write.
+ * \param counter to be written.
+ */
+static void render_counter(FILE* out, enum metric_counter counter)
+{
+    const struct metric_info* info = &scounter_info[counter];
+    size_t i;
+
+    if (info->help != NULL)
+    {
+        (void) fprintf(out, "# HELP %s %s\n# TYPE %s counter\n", info->name,
+            info->help, info->name);
+    }
+    for (i = 0; i < sslot_count; ++i)
+    {
+        if (!atomic_load(&sslots[i].used))
+        {
+            continue;
+        }
+        (void) fprintf(out, "%s{process=\"%s\"%s%s} %llu\n", info->name,
+            sslots[i].name, info->label != NULL ? "," : "",
+            info->label != NULL ? info->label : "",
+            (unsigned long long) atomic_load_explicit(
+            &sslots[i].counters[counter], memory_order_relaxed));
+    }
+}
+
+/**
+ * \brief Writes a histogram summed over all processes.
+ *
+ * The buckets are written cumulated, as Prometheus expects, up to the highest
+ * one holding values; the bounds of a series do not change between scrapes
+ * as long as no greater value is recorded.
+ *
+ * \param out where to write.
+ * \param histogram to be written.
+ */
+static void render_histogram(FILE* out, enum metric_histogram histogram)
+{
+    const struct metric_info* info = &shistogram_info[histogram];
+    const struct histogram* source;
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t cumulated = 0;
+    size_t i;
+    unsigned int bucket;
+    unsigned int used = 0;
+
+    memset(counts, 0, sizeof(counts));
+    for (i = 0; i < sslot_count; ++i)
+    {
+        if (!atomic_load(&sslots[i].used))
+        {
+            continue;
+        }
+        source = &sslots[i].histograms[histogram];
+        for (bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket)
+        {
+            counts[bucket] += atomic_load_explicit(&source->counts[bucket],
+                memory_order_relaxed);
+        }
+        sum += atomic_load_explicit(&source->sum, memory_order_relaxed);
+    }
+
+    (void) fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", info->name,
+        info->help, info->name);
+    for (bucket = 0; bucket < HISTOGRAM_BUCKETS; ++bucket)
+    {
+        if (counts[bucket] != 0)
+        {
+            used = bucket + 1;
+        }
+    }
+    for (bucket = 0; bucket < used; ++bucket)
+    {
+        cumulated += counts[bucket];
+        (void) fprintf(out, "%s_bucket{le=\"", info->name);
+        print_value(out, histogram_upper_bound(bucket), info);
+        (void) fprintf(out, "\"} %llu\n", (unsigned long long) cumulated);
+    }
+    /* the count matches the buckets, which are read one by one */
+    count = cumulated;
+    (void) fprintf(out, "%s_bucket{le=\"+Inf\"} %llu\n%s_sum ", info->name,
+        (unsigned long long) count, info->name);
+    print_value(out, sum, info);
+    (void) fprintf(out, "\n%s_count %llu\n", info->name,
+        (unsigned long long) count);
+}
+
+/**
+ * \brief Writes a recorded value in the unit of its metric.
+ *
+ * \param out where to write.
+ * \param value as recorded.
+ * \param info of the metric.
+ */
+static void print_value(FILE* out, uint64_t value,
+    const struct metric_info* info)
+{
+    if (info->divisor == 1)
+    {
+        (void) fprintf(out, "%llu",
+            (unsigned long long) (value * info->multiplier));
+    }
+    else
+    {
+        (void) fprintf(out, "%llu.%06llu",
+            (unsigned long long) (value / info->divisor),
+            (unsigned long long) (value % info->divisor));
+    }
+}
+
+/* === EOF ================================================================== */
@@ -0,0 +1,281 @@
+/**
+ * @file simple_message_server_plugin.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, host of an in-process business logic plugin.
+ *
+ * The plugin is loaded once at startup. Accepted connections are queued to
+ * the serving threads, which call the plugin directly instead of starting a
+ * business logic process per connection.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "simple_message_server.h"
+#include "simple_message_server_plugin.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* timeout for a stalled client in seconds */
+#define PLUGIN_IO_TIMEOUT 30
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/** Context of the reader and the writer of a connection. */
+struct plugin_connection
+{
+    /** connect socket */
+    int fd;
+    /** bytes of the request read */
+    uint64_t received;
+    /** bytes of the response sent */
+    uint64_t sent;
+};
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+
+/** Handle of the loaded plugin. */
+static void* shandle = NULL;
+/** Entry points of the loaded plugin. */
+static const struct sms_plugin* splugin = NULL;
+/** State returned by init() of the plugin. */
+static void* sstate = NULL;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static void serve_queued(void* context, int connection_fd);
+static ssize_t read_connection(const struct sms_reader* reader, void* buf,
+    size_t len);
+static ssize_t write_connection(const struct sms_writer* writer,
+    const void* buf, size_t len);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Loads and initializes the plugin.
+ *
+ * \param path of the shared object.
+ * \return 0 on success, else -1.
+ */
+int plugin_load(const char* path)
+{
+    shandle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (shandle == NULL)
+    {
+        print_error("dlopen() failed: %s.", dlerror());
+        return -1;
+    }
+    splugin = dlsym(shandle, SMS_PLUGIN_SYMBOL);
+    if (splugin == NULL)
+    {
+        print_error("Plugin %s does not export %s.", path, SMS_PLUGIN_SYMBOL);
+    }
+    else if (splugin->abi_version != SMS_PLUGIN_ABI_VERSION)
+    {
+        print_error("Plugin %s has ABI version %u, expected %u.", path,
+            splugin->abi_version, SMS_PLUGIN_ABI_VERSION);
+    }
+    else if (splugin->handle_request == NULL)
+    {
+        print_error("Plugin %s has no request handler.", path);
+    }
+    else if ((splugin->init != NULL) && (splugin->init(&sstate) != 0))
+    {
+        print_error("Plugin %s failed to initialize.", splugin->name);
+    }
+    else
+    {
+        return 0;
+    }
+    splugin = NULL;
+    (void) dlclose(shandle);
+    shandle = NULL;
+    return -1;
+}
+
+/**
+ * \brief Shuts the plugin down and unloads it.
+ *
+ * Must not be called while plugin threads are running.
+ */
+void plugin_unload(void)
+{
+    if (splugin == NULL)
+    {
+        return;
+    }
+    if (splugin->shutdown != NULL)
+    {
+        splugin->shutdown(sstate);
+    }
+    splugin = NULL;
+    (void) dlclose(shandle);
+    shandle = NULL;
+}
+
+/**
+ * \brief Tells whether a plugin is loaded.
+ *
+ * \return true if connections are served by the plugin.
+ */
+bool plugin_loaded(void)
+{
+    return splugin != NULL;
+}
+
+/**
+ * \brief Starts the threads which serve the queued connections.
+ *
+ * Must not be called before all processes serving the plugin are forked.
+ *
+ * \param threads number of threads.
+ * \return 0 if at least one thread runs, else -1.
+ */
+int plugin_start_threads(long threads)
+{
+    long i;
+
+    for (i = 0; (i < threads) && (threads_start(serve_queued, NULL) == 0);
+        ++i)
+    {
+    }
+    return i > 0 ? 0 : -1;
+}
+
+/**
+ * \brief Serves one connection by the plugin in the calling thread.
+ *
+ * \param connection_fd connect socket, closed by this function.
+ */
+void plugin_serve(int connection_fd)
+{
+    struct plugin_connection connection = {connection_fd, 0, 0};
+    struct sms_reader reader;
+    struct sms_writer writer;
+    struct timeval timeout;
+
+    (void) metrics_started(connection_fd);
+    /* a stalled client must not block this thread forever */
+    timeout.tv_sec = PLUGIN_IO_TIMEOUT;
+    timeout.tv_usec = 0;
+    (void) setsockopt(connection_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+        sizeof(timeout));
+    (void) setsockopt(connection_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+        sizeof(timeout));
+
+    reader.read = read_connection;
+    reader.context = &connection;
+    writer.write = write_connection;
+    writer.context = &connection;
+
+    (void) splugin->handle_request(sstate, &reader, &writer);
+    (void) close(connection_fd);
+
+    metrics_count(METRIC_BYTES_RECEIVED, connection.received);
+    metrics_count(METRIC_BYTES_SENT, connection.sent);
+    metrics_record(METRIC_REQUEST_BYTES, connection.received);
+    metrics_record(METRIC_RESPONSE_BYTES, connection.sent);
+}
+
+/**
+ * \brief Serves a queued connection by the plugin.
+ *
+ * \param context will be ignored.
+ * \param connection_fd connect socket, closed by this function.
+ */
+static void serve_queued(void* context, int connection_fd)
+{
+    uint64_t start_us = metrics_now_us();
+
+    (void) context; /* pedantic */
+    plugin_serve(connection_fd);
+    metrics_record(METRIC_EXEC_DURATION, metrics_now_us() - start_us);
+}
+
+/**
+ * \brief Reads the request from the connect socket.
+ *
+ * \param reader with the struct plugin_connection as context.
+ * \param buf where to put the data.
+ * \param len size of buf.
+ * \return bytes read, 0 at end of file, -1 on error.
+ */
+static ssize_t read_connection(const struct sms_reader* reader, void* buf,
+    size_t len)
+{
+    struct plugin_connection* connection = reader->context;
+    ssize_t result;
+
+    do
+    {
+        result = read(connection->fd, buf, len);
+    } while ((result < 0) && (errno == EINTR));
+    if (result > 0)
+    {
+        connection->received += (uint64_t) result;
+    }
+    return result;
+}
+
+/**
+ * \brief Writes the response to the connect socket.
+ *
+ * \param writer with the struct plugin_connection as context.
+ * \param buf data to be written.
+ * \param len number of bytes in buf.
+ * \return len on success, -1 on error.
+ */
+static ssize_t write_connection(const struct sms_writer* writer,
+    const void* buf, size_t len)
+{
+    struct plugin_connection* connection = writer->context;
+    const char* current_write_pos = buf;
+    size_t to_be_written = len;
+    ssize_t written;
+
+    while (to_be_written > 0)
+    {
+        /* the server must not be killed by SIGPIPE */
+        written = send(connection->fd, current_write_pos, to_be_written,
+            MSG_NOSIGNAL);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        current_write_pos += written;
+        to_be_written -= (size_t) written;
+        connection->sent += (uint64_t) written;
+    }
+    return (ssize_t) len;
+}
+
+/* === EOF ================================================================== */
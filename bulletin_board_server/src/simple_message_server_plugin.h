@@ -0,0 +1,108 @@
+/**
+ * @file simple_message_server_plugin.h
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, ABI of in-process business logic plugins.
+ *
+ * A plugin is a shared object which exports a constant struct sms_plugin
+ * named SMS_PLUGIN_SYMBOL. The server loads it once with dlopen(), calls
+ * init() once and handle_request() for every connection. A worker process
+ * of the pool calls shutdown() when it retires, a server terminated by a
+ * signal does not.
+ *
+ * handle_request() is called concurrently from several threads, so it has
+ * to be reentrant. It reads the request (user=, img=, message) from the
+ * reader until end of file and writes the response (status=, file=, len=,
+ * file content) to the writer, the same data the business logic reads from
+ * stdin and writes to stdout.
+ *
+ * The ABI only changes compatibly (new members at the end of the structs)
+ * as long as SMS_PLUGIN_ABI_VERSION stays the same.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_PLUGIN_H
+#define SIMPLE_MESSAGE_SERVER_PLUGIN_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* version of this ABI, checked by the server on loading */
+#define SMS_PLUGIN_ABI_VERSION 1
+
+/* name of the exported struct sms_plugin */
+#define SMS_PLUGIN_SYMBOL "sms_plugin"
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/**
+ * Source of the request.
+ */
+struct sms_reader
+{
+    /**
+     * Reads up to len bytes into buf like read(), retried on EINTR.
+     * Returns the number of bytes read, 0 at end of request, -1 on error.
+     */
+    ssize_t (*read)(const struct sms_reader* reader, void* buf, size_t len);
+    /** private to the server */
+    void* context;
+};
+
+/**
+ * Sink of the response.
+ */
+struct sms_writer
+{
+    /**
+     * Writes all len bytes of buf.
+     * Returns len on success, -1 on error, e.g. if the client went away.
+     */
+    ssize_t (*write)(const struct sms_writer* writer, const void* buf,
+        size_t len);
+    /** private to the server */
+    void* context;
+};
+
+/**
+ * Entry points of a plugin.
+ */
+struct sms_plugin
+{
+    /** must be SMS_PLUGIN_ABI_VERSION */
+    unsigned int abi_version;
+    /** name of the plugin for messages */
+    const char* name;
+    /**
+     * Called once after loading. May set *state, which is passed to the
+     * other functions. Returns 0 on success, else the plugin is not used.
+     */
+    int (*init)(void** state);
+    /**
+     * Serves one request. Returns 0 on success, else -1. The server closes
+     * the connection afterwards in any case.
+     */
+    int (*handle_request)(void* state, const struct sms_reader* reader,
+        const struct sms_writer* writer);
+    /** Called once before unloading, may be NULL. */
+    void (*shutdown)(void* state);
+};
+
+#endif /* SIMPLE_MESSAGE_SERVER_PLUGIN_H */
+
+/* === EOF ================================================================== */
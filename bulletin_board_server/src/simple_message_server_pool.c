@@ -0,0 +1,633 @@
+/**
+ * @file simple_message_server_pool.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, pool of pre-forked workers.
+ *
+ * The workers are long-lived children which take turns in accept() on the
+ * shared listening socket. Only the holder of the accept lock sits in
+ * accept(), so an incoming connection wakes exactly one worker. The master
+ * resizes the pool depending on the estimated wait in the accept queue and
+ * serves connections itself (fork per connection) when the pool is
+ * saturated.
+ *
+ * Without a plugin (-l) a worker executes the business logic itself on the
+ * connection it accepted, so no fork lies between accept() and exec. The
+ * worker is used up by that: once the master reaps it, it forks a new one
+ * into the slot right away, off the path of any connection. With a plugin
+ * the worker serves the connection itself, without any fork or exec.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "simple_message_server.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* period of the pool housekeeping in milliseconds */
+#define POOL_TICK_MS 100
+/* estimated accept queue wait in milliseconds which lets the pool grow */
+#define POOL_GROW_WAIT_MS 5
+/* number of ticks with spare idle workers until one worker retires */
+#define POOL_SHRINK_TICKS 50
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/** Life cycle of a worker slot. */
+enum worker_state
+{
+    WORKER_FREE = 0,   /**< slot not used */
+    WORKER_STARTING,   /**< forked, not yet waiting for connections */
+    WORKER_IDLE,       /**< waiting for the accept lock or in accept() */
+    WORKER_BUSY,       /**< serving a connection */
+    WORKER_EXECUTING   /**< replaced by the business logic */
+};
+
+/** Shared state of one worker. */
+struct worker_slot
+{
+    /** process id, written by the master only */
+    pid_t pid;
+    /** current enum worker_state */
+    atomic_int state;
+    /** set by the master, the worker exits before the next accept() */
+    atomic_int retire;
+    /** client of the business logic, read by the master once reaped */
+    struct sockaddr_in peer;
+    /** accept of its connection, as by metrics_now_us() */
+    uint64_t accepted_us;
+    /** start of the business logic, as by metrics_now_us() */
+    uint64_t start_us;
+};
+
+/** Scoreboard shared between the master and all workers. */
+struct scoreboard
+{
+    /** serializes accept(), avoids the thundering herd */
+    pthread_mutex_t accept_lock;
+    /** connections accepted by all workers */
+    atomic_ulong accepted;
+    /** one slot per possible worker */
+    struct worker_slot slot[MAX_WORKERS];
+};
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+
+/** Scoreboard mapped into the master and all workers. */
+static struct scoreboard* sboard = NULL;
+/** Pool limits. */
+static const struct server_config* sconfig = NULL;
+/** Listening socket, watched by the master while the pool is saturated. */
+static struct reactor_handler slistener;
+/** Periodic housekeeping of the pool. */
+static struct reactor_handler stick;
+/** Whether the master watches the listening socket. */
+static bool swatching = false;
+/** Accepted connections at the previous tick. */
+static unsigned long slast_accepted = 0;
+/** Consecutive ticks with spare idle workers. */
+static long sspare_ticks = 0;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static int init_scoreboard(void);
+static int lock_accept(void);
+static void interrupt_handler(int signal);
+static int install_handler(int signal_nr, void (*handler)(int));
+static bool manage_pool(struct reactor_handler* handler, uint32_t events);
+static int spawn_worker(int socket_fd, struct worker_slot* slot);
+static void worker_main(int socket_fd, struct worker_slot* slot);
+static void run_business_logic(int socket_fd, int connection_fd,
+    struct worker_slot* slot);
+static long accept_queue_length(int socket_fd);
+static bool accept_saturated(struct reactor_handler* handler, uint32_t events);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Runs the pre-forked worker pool.
+ *
+ * This function manages the pool in a loop, so it should never exit.
+ *
+ * \param socket_fd listening socket.
+ * \param config server configuration with the pool limits.
+ * \return -1 in case of a 'weird' program execution.
+ */
+int do_worker_pool(int socket_fd, const struct server_config* config)
+{
+    if (init_scoreboard() < 0)
+    {
+        (void) close(socket_fd);
+        return -1;
+    }
+    /* SIGUSR1 is meant for retiring workers only */
+    if (install_handler(SIGUSR1, SIG_IGN) < 0)
+    {
+        print_error("sigaction() failed: %s.", strerror(errno));
+        (void) close(socket_fd);
+        return -1;
+    }
+
+    sconfig = config;
+    slistener.fd = socket_fd;
+    slistener.callback = accept_saturated;
+    stick.callback = manage_pool;
+    if (reactor_add_timer(&stick, POOL_TICK_MS) < 0)
+    {
+        (void) close(socket_fd);
+        return -1;
+    }
+    /* start the workers right away */
+    (void) manage_pool(&stick, 0);
+
+    (void) reactor_run();
+    (void) close(socket_fd);
+    return -1;
+}
+
+/**
+ * \brief Frees the slot of a terminated worker.
+ *
+ * Called for every reaped child, which may be a business logic of the
+ * master as well. A worker which executed the business logic is entered
+ * as a child, so it is accounted like the others, and is replaced at once.
+ *
+ * \param pid process id of the terminated child.
+ */
+void pool_reaped(pid_t pid)
+{
+    struct worker_slot* slot;
+    long i;
+
+    if (sboard == NULL)
+    {
+        return;
+    }
+    for (i = 0; i < sconfig->max_workers; ++i)
+    {
+        slot = &sboard->slot[i];
+        if (slot->pid != pid)
+        {
+            continue;
+        }
+        slot->pid = 0;
+        if (atomic_exchange(&slot->state, WORKER_FREE) == WORKER_EXECUTING)
+        {
+            children_adopted(pid, &slot->peer, slot->accepted_us,
+                slot->start_us);
+            (void) spawn_worker(slistener.fd, slot);
+        }
+        break;
+    }
+}
+
+/**
+ * \brief Periodic housekeeping of the pool.
+ *
+ * Keeps the minimum size, grows and shrinks the pool and watches the
+ * listening socket while the pool is saturated.
+ *
+ * \param handler the timer handler.
+ * \param events will be ignored.
+ * \return false.
+ */
+static bool manage_pool(struct reactor_handler* handler, uint32_t events)
+{
+    const struct server_config* config = sconfig;
+    int socket_fd = slistener.fd;
+    long i;
+    long running = 0;
+    long idle = 0;
+    long grow;
+    long queued;
+    unsigned long accepted;
+    unsigned long wait_ms;
+    bool saturated;
+
+    (void) events; /* pedantic */
+    reactor_drain(handler);
+
+    /* keep the minimum size, replaces crashed or retired workers */
+    for (i = 0; i < config->max_workers; ++i)
+    {
+        if (sboard->slot[i].pid != 0)
+        {
+            ++running;
+            if (atomic_load(&sboard->slot[i].state) < WORKER_BUSY)
+            {
+                ++idle;
+            }
+        }
+    }
+    for (i = 0; (i < config->max_workers) && (running < config->workers); ++i)
+    {
+        if ((sboard->slot[i].pid == 0) &&
+            (spawn_worker(socket_fd, &sboard->slot[i]) == 0))
+        {
+            ++running;
+            ++idle;
+        }
+    }
+
+    /*
+     * Estimate the accept queue wait with Little's law from the queue
+     * length and the accept rate of the last tick.
+     */
+    queued = accept_queue_length(socket_fd);
+    accepted = atomic_load(&sboard->accepted);
+    if (queued <= 0)
+    {
+        wait_ms = 0;
+    }
+    else if (accepted == slast_accepted)
+    {
+        wait_ms = ULONG_MAX;
+    }
+    else
+    {
+        wait_ms = (unsigned long) queued * POOL_TICK_MS /
+            (accepted - slast_accepted);
+    }
+    slast_accepted = accepted;
+
+    if ((idle == 0) && (wait_ms > POOL_GROW_WAIT_MS))
+    {
+        grow = queued < 1 ? 1 : queued;
+        for (i = 0; (i < config->max_workers) && (grow > 0); ++i)
+        {
+            if ((sboard->slot[i].pid == 0) &&
+                (spawn_worker(socket_fd, &sboard->slot[i]) == 0))
+            {
+                ++running;
+                --grow;
+            }
+        }
+    }
+
+    /* retire one worker after a while with more than one idle worker */
+    sspare_ticks = (idle > 1) && (running > config->workers) ?
+        sspare_ticks + 1 : 0;
+    if (sspare_ticks >= POOL_SHRINK_TICKS)
+    {
+        sspare_ticks = 0;
+        for (i = config->max_workers - 1; i >= 0; --i)
+        {
+            if ((sboard->slot[i].pid != 0) &&
+                (atomic_load(&sboard->slot[i].state) == WORKER_IDLE) &&
+                (atomic_load(&sboard->slot[i].retire) == 0))
+            {
+                atomic_store(&sboard->slot[i].retire, 1);
+                /* interrupts accept(), the worker exits afterwards */
+                (void) kill(sboard->slot[i].pid, SIGUSR1);
+                break;
+            }
+        }
+    }
+
+    /* watch for connections only while the pool can not take them */
+    saturated = (idle == 0) && (running >= config->max_workers);
+    if (saturated && !swatching)
+    {
+        swatching = reactor_add(&slistener, EPOLLIN) == 0;
+    }
+    else if (!saturated && swatching)
+    {
+        (void) reactor_remove(&slistener);
+        swatching = false;
+    }
+    return false;
+}
+
+/**
+ * \brief Maps the scoreboard and initializes the accept lock.
+ *
+ * \return 0 on success, else -1.
+ */
+static int init_scoreboard(void)
+{
+    pthread_mutexattr_t attr;
+    int result;
+
+    sboard = mmap(NULL, sizeof(*sboard), PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (sboard == MAP_FAILED)
+    {
+        sboard = NULL;
+        print_error("mmap() of scoreboard failed: %s.", strerror(errno));
+        return -1;
+    }
+
+    /* the lock survives the death of a worker holding it */
+    result = pthread_mutexattr_init(&attr);
+    if (result == 0)
+    {
+        result = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    }
+    if (result == 0)
+    {
+        result = pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    }
+    if (result == 0)
+    {
+        result = pthread_mutex_init(&sboard->accept_lock, &attr);
+    }
+    (void) pthread_mutexattr_destroy(&attr);
+    if (result != 0)
+    {
+        print_error("Can not initialize accept lock: %s.", strerror(result));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Acquires the accept lock.
+ *
+ * \return 0 if the lock is held, else -1.
+ */
+static int lock_accept(void)
+{
+    int result;
+
+    result = pthread_mutex_lock(&sboard->accept_lock);
+    if (result == EOWNERDEAD)
+    {
+        /* previous holder died in accept(), nothing to repair */
+        result = pthread_mutex_consistent(&sboard->accept_lock);
+    }
+    if (result != 0)
+    {
+        print_error("Can not acquire accept lock: %s.", strerror(result));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Signal handler which only interrupts blocking system calls.
+ *
+ * \param signal will be ignored.
+ */
+static void interrupt_handler(int signal)
+{
+    (void) signal; /* pedantic */
+}
+
+/**
+ * \brief Installs a signal handler without restarting system calls.
+ *
+ * \param signal_nr signal to be handled.
+ * \param handler the handler function, SIG_IGN or SIG_DFL.
+ * \return 0 if the handler was installed, else -1.
+ */
+static int install_handler(int signal_nr, void (*handler)(int))
+{
+    struct sigaction sig;
+
+    memset(&sig, 0, sizeof(sig));
+    sig.sa_handler = handler;
+    (void) sigemptyset(&sig.sa_mask);
+    sig.sa_flags = 0; /* blocking system calls return with EINTR */
+
+    return sigaction(signal_nr, &sig, NULL);
+}
+
+/**
+ * \brief Forks a new worker into the given slot.
+ *
+ * \param socket_fd listening socket.
+ * \param slot free scoreboard slot.
+ * \return 0 if the worker was started, else -1.
+ */
+static int spawn_worker(int socket_fd, struct worker_slot* slot)
+{
+    pid_t pid;
+
+    atomic_store(&slot->state, WORKER_STARTING);
+    atomic_store(&slot->retire, 0);
+
+    if ((pid = fork()) < 0)
+    {
+        print_error("fork() of worker failed: %s.", strerror(errno));
+        atomic_store(&slot->state, WORKER_FREE);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        worker_main(socket_fd, slot);
+        assert(0);  /* never come here */
+        _exit(EXIT_FAILURE);
+    }
+    slot->pid = pid;
+    return 0;
+}
+
+/**
+ * \brief Main loop of a worker, never returns.
+ *
+ * \param socket_fd listening socket.
+ * \param slot own scoreboard slot.
+ */
+static void worker_main(int socket_fd, struct worker_slot* slot)
+{
+    int connection_fd;
+
+    reactor_child();
+    metrics_attach_worker((long) (slot - sboard->slot));
+    /* SIGUSR1 interrupts accept() when the master retires this worker */
+    if ((install_handler(SIGUSR1, interrupt_handler) < 0) ||
+        (install_handler(SIGCHLD, SIG_DFL) < 0))
+    {
+        print_error("Worker can not install signal handler.");
+        _exit(EXIT_FAILURE);
+    }
+
+    while (1)
+    {
+        atomic_store(&slot->state, WORKER_IDLE);
+        if (atomic_load(&slot->retire))
+        {
+            plugin_unload();
+            _exit(EXIT_SUCCESS);
+        }
+        if (lock_accept() < 0)
+        {
+            _exit(EXIT_FAILURE);
+        }
+        if (atomic_load(&slot->retire))
+        {
+            (void) pthread_mutex_unlock(&sboard->accept_lock);
+            plugin_unload();
+            _exit(EXIT_SUCCESS);
+        }
+        connection_fd = accept(socket_fd, NULL, NULL);
+        (void) pthread_mutex_unlock(&sboard->accept_lock);
+        if (connection_fd < 0)
+        {
+            if (errno != EINTR)
+            {
+                print_error("accept() failed: %s.", strerror(errno));
+            }
+            continue;
+        }
+
+        atomic_store(&slot->state, WORKER_BUSY);
+        atomic_fetch_add(&sboard->accepted, 1);
+        metrics_accepted(connection_fd);
+        run_business_logic(socket_fd, connection_fd, slot);
+    }
+}
+
+/**
+ * \brief Serves one connection with the business logic.
+ *
+ * A loaded plugin is called right in the worker. Else the worker executes
+ * the business logic itself and never returns; what the master needs to
+ * account the child is left in the slot.
+ *
+ * \param socket_fd listening socket.
+ * \param connection_fd connect socket, closed by this function.
+ * \param slot own scoreboard slot.
+ */
+static void run_business_logic(int socket_fd, int connection_fd,
+    struct worker_slot* slot)
+{
+    socklen_t length = sizeof(slot->peer);
+    uint64_t start_us;
+
+    start_us = metrics_now_us();
+    if (plugin_loaded())
+    {
+        plugin_serve(connection_fd);
+        metrics_record(METRIC_EXEC_DURATION, metrics_now_us() - start_us);
+        return;
+    }
+
+    memset(&slot->peer, 0, sizeof(slot->peer));
+    (void) getpeername(connection_fd, (struct sockaddr*) &slot->peer,
+        &length);
+    slot->accepted_us = metrics_accepted_at(connection_fd);
+    slot->start_us = start_us;
+    atomic_store(&slot->state, WORKER_EXECUTING);
+    /* survives the exec, a late retirement must not kill the client */
+    if (install_handler(SIGUSR1, SIG_IGN) < 0)
+    {
+        print_error("Worker can not ignore SIGUSR1.");
+    }
+    exec_business_logic(socket_fd, connection_fd);
+}
+
+/**
+ * \brief Determines the number of connections waiting in the accept queue.
+ *
+ * For listening sockets Linux reports the accept queue length in
+ * tcpi_unacked.
+ *
+ * \param socket_fd listening socket.
+ * \return queue length, or -1 if it is unknown.
+ */
+static long accept_queue_length(int socket_fd)
+{
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+
+    memset(&info, 0, sizeof(info));
+    if (getsockopt(socket_fd, IPPROTO_TCP, TCP_INFO, &info, &len) < 0)
+    {
+        return -1;
+    }
+    return (long) info.tcpi_unacked;
+}
+
+/**
+ * \brief Serves a connection by fork per connection while the pool is busy.
+ *
+ * The master holds the accept lock, so no worker competes in accept() and
+ * the master can not block there. If a worker holds the lock it is going to
+ * take the connection anyway. Parked business logics of the warm pool are
+ * used first. The listening socket is level triggered, so if the lock is
+ * held elsewhere or the connection is gone, it is not watched until the
+ * next tick of the pool instead of being reported again at once.
+ *
+ * \param handler the listening socket handler.
+ * \param events will be ignored.
+ * \return false, the listening socket is level triggered.
+ */
+static bool accept_saturated(struct reactor_handler* handler, uint32_t events)
+{
+    int socket_fd = handler->fd;
+    struct pollfd listener;
+    int connection_fd;
+    int result;
+
+    (void) events; /* pedantic */
+    result = pthread_mutex_trylock(&sboard->accept_lock);
+    if (result == EOWNERDEAD)
+    {
+        result = pthread_mutex_consistent(&sboard->accept_lock);
+    }
+    if (result != 0)
+    {
+        /* a worker takes the connection, manage_pool() watches again */
+        (void) reactor_remove(handler);
+        swatching = false;
+        return false;
+    }
+    listener.fd = socket_fd;
+    listener.events = POLLIN;
+    if (poll(&listener, 1, 0) <= 0)
+    {
+        (void) pthread_mutex_unlock(&sboard->accept_lock);
+        (void) reactor_remove(handler);
+        swatching = false;
+        return false;
+    }
+    connection_fd = accept(socket_fd, NULL, NULL);
+    (void) pthread_mutex_unlock(&sboard->accept_lock);
+    if (connection_fd < 0)
+    {
+        print_error("accept() failed: %s.", strerror(errno));
+        return false;
+    }
+
+    /* the child is reaped by the SIGCHLD handler of the server */
+    admission_accepted(connection_fd);
+    return false;
+}
+
+/* === EOF ================================================================== */
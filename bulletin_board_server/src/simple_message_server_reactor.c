@@ -0,0 +1,825 @@
+/**
+ * @file simple_message_server_reactor.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, epoll or io_uring based event loop.
+ *
+ * Every file descriptor the server waits for (listening socket, signalfd
+ * for the children, timerfd for the housekeeping, ...) is registered with a
+ * handler. A handler which stops before it has drained its descriptor, e.g.
+ * to give other handlers a chance after a batch of accepts, returns true and
+ * is called again without waiting in epoll_wait(). This is needed for edge
+ * triggered descriptors, which are not reported again until new data
+ * arrives.
+ *
+ * With io_uring the listening socket is served by one multishot accept,
+ * which delivers every connection as a completion without a system call of
+ * its own, the other descriptors are waited for by poll requests, and the
+ * connect sockets handed off to the children are closed by the ring. So the
+ * requests of a whole round are submitted and the completions are reaped by
+ * one io_uring_enter().
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+/* accept4() */
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include "simple_message_server.h"
+#include "simple_message_server_uring.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* maximum number of events handled per epoll_wait() */
+#define REACTOR_EVENTS 64
+
+/* connections accepted per wakeup with epoll, before other events */
+#define ACCEPT_BATCH 32
+/* submission queue entries of the io_uring */
+#define URING_ENTRIES 256
+/* handlers registered with the io_uring at the same time */
+#define URING_SLOTS 4096
+/* connect sockets closed by the io_uring before it is submitted */
+#define URING_CLOSE_BATCH 64
+
+#define MS_PER_SECOND 1000
+#define NS_PER_MS 1000000
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/** A handler registered with the io_uring. */
+struct uring_slot
+{
+    /** the handler, NULL if the slot is free */
+    struct reactor_handler* handler;
+    /** changes when the slot is freed, so stale completions are ignored */
+    uint32_t generation;
+};
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+
+/** The epoll instance. */
+static int sepoll_fd = -1;
+/** Handlers to be called again without waiting. */
+static struct reactor_handler* spending = NULL;
+/** Pending handlers of the current round, not yet called. */
+static struct reactor_handler* sprocessing = NULL;
+/** Signal mask before signals were redirected to a signalfd. */
+static sigset_t sorig_mask;
+/** Whether sorig_mask is valid. */
+static bool smask_saved = false;
+
+/** Whether the io_uring drives the event loop. */
+static bool suring = false;
+/** Handlers registered with the io_uring. */
+static struct uring_slot sslots[URING_SLOTS];
+/** Indices of the free slots. */
+static int sfree_slots[URING_SLOTS];
+/** Number of free slots. */
+static int sfree_count = 0;
+/** Descriptors closed by requests not yet submitted. */
+static int sclosing[URING_CLOSE_BATCH];
+/** Number of descriptors in sclosing. */
+static int sclosing_count = 0;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static void unlink_pending(struct reactor_handler* handler);
+static void call_pending(struct reactor_handler* handler);
+static bool accept_ready(struct reactor_handler* handler, uint32_t events);
+static int run_epoll(void);
+static int run_uring(void);
+static int uring_register(struct reactor_handler* handler);
+static int uring_arm(struct reactor_handler* handler);
+static void uring_complete(uint64_t user_data, int32_t result,
+    uint32_t flags);
+static uint64_t uring_tag(const struct reactor_handler* handler);
+static struct io_uring_sqe* uring_sqe(void);
+static int uring_submit(bool wait);
+static bool unlink_from(struct reactor_handler** list,
+    struct reactor_handler* handler);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Creates the epoll instance or the io_uring.
+ *
+ * Falls back to epoll if the io_uring can not be set up.
+ *
+ * \param io_uring whether to drive the event loop by io_uring.
+ * \return 0 on success, else -1.
+ */
+int reactor_init(bool io_uring)
+{
+    int i;
+
+    if (io_uring)
+    {
+        if (uring_init(URING_ENTRIES) == 0)
+        {
+            for (i = 0; i < URING_SLOTS; ++i)
+            {
+                sfree_slots[i] = URING_SLOTS - 1 - i;
+                sslots[i].generation = 1;
+            }
+            sfree_count = URING_SLOTS;
+            suring = true;
+            return 0;
+        }
+        print_error("io_uring not available, continue with epoll.");
+    }
+
+    sepoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (sepoll_fd < 0)
+    {
+        print_error("epoll_create1() failed: %s.", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Registers a handler for its file descriptor.
+ *
+ * The handler must stay valid as long as it is registered. Its callback has
+ * to cope with spurious calls, so the descriptor should be non-blocking.
+ *
+ * \param handler with fd and callback set.
+ * \param events epoll events, EPOLLET for edge triggered notification.
+ * \return 0 on success, else -1.
+ */
+int reactor_add(struct reactor_handler* handler, uint32_t events)
+{
+    struct epoll_event event;
+
+    handler->events = events;
+    handler->slot = -1;
+    handler->armed = false;
+    handler->pending = false;
+    handler->next_pending = NULL;
+    if (suring)
+    {
+        return uring_register(handler);
+    }
+
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = handler;
+    if (epoll_ctl(sepoll_fd, EPOLL_CTL_ADD, handler->fd, &event) < 0)
+    {
+        print_error("epoll_ctl() failed: %s.", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Unregisters a handler, its file descriptor stays open.
+ *
+ * \param handler registered handler.
+ * \return 0 on success, else -1.
+ */
+int reactor_remove(struct reactor_handler* handler)
+{
+    struct io_uring_sqe* sqe;
+    struct uring_slot* slot;
+
+    unlink_pending(handler);
+    if (suring)
+    {
+        if (handler->slot < 0)
+        {
+            return 0;
+        }
+        slot = &sslots[handler->slot];
+        if (handler->armed && ((sqe = uring_sqe()) != NULL))
+        {
+            sqe->opcode = handler->on_accept != NULL ?
+                IORING_OP_ASYNC_CANCEL : IORING_OP_POLL_REMOVE;
+            sqe->fd = -1;
+            sqe->addr = uring_tag(handler);
+        }
+        /* completions still in flight are ignored from now on */
+        slot->handler = NULL;
+        if (++slot->generation == 0)
+        {
+            slot->generation = 1;
+        }
+        sfree_slots[sfree_count++] = handler->slot;
+        handler->slot = -1;
+        handler->armed = false;
+        return 0;
+    }
+    if (epoll_ctl(sepoll_fd, EPOLL_CTL_DEL, handler->fd, NULL) < 0)
+    {
+        print_error("epoll_ctl() failed: %s.", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Registers a listening socket, which accepts its connections.
+ *
+ * With epoll the listening socket has to be non-blocking and is drained in
+ * batches of accept4(), with io_uring one multishot accept is armed.
+ * Scheduling the handler retries accepting after an error. The accepted
+ * sockets are blocking and close on exec.
+ *
+ * \param handler with fd set, callback is set by this function.
+ * \param on_accept called with each accepted connection.
+ * \return 0 on success, else -1.
+ */
+int reactor_add_accept(struct reactor_handler* handler,
+    reactor_accept_t on_accept)
+{
+    handler->callback = accept_ready;
+    handler->on_accept = on_accept;
+    return reactor_add(handler, EPOLLIN | EPOLLET);
+}
+
+/**
+ * \brief Closes a descriptor not registered with the reactor.
+ *
+ * With io_uring the close is submitted together with the other requests of
+ * the round, without a system call of its own.
+ *
+ * \param fd to be closed.
+ */
+void reactor_close(int fd)
+{
+    struct io_uring_sqe* sqe;
+
+    if (suring && (sclosing_count == URING_CLOSE_BATCH))
+    {
+        (void) uring_submit(false);
+    }
+    if (!suring || (sclosing_count == URING_CLOSE_BATCH) ||
+        ((sqe = uring_sqe()) == NULL))
+    {
+        (void) close(fd);
+        return;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    /* a child forked before the submission must not keep the descriptor */
+    sclosing[sclosing_count++] = fd;
+}
+
+/**
+ * \brief Creates a periodic timer and registers its handler.
+ *
+ * The callback has to drain the timer with reactor_drain().
+ *
+ * \param handler with callback set, fd is set by this function.
+ * \param interval_ms period of the timer in milliseconds.
+ * \return 0 on success, else -1.
+ */
+int reactor_add_timer(struct reactor_handler* handler, long interval_ms)
+{
+    handler->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (handler->fd < 0)
+    {
+        print_error("timerfd_create() failed: %s.", strerror(errno));
+        return -1;
+    }
+    if (reactor_set_timer(handler, interval_ms) < 0)
+    {
+        (void) close(handler->fd);
+        return -1;
+    }
+    return reactor_add(handler, EPOLLIN);
+}
+
+/**
+ * \brief Changes the period of a timer, starting it over.
+ *
+ * \param handler registered by reactor_add_timer().
+ * \param interval_ms new period of the timer in milliseconds.
+ * \return 0 on success, else -1.
+ */
+int reactor_set_timer(const struct reactor_handler* handler, long interval_ms)
+{
+    struct itimerspec spec;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.it_interval.tv_sec = interval_ms / MS_PER_SECOND;
+    spec.it_interval.tv_nsec = (interval_ms % MS_PER_SECOND) * NS_PER_MS;
+    spec.it_value = spec.it_interval;
+    if (timerfd_settime(handler->fd, 0, &spec, NULL) < 0)
+    {
+        print_error("timerfd_settime() failed: %s.", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Redirects signals to a signalfd and registers its handler.
+ *
+ * The signals are blocked, so they are only delivered by the signalfd.
+ * The callback has to drain the signalfd with reactor_drain().
+ *
+ * \param handler with callback set, fd is set by this function.
+ * \param mask signals to be handled.
+ * \return 0 on success, else -1.
+ */
+int reactor_add_signals(struct reactor_handler* handler, const sigset_t* mask)
+{
+    sigset_t old_mask;
+
+    if (sigprocmask(SIG_BLOCK, mask, &old_mask) < 0)
+    {
+        print_error("sigprocmask() failed: %s.", strerror(errno));
+        return -1;
+    }
+    if (!smask_saved)
+    {
+        sorig_mask = old_mask;
+        smask_saved = true;
+    }
+    handler->fd = signalfd(-1, mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (handler->fd < 0)
+    {
+        print_error("signalfd() failed: %s.", strerror(errno));
+        return -1;
+    }
+    return reactor_add(handler, EPOLLIN);
+}
+
+/**
+ * \brief Reads and discards everything from a timerfd or signalfd.
+ *
+ * \param handler registered by reactor_add_timer() or reactor_add_signals().
+ */
+void reactor_drain(const struct reactor_handler* handler)
+{
+    struct signalfd_siginfo info[REACTOR_EVENTS];
+
+    /* a signalfd_siginfo is big enough for the timer counter, too */
+    while (read(handler->fd, info, sizeof(info)) > 0)
+    {
+    }
+}
+
+/**
+ * \brief Calls a handler again, without waiting for an event.
+ *
+ * \param handler registered handler.
+ */
+void reactor_schedule(struct reactor_handler* handler)
+{
+    if (!handler->pending)
+    {
+        handler->pending = true;
+        handler->next_pending = spending;
+        spending = handler;
+    }
+}
+
+/**
+ * \brief Prepares a forked child which is not going to use the reactor.
+ *
+ * Restores the signal mask, which is inherited even by execl(), and closes
+ * the descriptors the parent has not closed yet.
+ */
+void reactor_child(void)
+{
+    int i;
+
+    for (i = 0; i < sclosing_count; ++i)
+    {
+        (void) close(sclosing[i]);
+    }
+    sclosing_count = 0;
+    if (suring)
+    {
+        uring_child();
+        suring = false;
+    }
+    if (smask_saved)
+    {
+        (void) sigprocmask(SIG_SETMASK, &sorig_mask, NULL);
+    }
+    if (sepoll_fd >= 0)
+    {
+        (void) close(sepoll_fd);
+        sepoll_fd = -1;
+    }
+}
+
+/**
+ * \brief Dispatches the events of all registered handlers.
+ *
+ * This function serves the handlers in a loop, so it should never exit.
+ *
+ * \return -1 if waiting for events failed.
+ */
+int reactor_run(void)
+{
+    return suring ? run_uring() : run_epoll();
+}
+
+/**
+ * \brief Dispatches the events by epoll.
+ *
+ * \return -1 if epoll_wait() failed.
+ */
+static int run_epoll(void)
+{
+    struct epoll_event events[REACTOR_EVENTS];
+    struct reactor_handler* handler;
+    int count;
+    int i;
+
+    while (1)
+    {
+        count = epoll_wait(sepoll_fd, events, REACTOR_EVENTS,
+            spending != NULL ? 0 : -1);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            print_error("epoll_wait() failed: %s.", strerror(errno));
+            return -1;
+        }
+
+        for (i = 0; i < count; ++i)
+        {
+            handler = events[i].data.ptr;
+            unlink_pending(handler);
+            if (handler->callback(handler, events[i].events))
+            {
+                reactor_schedule(handler);
+            }
+        }
+
+        /* handlers which did not finish in the previous round */
+        sprocessing = spending;
+        spending = NULL;
+        while (sprocessing != NULL)
+        {
+            handler = sprocessing;
+            sprocessing = handler->next_pending;
+            handler->pending = false;
+            handler->next_pending = NULL;
+            call_pending(handler);
+        }
+    }
+}
+
+/**
+ * \brief Dispatches the completions of the io_uring.
+ *
+ * \return -1 if io_uring_enter() failed.
+ */
+static int run_uring(void)
+{
+    struct reactor_handler* handler;
+    struct io_uring_cqe* cqe;
+    uint64_t user_data;
+    int32_t result;
+    uint32_t flags;
+
+    while (1)
+    {
+        if (uring_submit(spending == NULL) < 0)
+        {
+            return -1;
+        }
+
+        while ((cqe = uring_peek_cqe()) != NULL)
+        {
+            user_data = cqe->user_data;
+            result = cqe->res;
+            flags = cqe->flags;
+            uring_cqe_seen();
+            uring_complete(user_data, result, flags);
+        }
+
+        /* handlers which did not finish in the previous round */
+        sprocessing = spending;
+        spending = NULL;
+        while (sprocessing != NULL)
+        {
+            handler = sprocessing;
+            sprocessing = handler->next_pending;
+            handler->pending = false;
+            handler->next_pending = NULL;
+            call_pending(handler);
+        }
+    }
+}
+
+/**
+ * \brief Calls a handler scheduled by reactor_schedule().
+ *
+ * A listening socket served by io_uring only needs its accept armed again.
+ *
+ * \param handler registered handler.
+ */
+static void call_pending(struct reactor_handler* handler)
+{
+    if (suring && (handler->on_accept != NULL))
+    {
+        if (!handler->armed && (handler->slot >= 0))
+        {
+            (void) uring_arm(handler);
+        }
+        return;
+    }
+    if (handler->callback(handler, EPOLLIN))
+    {
+        reactor_schedule(handler);
+    }
+}
+
+/**
+ * \brief Accepts a batch of connections from the backlog with epoll.
+ *
+ * \param handler the listening socket handler.
+ * \param events will be ignored.
+ * \return true if the backlog may hold further connections.
+ */
+static bool accept_ready(struct reactor_handler* handler, uint32_t events)
+{
+    int connection_fd;
+    int i;
+
+    (void) events; /* pedantic */
+    for (i = 0; i < ACCEPT_BATCH; ++i)
+    {
+        connection_fd = accept4(handler->fd, NULL, NULL, SOCK_CLOEXEC);
+        if (connection_fd < 0)
+        {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            {
+                /* backlog drained, wait for the next edge */
+                return false;
+            }
+            if ((errno == EINTR) || (errno == ECONNABORTED))
+            {
+                continue;
+            }
+            /* e.g. out of descriptors, the owner schedules a retry */
+            print_error("accept() failed: %s.", strerror(errno));
+            return false;
+        }
+        handler->on_accept(handler, connection_fd);
+    }
+    return true;
+}
+
+/**
+ * \brief Assigns a slot to a handler and arms its request.
+ *
+ * \param handler with events set.
+ * \return 0 on success, else -1.
+ */
+static int uring_register(struct reactor_handler* handler)
+{
+    if (sfree_count == 0)
+    {
+        print_error("Too many handlers for io_uring.");
+        return -1;
+    }
+    handler->slot = sfree_slots[--sfree_count];
+    sslots[handler->slot].handler = handler;
+    if (uring_arm(handler) < 0)
+    {
+        (void) reactor_remove(handler);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Queues the request waiting for a handler.
+ *
+ * Listening sockets get a multishot accept, edge triggered handlers a
+ * multishot poll and level triggered handlers a poll, which is armed again
+ * after each call.
+ *
+ * \param handler registered handler, not armed.
+ * \return 0 on success, else -1.
+ */
+static int uring_arm(struct reactor_handler* handler)
+{
+    struct io_uring_sqe* sqe;
+
+    sqe = uring_sqe();
+    if (sqe == NULL)
+    {
+        return -1;
+    }
+    sqe->fd = handler->fd;
+    sqe->user_data = uring_tag(handler);
+    if (handler->on_accept != NULL)
+    {
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_CLOEXEC;
+    }
+    else
+    {
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->poll32_events = handler->events & ~(uint32_t) EPOLLET;
+        if (handler->events & EPOLLET)
+        {
+            sqe->len = IORING_POLL_ADD_MULTI;
+        }
+    }
+    handler->armed = true;
+    return 0;
+}
+
+/**
+ * \brief Dispatches a completion to its handler.
+ *
+ * \param user_data of the request.
+ * \param result of the request.
+ * \param flags of the completion.
+ */
+static void uring_complete(uint64_t user_data, int32_t result, uint32_t flags)
+{
+    struct reactor_handler* handler;
+    struct uring_slot* slot;
+    uint32_t index = (uint32_t) user_data;
+
+    /* closes and cancels, or a handler removed meanwhile */
+    if ((user_data == 0) || (index >= URING_SLOTS))
+    {
+        return;
+    }
+    slot = &sslots[index];
+    handler = slot->handler;
+    if ((handler == NULL) || (slot->generation != (uint32_t) (user_data >> 32)))
+    {
+        return;
+    }
+    if (!(flags & IORING_CQE_F_MORE))
+    {
+        handler->armed = false;
+    }
+
+    if (handler->on_accept != NULL)
+    {
+        if (result >= 0)
+        {
+            handler->on_accept(handler, result);
+        }
+        else if ((result != -EINTR) && (result != -ECONNABORTED) &&
+            (result != -EAGAIN))
+        {
+            /* e.g. out of descriptors, the owner schedules a retry */
+            print_error("accept() failed: %s.", strerror(-result));
+            return;
+        }
+    }
+    else if (result < 0)
+    {
+        print_error("io_uring poll failed: %s.", strerror(-result));
+        return;
+    }
+    else
+    {
+        unlink_pending(handler);
+        if (handler->callback(handler, (uint32_t) result))
+        {
+            reactor_schedule(handler);
+        }
+    }
+
+    /* the callback may have removed the handler */
+    if ((slot->handler == handler) && (handler->slot >= 0) &&
+        !handler->armed && (slot->generation == (uint32_t) (user_data >> 32)))
+    {
+        (void) uring_arm(handler);
+    }
+}
+
+/**
+ * \brief Returns the user data identifying the requests of a handler.
+ *
+ * \param handler registered handler.
+ * \return slot and generation, never 0.
+ */
+static uint64_t uring_tag(const struct reactor_handler* handler)
+{
+    return ((uint64_t) sslots[handler->slot].generation << 32) |
+        (uint64_t) handler->slot;
+}
+
+/**
+ * \brief Gets a submission queue entry, submits the queue if it is full.
+ *
+ * \return the entry, NULL on failure.
+ */
+static struct io_uring_sqe* uring_sqe(void)
+{
+    struct io_uring_sqe* sqe;
+
+    sqe = uring_get_sqe();
+    if ((sqe == NULL) && (uring_submit(false) == 0))
+    {
+        sqe = uring_get_sqe();
+    }
+    if (sqe == NULL)
+    {
+        print_error("io_uring submission queue full.");
+    }
+    return sqe;
+}
+
+/**
+ * \brief Submits the queued requests.
+ *
+ * \param wait whether to wait for a completion.
+ * \return 0 on success, else -1.
+ */
+static int uring_submit(bool wait)
+{
+    if (uring_enter(wait) < 0)
+    {
+        return -1;
+    }
+    /* closes are done by the kernel on submission */
+    if (uring_unsubmitted() == 0)
+    {
+        sclosing_count = 0;
+    }
+    return 0;
+}
+
+/**
+ * \brief Removes a handler from the list of pending handlers.
+ *
+ * \param handler registered handler.
+ */
+static void unlink_pending(struct reactor_handler* handler)
+{
+    if (!handler->pending)
+    {
+        return;
+    }
+    if (!unlink_from(&spending, handler))
+    {
+        (void) unlink_from(&sprocessing, handler);
+    }
+    handler->pending = false;
+    handler->next_pending = NULL;
+}
+
+/**
+ * \brief Removes a handler from a list of handlers.
+ *
+ * \param list head of the list.
+ * \param handler to be removed.
+ * \return true if the handler was found.
+ */
+static bool unlink_from(struct reactor_handler** list,
+    struct reactor_handler* handler)
+{
+    struct reactor_handler** link;
+
+    for (link = list; *link != NULL; link = &(*link)->next_pending)
+    {
+        if (*link == handler)
+        {
+            *link = handler->next_pending;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* === EOF ================================================================== */
@@ -0,0 +1,259 @@
+/**
+ * @file simple_message_server_relay.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, business logic output relayed by the server.
+ *
+ * The business logic reads the request from the connect socket as usual,
+ * but writes its response into a pipe. A serving thread moves the response
+ * from the pipe to the client with splice(), so the bytes are not copied
+ * through the server. The socket is corked meanwhile: the many short
+ * status=, file= and len= writes of the business logic leave the server in
+ * full segments instead of one small segment each.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+/* splice(), pipe2() */
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "simple_message_server.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* bytes moved per splice(), the default capacity of a pipe */
+#define RELAY_CHUNK 65536
+
+/* exit code of a business logic which could not be executed */
+#define EXEC_FAILED 127
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+
+/** Listening socket, not passed to the business logic. */
+static int ssocket_fd = -1;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static void serve_relay(void* context, int connection_fd);
+static int relay_output(int output_fd, int connection_fd, uint64_t* sent);
+static int copy_output(int output_fd, int connection_fd, uint64_t* sent);
+static void set_cork(int connection_fd, int cork);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Starts the threads relaying the output of the business logic.
+ *
+ * Every thread serves one business logic at a time.
+ *
+ * \param socket_fd listening socket, not passed to the business logic.
+ * \param threads number of threads.
+ * \return 0 if at least one thread runs, else -1.
+ */
+int relay_start(int socket_fd, long threads)
+{
+    sigset_t mask;
+    sigset_t old_mask;
+    long started;
+
+    ssocket_fd = socket_fd;
+    /*
+     * splice() to a closed connection raises SIGPIPE, the threads inherit
+     * it blocked, the business logic gets the original mask back
+     */
+    (void) sigemptyset(&mask);
+    (void) sigaddset(&mask, SIGPIPE);
+    (void) pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+    for (started = 0; (started < threads) &&
+        (threads_start(serve_relay, NULL) == 0); ++started)
+    {
+    }
+    (void) pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+    return started > 0 ? 0 : -1;
+}
+
+/**
+ * \brief Serves a queued connection by a business logic.
+ *
+ * Called on the serving threads, so the child only uses async-signal-safe
+ * functions until execl().
+ *
+ * \param context will be ignored.
+ * \param connection_fd connect socket, closed by this function.
+ */
+static void serve_relay(void* context, int connection_fd)
+{
+    uint64_t sent = 0;
+    int output[2];
+    pid_t pid;
+
+    (void) context; /* pedantic */
+    if (pipe2(output, O_CLOEXEC) < 0)
+    {
+        print_error("pipe2() failed: %s.", strerror(errno));
+        (void) close(connection_fd);
+        return;
+    }
+    if ((pid = children_fork(connection_fd)) < 0)
+    {
+        print_error("fork() failed: %s.", strerror(errno));
+        (void) close(output[0]);
+        (void) close(output[1]);
+        (void) close(connection_fd);
+        return;
+    }
+    /* the child is reaped by the event loop */
+    if (pid == 0)
+    {
+        reactor_child();
+        (void) metrics_started(connection_fd);
+        (void) close(ssocket_fd);
+        if ((dup2(connection_fd, STDIN_FILENO) == -1) ||
+            (dup2(output[1], STDOUT_FILENO) == -1))
+        {
+            _exit(EXEC_FAILED);
+        }
+        (void) execl(business_logic_path(), BUSINESS_LOGIC, (char*) NULL);
+        _exit(EXEC_FAILED);
+    }
+
+    (void) close(output[1]);
+    set_cork(connection_fd, 1);
+    /*
+     * if the client went away, closing the pipe stops the business logic by
+     * SIGPIPE or EPIPE, as writing to the socket would have done
+     */
+    (void) relay_output(output[0], connection_fd, &sent);
+    /* send what is left of the response in the cork */
+    set_cork(connection_fd, 0);
+    metrics_count(METRIC_BYTES_SENT, sent);
+    metrics_record(METRIC_RESPONSE_BYTES, sent);
+    (void) close(output[0]);
+    (void) close(connection_fd);
+}
+
+/**
+ * \brief Moves the output of the business logic to the client by splice().
+ *
+ * \param output_fd read end of the pipe of the business logic.
+ * \param connection_fd connect socket.
+ * \param sent incremented by the bytes moved.
+ * \return 0 at end of the output, -1 on error.
+ */
+static int relay_output(int output_fd, int connection_fd, uint64_t* sent)
+{
+    ssize_t moved;
+
+    while (1)
+    {
+        moved = splice(output_fd, NULL, connection_fd, NULL, RELAY_CHUNK,
+            SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (moved > 0)
+        {
+            *sent += (uint64_t) moved;
+            continue;
+        }
+        if (moved == 0)
+        {
+            return 0;
+        }
+        if (errno == EINTR)
+        {
+            continue;
+        }
+        if (errno == EINVAL)
+        {
+            /* no splice() for this socket, copy instead */
+            return copy_output(output_fd, connection_fd, sent);
+        }
+        return -1;
+    }
+}
+
+/**
+ * \brief Copies the output of the business logic to the client.
+ *
+ * \param output_fd read end of the pipe of the business logic.
+ * \param connection_fd connect socket.
+ * \param sent incremented by the bytes copied.
+ * \return 0 at end of the output, -1 on error.
+ */
+static int copy_output(int output_fd, int connection_fd, uint64_t* sent)
+{
+    char buf[BUFSIZ];
+    ssize_t read_count;
+    ssize_t result;
+    size_t written;
+
+    while (1)
+    {
+        read_count = read(output_fd, buf, sizeof(buf));
+        if (read_count == 0)
+        {
+            return 0;
+        }
+        if (read_count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        written = 0;
+        while (written < (size_t) read_count)
+        {
+            result = send(connection_fd, buf + written,
+                (size_t) read_count - written, MSG_NOSIGNAL | MSG_MORE);
+            if (result >= 0)
+            {
+                written += (size_t) result;
+                *sent += (uint64_t) result;
+            }
+            else if (errno != EINTR)
+            {
+                return -1;
+            }
+        }
+    }
+}
+
+/**
+ * \brief Corks or uncorks the connection.
+ *
+ * \param connection_fd connect socket.
+ * \param cork 1 to hold back partial segments, 0 to send them.
+ */
+static void set_cork(int connection_fd, int cork)
+{
+    (void) setsockopt(connection_fd, IPPROTO_TCP, TCP_CORK, &cork,
+        sizeof(cork));
+}
+
+/* === EOF ================================================================== */
@@ -0,0 +1,469 @@
+/**
+ * @file simple_message_server_stub.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, deterministic stub business logic.
+ *
+ * The stub stands in for simple_message_server_logic when the server or the
+ * client are measured: started by the server with -L, it reads the request
+ * from stdin, checks its user= and optional img= lines and writes a response
+ * of a configured shape to stdout. The first file is the page the client
+ * expects, showing the request, further files are named stub_<n>.bin. All
+ * content is generated, so equal configurations give equal responses. It is
+ * configured by the environment inherited from the server:
+ *
+ *  - SMS_STUB_FILES number of files of the response, 1 by default
+ *  - SMS_STUB_SIZES comma separated sizes of the files in bytes, used in
+ *    turn; the page is padded up to its size, 0 (default) is the bare page
+ *  - SMS_STUB_CPU_US CPU time burnt per request in microseconds
+ *  - SMS_STUB_DELAY_US time slept per request in microseconds
+ *  - SMS_STUB_STATUS status reported for a valid request, 0 by default
+ *
+ * A request without a user= line is answered with status 1.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* decimal format base for strtol */
+#define INPUT_NUM_BASE 10
+
+#define RESPONSE_FILE "vcs_tcpip_bulletin_board_response.html"
+#define STUB_FILE "stub_%ld.bin"
+#define PAGE_HEAD "<html><body><pre>\n"
+#define PAGE_TAIL "</pre></body></html>\n"
+
+#define SET_USER "user="
+#define SET_IMAGE "img="
+
+#define ENV_FILES "SMS_STUB_FILES"
+#define ENV_SIZES "SMS_STUB_SIZES"
+#define ENV_CPU "SMS_STUB_CPU_US"
+#define ENV_DELAY "SMS_STUB_DELAY_US"
+#define ENV_STATUS "SMS_STUB_STATUS"
+
+/* requests are cut off at this size */
+#define MAX_REQUEST 4096
+/* upper bound for the files of a response */
+#define MAX_FILES 1024
+/* upper bound for the sizes used in turn */
+#define MAX_SIZES 64
+/* upper bound for the size of a file, 1 GiB */
+#define MAX_SIZE (1L << 30)
+/* upper bound for the CPU time or delay, 10 s */
+#define MAX_US 10000000L
+
+/* filler lines padding the page and making up the other files */
+#define FILLER_LINE 64
+
+#define NS_PER_US 1000
+#define NS_PER_SECOND 1000000000L
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+static const char* sprogram_arg0 = NULL;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static void print_error(const char* message, ...);
+static long env_number(const char* name, long fallback, long lower,
+    long upper);
+static long env_sizes(long* sizes);
+static size_t read_request(char* request, size_t size);
+static bool check_request(const char* request);
+static size_t escape(const char* text, size_t length, char* page);
+static int write_page(const char* request, size_t length, long size);
+static int write_filler(long count);
+static void burn_cpu(long us);
+static void delay(long us);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief the main method for the stub business logic
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * \return success or failure.
+ * \retval EXIT_SUCCESS if the response was written.
+ * \retval EXIT_FAILURE on failure.
+ */
+int main(int argc, char* argv[])
+{
+    char request[MAX_REQUEST + 1];
+    long sizes[MAX_SIZES];
+    long files;
+    long size_count;
+    long cpu_us;
+    long delay_us;
+    long status;
+    size_t length;
+    long i;
+
+    (void) argc; /* pedantic */
+    sprogram_arg0 = argv[0];
+    files = env_number(ENV_FILES, 1, 1, MAX_FILES);
+    size_count = env_sizes(sizes);
+    cpu_us = env_number(ENV_CPU, 0, 0, MAX_US);
+    delay_us = env_number(ENV_DELAY, 0, 0, MAX_US);
+    status = env_number(ENV_STATUS, 0, 0, INT_MAX);
+    if ((files < 0) || (size_count < 0) || (cpu_us < 0) || (delay_us < 0) ||
+        (status < 0))
+    {
+        return EXIT_FAILURE;
+    }
+
+    length = read_request(request, sizeof(request) - 1);
+    request[length] = '\0';
+    if (!check_request(request))
+    {
+        status = 1;
+    }
+    burn_cpu(cpu_us);
+    delay(delay_us);
+
+    if ((printf("status=%ld\n", status) < 0) ||
+        (write_page(request, length, sizes[0]) < 0))
+    {
+        return EXIT_FAILURE;
+    }
+    for (i = 1; i < files; ++i)
+    {
+        if ((printf("file=" STUB_FILE "\nlen=%ld\n", i,
+            sizes[i % size_count]) < 0) ||
+            (write_filler(sizes[i % size_count]) < 0))
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    return fflush(stdout) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ *
+ * \brief Prints error message to stderr.
+ *
+ * A new line is printed after the message text automatically.
+ * Printout can be formatted like printf.
+ *
+ * \param message output on stderr.
+ *
+ * \return void
+ */
+static void print_error(const char* message, ...)
+{
+    va_list args;
+
+    /* do not handle return value of fprintf, because it makes no sense here */
+    (void) fprintf(stderr, "%s: ", sprogram_arg0);
+    va_start(args, message);
+    (void) vfprintf(stderr, message, args);
+    va_end(args);
+    (void) fprintf(stderr, "\n");
+}
+
+/**
+ * \brief Reads a number from the environment.
+ *
+ * \param name of the environment variable.
+ * \param fallback used if the variable is not set.
+ * \param lower smallest allowed value, not negative.
+ * \param upper greatest allowed value.
+ * \return the number, -1 if it is invalid.
+ */
+static long env_number(const char* name, long fallback, long lower,
+    long upper)
+{
+    const char* text = getenv(name);
+    char* end_ptr;
+    long number;
+
+    if (text == NULL)
+    {
+        return fallback;
+    }
+    errno = 0;
+    number = strtol(text, &end_ptr, INPUT_NUM_BASE);
+    if ((errno != 0) || (end_ptr == text) || (*end_ptr != '\0') ||
+        (number < lower) || (number > upper))
+    {
+        print_error("Invalid %s %s.", name, text);
+        return -1;
+    }
+    return number;
+}
+
+/**
+ * \brief Reads the sizes of the files from the environment.
+ *
+ * \param sizes where to put at least one and at most MAX_SIZES sizes.
+ * \return number of sizes, -1 if they are invalid.
+ */
+static long env_sizes(long* sizes)
+{
+    const char* text = getenv(ENV_SIZES);
+    char* end_ptr;
+    long count = 0;
+
+    sizes[0] = 0;
+    if (text == NULL)
+    {
+        return 1;
+    }
+    while (count < MAX_SIZES)
+    {
+        errno = 0;
+        sizes[count] = strtol(text, &end_ptr, INPUT_NUM_BASE);
+        if ((errno != 0) || (end_ptr == text) || (sizes[count] < 0) ||
+            (sizes[count] > MAX_SIZE) ||
+            ((*end_ptr != ',') && (*end_ptr != '\0')))
+        {
+            break;
+        }
+        ++count;
+        if (*end_ptr == '\0')
+        {
+            return count;
+        }
+        text = end_ptr + 1;
+    }
+    print_error("Invalid %s %s.", ENV_SIZES, getenv(ENV_SIZES));
+    return -1;
+}
+
+/**
+ * \brief Reads the request up to the end of the stream.
+ *
+ * The request is cut off at size, the rest is read and dropped, so the
+ * client is never blocked sending.
+ *
+ * \param request where to put the request.
+ * \param size of request.
+ * \return length of the request kept.
+ */
+static size_t read_request(char* request, size_t size)
+{
+    char drop[BUFSIZ];
+    size_t amount = 0;
+    ssize_t read_count;
+
+    while (1)
+    {
+        if (amount < size)
+        {
+            read_count = read(STDIN_FILENO, request + amount, size - amount);
+        }
+        else
+        {
+            read_count = read(STDIN_FILENO, drop, sizeof(drop));
+        }
+        if (read_count > 0)
+        {
+            amount += amount < size ? (size_t) read_count : 0;
+            continue;
+        }
+        if ((read_count < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        return amount;
+    }
+}
+
+/**
+ * \brief Checks the request has a user= and an optional img= line.
+ *
+ * \param request terminated by '\0'.
+ * \return true if the request is valid.
+ */
+static bool check_request(const char* request)
+{
+    const char* line_end;
+
+    if ((strncmp(request, SET_USER, strlen(SET_USER)) != 0) ||
+        ((line_end = strchr(request, '\n')) == NULL) ||
+        (line_end == request + strlen(SET_USER)))
+    {
+        return false;
+    }
+    request = line_end + 1;
+    if (strncmp(request, SET_IMAGE, strlen(SET_IMAGE)) == 0)
+    {
+        return strchr(request, '\n') != NULL;
+    }
+    return true;
+}
+
+/**
+ * \brief Escapes the markup characters of a text.
+ *
+ * \param text to be escaped.
+ * \param length of text.
+ * \param page where to put the escaped text, room for 5 * length bytes.
+ * \return length of the escaped text.
+ */
+static size_t escape(const char* text, size_t length, char* page)
+{
+    size_t page_len = 0;
+    size_t i;
+
+    for (i = 0; i < length; ++i)
+    {
+        switch (text[i])
+        {
+        case '<':
+            memcpy(page + page_len, "&lt;", 4);
+            page_len += 4;
+            break;
+        case '>':
+            memcpy(page + page_len, "&gt;", 4);
+            page_len += 4;
+            break;
+        case '&':
+            memcpy(page + page_len, "&amp;", 5);
+            page_len += 5;
+            break;
+        default:
+            page[page_len++] = text[i];
+            break;
+        }
+    }
+    return page_len;
+}
+
+/**
+ * \brief Writes the page showing the request.
+ *
+ * \param request terminated by '\0'.
+ * \param length of the request.
+ * \param size the page is padded up to by filler before its tail.
+ * \return 0 on success, else -1.
+ */
+static int write_page(const char* request, size_t length, long size)
+{
+    char page[sizeof(PAGE_HEAD) + 5 * MAX_REQUEST];
+    size_t page_len;
+    long filler = 0;
+
+    page_len = strlen(PAGE_HEAD);
+    memcpy(page, PAGE_HEAD, page_len);
+    page_len += escape(request, length, page + page_len);
+    if ((long) (page_len + strlen(PAGE_TAIL)) < size)
+    {
+        filler = size - (long) (page_len + strlen(PAGE_TAIL));
+    }
+    if ((printf("file=%s\nlen=%ld\n", RESPONSE_FILE,
+        (long) (page_len + strlen(PAGE_TAIL)) + filler) < 0) ||
+        (fwrite(page, 1, page_len, stdout) != page_len) ||
+        (write_filler(filler) < 0) ||
+        (fputs(PAGE_TAIL, stdout) == EOF))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Writes filler: lines of letters, the same for the same count.
+ *
+ * \param count bytes to be written.
+ * \return 0 on success, else -1.
+ */
+static int write_filler(long count)
+{
+    char line[FILLER_LINE];
+    long position;
+    size_t take;
+    int i;
+
+    for (i = 0; i < FILLER_LINE - 1; ++i)
+    {
+        line[i] = (char) ('a' + i % 26);
+    }
+    line[FILLER_LINE - 1] = '\n';
+    for (position = 0; position < count; position += (long) take)
+    {
+        take = (long) FILLER_LINE < count - position ?
+            FILLER_LINE : (size_t) (count - position);
+        if (fwrite(line, 1, take, stdout) != take)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * \brief Burns CPU time.
+ *
+ * \param us CPU time of the process to be reached, in microseconds.
+ */
+static void burn_cpu(long us)
+{
+    struct timespec now;
+    volatile unsigned long spin = 0;
+    long long target = (long long) us * NS_PER_US;
+    int i;
+
+    if (us == 0)
+    {
+        return;
+    }
+    do
+    {
+        for (i = 0; i < 1000; ++i)
+        {
+            ++spin;
+        }
+        (void) clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    } while ((long long) now.tv_sec * NS_PER_SECOND + now.tv_nsec < target);
+}
+
+/**
+ * \brief Sleeps, as if the business logic waited for a backend.
+ *
+ * \param us time to sleep in microseconds.
+ */
+static void delay(long us)
+{
+    struct timespec wait;
+
+    if (us == 0)
+    {
+        return;
+    }
+    wait.tv_sec = us / (NS_PER_SECOND / NS_PER_US);
+    wait.tv_nsec = us % (NS_PER_SECOND / NS_PER_US) * NS_PER_US;
+    while ((nanosleep(&wait, &wait) < 0) && (errno == EINTR))
+    {
+    }
+}
+
+/* === EOF ================================================================== */
@@ -0,0 +1,168 @@
+/**
+ * @file simple_message_server_threads.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, threads serving queued connections.
+ *
+ * Accepted connections are queued by the event loop and taken by a set of
+ * threads, each calling its serve function for the connection. The plugin
+ * and the framed workers use these threads instead of a business logic
+ * process per connection.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "simple_message_server.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* connections waiting for a thread */
+#define THREADS_QUEUE 1024
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/** What a thread does with a connection. */
+struct thread_task
+{
+    /** serves one connection */
+    threads_serve_t serve;
+    /** passed to serve */
+    void* context;
+};
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+
+/** Protects the connection queue. */
+static pthread_mutex_t squeue_lock = PTHREAD_MUTEX_INITIALIZER;
+/** Signals queued connections. */
+static pthread_cond_t squeue_filled = PTHREAD_COND_INITIALIZER;
+/** Ring buffer of queued connections. */
+static int squeue[THREADS_QUEUE];
+/** Index of the oldest queued connection. */
+static size_t squeue_head = 0;
+/** Number of queued connections. */
+static size_t squeue_count = 0;
+/** Number of running threads. */
+static long sthreads = 0;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static void* serving_thread(void* arg);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Starts a thread which serves queued connections.
+ *
+ * Must not be called before all processes of the server are forked.
+ *
+ * \param serve called for every connection the thread takes.
+ * \param context passed to serve.
+ * \return 0 on success, else -1.
+ */
+int threads_start(threads_serve_t serve, void* context)
+{
+    struct thread_task* task;
+    pthread_t thread;
+    int result;
+
+    task = malloc(sizeof(*task));
+    if (task == NULL)
+    {
+        print_error("Can not allocate thread: %s.", strerror(ENOMEM));
+        return -1;
+    }
+    task->serve = serve;
+    task->context = context;
+
+    result = pthread_create(&thread, NULL, serving_thread, task);
+    if (result != 0)
+    {
+        print_error("pthread_create() failed: %s.", strerror(result));
+        free(task);
+        return -1;
+    }
+    (void) pthread_detach(thread);
+    ++sthreads;
+    return 0;
+}
+
+/**
+ * \brief Queues a connection for the threads.
+ *
+ * \param connection_fd connect socket, owned by the threads from now on.
+ * \return 0 if queued, -1 if no thread runs. If the queue is full, the
+ *  connection is shed and 0 is returned.
+ */
+int threads_dispatch(int connection_fd)
+{
+    if (sthreads == 0)
+    {
+        return -1;
+    }
+    (void) pthread_mutex_lock(&squeue_lock);
+    if (squeue_count == THREADS_QUEUE)
+    {
+        (void) pthread_mutex_unlock(&squeue_lock);
+        admission_reject(connection_fd, SHED_QUEUE_FULL);
+        return 0;
+    }
+    squeue[(squeue_head + squeue_count) % THREADS_QUEUE] = connection_fd;
+    ++squeue_count;
+    (void) pthread_cond_signal(&squeue_filled);
+    (void) pthread_mutex_unlock(&squeue_lock);
+    return 0;
+}
+
+/**
+ * \brief Main function of a serving thread.
+ *
+ * \param arg the struct thread_task of this thread.
+ * \return never.
+ */
+static void* serving_thread(void* arg)
+{
+    const struct thread_task* task = arg;
+    int connection_fd;
+
+    while (1)
+    {
+        (void) pthread_mutex_lock(&squeue_lock);
+        while (squeue_count == 0)
+        {
+            (void) pthread_cond_wait(&squeue_filled, &squeue_lock);
+        }
+        connection_fd = squeue[squeue_head];
+        squeue_head = (squeue_head + 1) % THREADS_QUEUE;
+        --squeue_count;
+        (void) pthread_mutex_unlock(&squeue_lock);
+
+        metrics_count(METRIC_THREADED, 1);
+        task->serve(task->context, connection_fd);
+    }
+    return NULL;
+}
+
+/* === EOF ================================================================== */
@@ -0,0 +1,290 @@
+/**
+ * @file simple_message_server_uring.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, minimal io_uring access for the event loop.
+ *
+ * Sets up one ring by the raw system calls and maps its submission and
+ * completion queues, so the server needs no library for io_uring. The ring
+ * is used by the event loop thread only.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "simple_message_server.h"
+#include "simple_message_server_uring.h"
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+
+/** The ring, -1 if not set up. */
+static int sring_fd = -1;
+
+/** Mapping of the submission queue ring. */
+static void* ssq_ring = NULL;
+/** Size of ssq_ring. */
+static size_t ssq_ring_size = 0;
+/** Mapping of the completion queue ring, may be ssq_ring. */
+static void* scq_ring = NULL;
+/** Size of scq_ring. */
+static size_t scq_ring_size = 0;
+/** Mapping of the submission queue entries. */
+static struct io_uring_sqe* ssqes = NULL;
+/** Size of ssqes. */
+static size_t ssqes_size = 0;
+
+/** Head of the submission queue, written by the kernel. */
+static _Atomic unsigned int* ssq_head = NULL;
+/** Tail of the submission queue, written by the server. */
+static _Atomic unsigned int* ssq_tail = NULL;
+/** Index array of the submission queue. */
+static unsigned int* ssq_array = NULL;
+/** Mask of the submission queue indices. */
+static unsigned int ssq_mask = 0;
+/** Number of submission queue entries. */
+static unsigned int ssq_entries = 0;
+/** Tail including entries not yet made visible to the kernel. */
+static unsigned int ssq_local_tail = 0;
+
+/** Head of the completion queue, written by the server. */
+static _Atomic unsigned int* scq_head = NULL;
+/** Tail of the completion queue, written by the kernel. */
+static _Atomic unsigned int* scq_tail = NULL;
+/** Mask of the completion queue indices. */
+static unsigned int scq_mask = 0;
+/** The completion queue entries. */
+static struct io_uring_cqe* scqes = NULL;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static void unmap_rings(void);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Sets up the ring and maps its queues.
+ *
+ * \param entries number of submission queue entries.
+ * \return 0 on success, else -1.
+ */
+int uring_init(unsigned int entries)
+{
+    struct io_uring_params params;
+    char* sq;
+    char* cq;
+
+    memset(&params, 0, sizeof(params));
+    sring_fd = (int) syscall(SYS_io_uring_setup, entries, &params);
+    if (sring_fd < 0)
+    {
+        print_error("io_uring_setup() failed: %s.", strerror(errno));
+        return -1;
+    }
+
+    ssq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    scq_ring_size = params.cq_off.cqes +
+        params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (scq_ring_size > ssq_ring_size)
+        {
+            ssq_ring_size = scq_ring_size;
+        }
+        scq_ring_size = 0;
+    }
+    ssq_ring = mmap(NULL, ssq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, sring_fd, IORING_OFF_SQ_RING);
+    if (ssq_ring == MAP_FAILED)
+    {
+        ssq_ring = NULL;
+    }
+    else if (scq_ring_size == 0)
+    {
+        scq_ring = ssq_ring;
+    }
+    else
+    {
+        scq_ring = mmap(NULL, scq_ring_size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, sring_fd, IORING_OFF_CQ_RING);
+        if (scq_ring == MAP_FAILED)
+        {
+            scq_ring = NULL;
+        }
+    }
+    ssqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ssqes = mmap(NULL, ssqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, sring_fd, IORING_OFF_SQES);
+    if (ssqes == MAP_FAILED)
+    {
+        ssqes = NULL;
+    }
+    if ((ssq_ring == NULL) || (scq_ring == NULL) || (ssqes == NULL))
+    {
+        print_error("mmap() of io_uring failed: %s.", strerror(errno));
+        unmap_rings();
+        (void) close(sring_fd);
+        sring_fd = -1;
+        return -1;
+    }
+
+    sq = ssq_ring;
+    ssq_head = (_Atomic unsigned int*) (sq + params.sq_off.head);
+    ssq_tail = (_Atomic unsigned int*) (sq + params.sq_off.tail);
+    ssq_array = (unsigned int*) (sq + params.sq_off.array);
+    ssq_mask = *(unsigned int*) (sq + params.sq_off.ring_mask);
+    ssq_entries = *(unsigned int*) (sq + params.sq_off.ring_entries);
+    ssq_local_tail = atomic_load_explicit(ssq_tail, memory_order_relaxed);
+
+    cq = scq_ring;
+    scq_head = (_Atomic unsigned int*) (cq + params.cq_off.head);
+    scq_tail = (_Atomic unsigned int*) (cq + params.cq_off.tail);
+    scq_mask = *(unsigned int*) (cq + params.cq_off.ring_mask);
+    scqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+    return 0;
+}
+
+/**
+ * \brief Releases the ring in a forked child, which shares its mappings.
+ */
+void uring_child(void)
+{
+    if (sring_fd < 0)
+    {
+        return;
+    }
+    unmap_rings();
+    (void) close(sring_fd);
+    sring_fd = -1;
+}
+
+/**
+ * \brief Gets a free submission queue entry.
+ *
+ * \return the cleared entry, NULL if the queue is full and has to be
+ *  submitted with uring_enter() first.
+ */
+struct io_uring_sqe* uring_get_sqe(void)
+{
+    struct io_uring_sqe* sqe;
+
+    if ((ssq_local_tail -
+        atomic_load_explicit(ssq_head, memory_order_acquire)) >= ssq_entries)
+    {
+        return NULL;
+    }
+    sqe = &ssqes[ssq_local_tail & ssq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ssq_array[ssq_local_tail & ssq_mask] = ssq_local_tail & ssq_mask;
+    ++ssq_local_tail;
+    return sqe;
+}
+
+/**
+ * \brief Submits the queued entries and waits for a completion.
+ *
+ * \param wait whether to wait for at least one completion.
+ * \return 0 on success or if interrupted, -1 on error.
+ */
+int uring_enter(bool wait)
+{
+    unsigned int to_submit;
+    long result;
+
+    atomic_store_explicit(ssq_tail, ssq_local_tail, memory_order_release);
+    to_submit = ssq_local_tail -
+        atomic_load_explicit(ssq_head, memory_order_acquire);
+    if ((to_submit == 0) && !wait)
+    {
+        return 0;
+    }
+    result = syscall(SYS_io_uring_enter, sring_fd, to_submit, wait ? 1 : 0,
+        wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if ((result < 0) && (errno != EINTR) && (errno != EAGAIN) &&
+        (errno != EBUSY))
+    {
+        print_error("io_uring_enter() failed: %s.", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Returns the number of queued entries the kernel has not consumed.
+ *
+ * \return number of entries.
+ */
+unsigned int uring_unsubmitted(void)
+{
+    return ssq_local_tail - atomic_load_explicit(ssq_head, memory_order_acquire);
+}
+
+/**
+ * \brief Returns the oldest completion without waiting.
+ *
+ * \return the completion, NULL if there is none.
+ */
+struct io_uring_cqe* uring_peek_cqe(void)
+{
+    unsigned int head;
+
+    head = atomic_load_explicit(scq_head, memory_order_relaxed);
+    if (head == atomic_load_explicit(scq_tail, memory_order_acquire))
+    {
+        return NULL;
+    }
+    return &scqes[head & scq_mask];
+}
+
+/**
+ * \brief Releases the completion returned by uring_peek_cqe().
+ */
+void uring_cqe_seen(void)
+{
+    atomic_store_explicit(scq_head,
+        atomic_load_explicit(scq_head, memory_order_relaxed) + 1,
+        memory_order_release);
+}
+
+/**
+ * \brief Unmaps the queues and buffers of the ring.
+ */
+static void unmap_rings(void)
+{
+    if (ssqes != NULL)
+    {
+        (void) munmap(ssqes, ssqes_size);
+        ssqes = NULL;
+    }
+    if ((scq_ring != NULL) && (scq_ring != ssq_ring))
+    {
+        (void) munmap(scq_ring, scq_ring_size);
+    }
+    scq_ring = NULL;
+    if (ssq_ring != NULL)
+    {
+        (void) munmap(ssq_ring, ssq_ring_size);
+        ssq_ring = NULL;
+    }
+}
+
+/* === EOF ================================================================== */
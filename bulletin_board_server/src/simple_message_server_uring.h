@@ -0,0 +1,38 @@
+/**
+ * @file simple_message_server_uring.h
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, minimal io_uring access for the event loop.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+#ifndef SIMPLE_MESSAGE_SERVER_URING_H
+#define SIMPLE_MESSAGE_SERVER_URING_H
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdbool.h>
+#include <linux/io_uring.h>
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+
+int uring_init(unsigned int entries);
+void uring_child(void);
+struct io_uring_sqe* uring_get_sqe(void);
+int uring_enter(bool wait);
+unsigned int uring_unsubmitted(void);
+struct io_uring_cqe* uring_peek_cqe(void);
+void uring_cqe_seen(void);
+
+#endif /* SIMPLE_MESSAGE_SERVER_URING_H */
+
+/* === EOF ================================================================== */
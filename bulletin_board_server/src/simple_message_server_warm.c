@@ -0,0 +1,361 @@
+/**
+ * @file simple_message_server_warm.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, pool of parked business logic processes.
+ *
+ * The business logic is started ahead of time with the warm start library
+ * preloaded, which parks the process on a Unix domain control socket before
+ * main(). An accepted connect socket is passed to a parked process with
+ * SCM_RIGHTS, so loading and initializing the business logic is no longer
+ * on the critical path of the client. The pool is refilled after every
+ * hand-off.
+ *
+ * The library is put in front of the LD_PRELOAD the server was started
+ * with, which is passed along in WARMSTART_PRELOAD_ENV and restored by the
+ * warm start, so the business logic sees the environment of the server.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <libgen.h>
+#include <sys/socket.h>
+#include "simple_message_server.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* consecutive failed hand-offs until the warm pool is given up */
+#define WARM_MAX_FAILURES 16
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/** A parked business logic process. */
+struct parked_logic
+{
+    /** process id of the parked business logic */
+    pid_t pid;
+    /** server end of its control socket */
+    int control_fd;
+};
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+
+/** Parked processes, used as a stack. */
+static struct parked_logic* sparked = NULL;
+/** Number of parked processes. */
+static long sparked_count = 0;
+/** Configured size of the warm pool, 0 if disabled. */
+static long swarm_size = 0;
+/** Consecutive failed hand-offs. */
+static long sfailures = 0;
+/** Absolute path of the warm start library. */
+static char swarmstart_path[PATH_MAX];
+/** LD_PRELOAD of the parked processes. */
+static char* spreload = NULL;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static int locate_warmstart(void);
+static int compose_preload(void);
+static int park_logic(int socket_fd);
+static int pass_connection(int control_fd, int connection_fd);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Starts the warm pool.
+ *
+ * \param socket_fd listening socket, not passed to the business logic.
+ * \param size number of business logic processes to be kept parked.
+ * \return 0 on success, else -1.
+ */
+int warm_init(int socket_fd, long size)
+{
+    if ((locate_warmstart() < 0) || (compose_preload() < 0))
+    {
+        return -1;
+    }
+    sparked = calloc((size_t) size, sizeof(*sparked));
+    if (sparked == NULL)
+    {
+        print_error("Can not allocate warm pool: %s.", strerror(ENOMEM));
+        return -1;
+    }
+    swarm_size = size;
+    warm_refill(socket_fd);
+    return 0;
+}
+
+/**
+ * \brief Parks business logic processes until the pool is full again.
+ *
+ * \param socket_fd listening socket, not passed to the business logic.
+ */
+void warm_refill(int socket_fd)
+{
+    while ((sparked_count < swarm_size) && (park_logic(socket_fd) == 0))
+    {
+    }
+}
+
+/**
+ * \brief Hands a connection over to a parked business logic.
+ *
+ * Parked processes which died meanwhile are skipped. The caller still owns
+ * connection_fd and has to close it in any case.
+ *
+ * \param connection_fd connect socket of the client.
+ * \return process id of the business logic which took the connection, -1
+ *  if the caller has to start the business logic itself.
+ */
+pid_t warm_handoff(int connection_fd)
+{
+    struct parked_logic parked;
+
+    while (sparked_count > 0)
+    {
+        parked = sparked[--sparked_count];
+        if (pass_connection(parked.control_fd, connection_fd) == 0)
+        {
+            (void) close(parked.control_fd);
+            sfailures = 0;
+            return parked.pid;
+        }
+        (void) close(parked.control_fd);
+
+        if (++sfailures >= WARM_MAX_FAILURES)
+        {
+            /* e.g. a statically linked business logic ignores LD_PRELOAD */
+            print_error("Parked business logic keeps failing, warm pool "
+                "disabled.");
+            while (sparked_count > 0)
+            {
+                (void) close(sparked[--sparked_count].control_fd);
+            }
+            swarm_size = 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * \brief Determines the path of the warm start library.
+ *
+ * The library is expected next to the server executable.
+ *
+ * \return 0 on success, else -1.
+ */
+static int locate_warmstart(void)
+{
+    char exe[PATH_MAX];
+    ssize_t len;
+    int written;
+
+    len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (len < 0)
+    {
+        print_error("Can not determine server executable: %s.",
+            strerror(errno));
+        return -1;
+    }
+    exe[len] = '\0';
+
+    written = snprintf(swarmstart_path, sizeof(swarmstart_path), "%s/%s",
+        dirname(exe), WARMSTART_LIBRARY);
+    if ((written < 0) || ((size_t) written >= sizeof(swarmstart_path)))
+    {
+        print_error("Path of %s too long.", WARMSTART_LIBRARY);
+        return -1;
+    }
+    if (access(swarmstart_path, R_OK) < 0)
+    {
+        print_error("Can not access %s: %s.", swarmstart_path,
+            strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Puts the warm start library in front of the LD_PRELOAD of the
+ * server.
+ *
+ * \return 0 on success, else -1.
+ */
+static int compose_preload(void)
+{
+    const char* preload = getenv("LD_PRELOAD");
+    size_t size;
+
+    if ((preload == NULL) || (preload[0] == '\0'))
+    {
+        spreload = swarmstart_path;
+        return 0;
+    }
+    size = strlen(swarmstart_path) + 1 + strlen(preload) + 1;
+    if ((spreload = malloc(size)) == NULL)
+    {
+        print_error("Can not allocate LD_PRELOAD: %s.", strerror(ENOMEM));
+        return -1;
+    }
+    (void) snprintf(spreload, size, "%s:%s", swarmstart_path, preload);
+    return 0;
+}
+
+/**
+ * \brief Starts one business logic process and parks it.
+ *
+ * \param socket_fd listening socket, not passed to the business logic.
+ * \return 0 if the process was parked, else -1.
+ */
+static int park_logic(int socket_fd)
+{
+    int control[2];
+    char control_env[sizeof(int) * CHAR_BIT];
+    int null_fd;
+    pid_t pid;
+    const char* preload = getenv("LD_PRELOAD");
+    long i;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, control) < 0)
+    {
+        print_error("socketpair() failed: %s.", strerror(errno));
+        return -1;
+    }
+
+    if ((pid = fork()) < 0)
+    {
+        print_error("fork() failed: %s.", strerror(errno));
+        (void) close(control[0]);
+        (void) close(control[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        reactor_child();
+        /* the parked process must not hold other connections open */
+        (void) close(socket_fd);
+        for (i = 0; i < sparked_count; ++i)
+        {
+            (void) close(sparked[i].control_fd);
+        }
+        (void) close(control[0]);
+
+        /* stdin and stdout are replaced by the connection later */
+        null_fd = open("/dev/null", O_RDWR);
+        if ((null_fd < 0) || (dup2(null_fd, STDIN_FILENO) == -1) ||
+            (dup2(null_fd, STDOUT_FILENO) == -1))
+        {
+            print_error("Parked process can not open /dev/null.");
+            _exit(EXIT_FAILURE);
+        }
+        if (null_fd > STDERR_FILENO)
+        {
+            (void) close(null_fd);
+        }
+        /* the control socket has to survive execl() */
+        if (fcntl(control[1], F_SETFD, 0) < 0)
+        {
+            _exit(EXIT_FAILURE);
+        }
+        (void) snprintf(control_env, sizeof(control_env), "%d", control[1]);
+        /* the warm start restores the LD_PRELOAD of the server */
+        if ((preload != NULL) &&
+            (setenv(WARMSTART_PRELOAD_ENV, preload, 1) < 0))
+        {
+            _exit(EXIT_FAILURE);
+        }
+        if ((preload == NULL) && (unsetenv(WARMSTART_PRELOAD_ENV) < 0))
+        {
+            _exit(EXIT_FAILURE);
+        }
+        if ((setenv(WARMSTART_ENV, control_env, 1) < 0) ||
+            (setenv("LD_PRELOAD", spreload, 1) < 0))
+        {
+            _exit(EXIT_FAILURE);
+        }
+
+        if (execl(business_logic_path(), BUSINESS_LOGIC, NULL) < 0)
+        {
+            print_error("Could not start server business logic.");
+            _exit(EXIT_FAILURE);
+        }
+        _exit(EXIT_FAILURE);
+    }
+
+    (void) close(control[1]);
+    sparked[sparked_count].pid = pid;
+    sparked[sparked_count].control_fd = control[0];
+    ++sparked_count;
+    return 0;
+}
+
+/**
+ * \brief Passes the connect socket over the control socket.
+ *
+ * \param control_fd server end of the control socket.
+ * \param connection_fd connect socket of the client.
+ * \return 0 if the socket was passed, else -1.
+ */
+static int pass_connection(int control_fd, int connection_fd)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr* cmsg;
+    char byte = 0;
+    union
+    {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    ssize_t sent;
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    iov.iov_base = &byte;
+    iov.iov_len = sizeof(byte);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &connection_fd, sizeof(int));
+
+    do
+    {
+        /* a parked process which died answers with EPIPE */
+        sent = sendmsg(control_fd, &msg, MSG_NOSIGNAL);
+    } while ((sent < 0) && (errno == EINTR));
+
+    return sent == (ssize_t) sizeof(byte) ? 0 : -1;
+}
+
+/* === EOF ================================================================== */
@@ -0,0 +1,158 @@
+/**
+ * @file simple_message_server_warmstart.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, warm start of the business logic.
+ *
+ * This shared object is preloaded into parked business logic processes.
+ * Its constructor runs after the dynamic loader and the C library have been
+ * initialized, but before main() of the business logic. It waits on the
+ * control socket of the server until a connect socket is passed with
+ * SCM_RIGHTS, makes it stdin and stdout and returns, so the business logic
+ * starts with the same stdin/stdout contract as after fork and exec, and
+ * with the LD_PRELOAD of the server.
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include "simple_message_server.h"
+
+/*
+ * ---------------------------------------------------------------- defines --
+ */
+
+/* decimal format base for strtol */
+#define INPUT_NUM_BASE 10
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static void warmstart(void) __attribute__((constructor));
+static int receive_connection(int control_fd);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief Parks the process until the server hands over a connection.
+ *
+ * Does nothing if the process was not started as a warm business logic.
+ * If the server goes away before a connection is handed over, the process
+ * exits without running the business logic.
+ */
+static void warmstart(void)
+{
+    const char* control;
+    const char* preload;
+    char* end_ptr;
+    long control_fd;
+    int connection_fd;
+
+    control = getenv(WARMSTART_ENV);
+    if (control == NULL)
+    {
+        return;
+    }
+    errno = 0;
+    control_fd = strtol(control, &end_ptr, INPUT_NUM_BASE);
+    if ((errno != 0) || (end_ptr == control) || (control_fd < 0))
+    {
+        return;
+    }
+    /* programs started by the business logic must not be parked again */
+    (void) unsetenv(WARMSTART_ENV);
+    preload = getenv(WARMSTART_PRELOAD_ENV);
+    if (preload != NULL)
+    {
+        (void) setenv("LD_PRELOAD", preload, 1);
+        (void) unsetenv(WARMSTART_PRELOAD_ENV);
+    }
+    else
+    {
+        (void) unsetenv("LD_PRELOAD");
+    }
+
+    connection_fd = receive_connection((int) control_fd);
+    (void) close((int) control_fd);
+    if (connection_fd < 0)
+    {
+        _exit(EXIT_SUCCESS);
+    }
+
+    /* redirect stdin and stdout to connect socket */
+    if ((dup2(connection_fd, STDIN_FILENO) == -1) ||
+        (dup2(connection_fd, STDOUT_FILENO) == -1))
+    {
+        _exit(EXIT_FAILURE);
+    }
+    if ((connection_fd != STDIN_FILENO) && (connection_fd != STDOUT_FILENO))
+    {
+        (void) close(connection_fd);
+    }
+}
+
+/**
+ * \brief Waits for a connect socket passed by the server.
+ *
+ * \param control_fd control socket of the server.
+ * \return the received connect socket, or -1 if none was received.
+ */
+static int receive_connection(int control_fd)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr* cmsg;
+    char byte;
+    union
+    {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    ssize_t received;
+    int connection_fd = -1;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &byte;
+    iov.iov_len = sizeof(byte);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    do
+    {
+        received = recvmsg(control_fd, &msg, MSG_CMSG_CLOEXEC);
+    } while ((received < 0) && (errno == EINTR));
+    if (received <= 0)
+    {
+        return -1;
+    }
+
+    for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+        cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if ((cmsg->cmsg_level == SOL_SOCKET) &&
+            (cmsg->cmsg_type == SCM_RIGHTS) &&
+            (cmsg->cmsg_len == CMSG_LEN(sizeof(int))))
+        {
+            memcpy(&connection_fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    return connection_fd;
+}
+
+/* === EOF ================================================================== */
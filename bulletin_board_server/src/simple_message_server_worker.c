@@ -0,0 +1,306 @@
+/**
+ * @file simple_message_server_worker.c
+ * Verteilte Systeme
+ * TCP/IP Programmieruebung
+ *
+ * TCP/IP Server, framed logic worker hosting a business logic plugin.
+ *
+ * Speaks the protocol of simple_message_server_frame.h on stdin and stdout
+ * and serves every framed request by the plugin given on the command line,
+ * so any plugin of simple_message_server_plugin.h runs as a persistent
+ * worker in a process of its own:
+ *
+ *   simple_message_server -p 6823 -f "./simple_message_server_worker \
+ *       ./simple_message_server_echo.so"
+ *
+ * @author Andrea Maierhofer    1410258024  <andrea.maierhofer@technikum-wien.at>
+ * @author Thomas Schmid        1410258013  <thomas.schmid@technikum-wien.at>
+ * @date 2015/12/13
+ *
+ */
+
+/*
+ * --------------------------------------------------------------- includes --
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <dlfcn.h>
+#include "simple_message_server_plugin.h"
+#include "simple_message_server_frame.h"
+
+/*
+ * ------------------------------------------------------------------ types --
+ */
+
+/** State of reading the current request. */
+struct request_state
+{
+    /** body bytes left in the current SMS_FRAME_REQUEST */
+    size_t remaining;
+    /** SMS_FRAME_REQUEST_END has been read */
+    bool end;
+    /** the stream from the server is broken */
+    bool failed;
+};
+
+/*
+ * ----------------------------------------------------------------- static --
+ */
+static const char* sprogram_arg0 = NULL;
+
+/*
+ * ------------------------------------------------------------- prototypes --
+ */
+static void print_error(const char* message, ...);
+static const struct sms_plugin* load_plugin(const char* path);
+static int next_record(struct request_state* state);
+static ssize_t read_request(const struct sms_reader* reader, void* buf,
+    size_t len);
+static ssize_t write_response(const struct sms_writer* writer,
+    const void* buf, size_t len);
+
+/*
+ * -------------------------------------------------------------- functions --
+ */
+
+/**
+ * \brief the main method for the worker
+ *
+ * \param argc the number of arguments
+ * \param argv the arguments itselves (including the program name in argv[0])
+ *
+ * \return success or failure.
+ * \retval EXIT_SUCCESS if the server closed the stream.
+ * \retval EXIT_FAILURE on failure.
+ */
+int main(int argc, const char* const argv[])
+{
+    const struct sms_plugin* plugin;
+    struct request_state state;
+    struct sms_reader reader;
+    struct sms_writer writer;
+    void* plugin_state = NULL;
+    char discard[BUFSIZ];
+    int result;
+
+    sprogram_arg0 = argv[0];
+    if (argc != 2)
+    {
+        (void) fprintf(stderr, "usage: %s plugin\n", sprogram_arg0);
+        return EXIT_FAILURE;
+    }
+    plugin = load_plugin(argv[1]);
+    if ((plugin == NULL) ||
+        ((plugin->init != NULL) && (plugin->init(&plugin_state) != 0)))
+    {
+        print_error("Plugin %s not usable.", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    reader.read = read_request;
+    reader.context = &state;
+    writer.write = write_response;
+    writer.context = NULL;
+    while (1)
+    {
+        memset(&state, 0, sizeof(state));
+        /* wait for the next request, end of file ends the worker */
+        result = next_record(&state);
+        if (result <= 0)
+        {
+            break;
+        }
+
+        (void) plugin->handle_request(plugin_state, &reader, &writer);
+        /* the rest of a request the plugin did not read */
+        while (read_request(&reader, discard, sizeof(discard)) > 0)
+        {
+        }
+        if (state.failed ||
+            (frame_write(STDOUT_FILENO, SMS_FRAME_RESPONSE_END, NULL, 0) < 0))
+        {
+            result = -1;
+            break;
+        }
+    }
+
+    if (plugin->shutdown != NULL)
+    {
+        plugin->shutdown(plugin_state);
+    }
+    if (result < 0)
+    {
+        print_error("Stream to the server broken: %s.", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ *
+ * \brief Prints error message to stderr.
+ *
+ * A new line is printed after the message text automatically.
+ * Printout can be formatted like printf.
+ *
+ * \param message output on stderr.
+ *
+ * \return void
+ */
+static void print_error(const char* message, ...)
+{
+    va_list args;
+
+    /* do not handle return value of fprintf, because it makes no sense here */
+    (void) fprintf(stderr, "%s: ", sprogram_arg0);
+    va_start(args, message);
+    (void) vfprintf(stderr, message, args);
+    va_end(args);
+    (void) fprintf(stderr, "\n");
+}
+
+/**
+ * \brief Loads the plugin and checks its ABI version.
+ *
+ * \param path of the shared object.
+ * \return entry points of the plugin, NULL on failure.
+ */
+static const struct sms_plugin* load_plugin(const char* path)
+{
+    const struct sms_plugin* plugin;
+    void* handle;
+
+    handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL)
+    {
+        print_error("dlopen() failed: %s.", dlerror());
+        return NULL;
+    }
+    plugin = dlsym(handle, SMS_PLUGIN_SYMBOL);
+    if ((plugin == NULL) || (plugin->abi_version != SMS_PLUGIN_ABI_VERSION) ||
+        (plugin->handle_request == NULL))
+    {
+        print_error("Plugin %s does not export a valid %s.", path,
+            SMS_PLUGIN_SYMBOL);
+        (void) dlclose(handle);
+        return NULL;
+    }
+    return plugin;
+}
+
+/**
+ * \brief Reads the header of the next request record.
+ *
+ * \param state of the current request.
+ * \return 1 if a record was read, 0 at end of file, -1 on error.
+ */
+static int next_record(struct request_state* state)
+{
+    unsigned int type;
+    size_t length;
+    int result;
+
+    result = frame_read_header(STDIN_FILENO, &type, &length);
+    if (result <= 0)
+    {
+        state->failed = true;
+        return result;
+    }
+    if ((type == SMS_FRAME_REQUEST_END) && (length == 0))
+    {
+        state->end = true;
+    }
+    else if (type == SMS_FRAME_REQUEST)
+    {
+        state->remaining = length;
+    }
+    else
+    {
+        errno = EPROTO;
+        state->failed = true;
+        return -1;
+    }
+    return 1;
+}
+
+/**
+ * \brief Reads the request from the records of the server.
+ *
+ * \param reader with the struct request_state as context.
+ * \param buf where to put the data.
+ * \param len size of buf.
+ * \return bytes read, 0 at end of request, -1 on error.
+ */
+static ssize_t read_request(const struct sms_reader* reader, void* buf,
+    size_t len)
+{
+    struct request_state* state = reader->context;
+    ssize_t read_count;
+
+    while ((state->remaining == 0) && !state->end)
+    {
+        if (state->failed || (next_record(state) <= 0))
+        {
+            return -1;
+        }
+    }
+    if (state->end)
+    {
+        return 0;
+    }
+
+    if (len > state->remaining)
+    {
+        len = state->remaining;
+    }
+    do
+    {
+        read_count = read(STDIN_FILENO, buf, len);
+    } while ((read_count < 0) && (errno == EINTR));
+    if (read_count <= 0)
+    {
+        state->failed = true;
+        return -1;
+    }
+    state->remaining -= (size_t) read_count;
+    return read_count;
+}
+
+/**
+ * \brief Writes the response in records to the server.
+ *
+ * \param writer will be ignored.
+ * \param buf data to be written.
+ * \param len number of bytes in buf.
+ * \return len on success, -1 on error.
+ */
+static ssize_t write_response(const struct sms_writer* writer,
+    const void* buf, size_t len)
+{
+    const char* current_write_pos = buf;
+    size_t to_be_written = len;
+    size_t chunk;
+
+    (void) writer; /* pedantic */
+    while (to_be_written > 0)
+    {
+        chunk = to_be_written < SMS_FRAME_MAX_LENGTH ?
+            to_be_written : SMS_FRAME_MAX_LENGTH;
+        if (frame_write(STDOUT_FILENO, SMS_FRAME_RESPONSE, current_write_pos,
+            chunk) < 0)
+        {
+            return -1;
+        }
+        current_write_pos += chunk;
+        to_be_written -= chunk;
+    }
+    return (ssize_t) len;
+}
+
+/* === EOF ================================================================== */